@@ -0,0 +1,114 @@
+#include "batch.h"
+#include "rcon.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <glib.h>
+
+struct _batch
+{
+    /* NUL terminated
+     */
+    GByteArray *commands;
+    size_t count;
+    size_t max;
+    bool idempotent;
+    /* The last command cannot be followed by another
+     */
+    bool closed;
+};
+
+batch_t *batch_new(size_t max)
+{
+    batch_t *tmp = NULL;
+
+    tmp = calloc(1, sizeof(batch_t));
+    if (tmp == NULL) {
+        return NULL;
+    }
+
+    tmp->commands = g_byte_array_sized_new(max + 1);
+    tmp->max = max;
+    batch_clear(tmp);
+
+    return tmp;
+}
+
+void batch_free(batch_t *b)
+{
+    return_if_true(b == NULL,);
+
+    g_byte_array_free(b->commands, TRUE);
+    free(b);
+}
+
+bool batch_joinable(char const *cmd)
+{
+    bool quoted = false;
+    char const *p = NULL;
+
+    /* The server's tokenizer knows no escapes, a quote always toggles
+     */
+    for (p = cmd; *p != '\0'; p++) {
+        if (*p == '"') {
+            quoted = !quoted;
+        } else if (!quoted && p[0] == '/' && p[1] == '/') {
+            return false;
+        }
+    }
+
+    return !quoted;
+}
+
+int batch_add(batch_t *b, char const *cmd, bool idempotent)
+{
+    size_t len = 0;
+
+    return_if_true(b == NULL || cmd == NULL, -1);
+
+    len = strlen(cmd);
+
+    if (b->count > 0) {
+        if (b->closed || b->commands->len + len > b->max) {
+            return -1;
+        }
+        /* Replaces the NUL
+         */
+        b->commands->data[b->commands->len - 1] = ';';
+    } else {
+        g_byte_array_set_size(b->commands, 0);
+    }
+
+    g_byte_array_append(b->commands, (uint8_t const *)cmd, len + 1);
+    ++b->count;
+    b->idempotent = b->idempotent && idempotent;
+    b->closed = !batch_joinable(cmd);
+
+    return 0;
+}
+
+char const *batch_commands(batch_t const *b)
+{
+    return (b != NULL && b->count > 0 ? (char const *)b->commands->data : "");
+}
+
+size_t batch_count(batch_t const *b)
+{
+    return (b != NULL ? b->count : 0);
+}
+
+bool batch_idempotent(batch_t const *b)
+{
+    return (b != NULL ? b->idempotent : true);
+}
+
+void batch_clear(batch_t *b)
+{
+    return_if_true(b == NULL,);
+
+    g_byte_array_set_size(b->commands, 0);
+    b->count = 0;
+    b->idempotent = true;
+    b->closed = false;
+}
@@ -0,0 +1,44 @@
+#ifndef RCON_BATCH_H
+#define RCON_BATCH_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+/* Source servers split a command at semicolons that are not quoted, and run
+ * each part in turn. So consecutive script commands can share one frame,
+ * and one round trip, as "a;b;c". Their replies arrive as one.
+ */
+
+/* The largest body a server takes in one frame: the 4096 byte limit of the
+ * size field, less id, type and the two NULs.
+ */
+#define BATCH_MAX (4096 - 10)
+
+typedef struct _batch batch_t;
+
+batch_t *batch_new(size_t max);
+void batch_free(batch_t *b);
+
+/* Whether more commands may follow this one in the same frame. Not if it
+ * leaves a quote open, or has a comment, as either would swallow the rest.
+ */
+bool batch_joinable(char const *cmd);
+
+/* Appends the command. An empty batch takes any command, otherwise this
+ * returns -1 if the command does not fit, or the previous one cannot be
+ * followed by another. The batch must then be sent and cleared first.
+ */
+int batch_add(batch_t *b, char const *cmd, bool idempotent);
+
+/* The joined commands, and how many there are
+ */
+char const *batch_commands(batch_t const *b);
+size_t batch_count(batch_t const *b);
+
+/* Only if all commands in it are
+ */
+bool batch_idempotent(batch_t const *b);
+
+void batch_clear(batch_t *b);
+
+#endif
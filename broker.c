@@ -0,0 +1,502 @@
+#include "rcon.h"
+#include "lease.h"
+#include "timers.h"
+
+#include <glib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+/* Seconds a connection is kept while nobody borrows it. Servers drop idle
+ * connections after a while, and a dead one is only noticed when used.
+ */
+#define BROKER_IDLE 60
+/* Connections kept per server and password
+ */
+#define BROKER_KEEP 4
+
+static char *path = NULL;
+static double idletime = BROKER_IDLE;
+static unsigned int keep = BROKER_KEEP;
+static bool debug = false;
+
+/* A connection nobody borrowed yet
+ */
+typedef struct {
+    int fd;
+    char *key;
+    double since;
+} broker_idle_t;
+
+typedef struct {
+    int sock;
+    bool closing;
+    /* Borrowed, and not given back yet
+     */
+    unsigned int leased;
+} broker_client_t;
+
+static int listener = -1;
+static GPtrArray *pool = NULL;
+static GPtrArray *clients = NULL;
+static volatile sig_atomic_t quit = 0;
+
+static void usage(void)
+{
+    puts("");
+    puts("Usage:");
+    puts(" rcon-broker [options] socket");
+    puts("");
+    puts("Keeps the authenticated connections rcon gives back on exit, and");
+    puts("lends them to the next rcon for the same server. Use it with");
+    puts(" rcon --broker socket ...");
+    puts("");
+    puts("Options:");
+    puts(" -d, --debug     Report leases on standard error");
+    puts(" -h, --help      This bogus");
+    puts(" -i, --idle      Seconds to keep unused connections, 60 by default");
+    puts(" -k, --keep      Connections to keep per server, 4 by default");
+}
+
+static int parse_args(int ac, char **av)
+{
+    static struct option opts[] = {
+        { "debug", no_argument, 0, 'd' },
+        { "help", no_argument, 0, 'h' },
+        { "idle", required_argument, 0, 'i' },
+        { "keep", required_argument, 0, 'k' },
+        { NULL, 0, 0, 0 }
+    };
+
+    static char const *optstr = "dhi:k:";
+
+    int c = 0;
+
+    while ((c = getopt_long(ac, av, optstr, opts, NULL)) != -1) {
+        switch (c)
+        {
+        case 'd': debug = true; break;
+        case 'i': idletime = strtod(optarg, NULL); break;
+        case 'k': keep = strtoul(optarg, NULL, 10); break;
+        case 'h': usage(); exit(0); break;
+        default: /* intentional */
+        case '?': usage(); exit(1); break;
+        }
+    }
+
+    return 0;
+}
+
+static void broker_quit(int sig)
+{
+    quit = 1;
+}
+
+/* The host and port of a key, for messages. The password stays out.
+ */
+static void broker_report(char const *what, char const *key)
+{
+    char const *port = strchr(key, '\n');
+    char const *end = (port != NULL ? strchr(port + 1, '\n') : NULL);
+
+    if (!debug || end == NULL) {
+        return;
+    }
+
+    fprintf(stderr, "%s %.*s:%.*s\n", what, (int)(port - key), key,
+            (int)(end - port - 1), port + 1);
+}
+
+static void broker_drop(guint i, char const *why)
+{
+    broker_idle_t *c = g_ptr_array_index(pool, i);
+
+    broker_report(why, c->key);
+
+    close(c->fd);
+    free(c->key);
+    free(c);
+    g_ptr_array_remove_index(pool, i);
+}
+
+static void broker_client_free(broker_client_t *c)
+{
+    return_if_true(c == NULL,);
+
+    if (c->sock > -1) {
+        close(c->sock);
+    }
+    free(c);
+}
+
+/* Lends the connection that was given back last, which is the least likely
+ * to have been closed by the server
+ */
+static void broker_get(broker_client_t *c, char const *key)
+{
+    char answer = LEASE_NO;
+    guint i = 0;
+
+    for (i = pool->len; i > 0; i--) {
+        broker_idle_t *idle = g_ptr_array_index(pool, i - 1);
+
+        if (strcmp(idle->key, key) != 0) {
+            continue;
+        }
+
+        if (!lease_idle(idle->fd)) {
+            broker_drop(i - 1, "closed");
+            continue;
+        }
+
+        answer = LEASE_YES;
+        if (lease_send(c->sock, &answer, 1, idle->fd)) {
+            c->closing = true;
+            return;
+        }
+
+        ++c->leased;
+        broker_drop(i - 1, "lent");
+        return;
+    }
+
+    broker_report("miss", key);
+    if (lease_send(c->sock, &answer, 1, -1)) {
+        c->closing = true;
+    }
+}
+
+static void broker_put(broker_client_t *c, char const *key, int fd)
+{
+    broker_idle_t *idle = NULL;
+    char answer = LEASE_NO;
+    unsigned int kept = 0;
+    guint i = 0;
+
+    if (c->leased > 0) {
+        --c->leased;
+    }
+
+    for (i = 0; i < pool->len; i++) {
+        idle = g_ptr_array_index(pool, i);
+        if (strcmp(idle->key, key) == 0) {
+            ++kept;
+        }
+    }
+
+    if (fd > -1 && kept < keep && lease_idle(fd)) {
+        idle = calloc(1, sizeof(broker_idle_t));
+        if (idle != NULL) {
+            idle->fd = fd;
+            idle->key = strdup(key);
+            idle->since = timers_now();
+            g_ptr_array_add(pool, idle);
+            broker_report("kept", key);
+            answer = LEASE_YES;
+            fd = -1;
+        }
+    }
+
+    if (fd > -1) {
+        close(fd);
+    }
+
+    if (lease_send(c->sock, &answer, 1, -1)) {
+        c->closing = true;
+    }
+}
+
+static void broker_request(broker_client_t *c)
+{
+    char msg[LEASE_MESSAGE_MAX + 1];
+    ssize_t ret = 0;
+    int fd = -1;
+
+    ret = lease_recv(c->sock, msg, LEASE_MESSAGE_MAX, &fd);
+    if (ret <= 0) {
+        if (fd > -1) {
+            close(fd);
+        }
+        c->closing = true;
+        return;
+    }
+    msg[ret] = '\0';
+
+    if (msg[0] == LEASE_GET && fd < 0) {
+        broker_get(c, msg + 1);
+    } else if (msg[0] == LEASE_PUT) {
+        broker_put(c, msg + 1, fd);
+    } else {
+        if (fd > -1) {
+            close(fd);
+        }
+        c->closing = true;
+    }
+}
+
+static void broker_accept(void)
+{
+    broker_client_t *c = NULL;
+    int sock = -1;
+
+    sock = accept(listener, NULL, NULL);
+    if (sock < 0) {
+        return;
+    }
+
+    c = calloc(1, sizeof(broker_client_t));
+    if (c == NULL) {
+        close(sock);
+        return;
+    }
+
+    c->sock = sock;
+    g_ptr_array_add(clients, c);
+}
+
+/* Only the user who started the broker may talk to it, since it hands out
+ * authenticated connections
+ */
+static int broker_listen(void)
+{
+    struct sockaddr_un addr = {0};
+    mode_t mask = 0;
+    int sock = -1;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path is too long: %s\n", path);
+        return -1;
+    }
+
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    /* A socket nobody listens on is left over from an earlier broker
+     */
+    sock = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (sock > -1 &&
+        connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        fprintf(stderr, "A broker is running already: %s\n", path);
+        close(sock);
+        return -1;
+    }
+    if (sock > -1) {
+        close(sock);
+    }
+    unlink(path);
+
+    listener = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (listener < 0) {
+        fprintf(stderr, "Failed to create socket: %s\n", strerror(errno));
+        return -1;
+    }
+
+    mask = umask(0077);
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(listener, SOMAXCONN) < 0) {
+        fprintf(stderr, "Failed to listen on %s: %s\n", path,
+                strerror(errno));
+        umask(mask);
+        return -1;
+    }
+    umask(mask);
+
+    return 0;
+}
+
+static int broker_run(void)
+{
+    GArray *pfds = g_array_new(FALSE, TRUE, sizeof(struct pollfd));
+    guint i = 0, k = 0, count = 0, idle = 0;
+    int ec = -1;
+
+    while (!quit) {
+        double now = timers_now(), wake = 0;
+        struct pollfd p = {0};
+        int timeout = -1;
+
+        for (i = 0; i < clients->len; ) {
+            broker_client_t *c = g_ptr_array_index(clients, i);
+
+            if (c->closing) {
+                broker_client_free(c);
+                g_ptr_array_remove_index(clients, i);
+            } else {
+                ++i;
+            }
+        }
+
+        for (i = 0; i < pool->len; ) {
+            broker_idle_t *c = g_ptr_array_index(pool, i);
+
+            if (now - c->since >= idletime) {
+                broker_drop(i, "expired");
+            } else {
+                if (wake == 0 || c->since + idletime < wake) {
+                    wake = c->since + idletime;
+                }
+                ++i;
+            }
+        }
+
+        /* The listener, the clients, and then the idle connections, which
+         * only become readable when the server closes them
+         */
+        g_array_set_size(pfds, 0);
+
+        p.fd = listener;
+        p.events = POLLIN;
+        g_array_append_val(pfds, p);
+
+        for (i = 0; i < clients->len; i++) {
+            broker_client_t *c = g_ptr_array_index(clients, i);
+
+            p.fd = c->sock;
+            g_array_append_val(pfds, p);
+        }
+
+        for (i = 0; i < pool->len; i++) {
+            broker_idle_t *c = g_ptr_array_index(pool, i);
+
+            p.fd = c->fd;
+            g_array_append_val(pfds, p);
+        }
+
+        if (wake > 0) {
+            timeout = (int)((wake - now) * 1000) + 1;
+            if (timeout < 0) {
+                timeout = 0;
+            }
+        }
+
+        if (poll((struct pollfd*)pfds->data, pfds->len, timeout) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            goto cleanup;
+        }
+
+        count = clients->len;
+        idle = pool->len;
+
+        /* Closed idle connections first, from the back so the indexes of
+         * the rest stay put, and before anything is lent or kept
+         */
+        for (i = idle; i > 0; i--) {
+            struct pollfd *q = &g_array_index(pfds, struct pollfd,
+                                              1 + count + i - 1);
+
+            if (q->revents != 0) {
+                broker_drop(i - 1, "closed");
+            }
+        }
+
+        for (i = 0, k = 1; i < count; i++, k++) {
+            broker_client_t *c = g_ptr_array_index(clients, i);
+            struct pollfd *q = &g_array_index(pfds, struct pollfd, k);
+
+            if (q->revents & POLLIN) {
+                broker_request(c);
+            } else if (q->revents != 0) {
+                c->closing = true;
+            }
+
+            /* What it borrowed is gone with it
+             */
+            if (c->closing && c->leased > 0 && debug) {
+                fprintf(stderr, "client left with %u connections\n",
+                        c->leased);
+            }
+        }
+
+        if (g_array_index(pfds, struct pollfd, 0).revents & POLLIN) {
+            broker_accept();
+        }
+    }
+
+    ec = 0;
+
+cleanup:
+
+    g_array_free(pfds, TRUE);
+
+    return ec;
+}
+
+int main(int ac, char **av)
+{
+    struct sigaction sa = {{0}};
+    guint i = 0;
+    int ec = 1;
+
+    parse_args(ac, av);
+
+    ac -= optind;
+    av += optind;
+
+    if (ac != 1) {
+        usage();
+        goto cleanup;
+    }
+
+    path = strdup(av[0]);
+    pool = g_ptr_array_new();
+    clients = g_ptr_array_new();
+
+    signal(SIGPIPE, SIG_IGN);
+
+    /* Without SA_RESTART, so that poll() returns
+     */
+    sa.sa_handler = broker_quit;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    if (broker_listen()) {
+        ec = 2;
+        goto cleanup;
+    }
+
+    if (broker_run()) {
+        fprintf(stderr, "Failed to wait for clients: %s\n", strerror(errno));
+        goto cleanup;
+    }
+
+    ec = 0;
+
+cleanup:
+
+    for (i = 0; clients != NULL && i < clients->len; i++) {
+        broker_client_free(g_ptr_array_index(clients, i));
+    }
+    if (clients != NULL) {
+        g_ptr_array_free(clients, TRUE);
+    }
+
+    while (pool != NULL && pool->len > 0) {
+        broker_drop(pool->len - 1, "closed");
+    }
+    if (pool != NULL) {
+        g_ptr_array_free(pool, TRUE);
+    }
+
+    if (listener > -1) {
+        close(listener);
+        unlink(path);
+    }
+    free(path);
+
+    return ec;
+}
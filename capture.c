@@ -0,0 +1,211 @@
+#include "capture.h"
+#include "timers.h"
+#include "rcon.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+struct _capture
+{
+    FILE *file;
+    double start;
+};
+
+struct _capture_file
+{
+    uint8_t *data;
+    size_t size;
+    size_t off;
+};
+
+static void capture_put64(uint8_t *p, uint64_t v)
+{
+    int i = 0;
+
+    for (i = 0; i < 8; i++) {
+        p[i] = (uint8_t)(v >> (i * 8));
+    }
+}
+
+static uint64_t capture_get64(uint8_t const *p)
+{
+    uint64_t v = 0;
+    int i = 0;
+
+    for (i = 7; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+
+    return v;
+}
+
+static void capture_put32(uint8_t *p, uint32_t v)
+{
+    int i = 0;
+
+    for (i = 0; i < 4; i++) {
+        p[i] = (uint8_t)(v >> (i * 8));
+    }
+}
+
+static uint32_t capture_get32(uint8_t const *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 |
+        (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+capture_t *capture_open(char const *filename)
+{
+    uint8_t header[CAPTURE_HEADER_SIZE] = {0};
+    struct timespec ts = {0};
+    capture_t *tmp = NULL;
+
+    tmp = calloc(1, sizeof(capture_t));
+    if (tmp == NULL) {
+        return NULL;
+    }
+
+    tmp->file = fopen(filename, "wb");
+    if (tmp->file == NULL) {
+        free(tmp);
+        return NULL;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    tmp->start = timers_now();
+
+    memcpy(header, CAPTURE_MAGIC, 8);
+    capture_put64(header + 8,
+                  (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+
+    if (fwrite(header, 1, sizeof(header), tmp->file) < sizeof(header)) {
+        capture_close(tmp);
+        return NULL;
+    }
+
+    return tmp;
+}
+
+int capture_write(capture_t *c, capture_direction_t dir,
+                  void const *data, size_t len)
+{
+    uint8_t record[CAPTURE_RECORD_SIZE] = {0};
+
+    return_if_true(c == NULL, -1);
+    return_if_true(len > UINT32_MAX, -1);
+
+    capture_put64(record, (uint64_t)((timers_now() - c->start) * 1e9));
+    capture_put32(record + 8, (uint32_t)len);
+    record[12] = (uint8_t)dir;
+
+    if (fwrite(record, 1, sizeof(record), c->file) < sizeof(record) ||
+        fwrite(data, 1, len, c->file) < len) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int capture_close(capture_t *c)
+{
+    int ret = 0;
+
+    return_if_true(c == NULL, 0);
+
+    ret = fclose(c->file);
+    free(c);
+
+    return ret;
+}
+
+capture_file_t *capture_map(char const *filename)
+{
+    capture_file_t *tmp = NULL;
+    struct stat st;
+    int fd = -1;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    if (fstat(fd, &st) < 0 || st.st_size < CAPTURE_HEADER_SIZE) {
+        close(fd);
+        return NULL;
+    }
+
+    tmp = calloc(1, sizeof(capture_file_t));
+    if (tmp == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    tmp->size = (size_t)st.st_size;
+    tmp->data = mmap(NULL, tmp->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (tmp->data == MAP_FAILED) {
+        free(tmp);
+        return NULL;
+    }
+
+    if (memcmp(tmp->data, CAPTURE_MAGIC, 8) != 0) {
+        capture_unmap(tmp);
+        return NULL;
+    }
+
+    madvise(tmp->data, tmp->size, MADV_SEQUENTIAL);
+    capture_rewind(tmp);
+
+    return tmp;
+}
+
+void capture_unmap(capture_file_t *f)
+{
+    return_if_true(f == NULL,);
+
+    munmap(f->data, f->size);
+    free(f);
+}
+
+void capture_rewind(capture_file_t *f)
+{
+    f->off = CAPTURE_HEADER_SIZE;
+}
+
+uint64_t capture_start(capture_file_t const *f)
+{
+    return capture_get64(f->data + 8);
+}
+
+int capture_next(capture_file_t *f, capture_record_t *rec)
+{
+    uint8_t const *p = NULL;
+    size_t len = 0;
+
+    return_if_true(f == NULL || rec == NULL, -1);
+    return_if_true(f->off == f->size, 0);
+    return_if_true(f->size - f->off < CAPTURE_RECORD_SIZE, -1);
+
+    p = f->data + f->off;
+    len = capture_get32(p + 8);
+
+    if (f->size - f->off - CAPTURE_RECORD_SIZE < len) {
+        return -1;
+    }
+
+    rec->time = capture_get64(p);
+    rec->length = len;
+    rec->direction = (capture_direction_t)p[12];
+    rec->data = p + CAPTURE_RECORD_SIZE;
+
+    f->off += CAPTURE_RECORD_SIZE + len;
+
+    return 1;
+}
@@ -0,0 +1,61 @@
+#ifndef RCON_CAPTURE_H
+#define RCON_CAPTURE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Raw wire traffic, as it was read from or written to the socket. The file
+ * starts with a header:
+ *
+ *   char     magic[8]   "RCONCAP1"
+ *   uint64_t start      wall clock time of the capture, ns since the epoch
+ *
+ * followed by one record per read() or write():
+ *
+ *   uint64_t time       ns since start
+ *   uint32_t length     of the data that follows
+ *   uint8_t  direction  capture_in or capture_out
+ *   uint8_t  reserved[3]
+ *   uint8_t  data[length]
+ *
+ * All integers are little endian.
+ */
+#define CAPTURE_MAGIC "RCONCAP1"
+#define CAPTURE_HEADER_SIZE 16
+#define CAPTURE_RECORD_SIZE 16
+
+typedef enum {
+    capture_in = 0,
+    capture_out = 1,
+} capture_direction_t;
+
+typedef struct _capture capture_t;
+
+capture_t *capture_open(char const *filename);
+int capture_write(capture_t *c, capture_direction_t dir,
+                  void const *data, size_t len);
+int capture_close(capture_t *c);
+
+typedef struct {
+    uint64_t time;
+    capture_direction_t direction;
+    size_t length;
+    uint8_t const *data;
+} capture_record_t;
+
+typedef struct _capture_file capture_file_t;
+
+/* Maps a capture into memory for reading. Records point into the mapping
+ * and are valid until the file is unmapped.
+ */
+capture_file_t *capture_map(char const *filename);
+void capture_unmap(capture_file_t *f);
+
+/* Returns 1 and fills rec with the next record, 0 at the end of the file,
+ * and -1 if the file is truncated or corrupt.
+ */
+int capture_next(capture_file_t *f, capture_record_t *rec);
+void capture_rewind(capture_file_t *f);
+uint64_t capture_start(capture_file_t const *f);
+
+#endif
@@ -0,0 +1,106 @@
+#include "check.h"
+#include "json.h"
+#include "rcon.h"
+
+#include <string.h>
+
+static void check_latency(FILE *out, double seconds)
+{
+    if (seconds < 0) {
+        fprintf(out, " %9s", "-");
+    } else {
+        fprintf(out, " %7.1fms", seconds * 1000);
+    }
+}
+
+static void check_text(FILE *out, session_t const *s)
+{
+    char const *error = session_error(s);
+    int i = 0;
+
+    fprintf(out, "%-24s %-8s", s->name, session_status_name(s->status));
+
+    for (i = 0; i < session_phase_max; i++) {
+        check_latency(out, s->latency[i]);
+    }
+
+    if (error != NULL) {
+        fprintf(out, "  %s: %s", session_phase_name(s->phase), error);
+    } else if (s->outputlen > 0) {
+        /* Only the first line of the reply to the probe
+         */
+        char const *nl = memchr(s->output, '\n', s->outputlen);
+        size_t len = (nl != NULL ? (size_t)(nl - s->output) : s->outputlen);
+
+        fprintf(out, "  %.*s", (int)len, s->output);
+    }
+
+    fputc('\n', out);
+}
+
+static void check_json(FILE *out, session_t const *s)
+{
+    char const *error = session_error(s);
+    int i = 0;
+
+    fputs("{\"server\":", out);
+    json_string(out, s->name, strlen(s->name));
+    fputs(",\"host\":", out);
+    json_string(out, s->host, strlen(s->host));
+    fputs(",\"port\":", out);
+    json_string(out, s->port, strlen(s->port));
+    fprintf(out, ",\"status\":\"%s\"", session_status_name(s->status));
+
+    if (error != NULL) {
+        fprintf(out, ",\"phase\":\"%s\",\"error\":",
+                session_phase_name(s->phase));
+        json_string(out, error, strlen(error));
+    }
+
+    for (i = 0; i < session_phase_max; i++) {
+        fprintf(out, ",\"%s\":", session_phase_name(i));
+        json_seconds(out, s->latency[i]);
+    }
+
+    if (s->output != NULL) {
+        fputs(",\"reply\":", out);
+        json_string(out, s->output, s->outputlen);
+    }
+
+    fputc('}', out);
+}
+
+void check_report(FILE *out, session_t * const *sessions, size_t count,
+                  bool json)
+{
+    size_t i = 0;
+
+    if (json) {
+        fputc('[', out);
+        for (i = 0; i < count; i++) {
+            fputs((i > 0 ? ",\n " : "\n "), out);
+            check_json(out, sessions[i]);
+        }
+        fputs("\n]\n", out);
+        return;
+    }
+
+    fprintf(out, "%-24s %-8s %9s %9s %9s %9s\n",
+            "SERVER", "STATUS", "CONNECT", "AUTH", "FIRSTBYTE", "COMMAND");
+    for (i = 0; i < count; i++) {
+        check_text(out, sessions[i]);
+    }
+}
+
+bool check_passed(session_t * const *sessions, size_t count)
+{
+    size_t i = 0;
+
+    for (i = 0; i < count; i++) {
+        if (sessions[i]->status != session_status_ok) {
+            return false;
+        }
+    }
+
+    return true;
+}
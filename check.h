@@ -0,0 +1,19 @@
+#ifndef RCON_CHECK_H
+#define RCON_CHECK_H
+
+#include "session.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+
+/* Prints the outcome of a health check, either as a table with one row
+ * per server, or as a JSON array.
+ */
+void check_report(FILE *out, session_t * const *sessions, size_t count,
+                  bool json);
+
+/* Whether every server passed
+ */
+bool check_passed(session_t * const *sessions, size_t count);
+
+#endif
@@ -0,0 +1,391 @@
+#include "confcache.h"
+#include "sysconfig.h"
+#include "rcon.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+struct _confcache
+{
+    uint8_t *data;
+    size_t size;
+
+    uint32_t buckets;
+    uint32_t groups;
+    uint32_t pairs;
+
+    uint8_t const *bucket;
+    uint8_t const *group;
+    uint8_t const *pair;
+    char const *strings;
+    size_t stringsize;
+};
+
+static void confcache_put64(uint8_t *p, uint64_t v)
+{
+    int i = 0;
+
+    for (i = 0; i < 8; i++) {
+        p[i] = (uint8_t)(v >> (i * 8));
+    }
+}
+
+static uint64_t confcache_get64(uint8_t const *p)
+{
+    uint64_t v = 0;
+    int i = 0;
+
+    for (i = 7; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+
+    return v;
+}
+
+static void confcache_put32(uint8_t *p, uint32_t v)
+{
+    int i = 0;
+
+    for (i = 0; i < 4; i++) {
+        p[i] = (uint8_t)(v >> (i * 8));
+    }
+}
+
+static uint32_t confcache_get32(uint8_t const *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 |
+        (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint32_t confcache_hash(char const *s)
+{
+    uint32_t h = 2166136261U;
+
+    for (; *s != '\0'; s++) {
+        h ^= (uint8_t)*s;
+        h *= 16777619U;
+    }
+
+    return h;
+}
+
+/* With nanoseconds where the system has them, so that a file written twice
+ * within a second is told apart
+ */
+static uint64_t confcache_mtime(struct stat const *st)
+{
+#if defined(HAVE_STAT_MTIM)
+    return (uint64_t)st->st_mtim.tv_sec * 1000000000ULL +
+        (uint64_t)st->st_mtim.tv_nsec;
+#elif defined(HAVE_STAT_MTIMESPEC)
+    return (uint64_t)st->st_mtimespec.tv_sec * 1000000000ULL +
+        (uint64_t)st->st_mtimespec.tv_nsec;
+#else
+    return (uint64_t)st->st_mtime * 1000000000ULL;
+#endif
+}
+
+/* Offsets are only checked when they are used, so that mapping the cache
+ * does not depend on its size.
+ */
+static char const *confcache_string(confcache_t const *c, uint32_t off)
+{
+    return_if_true(off >= c->stringsize, NULL);
+    return c->strings + off;
+}
+
+confcache_t *confcache_map(char const *filename, struct stat const *config)
+{
+    confcache_t *tmp = NULL;
+    struct stat st;
+    uint8_t const *h = NULL;
+    size_t tables = 0;
+    int fd = -1;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    if (fstat(fd, &st) < 0 || st.st_size <= CONFCACHE_HEADER_SIZE) {
+        close(fd);
+        return NULL;
+    }
+
+    tmp = calloc(1, sizeof(confcache_t));
+    if (tmp == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    tmp->size = (size_t)st.st_size;
+    tmp->data = mmap(NULL, tmp->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (tmp->data == MAP_FAILED) {
+        free(tmp);
+        return NULL;
+    }
+
+    h = tmp->data;
+    if (memcmp(h, CONFCACHE_MAGIC, 8) != 0 ||
+        confcache_get64(h + 8) != (uint64_t)config->st_size ||
+        confcache_get64(h + 16) != confcache_mtime(config) ||
+        confcache_get64(h + 24) != (uint64_t)config->st_ino) {
+        confcache_unmap(tmp);
+        return NULL;
+    }
+
+    tmp->buckets = confcache_get32(h + 32);
+    tmp->groups = confcache_get32(h + 36);
+    tmp->pairs = confcache_get32(h + 40);
+
+    tables = (size_t)tmp->buckets * 4 + (size_t)tmp->groups * 12 +
+        (size_t)tmp->pairs * 8;
+
+    /* The strings must end in a NUL, so that none of them can run past the
+     * end of the mapping.
+     */
+    if (tmp->buckets == 0 || (tmp->buckets & (tmp->buckets - 1)) != 0 ||
+        tables >= tmp->size - CONFCACHE_HEADER_SIZE ||
+        tmp->data[tmp->size - 1] != '\0') {
+        confcache_unmap(tmp);
+        return NULL;
+    }
+
+    tmp->bucket = h + CONFCACHE_HEADER_SIZE;
+    tmp->group = tmp->bucket + (size_t)tmp->buckets * 4;
+    tmp->pair = tmp->group + (size_t)tmp->groups * 12;
+    tmp->strings = (char const *)(tmp->pair + (size_t)tmp->pairs * 8);
+    tmp->stringsize = tmp->size - CONFCACHE_HEADER_SIZE - tables;
+
+    return tmp;
+}
+
+void confcache_unmap(confcache_t *c)
+{
+    return_if_true(c == NULL,);
+
+    munmap(c->data, c->size);
+    free(c);
+}
+
+uint32_t confcache_groups(confcache_t const *c)
+{
+    return (c != NULL ? c->groups : 0);
+}
+
+char const *confcache_name(confcache_t const *c, uint32_t group)
+{
+    return_if_true(c == NULL || group >= c->groups, NULL);
+    return confcache_string(c, confcache_get32(c->group + group * 12));
+}
+
+bool confcache_find(confcache_t const *c, char const *name,
+                    uint32_t *group)
+{
+    uint32_t i = 0, n = 0, probe = 0;
+
+    return_if_true(c == NULL || name == NULL, false);
+
+    i = confcache_hash(name) & (c->buckets - 1);
+
+    for (probe = 0; probe < c->buckets; probe++) {
+        char const *g = NULL;
+
+        n = confcache_get32(c->bucket + i * 4);
+        if (n == 0 || n > c->groups) {
+            return false;
+        }
+
+        g = confcache_name(c, n - 1);
+        if (g != NULL && strcmp(g, name) == 0) {
+            if (group) {
+                *group = n - 1;
+            }
+            return true;
+        }
+
+        i = (i + 1) & (c->buckets - 1);
+    }
+
+    return false;
+}
+
+uint32_t confcache_pairs(confcache_t const *c, uint32_t group)
+{
+    return_if_true(c == NULL || group >= c->groups, 0);
+    return confcache_get32(c->group + group * 12 + 8);
+}
+
+bool confcache_pair(confcache_t const *c, uint32_t group, uint32_t i,
+                    char const **key, char const **value)
+{
+    uint32_t first = 0;
+    uint8_t const *p = NULL;
+
+    return_if_true(c == NULL || group >= c->groups, false);
+    return_if_true(i >= confcache_pairs(c, group), false);
+
+    first = confcache_get32(c->group + group * 12 + 4);
+    return_if_true(first >= c->pairs || i >= c->pairs - first, false);
+
+    p = c->pair + (size_t)(first + i) * 8;
+    *key = confcache_string(c, confcache_get32(p));
+    *value = confcache_string(c, confcache_get32(p + 4));
+
+    return (*key != NULL && *value != NULL);
+}
+
+/* Appends a string, including its NUL, and returns its offset
+ */
+static uint32_t confcache_intern(GByteArray *strings, char const *s)
+{
+    uint32_t off = strings->len;
+
+    g_byte_array_append(strings, (guint8 const *)s, strlen(s) + 1);
+
+    return off;
+}
+
+int confcache_write(char const *filename, struct stat const *config,
+                    GKeyFile *keyfile)
+{
+    gchar **groups = NULL, **keys = NULL;
+    GByteArray *grouptab = NULL, *pairtab = NULL, *strings = NULL;
+    uint8_t header[CONFCACHE_HEADER_SIZE] = {0};
+    uint8_t *bucket = NULL;
+    uint32_t buckets = 1, ngroups = 0, npairs = 0, i = 0, j = 0;
+    char *tmp = NULL;
+    size_t len = 0;
+    FILE *f = NULL;
+    int fd = -1, ec = -1;
+
+    return_if_true(keyfile == NULL || config == NULL, -1);
+
+    groups = g_key_file_get_groups(keyfile, NULL);
+    for (ngroups = 0; groups[ngroups] != NULL; ngroups++)
+        ;
+
+    /* Keep the table at most half full
+     */
+    while (buckets < ngroups * 2) {
+        buckets *= 2;
+    }
+
+    bucket = calloc(buckets, 4);
+    grouptab = g_byte_array_new();
+    pairtab = g_byte_array_new();
+    strings = g_byte_array_new();
+    if (bucket == NULL) {
+        goto cleanup;
+    }
+
+    /* Offset zero is the empty string
+     */
+    confcache_intern(strings, "");
+
+    for (i = 0; i < ngroups; i++) {
+        uint8_t entry[12];
+        uint32_t count = 0, b = 0;
+
+        keys = g_key_file_get_keys(keyfile, groups[i], NULL, NULL);
+        for (j = 0; keys != NULL && keys[j] != NULL; j++) {
+            gchar *value = g_key_file_get_value(keyfile, groups[i], keys[j],
+                                                NULL);
+            uint8_t pair[8];
+
+            if (value == NULL) {
+                continue;
+            }
+
+            confcache_put32(pair, confcache_intern(strings, keys[j]));
+            confcache_put32(pair + 4, confcache_intern(strings, value));
+            g_free(value);
+            g_byte_array_append(pairtab, pair, sizeof(pair));
+            ++count;
+        }
+        g_strfreev(keys);
+        keys = NULL;
+
+        confcache_put32(entry, confcache_intern(strings, groups[i]));
+        confcache_put32(entry + 4, npairs);
+        confcache_put32(entry + 8, count);
+        npairs += count;
+        g_byte_array_append(grouptab, entry, sizeof(entry));
+
+        b = confcache_hash(groups[i]) & (buckets - 1);
+        while (confcache_get32(bucket + b * 4) != 0) {
+            b = (b + 1) & (buckets - 1);
+        }
+        confcache_put32(bucket + b * 4, i + 1);
+    }
+
+    memcpy(header, CONFCACHE_MAGIC, 8);
+    confcache_put64(header + 8, (uint64_t)config->st_size);
+    confcache_put64(header + 16, confcache_mtime(config));
+    confcache_put64(header + 24, (uint64_t)config->st_ino);
+    confcache_put32(header + 32, buckets);
+    confcache_put32(header + 36, ngroups);
+    confcache_put32(header + 40, npairs);
+
+    len = strlen(filename) + 32;
+    tmp = calloc(1, len);
+    if (tmp == NULL) {
+        goto cleanup;
+    }
+    snprintf(tmp, len, "%s.%ld.tmp", filename, (long)getpid());
+
+    /* It contains the passwords
+     */
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        goto cleanup;
+    }
+
+    f = fdopen(fd, "wb");
+    if (f == NULL) {
+        close(fd);
+        unlink(tmp);
+        goto cleanup;
+    }
+
+    fwrite(header, 1, sizeof(header), f);
+    fwrite(bucket, 4, buckets, f);
+    fwrite(grouptab->data, 1, grouptab->len, f);
+    fwrite(pairtab->data, 1, pairtab->len, f);
+    fwrite(strings->data, 1, strings->len, f);
+
+    if (ferror(f) | fclose(f)) {
+        unlink(tmp);
+        goto cleanup;
+    }
+
+    if (rename(tmp, filename)) {
+        unlink(tmp);
+        goto cleanup;
+    }
+
+    ec = 0;
+
+cleanup:
+
+    free(tmp);
+    free(bucket);
+    g_strfreev(groups);
+    if (grouptab != NULL) {
+        g_byte_array_free(grouptab, TRUE);
+    }
+    if (pairtab != NULL) {
+        g_byte_array_free(pairtab, TRUE);
+    }
+    if (strings != NULL) {
+        g_byte_array_free(strings, TRUE);
+    }
+
+    return ec;
+}
@@ -0,0 +1,62 @@
+#ifndef RCON_CONFCACHE_H
+#define RCON_CONFCACHE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+/* A compiled copy of the configuration file, that is mapped into memory
+ * instead of being parsed. It holds the raw values of all keys, and a hash
+ * index of the groups, so looking up one server does not touch the others:
+ *
+ *   char     magic[8]   "RCONCFG2"
+ *   uint64_t size       of the configuration file
+ *   uint64_t mtime      of the configuration file, in ns since the epoch
+ *   uint64_t inode      of the configuration file
+ *   uint32_t buckets    amount of hash buckets, a power of two
+ *   uint32_t groups     amount of groups
+ *   uint32_t pairs      amount of key/value pairs
+ *   uint32_t reserved
+ *
+ *   uint32_t bucket[buckets]           group index + 1, or 0 if empty
+ *   uint32_t group[groups][3]          name, first pair, amount of pairs
+ *   uint32_t pair[pairs][2]            key, value
+ *   char     strings[]                 NUL terminated
+ *
+ * Names, keys and values are offsets into strings. All integers are little
+ * endian. Groups are hashed with FNV-1a and probed linearly.
+ */
+#define CONFCACHE_MAGIC "RCONCFG2"
+#define CONFCACHE_HEADER_SIZE 48
+
+typedef struct _confcache confcache_t;
+
+/* Maps the cache, if it was built from the configuration file with the
+ * given stat(). Returns NULL if the cache is missing, broken or stale.
+ */
+confcache_t *confcache_map(char const *filename, struct stat const *config);
+void confcache_unmap(confcache_t *c);
+
+/* Compiles the parsed configuration file, that had the given stat() before
+ * it was parsed, into a new cache. The cache is replaced atomically, and
+ * only readable by the user.
+ */
+int confcache_write(char const *filename, struct stat const *config,
+                    GKeyFile *keyfile);
+
+uint32_t confcache_groups(confcache_t const *c);
+char const *confcache_name(confcache_t const *c, uint32_t group);
+
+/* Finds the group with the given name
+ */
+bool confcache_find(confcache_t const *c, char const *name,
+                    uint32_t *group);
+
+uint32_t confcache_pairs(confcache_t const *c, uint32_t group);
+bool confcache_pair(confcache_t const *c, uint32_t group, uint32_t i,
+                    char const **key, char const **value);
+
+#endif
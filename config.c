@@ -1,9 +1,12 @@
 #include "config.h"
+#include "confcache.h"
 #include "rcon.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
 
 #include <glib.h>
 
@@ -14,20 +17,83 @@
 #define CONFIG_KEY_SERVICE  "port"
 #define CONFIG_KEY_PASSWORD "password"
 #define CONFIG_KEY_MINECRAFT "minecraft"
+/* Command rate limiting, see ratelimit.h
+ */
+#define CONFIG_KEY_RATE "rate"
+#define CONFIG_KEY_BURST "burst"
+#define CONFIG_KEY_URGENT "urgent"
+#define CONFIG_KEY_BULK "bulk"
+/* Deadlines, in seconds
+ */
+#define CONFIG_KEY_CONNECT_TIMEOUT "connect_timeout"
+#define CONFIG_KEY_AUTH_TIMEOUT "auth_timeout"
+#define CONFIG_KEY_FIRST_BYTE_TIMEOUT "first_byte_timeout"
+#define CONFIG_KEY_TIMEOUT "timeout"
+/* Socket options, see sockopt.h
+ */
+#define CONFIG_KEY_NODELAY "nodelay"
+#define CONFIG_KEY_KEEPALIVE "keepalive"
+#define CONFIG_KEY_KEEPALIVE_IDLE "keepalive_idle"
+#define CONFIG_KEY_KEEPALIVE_INTERVAL "keepalive_interval"
+#define CONFIG_KEY_KEEPALIVE_COUNT "keepalive_count"
+#define CONFIG_KEY_RCVBUF "rcvbuf"
+#define CONFIG_KEY_SNDBUF "sndbuf"
+#define CONFIG_KEY_BUSY_POLL "busy_poll"
+/* Servers can be selected by tag, and take the keys they do not have from
+ * the group they inherit from.
+ */
+#define CONFIG_KEY_TAGS "tags"
+#define CONFIG_KEY_INHERIT "inherit"
+/* How many levels of inheritance are followed, which also ends loops
+ */
+#define CONFIG_INHERIT_MAX 16
 
 static GKeyFile *config = NULL;
+/* If the compiled cache is used, groups are copied from it into config when
+ * they are first looked up.
+ */
+static confcache_t *cache = NULL;
+static char *cachefile = NULL;
+/* Groups that already had their inherited keys copied in
+ */
+static GHashTable *resolved = NULL;
+/* All groups, and the indices of the groups that have each tag. Built on
+ * the first selection.
+ */
+static char **groupnames = NULL;
+static GHashTable *groupindex = NULL;
+static GHashTable *tagindex = NULL;
+
+void config_set_cache(char const *filename)
+{
+    free(cachefile);
+    cachefile = (filename != NULL ? strdup(filename) : NULL);
+}
 
 int config_load(char const *filename)
 {
     GError *error = NULL;
+    struct stat st;
+    bool cached = false;
 
     config_free();
 
+    cached = (cachefile != NULL && stat(filename, &st) == 0);
+    if (cached) {
+        cache = confcache_map(cachefile, &st);
+    }
+
     config = g_key_file_new();
     if (config == NULL) {
         return -1;
     }
 
+    g_key_file_set_list_separator(config, ',');
+
+    if (cache != NULL) {
+        return 0;
+    }
+
     if (!g_key_file_load_from_file(config, filename, G_KEY_FILE_NONE, &error)) {
         fprintf(stderr, "Failed to load configuration file: %s: %s\n",
                 filename, error->message
@@ -37,6 +103,11 @@ int config_load(char const *filename)
         return -2;
     }
 
+    if (cached && confcache_write(cachefile, &st, config)) {
+        fprintf(stderr, "Failed to write configuration cache: %s: %s\n",
+                cachefile, strerror(errno));
+    }
+
     return 0;
 }
 
@@ -46,6 +117,306 @@ void config_free(void)
         g_key_file_free(config);
         config = NULL;
     }
+
+    confcache_unmap(cache);
+    cache = NULL;
+
+    if (resolved != NULL) {
+        g_hash_table_destroy(resolved);
+        resolved = NULL;
+    }
+
+    if (tagindex != NULL) {
+        g_hash_table_destroy(tagindex);
+        tagindex = NULL;
+    }
+
+    if (groupindex != NULL) {
+        g_hash_table_destroy(groupindex);
+        groupindex = NULL;
+    }
+
+    g_strfreev(groupnames);
+    groupnames = NULL;
+}
+
+/* Looks up the group, and copies it over from the cache if needed
+ */
+static bool config_copy_group(char const *name)
+{
+    char const *key = NULL, *value = NULL;
+    uint32_t group = 0, i = 0;
+
+    if (g_key_file_has_group(config, name)) {
+        return true;
+    }
+
+    if (!confcache_find(cache, name, &group)) {
+        return false;
+    }
+
+    for (i = 0; i < confcache_pairs(cache, group); i++) {
+        if (confcache_pair(cache, group, i, &key, &value)) {
+            g_key_file_set_value(config, name, key, value);
+        }
+    }
+
+    return true;
+}
+
+/* Looks up the group, and fills in what it inherits
+ */
+static bool config_has_group(char const *name)
+{
+    gchar *parent = NULL, *next = NULL;
+    gchar **keys = NULL, **k = NULL;
+    int depth = 0;
+
+    if (resolved != NULL && g_hash_table_contains(resolved, name)) {
+        return true;
+    }
+
+    if (!config_copy_group(name)) {
+        return false;
+    }
+
+    parent = g_key_file_get_value(config, name, CONFIG_KEY_INHERIT, NULL);
+
+    for (depth = 0; parent != NULL && depth < CONFIG_INHERIT_MAX; depth++) {
+        if (!config_copy_group(parent)) {
+            fprintf(stderr, "Server %s inherits from unknown server %s\n",
+                    name, parent);
+            break;
+        }
+
+        /* The closest ancestor wins
+         */
+        keys = g_key_file_get_keys(config, parent, NULL, NULL);
+        for (k = keys; k != NULL && *k != NULL; k++) {
+            gchar *value = NULL;
+
+            if (strcmp(*k, CONFIG_KEY_INHERIT) == 0 ||
+                g_key_file_has_key(config, name, *k, NULL)) {
+                continue;
+            }
+
+            value = g_key_file_get_value(config, parent, *k, NULL);
+            if (value != NULL) {
+                g_key_file_set_value(config, name, *k, value);
+            }
+            g_free(value);
+        }
+        g_strfreev(keys);
+
+        next = g_key_file_get_value(config, parent, CONFIG_KEY_INHERIT, NULL);
+        g_free(parent);
+        parent = next;
+    }
+    g_free(parent);
+
+    if (resolved == NULL) {
+        resolved = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                         NULL);
+    }
+    g_hash_table_insert(resolved, g_strdup(name), NULL);
+
+    return true;
+}
+
+char **config_groups(void)
+{
+    char **tmp = NULL;
+    uint32_t i = 0, count = 0;
+
+    return_if_true(config == NULL, NULL);
+
+    if (cache == NULL) {
+        return g_key_file_get_groups(config, NULL);
+    }
+
+    count = confcache_groups(cache);
+    tmp = g_new0(char*, count + 1);
+
+    for (i = 0; i < count; i++) {
+        char const *name = confcache_name(cache, i);
+
+        tmp[i] = g_strdup(name != NULL ? name : "");
+    }
+
+    return tmp;
+}
+
+/* The raw value of a key, without copying the group out of the cache
+ */
+static gchar *config_raw(char const *name, char const *key)
+{
+    char const *k = NULL, *v = NULL;
+    uint32_t group = 0, i = 0;
+
+    if (cache == NULL || g_key_file_has_group(config, name)) {
+        return g_key_file_get_value(config, name, key, NULL);
+    }
+
+    if (!confcache_find(cache, name, &group)) {
+        return NULL;
+    }
+
+    for (i = 0; i < confcache_pairs(cache, group); i++) {
+        if (confcache_pair(cache, group, i, &k, &v) && strcmp(k, key) == 0) {
+            return g_strdup(v);
+        }
+    }
+
+    return NULL;
+}
+
+/* Like config_raw(), but follows inheritance
+ */
+static gchar *config_inherited(char const *name, char const *key)
+{
+    gchar *value = NULL, *parent = NULL, *next = NULL;
+    int depth = 0;
+
+    value = config_raw(name, key);
+    parent = config_raw(name, CONFIG_KEY_INHERIT);
+
+    for (depth = 0; value == NULL && parent != NULL &&
+             depth < CONFIG_INHERIT_MAX; depth++) {
+        value = config_raw(parent, key);
+        next = config_raw(parent, CONFIG_KEY_INHERIT);
+        g_free(parent);
+        parent = next;
+    }
+    g_free(parent);
+
+    return value;
+}
+
+/* Builds the inverted index from tags to the servers that have them. Tags
+ * are read straight from the cache if there is one.
+ */
+static int config_index(void)
+{
+    guint i = 0;
+    gchar **tags = NULL, **t = NULL;
+
+    if (tagindex != NULL) {
+        return 0;
+    }
+
+    groupnames = config_groups();
+    if (groupnames == NULL) {
+        return -1;
+    }
+
+    groupindex = g_hash_table_new(g_str_hash, g_str_equal);
+    tagindex = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                     (GDestroyNotify)g_ptr_array_unref);
+
+    for (i = 0; groupnames[i] != NULL; i++) {
+        gchar *value = NULL;
+
+        g_hash_table_insert(groupindex, groupnames[i], GUINT_TO_POINTER(i));
+
+        value = config_inherited(groupnames[i], CONFIG_KEY_TAGS);
+        if (value == NULL) {
+            continue;
+        }
+
+        tags = g_strsplit(value, ",", -1);
+        g_free(value);
+
+        for (t = tags; t != NULL && *t != NULL; t++) {
+            GPtrArray *members = NULL;
+
+            g_strstrip(*t);
+            if (**t == '\0') {
+                continue;
+            }
+
+            members = g_hash_table_lookup(tagindex, *t);
+            if (members == NULL) {
+                members = g_ptr_array_new();
+                g_hash_table_insert(tagindex, g_strdup(*t), members);
+            }
+            g_ptr_array_add(members, GUINT_TO_POINTER(i));
+        }
+        g_strfreev(tags);
+    }
+
+    return 0;
+}
+
+char **config_select(char const *selector)
+{
+    gchar **terms = NULL, **t = NULL;
+    char **tmp = NULL;
+    bool *selected = NULL;
+    guint count = 0, i = 0, n = 0;
+
+    return_if_true(config == NULL || selector == NULL, NULL);
+
+    if (config_index()) {
+        return NULL;
+    }
+
+    count = g_strv_length(groupnames);
+    selected = calloc(count + 1, sizeof(bool));
+    if (selected == NULL) {
+        return NULL;
+    }
+
+    terms = g_strsplit(selector, ",", -1);
+
+    for (t = terms; *t != NULL; t++) {
+        char *term = g_strstrip(*t);
+        bool value = true;
+        gpointer index = NULL;
+
+        if (*term == '-') {
+            value = false;
+            ++term;
+        }
+
+        if (*term == '\0') {
+            continue;
+        }
+
+        if (strcmp(term, "all") == 0) {
+            for (i = 0; i < count; i++) {
+                selected[i] = value;
+            }
+        } else if (strncmp(term, "tag:", 4) == 0) {
+            GPtrArray *members = g_hash_table_lookup(tagindex, term + 4);
+
+            for (i = 0; members != NULL && i < members->len; i++) {
+                selected[GPOINTER_TO_UINT(g_ptr_array_index(members, i))] =
+                    value;
+            }
+        } else if (g_hash_table_lookup_extended(groupindex, term, NULL,
+                                                &index)) {
+            selected[GPOINTER_TO_UINT(index)] = value;
+        } else {
+            fprintf(stderr, "Server %s not found in configuration\n", term);
+            goto cleanup;
+        }
+    }
+
+    /* In the order of the configuration file, and each server only once
+     */
+    tmp = g_new0(char*, count + 1);
+    for (i = 0; i < count; i++) {
+        if (selected[i]) {
+            tmp[n++] = g_strdup(groupnames[i]);
+        }
+    }
+
+cleanup:
+
+    g_strfreev(terms);
+    free(selected);
+
+    return tmp;
 }
 
 int config_host_data(char const *name, char **hostname,
@@ -57,7 +428,7 @@ int config_host_data(char const *name, char **hostname,
 
     return_if_true(config == NULL, -1);
 
-    if (!g_key_file_has_group(config, name)) {
+    if (!config_has_group(name)) {
         return -2;
     }
 
@@ -69,7 +440,7 @@ int config_host_data(char const *name, char **hostname,
     s = g_key_file_get_string(config, name, CONFIG_KEY_SERVICE, NULL);
     if (s == NULL) {
         g_free(h);
-        return -3;
+        return -4;
     }
 
     p = g_key_file_get_string(config, name, CONFIG_KEY_PASSWORD, NULL);
@@ -97,3 +468,103 @@ int config_host_data(char const *name, char **hostname,
 
     return 0;
 }
+
+static void config_get_double(char const *name, char const *key,
+                              double *value)
+{
+    GError *error = NULL;
+    gdouble d = 0;
+
+    d = g_key_file_get_double(config, name, key, &error);
+    if (error == NULL && value) {
+        *value = d;
+    }
+    g_clear_error(&error);
+}
+
+static void config_get_int(char const *name, char const *key, int *value)
+{
+    GError *error = NULL;
+    gint i = 0;
+
+    i = g_key_file_get_integer(config, name, key, &error);
+    if (error == NULL && value) {
+        *value = i;
+    }
+    g_clear_error(&error);
+}
+
+static void config_get_bool(char const *name, char const *key, int *value)
+{
+    GError *error = NULL;
+    gboolean b = FALSE;
+
+    b = g_key_file_get_boolean(config, name, key, &error);
+    if (error == NULL && value) {
+        *value = (b ? 1 : 0);
+    }
+    g_clear_error(&error);
+}
+
+int config_host_schedule(char const *name, double *rate, double *burst,
+                         char ***urgent, char ***bulk)
+{
+    return_if_true(config == NULL, -1);
+
+    if (!config_has_group(name)) {
+        return -2;
+    }
+
+    config_get_double(name, CONFIG_KEY_RATE, rate);
+    config_get_double(name, CONFIG_KEY_BURST, burst);
+
+    if (urgent) {
+        *urgent = g_key_file_get_string_list(config, name, CONFIG_KEY_URGENT,
+                                             NULL, NULL);
+    }
+
+    if (bulk) {
+        *bulk = g_key_file_get_string_list(config, name, CONFIG_KEY_BULK,
+                                           NULL, NULL);
+    }
+
+    return 0;
+}
+
+int config_host_timeouts(char const *name, double *connect, double *auth,
+                         double *first_byte, double *command)
+{
+    return_if_true(config == NULL, -1);
+
+    if (!config_has_group(name)) {
+        return -2;
+    }
+
+    config_get_double(name, CONFIG_KEY_CONNECT_TIMEOUT, connect);
+    config_get_double(name, CONFIG_KEY_AUTH_TIMEOUT, auth);
+    config_get_double(name, CONFIG_KEY_FIRST_BYTE_TIMEOUT, first_byte);
+    config_get_double(name, CONFIG_KEY_TIMEOUT, command);
+
+    return 0;
+}
+
+int config_host_sockopts(char const *name, sockopt_t *o)
+{
+    return_if_true(config == NULL || o == NULL, -1);
+
+    if (!config_has_group(name)) {
+        return -2;
+    }
+
+    config_get_bool(name, CONFIG_KEY_NODELAY, &o->nodelay);
+    config_get_bool(name, CONFIG_KEY_KEEPALIVE, &o->keepalive);
+    config_get_int(name, CONFIG_KEY_KEEPALIVE_IDLE, &o->keepalive_idle);
+    config_get_int(name, CONFIG_KEY_KEEPALIVE_INTERVAL,
+                   &o->keepalive_interval);
+    config_get_int(name, CONFIG_KEY_KEEPALIVE_COUNT, &o->keepalive_count);
+    config_get_int(name, CONFIG_KEY_RCVBUF, &o->rcvbuf);
+    config_get_int(name, CONFIG_KEY_SNDBUF, &o->sndbuf);
+    config_get_int(name, CONFIG_KEY_BUSY_POLL, &o->busy_poll);
+
+    return 0;
+}
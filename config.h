@@ -1,12 +1,48 @@
 #ifndef RCON_CONFIG_H
 #define RCON_CONFIG_H
 
+#include "sockopt.h"
+
 #include <stdbool.h>
 
 void config_free(void);
+
+/* Use a compiled copy of the configuration file, that is kept in the given
+ * file, and rebuilt whenever the configuration changes.
+ */
+void config_set_cache(char const *filename);
 int config_load(char const *file);
 
+/* Names of all servers in the configuration, free with g_strfreev()
+ */
+char **config_groups(void);
+
+/* Names of the servers that match the selector, a comma separated list of
+ * server names, "tag:name" for all servers with that tag, or "all". A term
+ * prefixed with "-" removes servers again. Each server is listed once, in
+ * the order of the configuration file. Free with g_strfreev().
+ */
+char **config_select(char const *selector);
+
+/* Returns -2 for unknown servers, -3 for servers without a hostname, and -4
+ * for servers without a port
+ */
 int config_host_data(char const *name, char **hostname,
                      char **port, char **passwd, bool *minecraft);
 
+/* Only touches the values that are present in the configuration. The
+ * returned lists must be freed with g_strfreev().
+ */
+int config_host_schedule(char const *name, double *rate, double *burst,
+                         char ***urgent, char ***bulk);
+
+/* Deadlines in seconds, also only touched if present
+ */
+int config_host_timeouts(char const *name, double *connect, double *auth,
+                         double *first_byte, double *command);
+
+/* Overrides the socket options that are present
+ */
+int config_host_sockopts(char const *name, sockopt_t *o);
+
 #endif
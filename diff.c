@@ -0,0 +1,234 @@
+#include "diff.h"
+#include "rcon.h"
+
+#include <string.h>
+#include <stdbool.h>
+
+/* Texts that need more edits than this are not compared line by line,
+ * which bounds the trace to about DIFF_MAX_D^2/2 entries.
+ */
+#define DIFF_MAX_D 1024
+
+static uint32_t diff_hash(char const *s, size_t len)
+{
+    uint32_t h = 2166136261U;
+    size_t i = 0;
+
+    for (i = 0; i < len; i++) {
+        h ^= (uint8_t)s[i];
+        h *= 16777619U;
+    }
+
+    return h;
+}
+
+ssize_t diff_split(char const *text, size_t len, diff_line_t **lines)
+{
+    diff_line_t *tmp = NULL;
+    char const *p = text, *end = text + len, *nl = NULL;
+    size_t count = 0, i = 0;
+
+    for (p = text; p < end; p = nl + 1) {
+        nl = memchr(p, '\n', end - p);
+        ++count;
+        if (nl == NULL) {
+            break;
+        }
+    }
+
+    tmp = calloc(count + 1, sizeof(diff_line_t));
+    if (tmp == NULL) {
+        return -1;
+    }
+
+    for (p = text; i < count; p = nl + 1, i++) {
+        nl = memchr(p, '\n', end - p);
+        if (nl == NULL) {
+            nl = end;
+        }
+
+        tmp[i].data = p;
+        tmp[i].len = nl - p;
+        tmp[i].hash = diff_hash(p, tmp[i].len);
+    }
+
+    *lines = tmp;
+
+    return (ssize_t)count;
+}
+
+static bool diff_equal(diff_line_t const *a, diff_line_t const *b)
+{
+    return (a->hash == b->hash && a->len == b->len &&
+            memcmp(a->data, b->data, a->len) == 0);
+}
+
+static void diff_replace(diff_line_t const *a, long n,
+                         diff_line_t const *b, long m,
+                         diff_callback_t cb, void *data)
+{
+    long i = 0;
+
+    for (i = 0; i < n; i++) {
+        cb(diff_delete, &a[i], data);
+    }
+
+    for (i = 0; i < m; i++) {
+        cb(diff_insert, &b[i], data);
+    }
+}
+
+/* Myers' greedy algorithm. For each amount of edits d it remembers how far
+ * each diagonal k = x - y got, and then walks back from the end.
+ */
+static int diff_middle(diff_line_t const *a, long n,
+                       diff_line_t const *b, long m,
+                       diff_callback_t cb, void *data)
+{
+    long max = n + m, limit = 0, off = 0, d = 0, k = 0, x = 0, y = 0;
+    long found = -1, i = 0;
+    long *v = NULL, *trace = NULL;
+    unsigned char *ops = NULL;
+    size_t nops = 0;
+    int ec = -1;
+
+    if (n == 0 || m == 0) {
+        diff_replace(a, n, b, m, cb, data);
+        return 0;
+    }
+
+    limit = (max < DIFF_MAX_D ? max : DIFF_MAX_D);
+    off = max + 1;
+
+    v = calloc(2 * max + 3, sizeof(long));
+    trace = calloc((limit + 1) * (limit + 2) / 2, sizeof(long));
+    ops = calloc(max, 1);
+    if (v == NULL || trace == NULL || ops == NULL) {
+        goto cleanup;
+    }
+
+    for (d = 0; d <= limit && found < 0; d++) {
+        long *t = trace + d * (d + 1) / 2;
+
+        for (k = -d; k <= d; k += 2) {
+            if (k == -d || (k != d && v[off+k-1] < v[off+k+1])) {
+                x = v[off+k+1];
+            } else {
+                x = v[off+k-1] + 1;
+            }
+            y = x - k;
+
+            while (x < n && y < m && diff_equal(&a[x], &b[y])) {
+                ++x;
+                ++y;
+            }
+
+            v[off+k] = x;
+            t[(k + d) / 2] = x;
+
+            if (x >= n && y >= m) {
+                found = d;
+                break;
+            }
+        }
+    }
+
+    if (found < 0) {
+        diff_replace(a, n, b, m, cb, data);
+        ec = 0;
+        goto cleanup;
+    }
+
+    /* Walk back, the operations come out in reverse
+     */
+    x = n;
+    y = m;
+    for (d = found; d > 0; d--) {
+        long const *p = trace + (d - 1) * d / 2;
+        long pk = 0, px = 0, py = 0;
+
+        k = x - y;
+        if (k == -d ||
+            (k != d && p[(k - 1 + d - 1) / 2] < p[(k + 1 + d - 1) / 2])) {
+            pk = k + 1;
+        } else {
+            pk = k - 1;
+        }
+        px = p[(pk + d - 1) / 2];
+        py = px - pk;
+
+        while (x > px && y > py) {
+            ops[nops++] = diff_keep;
+            --x;
+            --y;
+        }
+
+        if (x == px) {
+            ops[nops++] = diff_insert;
+            --y;
+        } else {
+            ops[nops++] = diff_delete;
+            --x;
+        }
+    }
+
+    while (x > 0 && y > 0) {
+        ops[nops++] = diff_keep;
+        --x;
+        --y;
+    }
+
+    for (i = (long)nops - 1; i >= 0; i--) {
+        switch (ops[i])
+        {
+        case diff_keep: cb(diff_keep, &b[y], data); ++x; ++y; break;
+        case diff_insert: cb(diff_insert, &b[y], data); ++y; break;
+        case diff_delete: cb(diff_delete, &a[x], data); ++x; break;
+        }
+    }
+
+    ec = 0;
+
+cleanup:
+
+    free(v);
+    free(trace);
+    free(ops);
+
+    return ec;
+}
+
+int diff_lines(diff_line_t const *a, size_t na,
+               diff_line_t const *b, size_t nb,
+               diff_callback_t cb, void *data)
+{
+    size_t pre = 0, suf = 0, i = 0;
+
+    return_if_true(cb == NULL, -1);
+
+    /* Most of the time only a few lines in the middle change
+     */
+    while (pre < na && pre < nb && diff_equal(&a[pre], &b[pre])) {
+        ++pre;
+    }
+
+    while (suf < na - pre && suf < nb - pre &&
+           diff_equal(&a[na - 1 - suf], &b[nb - 1 - suf])) {
+        ++suf;
+    }
+
+    for (i = 0; i < pre; i++) {
+        cb(diff_keep, &b[i], data);
+    }
+
+    if (diff_middle(a + pre, (long)(na - pre - suf),
+                    b + pre, (long)(nb - pre - suf), cb, data)) {
+        return -1;
+    }
+
+    for (i = nb - suf; i < nb; i++) {
+        cb(diff_keep, &b[i], data);
+    }
+
+    return 0;
+}
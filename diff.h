@@ -0,0 +1,42 @@
+#ifndef RCON_DIFF_H
+#define RCON_DIFF_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+/* Line based differences between two texts, as found by Myers' O(ND)
+ * algorithm. Lines point into the texts, and are compared by hash first.
+ */
+typedef struct {
+    char const *data;
+    /* Without the newline
+     */
+    size_t len;
+    uint32_t hash;
+} diff_line_t;
+
+typedef enum {
+    diff_keep = 0,
+    diff_insert,
+    diff_delete,
+} diff_op_t;
+
+typedef void (*diff_callback_t)(diff_op_t op, diff_line_t const *line,
+                                void *data);
+
+/* Splits the text into lines. The array must be freed by the caller.
+ * Returns the amount of lines, or -1 if out of memory.
+ */
+ssize_t diff_split(char const *text, size_t len, diff_line_t **lines);
+
+/* Calls back for each line of a and b in order, telling whether it was
+ * kept, deleted from a, or inserted from b. Very different texts are
+ * reported as a deleted and b inserted as a whole, to bound the memory
+ * used.
+ */
+int diff_lines(diff_line_t const *a, size_t na,
+               diff_line_t const *b, size_t nb,
+               diff_callback_t cb, void *data);
+
+#endif
@@ -0,0 +1,59 @@
+#include "hexdump.h"
+
+#include <string.h>
+
+/* Rendering of each byte value, including the trailing comma
+ */
+static char table[256][5];
+static uint8_t lengths[256];
+static int initialised = 0;
+
+static void hexdump_init(void)
+{
+    static char const hex[] = "0123456789ABCDEF";
+    int i = 0;
+
+    for (i = 0; i < 256; i++) {
+        /* Same as isprint() in the C locale
+         */
+        if (i >= 0x20 && i < 0x7F) {
+            table[i][0] = (char)i;
+            table[i][1] = ',';
+            lengths[i] = 2;
+        } else {
+            table[i][0] = '0';
+            table[i][1] = 'x';
+            table[i][2] = hex[i >> 4];
+            table[i][3] = hex[i & 0x0F];
+            table[i][4] = ',';
+            lengths[i] = 5;
+        }
+    }
+
+    initialised = 1;
+}
+
+size_t hexdump_format(char *out, uint8_t const *data, size_t sz)
+{
+    char *p = out;
+    size_t i = 0;
+
+    if (!initialised) {
+        hexdump_init();
+    }
+
+    for (i = 0; i < sz; i++) {
+        /* Always copy the whole entry, and only advance by its length
+         */
+        memcpy(p, table[data[i]], 5);
+        p += lengths[data[i]];
+    }
+
+    /* No comma after the last byte
+     */
+    if (p > out) {
+        --p;
+    }
+
+    return p - out;
+}
@@ -0,0 +1,15 @@
+#ifndef RCON_HEXDUMP_H
+#define RCON_HEXDUMP_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Renders data as comma separated list, printable characters as is, and all
+ * others as 0xHH. Returns the amount of bytes written to out, which must
+ * have room for at least hexdump_size(sz) bytes. Does not terminate out.
+ */
+size_t hexdump_format(char *out, uint8_t const *data, size_t sz);
+
+#define hexdump_size(sz) ((sz) * 5)
+
+#endif
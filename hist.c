@@ -0,0 +1,176 @@
+#include "hist.h"
+#include "rcon.h"
+
+#define HIST_HALF (HIST_LINEAR / 2)
+/* Index of HIST_MAX, plus one
+ */
+#define HIST_BUCKETS ((36 - 10 + 1) * HIST_HALF + 1)
+
+struct _hist
+{
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+    double sum;
+    uint64_t buckets[HIST_BUCKETS];
+};
+
+static size_t hist_index(uint64_t value)
+{
+    unsigned int shift = 0;
+
+    if (value < HIST_LINEAR) {
+        return (size_t)value;
+    }
+
+    /* Keep the top 11 bits of the value
+     */
+    while ((value >> shift) >= HIST_LINEAR) {
+        ++shift;
+    }
+
+    return (size_t)shift * HIST_HALF + (size_t)(value >> shift);
+}
+
+static uint64_t hist_highest(size_t index)
+{
+    unsigned int shift = 0;
+    uint64_t sub = 0;
+
+    if (index < HIST_LINEAR) {
+        return index;
+    }
+
+    shift = index / HIST_HALF - 1;
+    sub = index - (size_t)shift * HIST_HALF;
+
+    return ((sub + 1) << shift) - 1;
+}
+
+hist_t *hist_new(void)
+{
+    hist_t *tmp = NULL;
+
+    tmp = calloc(1, sizeof(hist_t));
+    if (tmp == NULL) {
+        return NULL;
+    }
+
+    tmp->min = HIST_MAX;
+
+    return tmp;
+}
+
+void hist_free(hist_t *h)
+{
+    free(h);
+}
+
+void hist_record(hist_t *h, uint64_t value)
+{
+    return_if_true(h == NULL,);
+
+    if (value > HIST_MAX) {
+        value = HIST_MAX;
+    }
+
+    ++h->buckets[hist_index(value)];
+    ++h->count;
+    h->sum += (double)value;
+
+    if (value < h->min) {
+        h->min = value;
+    }
+    if (value > h->max) {
+        h->max = value;
+    }
+}
+
+void hist_record_corrected(hist_t *h, uint64_t value, uint64_t interval)
+{
+    uint64_t missing = 0;
+
+    hist_record(h, value);
+
+    if (interval == 0 || value > HIST_MAX) {
+        return;
+    }
+
+    for (missing = value - interval; missing >= interval && missing < value;
+         missing -= interval) {
+        hist_record(h, missing);
+    }
+}
+
+void hist_add(hist_t *h, hist_t const *other)
+{
+    size_t i = 0;
+
+    return_if_true(h == NULL || other == NULL || other->count == 0,);
+
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        h->buckets[i] += other->buckets[i];
+    }
+
+    h->count += other->count;
+    h->sum += other->sum;
+
+    if (other->min < h->min) {
+        h->min = other->min;
+    }
+    if (other->max > h->max) {
+        h->max = other->max;
+    }
+}
+
+uint64_t hist_count(hist_t const *h)
+{
+    return (h != NULL ? h->count : 0);
+}
+
+uint64_t hist_min(hist_t const *h)
+{
+    return (h != NULL && h->count > 0 ? h->min : 0);
+}
+
+uint64_t hist_max(hist_t const *h)
+{
+    return (h != NULL ? h->max : 0);
+}
+
+double hist_mean(hist_t const *h)
+{
+    return (h != NULL && h->count > 0 ? h->sum / h->count : 0);
+}
+
+uint64_t hist_percentile(hist_t const *h, double percentile)
+{
+    uint64_t rank = 0, seen = 0;
+    size_t i = 0;
+
+    return_if_true(h == NULL || h->count == 0, 0);
+
+    if (percentile >= 100) {
+        return h->max;
+    } else if (percentile < 0) {
+        percentile = 0;
+    }
+
+    /* The smallest value that at least this many values are not above
+     */
+    rank = (uint64_t)(percentile / 100.0 * h->count + 0.5);
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            uint64_t v = hist_highest(i);
+
+            return (v < h->max ? v : h->max);
+        }
+    }
+
+    return h->max;
+}
@@ -0,0 +1,46 @@
+#ifndef RCON_HIST_H
+#define RCON_HIST_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Latency histogram in the manner of HdrHistogram: values up to
+ * HIST_LINEAR are counted exactly, and above that every power of two is
+ * split into HIST_LINEAR / 2 buckets, so that any value is off by less than
+ * 0.1%. Recording is a few shifts, and never allocates.
+ *
+ * Values are unit-less, the load generator uses microseconds. Values above
+ * HIST_MAX are counted as HIST_MAX.
+ */
+#define HIST_LINEAR 2048
+#define HIST_MAX ((uint64_t)1 << 36)
+
+typedef struct _hist hist_t;
+
+hist_t *hist_new(void);
+void hist_free(hist_t *h);
+
+void hist_record(hist_t *h, uint64_t value);
+
+/* Records the value, and if it exceeds the interval the requests were
+ * expected to come in at, also the values of the requests that would have
+ * been sent, and delayed, in the meantime. This corrects for coordinated
+ * omission when the sender waits for each reply before sending again.
+ */
+void hist_record_corrected(hist_t *h, uint64_t value, uint64_t interval);
+
+/* Adds all values recorded in other to h
+ */
+void hist_add(hist_t *h, hist_t const *other);
+
+uint64_t hist_count(hist_t const *h);
+uint64_t hist_min(hist_t const *h);
+uint64_t hist_max(hist_t const *h);
+double hist_mean(hist_t const *h);
+
+/* The value at the given percentile, between 0 and 100. Returns the highest
+ * value that is counted in the same bucket, or 0 if nothing was recorded.
+ */
+uint64_t hist_percentile(hist_t const *h, double percentile);
+
+#endif
@@ -0,0 +1,191 @@
+#include "http.h"
+#include "rcon.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+/* Finds the empty line that ends the head
+ */
+static ssize_t http_head_size(char const *buf, size_t size)
+{
+    size_t i = 0;
+
+    for (i = 0; i + 3 < size; i++) {
+        if (buf[i] == '\r' && buf[i+1] == '\n' &&
+            buf[i+2] == '\r' && buf[i+3] == '\n') {
+            return i + 4;
+        }
+    }
+
+    return 0;
+}
+
+static void http_header(http_request_t *req, char const *name,
+                        char const *value)
+{
+    if (g_ascii_strcasecmp(name, "Content-Length") == 0) {
+        req->length = strtoul(value, NULL, 10);
+    } else if (g_ascii_strcasecmp(name, "Transfer-Encoding") == 0) {
+        req->encoded = true;
+    } else if (g_ascii_strcasecmp(name, "Authorization") == 0) {
+        if (g_ascii_strncasecmp(value, "Bearer ", 7) == 0) {
+            for (value += 7; *value == ' '; value++)
+                ;
+            free(req->token);
+            req->token = strdup(value);
+        }
+    } else if (g_ascii_strcasecmp(name, "Connection") == 0) {
+        if (g_ascii_strcasecmp(value, "close") == 0) {
+            req->close = true;
+        } else if (g_ascii_strcasecmp(value, "keep-alive") == 0) {
+            req->close = false;
+        }
+    }
+}
+
+ssize_t http_parse(void const *buf, size_t size, http_request_t *req)
+{
+    char *head = NULL, **lines = NULL;
+    char path[2048];
+    ssize_t len = 0;
+    int major = 0, i = 0;
+
+    return_if_true(buf == NULL || req == NULL, -1);
+
+    memset(req, 0, sizeof(*req));
+
+    len = http_head_size((char const *)buf, size);
+    if (len == 0) {
+        return (size >= HTTP_HEAD_MAX ? -1 : 0);
+    } else if (len > HTTP_HEAD_MAX) {
+        return -1;
+    }
+
+    head = g_strndup((char const *)buf, len - 4);
+    lines = g_strsplit(head, "\r\n", 0);
+    g_free(head);
+
+    if (lines[0] == NULL ||
+        sscanf(lines[0], "%15s %2047s HTTP/%d.%d", req->method, path,
+               &major, &req->minor) != 4 || major != 1) {
+        g_strfreev(lines);
+        return -1;
+    }
+
+    req->path = strdup(path);
+    /* Before 1.1 connections are closed unless asked otherwise
+     */
+    req->close = (req->minor == 0);
+
+    for (i = 1; lines[i] != NULL; i++) {
+        char *value = strchr(lines[i], ':');
+
+        if (value == NULL) {
+            continue;
+        }
+        *value++ = '\0';
+
+        http_header(req, g_strstrip(lines[i]), g_strstrip(value));
+    }
+
+    g_strfreev(lines);
+
+    if (req->path == NULL) {
+        http_request_clear(req);
+        return -1;
+    }
+
+    return len;
+}
+
+void http_request_clear(http_request_t *req)
+{
+    return_if_true(req == NULL,);
+
+    free(req->path);
+    req->path = NULL;
+    free(req->token);
+    req->token = NULL;
+}
+
+char const *http_reason(int status)
+{
+    switch (status) {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 413: return "Payload Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 502: return "Bad Gateway";
+    case 503: return "Service Unavailable";
+    case 504: return "Gateway Timeout";
+    default: break;
+    }
+
+    return "Error";
+}
+
+static void http_append(GByteArray *out, char *text)
+{
+    g_byte_array_append(out, (uint8_t const *)text, strlen(text));
+    g_free(text);
+}
+
+void http_respond(GByteArray *out, int status, char const *body,
+                  bool close)
+{
+    http_append(out, g_strdup_printf(
+                    "HTTP/1.1 %d %s\r\n"
+                    "Content-Type: text/plain; charset=utf-8\r\n"
+                    "Content-Length: %lu\r\n"
+                    "%s%s"
+                    "\r\n"
+                    "%s",
+                    status, http_reason(status), (unsigned long)strlen(body),
+                    (status == 401 ?
+                     "WWW-Authenticate: Bearer realm=\"rcon-proxy\"\r\n" : ""),
+                    (close ? "Connection: close\r\n" : ""), body));
+}
+
+void http_start(GByteArray *out, bool chunked, bool close)
+{
+    http_append(out, g_strdup_printf(
+                    "HTTP/1.1 200 OK\r\n"
+                    "Content-Type: text/plain; charset=utf-8\r\n"
+                    "%s%s"
+                    "\r\n",
+                    (chunked ? "Transfer-Encoding: chunked\r\n" : ""),
+                    (close || !chunked ? "Connection: close\r\n" : "")));
+}
+
+void http_chunk(GByteArray *out, void const *data, size_t len,
+                bool chunked)
+{
+    char size[32];
+
+    /* An empty chunk would end the body
+     */
+    if (len == 0) {
+        return;
+    }
+
+    if (chunked) {
+        snprintf(size, sizeof(size), "%lx\r\n", (unsigned long)len);
+        g_byte_array_append(out, (uint8_t const *)size, strlen(size));
+    }
+    g_byte_array_append(out, (uint8_t const *)data, len);
+    if (chunked) {
+        g_byte_array_append(out, (uint8_t const *)"\r\n", 2);
+    }
+}
+
+void http_finish(GByteArray *out, bool chunked)
+{
+    if (chunked) {
+        g_byte_array_append(out, (uint8_t const *)"0\r\n\r\n", 5);
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef RCON_HTTP_H
+#define RCON_HTTP_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include <glib.h>
+
+/* Just enough HTTP/1.1 for the gateway of rcon-proxy: request heads are
+ * parsed, and responses are written either whole, or streamed in chunks.
+ */
+
+/* Longest request head that is accepted
+ */
+#define HTTP_HEAD_MAX 8192
+
+typedef struct {
+    char method[16];
+    char *path;
+    /* The x in HTTP/1.x
+     */
+    int minor;
+    size_t length;
+    /* No further requests follow on the connection
+     */
+    bool close;
+    /* The body is sent with a transfer encoding, which is not supported
+     */
+    bool encoded;
+    /* The credentials of an "Authorization: Bearer" header, or NULL
+     */
+    char *token;
+} http_request_t;
+
+/* Parses the request head at the start of the buffer. Returns its size,
+ * 0 if it is not complete yet, or -1 if it is malformed or too long. Free
+ * the request with http_request_clear().
+ */
+ssize_t http_parse(void const *buf, size_t size, http_request_t *req);
+void http_request_clear(http_request_t *req);
+
+char const *http_reason(int status);
+
+/* A complete response with a plain text body. A 401 asks for a bearer
+ * token.
+ */
+void http_respond(GByteArray *out, int status, char const *body,
+                  bool close);
+
+/* Starts a successful response, whose body follows in chunks. Without
+ * chunked encoding, the connection has to be closed to end the body.
+ */
+void http_start(GByteArray *out, bool chunked, bool close);
+void http_chunk(GByteArray *out, void const *data, size_t len,
+                bool chunked);
+void http_finish(GByteArray *out, bool chunked);
+
+#endif
@@ -0,0 +1,910 @@
+#include "journal.h"
+#include "rcon.h"
+
+#include <glib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifndef IOV_MAX
+# define IOV_MAX 16
+#endif
+
+struct _journal
+{
+    char *dir;
+    uint64_t size;
+    double age;
+    /* Held while appending, so records of different processes don't mix
+     */
+    int lock;
+    unsigned long seq;
+    int seg;
+    int idx;
+    uint64_t created;
+};
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+} journal_map_t;
+
+struct _journal_query
+{
+    char *dir;
+    uint64_t from;
+    uint64_t to;
+    char *server;
+    uint32_t hash;
+    bool done;
+
+    GArray *segments;
+    guint next;
+
+    journal_map_t seg;
+    journal_map_t idx;
+    size_t entry;
+    size_t entries;
+    /* The first record that is not in the index
+     */
+    size_t tail;
+};
+
+static void journal_put64(uint8_t *p, uint64_t v)
+{
+    int i = 0;
+
+    for (i = 0; i < 8; i++) {
+        p[i] = (uint8_t)(v >> (i * 8));
+    }
+}
+
+static uint64_t journal_get64(uint8_t const *p)
+{
+    uint64_t v = 0;
+    int i = 0;
+
+    for (i = 7; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+
+    return v;
+}
+
+static void journal_put32(uint8_t *p, uint32_t v)
+{
+    int i = 0;
+
+    for (i = 0; i < 4; i++) {
+        p[i] = (uint8_t)(v >> (i * 8));
+    }
+}
+
+static uint32_t journal_get32(uint8_t const *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 |
+        (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t journal_now(void)
+{
+    struct timespec ts = {0};
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* FNV-1a
+ */
+uint32_t journal_hash(char const *s, size_t len)
+{
+    uint32_t h = 2166136261U;
+    size_t i = 0;
+
+    for (i = 0; i < len; i++) {
+        h ^= (uint8_t)s[i];
+        h *= 16777619U;
+    }
+
+    return h;
+}
+
+static char *journal_path(char const *dir, unsigned long seq,
+                          char const *ext)
+{
+    return g_strdup_printf("%s/%08lu.%s", dir, seq, ext);
+}
+
+/* The numbers of all segments, in order
+ */
+static GArray *journal_segments(char const *dir)
+{
+    GArray *tmp = NULL;
+    struct dirent *e = NULL;
+    DIR *d = NULL;
+
+    d = opendir(dir);
+    if (d == NULL) {
+        return NULL;
+    }
+
+    tmp = g_array_new(FALSE, TRUE, sizeof(gulong));
+
+    while ((e = readdir(d)) != NULL) {
+        char *end = NULL;
+        gulong seq = strtoul(e->d_name, &end, 10);
+        guint i = 0;
+
+        if (seq == 0 || end != e->d_name + 8 || strcmp(end, ".seg") != 0) {
+            continue;
+        }
+
+        /* Keep them sorted, there are not many
+         */
+        g_array_append_val(tmp, seq);
+        for (i = tmp->len - 1; i > 0 &&
+                 g_array_index(tmp, gulong, i - 1) > seq; i--) {
+            g_array_index(tmp, gulong, i) = g_array_index(tmp, gulong, i - 1);
+        }
+        g_array_index(tmp, gulong, i) = seq;
+    }
+
+    closedir(d);
+
+    return tmp;
+}
+
+static unsigned long journal_last(char const *dir)
+{
+    GArray *segments = journal_segments(dir);
+    unsigned long seq = 0;
+
+    if (segments != NULL && segments->len > 0) {
+        seq = g_array_index(segments, gulong, segments->len - 1);
+    }
+    if (segments != NULL) {
+        g_array_free(segments, TRUE);
+    }
+
+    return seq;
+}
+
+static int journal_write(int fd, void const *data, size_t len)
+{
+    uint8_t const *p = (uint8_t const *)data;
+    ssize_t ret = 0;
+
+    while (len > 0) {
+        ret = write(fd, p, len);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += ret;
+        len -= ret;
+    }
+
+    return 0;
+}
+
+static int journal_writev(int fd, struct iovec *iov, int count)
+{
+    ssize_t ret = 0;
+
+    while (count > 0) {
+        ret = writev(fd, iov, (count > IOV_MAX ? IOV_MAX : count));
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+
+        while (count > 0 && (size_t)ret >= iov->iov_len) {
+            ret -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if (count > 0) {
+            iov->iov_base = (uint8_t *)iov->iov_base + ret;
+            iov->iov_len -= ret;
+        }
+    }
+
+    return 0;
+}
+
+static void journal_release(journal_t *j)
+{
+    if (j->seg > -1) {
+        close(j->seg);
+        j->seg = -1;
+    }
+    if (j->idx > -1) {
+        close(j->idx);
+        j->idx = -1;
+    }
+}
+
+/* Opens segment seq and its index for appending, and creates both if asked
+ */
+static int journal_use(journal_t *j, unsigned long seq, bool create)
+{
+    uint8_t header[JOURNAL_HEADER_SIZE] = {0};
+    char *seg = journal_path(j->dir, seq, "seg");
+    char *idx = journal_path(j->dir, seq, "idx");
+    struct stat st;
+    int ec = -1;
+
+    journal_release(j);
+
+    j->seg = open(seg, O_RDWR | O_APPEND | (create ? O_CREAT | O_EXCL : 0),
+                  0600);
+    if (j->seg < 0) {
+        goto cleanup;
+    }
+
+    if (create) {
+        j->created = journal_now();
+        memcpy(header, JOURNAL_MAGIC, 8);
+        journal_put64(header + 8, j->created);
+        if (journal_write(j->seg, header, sizeof(header))) {
+            goto cleanup;
+        }
+    } else {
+        if (pread(j->seg, header, sizeof(header), 0) != sizeof(header) ||
+            memcmp(header, JOURNAL_MAGIC, 8) != 0) {
+            errno = EINVAL;
+            goto cleanup;
+        }
+        j->created = journal_get64(header + 8);
+    }
+
+    j->idx = open(idx, O_RDWR | O_APPEND | O_CREAT, 0600);
+    if (j->idx < 0 || fstat(j->idx, &st) < 0) {
+        goto cleanup;
+    }
+
+    if (st.st_size == 0 &&
+        journal_write(j->idx, JOURNAL_INDEX_MAGIC,
+                      JOURNAL_INDEX_HEADER_SIZE)) {
+        goto cleanup;
+    }
+
+    j->seq = seq;
+    ec = 0;
+
+cleanup:
+
+    if (ec) {
+        journal_release(j);
+    }
+
+    g_free(seg);
+    g_free(idx);
+
+    return ec;
+}
+
+/* The length of the record with the given header
+ */
+static uint64_t journal_record_size(uint8_t const *record)
+{
+    return JOURNAL_RECORD_SIZE + ((uint64_t)record[20] |
+                                  (uint64_t)record[21] << 8) +
+        journal_get32(record + 24) + journal_get32(record + 28);
+}
+
+/* The time of the last record in the index of segment seq, or 0
+ */
+static uint64_t journal_index_time(char const *dir, unsigned long seq)
+{
+    uint8_t time[8];
+    char *idx = journal_path(dir, seq, "idx");
+    struct stat st;
+    off_t entries = 0;
+    uint64_t ret = 0;
+    int fd = -1;
+
+    fd = open(idx, O_RDONLY);
+    g_free(idx);
+    if (fd < 0) {
+        return 0;
+    }
+
+    if (fstat(fd, &st) == 0) {
+        entries = (st.st_size - JOURNAL_INDEX_HEADER_SIZE) /
+            JOURNAL_ENTRY_SIZE;
+    }
+
+    if (entries > 0 &&
+        pread(fd, time, sizeof(time), JOURNAL_INDEX_HEADER_SIZE +
+              (entries - 1) * JOURNAL_ENTRY_SIZE) == sizeof(time)) {
+        ret = journal_get64(time);
+    }
+
+    close(fd);
+
+    return ret;
+}
+
+/* Indexes the records at the end of the segment that are missing from the
+ * index, which a writer that died between the two writes leaves behind,
+ * and cuts off half a record or entry. This way no record ever follows one
+ * that is not in the index. last is set to the time of the last record.
+ * Called with the lock held.
+ */
+static int journal_repair(journal_t *j, uint64_t *last)
+{
+    uint8_t entry[JOURNAL_ENTRY_SIZE] = {0};
+    uint8_t record[JOURNAL_RECORD_SIZE];
+    char *server = NULL, *name = NULL;
+    struct stat seg, idx;
+    uint64_t off = JOURNAL_HEADER_SIZE, len = 0;
+    off_t end = 0;
+    size_t serverlen = 0;
+    int ec = -1;
+
+    *last = 0;
+
+    if (fstat(j->seg, &seg) < 0 || fstat(j->idx, &idx) < 0) {
+        return -1;
+    }
+
+    end = idx.st_size - (idx.st_size - JOURNAL_INDEX_HEADER_SIZE) %
+        JOURNAL_ENTRY_SIZE;
+    if (end < idx.st_size && ftruncate(j->idx, end) < 0) {
+        return -1;
+    }
+
+    if (end > JOURNAL_INDEX_HEADER_SIZE) {
+        if (pread(j->idx, entry, sizeof(entry), end - JOURNAL_ENTRY_SIZE) !=
+            sizeof(entry)) {
+            return -1;
+        }
+        *last = journal_get64(entry);
+        off = journal_get64(entry + 8);
+
+        if (off > (uint64_t)seg.st_size ||
+            seg.st_size - off < JOURNAL_RECORD_SIZE ||
+            pread(j->seg, record, sizeof(record), off) != sizeof(record)) {
+            errno = EINVAL;
+            return -1;
+        }
+        off += journal_record_size(record);
+        if (off > (uint64_t)seg.st_size) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    while (off < (uint64_t)seg.st_size) {
+        len = 0;
+        if (seg.st_size - off >= JOURNAL_RECORD_SIZE &&
+            pread(j->seg, record, sizeof(record), off) == sizeof(record)) {
+            len = journal_record_size(record);
+        }
+
+        if (len == 0 || seg.st_size - off < len) {
+            if (ftruncate(j->seg, off) < 0) {
+                goto cleanup;
+            }
+            break;
+        }
+
+        serverlen = (size_t)record[20] | (size_t)record[21] << 8;
+        name = realloc(server, serverlen + 1);
+        if (name == NULL) {
+            goto cleanup;
+        }
+        server = name;
+
+        if (pread(j->seg, server, serverlen, off + JOURNAL_RECORD_SIZE) !=
+            (ssize_t)serverlen) {
+            goto cleanup;
+        }
+
+        *last = journal_get64(record);
+        journal_put64(entry, *last);
+        journal_put64(entry + 8, off);
+        journal_put32(entry + 16, journal_hash(server, serverlen));
+        if (journal_write(j->idx, entry, sizeof(entry))) {
+            goto cleanup;
+        }
+
+        off += len;
+    }
+
+    ec = 0;
+
+cleanup:
+
+    free(server);
+
+    return ec;
+}
+
+/* Picks up segments other processes started, and starts a new one when the
+ * current one is full or too old. last is set to the time of the last
+ * record, which a new segment carries over from the one before. Called with
+ * the lock held.
+ */
+static int journal_current(journal_t *j, uint64_t now, uint64_t *last)
+{
+    unsigned long seq = 0;
+    struct stat st;
+
+    *last = 0;
+
+    if (j->seg < 0 || j->idx < 0) {
+        seq = journal_last(j->dir);
+        if (seq == 0) {
+            return journal_use(j, 1, true);
+        } else if (journal_use(j, seq, false)) {
+            return -1;
+        }
+    } else {
+        char *next = journal_path(j->dir, j->seq + 1, "seg");
+        bool rotated = (access(next, F_OK) == 0);
+
+        g_free(next);
+        if (rotated && journal_use(j, journal_last(j->dir), false)) {
+            return -1;
+        }
+    }
+
+    if (journal_repair(j, last) || fstat(j->seg, &st) < 0) {
+        return -1;
+    }
+
+    /* A segment another process just started
+     */
+    if (*last == 0 && j->seq > 1) {
+        *last = journal_index_time(j->dir, j->seq - 1);
+    }
+
+    /* An empty segment is never too large or too old
+     */
+    if (st.st_size > JOURNAL_HEADER_SIZE &&
+        ((j->size > 0 && (uint64_t)st.st_size >= j->size) ||
+         (j->age > 0 && now > j->created &&
+          (double)(now - j->created) / 1e9 >= j->age))) {
+        return journal_use(j, j->seq + 1, true);
+    }
+
+    return 0;
+}
+
+journal_t *journal_open(char const *dir, uint64_t size, double age)
+{
+    journal_t *tmp = NULL;
+    char *lock = NULL;
+
+    return_if_true(dir == NULL, NULL);
+
+    if (mkdir(dir, 0700) < 0 && errno != EEXIST) {
+        return NULL;
+    }
+
+    tmp = calloc(1, sizeof(journal_t));
+    if (tmp == NULL) {
+        return NULL;
+    }
+
+    tmp->dir = strdup(dir);
+    tmp->size = size;
+    tmp->age = age;
+    tmp->seg = -1;
+    tmp->idx = -1;
+
+    lock = g_strdup_printf("%s/lock", dir);
+    tmp->lock = open(lock, O_RDWR | O_CREAT, 0600);
+    g_free(lock);
+
+    if (tmp->dir == NULL || tmp->lock < 0) {
+        journal_close(tmp);
+        return NULL;
+    }
+
+    return tmp;
+}
+
+int journal_append(journal_t *j, char const *server, int32_t id,
+                   char const *command, struct iovec const *body,
+                   int count, double latency)
+{
+    uint8_t record[JOURNAL_RECORD_SIZE] = {0};
+    uint8_t entry[JOURNAL_ENTRY_SIZE] = {0};
+    struct iovec *iov = NULL;
+    size_t serverlen = 0, commandlen = 0, bodylen = 0;
+    uint64_t now = 0, last = 0;
+    struct stat st;
+    int i = 0, ec = -1;
+
+    return_if_true(j == NULL || server == NULL || command == NULL, -1);
+    return_if_true(count < 0 || (count > 0 && body == NULL), -1);
+
+    serverlen = strlen(server);
+    commandlen = strlen(command);
+    for (i = 0; i < count; i++) {
+        bodylen += body[i].iov_len;
+    }
+
+    return_if_true(serverlen > UINT16_MAX || commandlen > UINT32_MAX ||
+                   bodylen > UINT32_MAX, -1);
+
+    iov = calloc(count + 3, sizeof(struct iovec));
+    if (iov == NULL) {
+        return -1;
+    }
+
+    while (flock(j->lock, LOCK_EX) < 0) {
+        if (errno != EINTR) {
+            free(iov);
+            return -1;
+        }
+    }
+
+    now = journal_now();
+    if (journal_current(j, now, &last) || fstat(j->seg, &st) < 0) {
+        goto cleanup;
+    }
+
+    /* Keep times in order, even if the clock was set back
+     */
+    if (now < last) {
+        now = last;
+    }
+
+    journal_put64(record, now);
+    journal_put64(record + 8, (uint64_t)(latency > 0 ? latency * 1e9 : 0));
+    journal_put32(record + 16, (uint32_t)id);
+    record[20] = (uint8_t)serverlen;
+    record[21] = (uint8_t)(serverlen >> 8);
+    journal_put32(record + 24, (uint32_t)commandlen);
+    journal_put32(record + 28, (uint32_t)bodylen);
+
+    iov[0].iov_base = record;
+    iov[0].iov_len = sizeof(record);
+    iov[1].iov_base = (void *)server;
+    iov[1].iov_len = serverlen;
+    iov[2].iov_base = (void *)command;
+    iov[2].iov_len = commandlen;
+    for (i = 0; i < count; i++) {
+        iov[i + 3] = body[i];
+    }
+
+    /* Don't leave half a record behind for the next one to follow
+     */
+    if (journal_writev(j->seg, iov, count + 3)) {
+        if (ftruncate(j->seg, st.st_size) < 0) {
+            /* Nothing left to do about it
+             */
+        }
+        goto cleanup;
+    }
+
+    journal_put64(entry, now);
+    journal_put64(entry + 8, (uint64_t)st.st_size);
+    journal_put32(entry + 16, journal_hash(server, serverlen));
+
+    /* A record that is not in the index is not kept either
+     */
+    if (journal_write(j->idx, entry, sizeof(entry))) {
+        if (ftruncate(j->seg, st.st_size) < 0) {
+            /* Nothing left to do about it
+             */
+        }
+        goto cleanup;
+    }
+
+    ec = 0;
+
+cleanup:
+
+    flock(j->lock, LOCK_UN);
+    free(iov);
+
+    return ec;
+}
+
+void journal_close(journal_t *j)
+{
+    return_if_true(j == NULL,);
+
+    journal_release(j);
+    if (j->lock > -1) {
+        close(j->lock);
+    }
+    free(j->dir);
+    free(j);
+}
+
+static int journal_map(journal_map_t *m, char const *filename)
+{
+    struct stat st;
+    int fd = -1;
+
+    m->data = NULL;
+    m->size = 0;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return -1;
+    }
+
+    m->size = (size_t)st.st_size;
+    m->data = mmap(NULL, m->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (m->data == MAP_FAILED) {
+        m->data = NULL;
+        m->size = 0;
+        return -1;
+    }
+
+    return 0;
+}
+
+static void journal_unmap(journal_map_t *m)
+{
+    if (m->data != NULL) {
+        munmap(m->data, m->size);
+    }
+    m->data = NULL;
+    m->size = 0;
+}
+
+/* Reads the record at off. Returns the offset after it, or 0 if it does
+ * not fit into the segment.
+ */
+static size_t journal_record(journal_map_t const *seg, size_t off,
+                             journal_record_t *rec)
+{
+    uint8_t const *p = NULL;
+    size_t len = 0;
+
+    return_if_true(off < JOURNAL_HEADER_SIZE || off > seg->size ||
+                   seg->size - off < JOURNAL_RECORD_SIZE, 0);
+
+    p = seg->data + off;
+
+    rec->time = journal_get64(p);
+    rec->latency = journal_get64(p + 8);
+    rec->id = (int32_t)journal_get32(p + 16);
+    rec->serverlen = (size_t)p[20] | (size_t)p[21] << 8;
+    rec->commandlen = journal_get32(p + 24);
+    rec->bodylen = journal_get32(p + 28);
+
+    len = rec->serverlen + rec->commandlen + rec->bodylen;
+    return_if_true(len < rec->bodylen ||
+                   seg->size - off - JOURNAL_RECORD_SIZE < len, 0);
+
+    rec->server = (char const *)p + JOURNAL_RECORD_SIZE;
+    rec->command = rec->server + rec->serverlen;
+    rec->body = rec->command + rec->commandlen;
+
+    return off + JOURNAL_RECORD_SIZE + len;
+}
+
+static uint64_t journal_entry_time(journal_query_t const *q, size_t i)
+{
+    return journal_get64(q->idx.data + JOURNAL_INDEX_HEADER_SIZE +
+                         i * JOURNAL_ENTRY_SIZE);
+}
+
+/* Maps the next segment that may have records in range. Returns 0 once
+ * there are none left.
+ */
+static int journal_query_segment(journal_query_t *q)
+{
+    journal_record_t rec;
+    size_t lo = 0, hi = 0;
+    int found = 0;
+
+    while (!found && q->next < q->segments->len) {
+        gulong seq = g_array_index(q->segments, gulong, q->next++);
+        char *seg = journal_path(q->dir, seq, "seg");
+        char *idx = journal_path(q->dir, seq, "idx");
+
+        journal_unmap(&q->seg);
+        journal_unmap(&q->idx);
+
+        if (journal_map(&q->seg, seg) ||
+            q->seg.size < JOURNAL_HEADER_SIZE ||
+            memcmp(q->seg.data, JOURNAL_MAGIC, 8) != 0) {
+            found = -1;
+        } else if (journal_map(&q->idx, idx) == 0 &&
+                   q->idx.size >= JOURNAL_INDEX_HEADER_SIZE &&
+                   memcmp(q->idx.data, JOURNAL_INDEX_MAGIC, 8) == 0) {
+            found = 1;
+        } else {
+            /* Without an index, the whole segment is read
+             */
+            journal_unmap(&q->idx);
+            found = 1;
+        }
+
+        g_free(seg);
+        g_free(idx);
+    }
+
+    return_if_true(found <= 0, found);
+
+    q->entry = 0;
+    q->entries = 0;
+    q->tail = JOURNAL_HEADER_SIZE;
+
+    if (q->idx.data != NULL) {
+        q->entries = (q->idx.size - JOURNAL_INDEX_HEADER_SIZE) /
+            JOURNAL_ENTRY_SIZE;
+    }
+
+    if (q->entries > 0) {
+        size_t off = journal_get64(q->idx.data + JOURNAL_INDEX_HEADER_SIZE +
+                                   (q->entries - 1) * JOURNAL_ENTRY_SIZE + 8);
+
+        q->tail = journal_record(&q->seg, off, &rec);
+        return_if_true(q->tail == 0, -1);
+
+        /* Later segments only have later records
+         */
+        if (journal_entry_time(q, 0) > q->to) {
+            q->done = true;
+            return 0;
+        }
+
+        /* The first entry in range
+         */
+        lo = 0;
+        hi = q->entries;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+
+            if (journal_entry_time(q, mid) < q->from) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        q->entry = lo;
+    }
+
+    return 1;
+}
+
+journal_query_t *journal_query(char const *dir, uint64_t from, uint64_t to,
+                               char const *server)
+{
+    journal_query_t *tmp = NULL;
+
+    return_if_true(dir == NULL, NULL);
+
+    tmp = calloc(1, sizeof(journal_query_t));
+    if (tmp == NULL) {
+        return NULL;
+    }
+
+    tmp->dir = strdup(dir);
+    tmp->from = from;
+    tmp->to = to;
+    if (server != NULL) {
+        tmp->server = strdup(server);
+        tmp->hash = journal_hash(server, strlen(server));
+    }
+
+    tmp->segments = journal_segments(dir);
+    if (tmp->dir == NULL || tmp->segments == NULL ||
+        (server != NULL && tmp->server == NULL)) {
+        journal_query_free(tmp);
+        return NULL;
+    }
+
+    return tmp;
+}
+
+static bool journal_match(journal_query_t const *q,
+                          journal_record_t const *rec)
+{
+    return (q->server == NULL ||
+            (rec->serverlen == strlen(q->server) &&
+             memcmp(rec->server, q->server, rec->serverlen) == 0));
+}
+
+int journal_next(journal_query_t *q, journal_record_t *rec)
+{
+    size_t end = 0;
+    int ret = 0;
+
+    return_if_true(q == NULL || rec == NULL, -1);
+
+    while (!q->done) {
+        if (q->seg.data == NULL) {
+            ret = journal_query_segment(q);
+            if (ret <= 0) {
+                q->done = true;
+                return ret;
+            }
+        }
+
+        /* Through the index, for as long as it is in range
+         */
+        while (q->entry < q->entries) {
+            uint8_t const *e = q->idx.data + JOURNAL_INDEX_HEADER_SIZE +
+                q->entry * JOURNAL_ENTRY_SIZE;
+
+            ++q->entry;
+
+            if (journal_get64(e) > q->to) {
+                q->done = true;
+                return 0;
+            }
+
+            if (q->server != NULL && journal_get32(e + 16) != q->hash) {
+                continue;
+            }
+
+            if (journal_record(&q->seg, journal_get64(e + 8), rec) == 0) {
+                return -1;
+            }
+
+            if (journal_match(q, rec)) {
+                return 1;
+            }
+        }
+
+        /* Then the records the index is missing
+         */
+        while (q->tail < q->seg.size) {
+            end = journal_record(&q->seg, q->tail, rec);
+            if (end == 0) {
+                return -1;
+            }
+            q->tail = end;
+
+            if (rec->time >= q->from && rec->time <= q->to &&
+                journal_match(q, rec)) {
+                return 1;
+            }
+        }
+
+        journal_unmap(&q->seg);
+        journal_unmap(&q->idx);
+    }
+
+    return 0;
+}
+
+void journal_query_free(journal_query_t *q)
+{
+    return_if_true(q == NULL,);
+
+    journal_unmap(&q->seg);
+    journal_unmap(&q->idx);
+
+    if (q->segments != NULL) {
+        g_array_free(q->segments, TRUE);
+    }
+    free(q->server);
+    free(q->dir);
+    free(q);
+}
@@ -0,0 +1,99 @@
+#ifndef RCON_JOURNAL_H
+#define RCON_JOURNAL_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/uio.h>
+
+/* An append-only log of commands and their replies, kept in a directory of
+ * numbered segments, 00000001.seg and so on. Any number of processes may
+ * append to the same journal, one record at a time under a lock. A segment
+ * starts with a header:
+ *
+ *   char     magic[8]   "RCONJRN1"
+ *   uint64_t created    ns since the epoch
+ *
+ * followed by one record per command:
+ *
+ *   uint64_t time       ns since the epoch, when the reply was complete
+ *   uint64_t latency    ns from sending the command until then
+ *   int32_t  id         request id of the command
+ *   uint16_t server     length of the server name
+ *   uint16_t reserved
+ *   uint32_t command    length of the command
+ *   uint32_t body       length of the reply
+ *   uint8_t  data[]     server name, command and reply
+ *
+ * Each segment has an index next to it, 00000001.idx, of a header and one
+ * entry per record, in the same order:
+ *
+ *   char     magic[8]   "RCONIDX1"
+ *
+ *   uint64_t time       of the record
+ *   uint64_t offset     of the record in the segment
+ *   uint32_t server     journal_hash() of the server name
+ *   uint32_t reserved
+ *
+ * Times never go backwards within a journal, so that the index can be
+ * searched by time. Once a segment is larger or older than the limits
+ * given to journal_open(), the next record starts a new one. All integers
+ * are little endian.
+ */
+#define JOURNAL_MAGIC "RCONJRN1"
+#define JOURNAL_INDEX_MAGIC "RCONIDX1"
+#define JOURNAL_HEADER_SIZE 16
+#define JOURNAL_RECORD_SIZE 32
+#define JOURNAL_INDEX_HEADER_SIZE 8
+#define JOURNAL_ENTRY_SIZE 24
+
+/* Default limits of a segment
+ */
+#define JOURNAL_SIZE (64 * 1024 * 1024)
+#define JOURNAL_AGE (24 * 60 * 60)
+
+typedef struct _journal journal_t;
+
+/* Creates the directory if needed. A segment is rotated when it reaches
+ * size bytes, or is older than age seconds; zero disables either limit.
+ */
+journal_t *journal_open(char const *dir, uint64_t size, double age);
+int journal_append(journal_t *j, char const *server, int32_t id,
+                   char const *command, struct iovec const *body,
+                   int count, double latency);
+void journal_close(journal_t *j);
+
+uint32_t journal_hash(char const *s, size_t len);
+
+typedef struct {
+    uint64_t time;
+    uint64_t latency;
+    int32_t id;
+    char const *server;
+    size_t serverlen;
+    char const *command;
+    size_t commandlen;
+    char const *body;
+    size_t bodylen;
+} journal_record_t;
+
+typedef struct _journal_query journal_query_t;
+
+/* All records from from to to, both ns since the epoch and inclusive, and
+ * of the given server, or of all servers if it is NULL. Segments are
+ * mapped into memory one at a time, and skipped when their index shows no
+ * record in range. Records at the end of a segment that did not make it
+ * into the index, as a writer died in between, are found by reading the
+ * rest of the segment. The next journal_append() adds them to the index,
+ * so that they are never followed by indexed records.
+ */
+journal_query_t *journal_query(char const *dir, uint64_t from, uint64_t to,
+                               char const *server);
+
+/* Returns 1 and fills rec with the next record, 0 when there are no more,
+ * and -1 if a segment is corrupt. The record points into the mapping, and
+ * is valid until the next call.
+ */
+int journal_next(journal_query_t *q, journal_record_t *rec);
+void journal_query_free(journal_query_t *q);
+
+#endif
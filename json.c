@@ -0,0 +1,115 @@
+#include "json.h"
+
+#include <stdint.h>
+
+/* Length of the UTF-8 sequence at p, 0 if it is not valid, and -1 if it
+ * may still be, but len ends within it. Overlong forms, surrogates and
+ * code points above U+10FFFF are not valid.
+ */
+static int json_utf8(uint8_t const *p, size_t len)
+{
+    uint32_t c = 0;
+    size_t n = 0, i = 0;
+
+    if (p[0] >= 0xC2 && p[0] < 0xE0) {
+        n = 2;
+        c = p[0] & 0x1F;
+    } else if (p[0] >= 0xE0 && p[0] < 0xF0) {
+        n = 3;
+        c = p[0] & 0x0F;
+    } else if (p[0] >= 0xF0 && p[0] < 0xF5) {
+        n = 4;
+        c = p[0] & 0x07;
+    } else {
+        return 0;
+    }
+
+    for (i = 1; i < n; i++) {
+        if (i == len) {
+            return -1;
+        }
+        if ((p[i] & 0xC0) != 0x80) {
+            return 0;
+        }
+        c = (c << 6) | (p[i] & 0x3F);
+    }
+
+    if ((n == 3 && (c < 0x800 || (c >= 0xD800 && c < 0xE000))) ||
+        (n == 4 && (c < 0x10000 || c > 0x10FFFF))) {
+        return 0;
+    }
+
+    return (int)n;
+}
+
+size_t json_chars(FILE *out, char const *s, size_t len, bool more)
+{
+    static char const hex[] = "0123456789abcdef";
+    uint8_t const *p = (uint8_t const *)s;
+    size_t start = 0, i = 0;
+
+    for (i = 0; i < len; i++) {
+        char esc = 0;
+        int n = 0;
+
+        if (p[i] >= 0x80) {
+            n = json_utf8(p + i, len - i);
+            if (n > 0) {
+                i += n - 1;
+                continue;
+            }
+
+            fwrite(p + start, 1, i - start, out);
+            if (n < 0 && more) {
+                return len - i;
+            }
+            start = i + 1;
+            fputs("\\ufffd", out);
+            continue;
+        }
+
+        switch (p[i])
+        {
+        case '"': esc = '"'; break;
+        case '\\': esc = '\\'; break;
+        case '\n': esc = 'n'; break;
+        case '\r': esc = 'r'; break;
+        case '\t': esc = 't'; break;
+        default:
+            if (p[i] >= 0x20 && p[i] < 0x7F) {
+                continue;
+            }
+            break;
+        }
+
+        fwrite(p + start, 1, i - start, out);
+        start = i + 1;
+
+        if (esc != 0) {
+            fputc('\\', out);
+            fputc(esc, out);
+        } else {
+            fprintf(out, "\\u00%c%c", hex[p[i] >> 4], hex[p[i] & 0x0F]);
+        }
+    }
+
+    fwrite(p + start, 1, len - start, out);
+
+    return 0;
+}
+
+void json_string(FILE *out, char const *s, size_t len)
+{
+    fputc('"', out);
+    json_chars(out, s, len, false);
+    fputc('"', out);
+}
+
+void json_seconds(FILE *out, double seconds)
+{
+    if (seconds < 0) {
+        fputs("null", out);
+    } else {
+        fprintf(out, "%.6f", seconds);
+    }
+}
@@ -0,0 +1,24 @@
+#ifndef RCON_JSON_H
+#define RCON_JSON_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+/* Writes the given bytes as a JSON string, including the quotes. Runs of
+ * bytes that need no escaping are written straight from the buffer. Bytes
+ * that are not valid UTF-8 become U+FFFD each.
+ */
+void json_string(FILE *out, char const *s, size_t len);
+
+/* The same without the quotes, so that a string can be written in pieces.
+ * If more follow, a character cut off at the end is not written, and the
+ * amount of its bytes is returned, to be passed again with the next piece.
+ */
+size_t json_chars(FILE *out, char const *s, size_t len, bool more);
+
+/* Seconds with microsecond precision, or null if negative
+ */
+void json_seconds(FILE *out, double seconds);
+
+#endif
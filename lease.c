@@ -0,0 +1,231 @@
+#include "lease.h"
+#include "rcon.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+/* The broker answers right away, but it must not hold us up if it hangs
+ */
+#define LEASE_TIMEOUT 1
+
+#ifndef MSG_NOSIGNAL
+# define MSG_NOSIGNAL 0
+#endif
+
+struct _lease
+{
+    int sock;
+};
+
+lease_t *lease_open(char const *path)
+{
+    struct sockaddr_un addr = {0};
+    struct timeval timeout = {0};
+    lease_t *tmp = NULL;
+
+    return_if_true(path == NULL || strlen(path) >= sizeof(addr.sun_path),
+                   NULL);
+
+    tmp = calloc(1, sizeof(lease_t));
+    if (tmp == NULL) {
+        return NULL;
+    }
+
+    tmp->sock = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (tmp->sock < 0) {
+        goto cleanup;
+    }
+
+    timeout.tv_sec = LEASE_TIMEOUT;
+    setsockopt(tmp->sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(tmp->sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    if (connect(tmp->sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        goto cleanup;
+    }
+
+    return tmp;
+
+cleanup:
+
+    lease_close(tmp);
+
+    return NULL;
+}
+
+void lease_close(lease_t *l)
+{
+    return_if_true(l == NULL,);
+
+    if (l->sock > -1) {
+        close(l->sock);
+    }
+    free(l);
+}
+
+/* The operation and "host\nport\npassword". Neither host nor port can have
+ * a newline in them, so each key stands for one server and password.
+ */
+static size_t lease_message(char *msg, char op, char const *host,
+                            char const *port, char const *password)
+{
+    int ret = 0;
+
+    ret = snprintf(msg, LEASE_MESSAGE_MAX, "%c%s\n%s\n%s", op, host, port,
+                   (password != NULL ? password : ""));
+    if (ret < 0 || ret >= LEASE_MESSAGE_MAX) {
+        return 0;
+    }
+
+    return (size_t)ret;
+}
+
+int lease_get(lease_t *l, char const *host, char const *port,
+              char const *password)
+{
+    char msg[LEASE_MESSAGE_MAX];
+    size_t size = 0;
+    int fd = -1;
+
+    return_if_true(l == NULL || host == NULL || port == NULL, -1);
+
+    size = lease_message(msg, LEASE_GET, host, port, password);
+    return_if_true(size == 0, -1);
+
+    if (lease_send(l->sock, msg, size, -1) ||
+        lease_recv(l->sock, msg, sizeof(msg), &fd) < 1) {
+        return -1;
+    }
+
+    if (msg[0] != LEASE_YES && fd > -1) {
+        close(fd);
+        fd = -1;
+    }
+
+    return fd;
+}
+
+int lease_put(lease_t *l, char const *host, char const *port,
+              char const *password, int fd)
+{
+    char msg[LEASE_MESSAGE_MAX];
+    size_t size = 0;
+
+    return_if_true(l == NULL || host == NULL || port == NULL || fd < 0, -1);
+    return_if_true(!lease_idle(fd), -1);
+
+    size = lease_message(msg, LEASE_PUT, host, port, password);
+    return_if_true(size == 0, -1);
+
+    if (lease_send(l->sock, msg, size, fd) ||
+        lease_recv(l->sock, msg, sizeof(msg), NULL) < 1) {
+        return -1;
+    }
+
+    return (msg[0] == LEASE_YES ? 0 : -1);
+}
+
+int lease_send(int sock, void const *msg, size_t size, int fd)
+{
+    struct msghdr hdr = {0};
+    struct iovec iov = {0};
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct cmsghdr *cmsg = NULL;
+
+    iov.iov_base = (void *)msg;
+    iov.iov_len = size;
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+
+    if (fd > -1) {
+        memset(&control, 0, sizeof(control));
+        hdr.msg_control = control.buf;
+        hdr.msg_controllen = sizeof(control.buf);
+
+        cmsg = CMSG_FIRSTHDR(&hdr);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+
+    return (sendmsg(sock, &hdr, MSG_NOSIGNAL) == (ssize_t)size ? 0 : -1);
+}
+
+ssize_t lease_recv(int sock, void *msg, size_t size, int *fd)
+{
+    struct msghdr hdr = {0};
+    struct iovec iov = {0};
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct cmsghdr *cmsg = NULL;
+    ssize_t ret = 0;
+    int passed = -1;
+
+    iov.iov_base = msg;
+    iov.iov_len = size;
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = control.buf;
+    hdr.msg_controllen = sizeof(control.buf);
+
+    ret = recvmsg(sock, &hdr, 0);
+    if (ret < 0) {
+        return -1;
+    }
+
+    for (cmsg = CMSG_FIRSTHDR(&hdr); cmsg != NULL;
+         cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+            cmsg->cmsg_len == CMSG_LEN(sizeof(int))) {
+            memcpy(&passed, CMSG_DATA(cmsg), sizeof(int));
+        }
+    }
+
+    /* Nobody asked for it, or the message was cut short
+     */
+    if (passed > -1 && (fd == NULL || (hdr.msg_flags & MSG_TRUNC))) {
+        close(passed);
+        passed = -1;
+    }
+    if (fd != NULL) {
+        *fd = passed;
+    }
+
+    return ((hdr.msg_flags & MSG_TRUNC) ? -1 : ret);
+}
+
+bool lease_idle(int fd)
+{
+    struct pollfd p = {0};
+    int error = 0;
+    socklen_t len = sizeof(error);
+
+    p.fd = fd;
+    p.events = POLLIN;
+
+    /* Anything to read is either the server closing, or a reply nobody
+     * will ever pick up
+     */
+    if (poll(&p, 1, 0) != 0) {
+        return false;
+    }
+
+    return (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) == 0 &&
+            error == 0);
+}
@@ -0,0 +1,57 @@
+#ifndef RCON_LEASE_H
+#define RCON_LEASE_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/* Authenticated connections lent out by rcon-broker. The broker keeps the
+ * connections rcon processes were done with, and hands each one to the
+ * next process for the same server, with SCM_RIGHTS over a Unix socket.
+ * A lent connection leaves the broker, so no two processes ever write
+ * frames to it at the same time. It comes back only when the borrower
+ * gives it back in a clean state, and is lost if the borrower exits.
+ */
+
+/* Messages are one of these bytes, followed by the key of the server
+ */
+#define LEASE_GET 'L'
+#define LEASE_PUT 'R'
+#define LEASE_YES 'Y'
+#define LEASE_NO 'N'
+
+/* Longest message, host and port and password included
+ */
+#define LEASE_MESSAGE_MAX 2048
+
+typedef struct _lease lease_t;
+
+/* Connects to the broker listening at path. Returns NULL if there is none.
+ */
+lease_t *lease_open(char const *path);
+void lease_close(lease_t *l);
+
+/* Borrows a connection to the server, which is authenticated already if
+ * there was a password. Returns -1 if the broker has none.
+ */
+int lease_get(lease_t *l, char const *host, char const *port,
+              char const *password);
+
+/* Gives a connection to the broker, the borrowed one or a new one. The
+ * caller still closes its own descriptor. Only connections without any
+ * unread reply may be given back.
+ */
+int lease_put(lease_t *l, char const *host, char const *port,
+              char const *password, int fd);
+
+/* Used by both sides: one message with an optional descriptor, which is -1
+ * if none is passed or came along
+ */
+int lease_send(int sock, void const *msg, size_t size, int fd);
+ssize_t lease_recv(int sock, void *msg, size_t size, int *fd);
+
+/* Whether the connection is still open, and has nothing waiting to be read
+ */
+bool lease_idle(int fd);
+
+#endif
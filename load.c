@@ -0,0 +1,791 @@
+#include "rcon.h"
+#include "srcrcon.h"
+#include "hist.h"
+#include "timers.h"
+#include "sockopt.h"
+#include "sysconfig.h"
+
+#ifndef HAVE_ARC4RANDOM_UNIFORM
+#include <bsd/stdlib.h>
+#endif
+
+#include <glib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <ctype.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+
+/* Minecraft splits replies into frames of this many bytes
+ */
+#define LOAD_FRAGMENT 4096
+
+static char *host = NULL;
+static char *port = NULL;
+static char *password = NULL;
+static bool minecraft = false;
+static unsigned int connections = 1;
+static double rate = 0;
+static double duration = 10;
+static double drain = 5;
+static double expected = 0;
+static char *mixfile = NULL;
+
+typedef struct {
+    char *command;
+    unsigned int weight;
+} load_command_t;
+
+/* A command that was sent, and whose reply has not been seen yet
+ */
+typedef struct {
+    /* The end marker, or with Minecraft the command itself
+     */
+    int32_t id;
+    /* When the command should have been sent, and when it was
+     */
+    double intended;
+    double sent;
+} load_pending_t;
+
+typedef struct {
+    int sock;
+    GByteArray *in;
+    GByteArray *out;
+    size_t outoff;
+    /* Replies come back in order, so this is a queue
+     */
+    GArray *pending;
+    guint head;
+    int32_t stale;
+} load_conn_t;
+
+typedef struct {
+    unsigned long sent;
+    unsigned long completed;
+    unsigned long errors;
+    unsigned long long bytes;
+    /* Latency from when each command should have been sent, and from when
+     * it actually was, in microseconds.
+     */
+    hist_t *corrected;
+    hist_t *measured;
+} load_stats_t;
+
+static src_rcon_t *r = NULL;
+static GArray *mix = NULL;
+static unsigned int mixweight = 0;
+static load_stats_t stats = {0};
+
+static void usage(void)
+{
+    puts("");
+    puts("Usage:");
+    puts(" rcon-load [options] command...");
+    puts("");
+    puts("Sends commands to a server as fast as it answers them, or at a fixed");
+    puts("rate, over many connections, and reports the latency percentiles.");
+    puts("");
+    puts("Options:");
+    puts(" -c, --connections  Open this many connections");
+    puts(" -d, --duration     Send commands for this many seconds");
+    puts(" -e, --expected     Milliseconds each connection should take per");
+    puts("                    command, to correct for coordinated omission");
+    puts(" -f, --mix          Read weighted commands from this file");
+    puts(" -h, --help         This bogus");
+    puts(" -H, --host         Host name or IP");
+    puts(" -m, --minecraft    Minecraft mode");
+    puts(" -P, --password     RCON Password");
+    puts(" -p, --port         Port or service");
+    puts(" -r, --rate         Send this many commands per second in total");
+    puts(" -w, --drain        Seconds to wait for outstanding replies");
+}
+
+static int parse_args(int ac, char **av)
+{
+    static struct option opts[] = {
+        { "connections", required_argument, 0, 'c' },
+        { "duration", required_argument, 0, 'd' },
+        { "expected", required_argument, 0, 'e' },
+        { "mix", required_argument, 0, 'f' },
+        { "help", no_argument, 0, 'h' },
+        { "host", required_argument, 0, 'H' },
+        { "minecraft", no_argument, 0, 'm' },
+        { "password", required_argument, 0, 'P' },
+        { "port", required_argument, 0, 'p' },
+        { "rate", required_argument, 0, 'r' },
+        { "drain", required_argument, 0, 'w' },
+        { NULL, 0, 0, 0 }
+    };
+
+    static char const *optstr = "c:d:e:f:hH:mP:p:r:w:";
+
+    int c = 0;
+
+    while ((c = getopt_long(ac, av, optstr, opts, NULL)) != -1) {
+        switch (c)
+        {
+        case 'c': connections = strtoul(optarg, NULL, 10); break;
+        case 'd': duration = strtod(optarg, NULL); break;
+        case 'e': expected = strtod(optarg, NULL) / 1000.0; break;
+        case 'f': free(mixfile); mixfile = strdup(optarg); break;
+        case 'H': free(host); host = strdup(optarg); break;
+        case 'm': minecraft = true; break;
+        case 'P': free(password); password = strdup(optarg); break;
+        case 'p': free(port); port = strdup(optarg); break;
+        case 'r': rate = strtod(optarg, NULL); break;
+        case 'w': drain = strtod(optarg, NULL); break;
+        case 'h': usage(); exit(0); break;
+        default: /* intentional */
+        case '?': usage(); exit(1); break;
+        }
+    }
+
+    return 0;
+}
+
+static void mix_add(char const *command, unsigned int weight)
+{
+    load_command_t c;
+
+    if (weight == 0) {
+        return;
+    }
+
+    c.command = g_strdup(command);
+    c.weight = weight;
+    g_array_append_val(mix, c);
+    mixweight += weight;
+}
+
+/* Each line is a command, optionally preceded by its weight
+ */
+static int mix_load(char const *filename)
+{
+    FILE *f = NULL;
+    char *line = NULL;
+    size_t sz = 0;
+
+    f = fopen(filename, "r");
+    if (f == NULL) {
+        fprintf(stderr, "Failed to open command mix: %s: %s\n",
+                filename, strerror(errno));
+        return -1;
+    }
+
+    while (getline(&line, &sz, f) != -1) {
+        char *cmd = g_strstrip(line), *end = NULL;
+        unsigned long weight = 1;
+
+        if (cmd[0] == '\0' || cmd[0] == '#') {
+            continue;
+        }
+
+        if (isdigit(cmd[0])) {
+            weight = strtoul(cmd, &end, 10);
+            if (isspace(*end)) {
+                cmd = g_strchug(end);
+            } else {
+                weight = 1;
+            }
+        }
+
+        mix_add(cmd, weight);
+    }
+
+    free(line);
+    fclose(f);
+
+    return 0;
+}
+
+static char const *mix_pick(void)
+{
+    unsigned int n = arc4random_uniform(mixweight);
+    guint i = 0;
+
+    for (i = 0; i < mix->len; i++) {
+        load_command_t const *c = &g_array_index(mix, load_command_t, i);
+
+        if (n < c->weight) {
+            return c->command;
+        }
+        n -= c->weight;
+    }
+
+    return g_array_index(mix, load_command_t, mix->len - 1).command;
+}
+
+static int load_write_all(int sock, uint8_t const *data, size_t size)
+{
+    size_t done = 0;
+
+    while (done < size) {
+        ssize_t ret = write(sock, data + done, size - done);
+
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        done += ret;
+    }
+
+    return 0;
+}
+
+/* Connects and authenticates, blocking, before the clock starts
+ */
+static int load_connect(load_conn_t *c, struct addrinfo const *addresses)
+{
+    struct addrinfo const *ai = NULL;
+    src_rcon_message_t *auth = NULL;
+    GByteArray *in = NULL;
+    uint8_t *data = NULL;
+    size_t size = 0, off = 0;
+    uint8_t tmp[512];
+    rcon_error_t status = rcon_error_moredata;
+    sockopt_t opts;
+    int flags = 0;
+
+    /* The same defaults rcon uses, so that Nagle does not show up in the
+     * percentiles
+     */
+    sockopt_init(&opts);
+
+    c->sock = -1;
+    for (ai = addresses; ai != NULL && c->sock < 0; ai = ai->ai_next) {
+        c->sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (c->sock < 0) {
+            continue;
+        }
+
+        sockopt_apply(c->sock, &opts);
+        if (connect(c->sock, ai->ai_addr, ai->ai_addrlen) < 0) {
+            close(c->sock);
+            c->sock = -1;
+        }
+    }
+
+    if (c->sock < 0) {
+        fprintf(stderr, "Failed to connect: %s\n", strerror(errno));
+        return -1;
+    }
+
+    if (password != NULL && strlen(password) > 0) {
+        auth = src_rcon_auth(r, password);
+        if (auth == NULL || src_rcon_serialize(r, auth, &data, &size) ||
+            load_write_all(c->sock, data, size)) {
+            fprintf(stderr, "Failed to send auth request\n");
+            goto cleanup;
+        }
+
+        in = g_byte_array_new();
+        while (status == rcon_error_moredata) {
+            ssize_t ret = read(c->sock, tmp, sizeof(tmp));
+
+            if (ret <= 0) {
+                break;
+            }
+
+            g_byte_array_append(in, tmp, ret);
+            status = src_rcon_auth_wait(r, auth, &off, in->data, in->len);
+        }
+
+        if (status != rcon_error_success) {
+            fprintf(stderr, "Invalid auth reply, valid password?\n");
+            goto cleanup;
+        }
+    }
+
+    flags = fcntl(c->sock, F_GETFL);
+    if (flags < 0 || fcntl(c->sock, F_SETFL, flags | O_NONBLOCK) < 0) {
+        goto cleanup;
+    }
+
+    c->in = g_byte_array_new();
+    c->out = g_byte_array_new();
+    c->pending = g_array_new(FALSE, FALSE, sizeof(load_pending_t));
+
+    free(data);
+    src_rcon_message_free(auth);
+    if (in != NULL) {
+        g_byte_array_free(in, TRUE);
+    }
+
+    return 0;
+
+cleanup:
+
+    free(data);
+    src_rcon_message_free(auth);
+    if (in != NULL) {
+        g_byte_array_free(in, TRUE);
+    }
+    close(c->sock);
+    c->sock = -1;
+
+    return -1;
+}
+
+static void load_close(load_conn_t *c)
+{
+    if (c->sock > -1) {
+        close(c->sock);
+        c->sock = -1;
+    }
+
+    if (c->in != NULL) {
+        g_byte_array_free(c->in, TRUE);
+        c->in = NULL;
+    }
+    if (c->out != NULL) {
+        g_byte_array_free(c->out, TRUE);
+        c->out = NULL;
+    }
+    if (c->pending != NULL) {
+        g_array_free(c->pending, TRUE);
+        c->pending = NULL;
+    }
+}
+
+static guint load_outstanding(load_conn_t const *c)
+{
+    return (c->pending != NULL ? c->pending->len - c->head : 0);
+}
+
+static int load_queue(load_conn_t *c, src_rcon_message_t const *m)
+{
+    uint8_t *data = NULL;
+    size_t size = 0;
+
+    if (src_rcon_serialize(r, m, &data, &size)) {
+        return -1;
+    }
+
+    g_byte_array_append(c->out, data, size);
+    free(data);
+
+    return 0;
+}
+
+/* Queues a command from the mix, and its end marker
+ */
+static int load_send(load_conn_t *c, double intended, double now)
+{
+    src_rcon_message_t *cmd = NULL, *end = NULL;
+    load_pending_t p;
+    int ec = -1;
+
+    cmd = src_rcon_command(r, mix_pick());
+    if (cmd == NULL || load_queue(c, cmd)) {
+        goto cleanup;
+    }
+    p.id = cmd->id;
+
+    if (!minecraft) {
+        end = src_rcon_command(r, "");
+        if (end == NULL || load_queue(c, end)) {
+            goto cleanup;
+        }
+        p.id = end->id;
+    }
+
+    p.intended = intended;
+    p.sent = now;
+    g_array_append_val(c->pending, p);
+    ++stats.sent;
+
+    ec = 0;
+
+cleanup:
+
+    src_rcon_message_free(cmd);
+    src_rcon_message_free(end);
+
+    return ec;
+}
+
+static void load_complete(load_conn_t *c, double now)
+{
+    load_pending_t const *p = &g_array_index(c->pending, load_pending_t,
+                                             c->head);
+    uint64_t us = (uint64_t)((now - p->intended) * 1e6);
+
+    if (expected > 0) {
+        hist_record_corrected(stats.corrected, us,
+                              (uint64_t)(expected * 1e6));
+    } else {
+        hist_record(stats.corrected, us);
+    }
+    hist_record(stats.measured, (uint64_t)((now - p->sent) * 1e6));
+
+    ++stats.completed;
+    c->stale = p->id;
+
+    if (++c->head == c->pending->len) {
+        g_array_set_size(c->pending, 0);
+        c->head = 0;
+    }
+}
+
+/* Reads replies, and returns how many commands they completed, or -1 if
+ * the connection is gone.
+ */
+static int load_readable(load_conn_t *c, double now)
+{
+    src_rcon_message_t **msgs = NULL, **p = NULL;
+    uint8_t tmp[LOAD_FRAGMENT];
+    size_t off = 0, count = 0;
+    rcon_error_t status;
+    ssize_t ret = 0;
+    int done = 0;
+
+    ret = read(c->sock, tmp, sizeof(tmp));
+    if (ret < 0) {
+        return (errno == EAGAIN || errno == EINTR ? 0 : -1);
+    } else if (ret == 0) {
+        return -1;
+    }
+
+    stats.bytes += ret;
+    g_byte_array_append(c->in, tmp, ret);
+
+    status = src_rcon_deserialize(r, &msgs, &off, &count,
+                                  c->in->data, c->in->len);
+    if (status == rcon_error_moredata) {
+        return 0;
+    } else if (status != rcon_error_success) {
+        return -1;
+    }
+
+    g_byte_array_remove_range(c->in, 0, off);
+
+    for (p = msgs; *p != NULL; p++) {
+        if (load_outstanding(c) == 0 || (*p)->id == c->stale) {
+            continue;
+        }
+
+        if (minecraft) {
+            /* Done after the first frame that is not full
+             */
+            if (strlen((char const *)(*p)->body) < LOAD_FRAGMENT) {
+                load_complete(c, now);
+                ++done;
+            }
+        } else if ((*p)->id == g_array_index(c->pending, load_pending_t,
+                                              c->head).id) {
+            load_complete(c, now);
+            ++done;
+        }
+    }
+
+    src_rcon_message_freev(msgs);
+
+    return done;
+}
+
+static int load_writable(load_conn_t *c)
+{
+    ssize_t ret = 0;
+
+    ret = write(c->sock, c->out->data + c->outoff, c->out->len - c->outoff);
+    if (ret < 0) {
+        return (errno == EAGAIN || errno == EINTR ? 0 : -1);
+    }
+
+    c->outoff += ret;
+    if (c->outoff == c->out->len) {
+        g_byte_array_set_size(c->out, 0);
+        c->outoff = 0;
+    }
+
+    return 0;
+}
+
+/* The open connection with the fewest commands in flight
+ */
+static load_conn_t *load_least(load_conn_t *conns, unsigned int *next)
+{
+    load_conn_t *best = NULL;
+    unsigned int i = 0;
+
+    /* Start where the last search stopped, so ties are spread evenly
+     */
+    for (i = 0; i < connections; i++) {
+        load_conn_t *c = &conns[(*next + i) % connections];
+
+        if (c->sock < 0) {
+            continue;
+        }
+        if (best == NULL || load_outstanding(c) < load_outstanding(best)) {
+            best = c;
+        }
+    }
+
+    *next = (*next + 1) % connections;
+
+    return best;
+}
+
+static int load_run(load_conn_t *conns)
+{
+    struct pollfd *pfds = NULL;
+    double start = 0, stop = 0, due = 0, now = 0, limit = 0;
+    unsigned int i = 0, open = connections, next = 0;
+    unsigned long outstanding = 0, scheduled = 0;
+
+    pfds = calloc(connections, sizeof(struct pollfd));
+    if (pfds == NULL) {
+        return -1;
+    }
+
+    start = due = now = timers_now();
+    stop = start + duration;
+
+    /* Closed loop: every connection has one command in flight at a time
+     */
+    if (rate <= 0) {
+        for (i = 0; i < connections; i++) {
+            load_send(&conns[i], now, now);
+        }
+    }
+
+    while (open > 0) {
+        now = timers_now();
+        outstanding = stats.sent - stats.completed - stats.errors;
+
+        if (now >= stop + drain || (now >= stop && outstanding == 0)) {
+            break;
+        }
+
+        /* Open loop: send whatever is due, no matter how many commands
+         * are still in flight.
+         */
+        if (rate > 0) {
+            while (due <= now && due < stop) {
+                load_conn_t *c = load_least(conns, &next);
+
+                if (c == NULL || load_send(c, due, now)) {
+                    break;
+                }
+                due = start + ++scheduled / rate;
+            }
+        }
+
+        limit = (now < stop ? stop : stop + drain);
+        if (rate > 0 && due < limit) {
+            limit = due;
+        }
+
+        for (i = 0; i < connections; i++) {
+            load_conn_t *c = &conns[i];
+
+            pfds[i].fd = c->sock;
+            pfds[i].events = POLLIN;
+            pfds[i].revents = 0;
+            if (c->out != NULL && c->outoff < c->out->len) {
+                pfds[i].events |= POLLOUT;
+            }
+        }
+
+        if (poll(pfds, connections, (int)((limit - now) * 1000) + 1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            free(pfds);
+            return -1;
+        }
+
+        now = timers_now();
+
+        for (i = 0; i < connections; i++) {
+            load_conn_t *c = &conns[i];
+            int done = 0;
+
+            if (c->sock < 0 || pfds[i].revents == 0) {
+                continue;
+            }
+
+            if ((pfds[i].revents & POLLOUT) && load_writable(c) < 0) {
+                done = -1;
+            } else if (pfds[i].revents & (POLLIN | POLLERR | POLLHUP)) {
+                done = load_readable(c, now);
+            }
+
+            if (done < 0) {
+                stats.errors += load_outstanding(c);
+                load_close(c);
+                --open;
+                continue;
+            }
+
+            /* Closed loop: the next command goes out right away
+             */
+            for (; rate <= 0 && done > 0 && now < stop; done--) {
+                load_send(c, now, now);
+            }
+        }
+    }
+
+    free(pfds);
+
+    return 0;
+}
+
+static void load_report(double took)
+{
+    static double const percentiles[] = { 50, 90, 99, 99.9, 99.99 };
+    unsigned long outstanding = stats.sent - stats.completed - stats.errors;
+    size_t i = 0;
+
+    printf("%s:%s, %u connections, ", host, port, connections);
+    if (rate > 0) {
+        printf("open loop at %.1f commands/s", rate);
+    } else {
+        printf("closed loop");
+    }
+    printf(", %.1fs\n", duration);
+
+    printf("  commands   %lu sent, %lu completed, %lu lost, "
+           "%lu unanswered\n", stats.sent, stats.completed, stats.errors,
+           outstanding);
+    if (took > 0) {
+        printf("  throughput %.1f commands/s, %.2f KiB/s received\n",
+               stats.completed / took, stats.bytes / took / 1024.0);
+    }
+
+    if (hist_count(stats.measured) == 0) {
+        return;
+    }
+
+    printf("  latency    %12s %12s\n", "corrected", "measured");
+    printf("    %-8s %10.3fms %10.3fms\n", "min",
+           hist_min(stats.corrected) / 1000.0,
+           hist_min(stats.measured) / 1000.0);
+    for (i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++) {
+        char name[16];
+
+        snprintf(name, sizeof(name), "%g%%", percentiles[i]);
+        printf("    %-8s %10.3fms %10.3fms\n", name,
+               hist_percentile(stats.corrected, percentiles[i]) / 1000.0,
+               hist_percentile(stats.measured, percentiles[i]) / 1000.0);
+    }
+    printf("    %-8s %10.3fms %10.3fms\n", "max",
+           hist_max(stats.corrected) / 1000.0,
+           hist_max(stats.measured) / 1000.0);
+    printf("    %-8s %10.3fms %10.3fms\n", "mean",
+           hist_mean(stats.corrected) / 1000.0,
+           hist_mean(stats.measured) / 1000.0);
+}
+
+int main(int ac, char **av)
+{
+    struct addrinfo hint = {0};
+    struct addrinfo *addresses = NULL;
+    load_conn_t *conns = NULL;
+    double start = 0;
+    unsigned int i = 0;
+    int ret = 0, ec = 1;
+
+    parse_args(ac, av);
+
+    ac -= optind;
+    av += optind;
+
+    mix = g_array_new(FALSE, FALSE, sizeof(load_command_t));
+    for (i = 0; i < (unsigned int)ac; i++) {
+        mix_add(av[i], 1);
+    }
+    if (mixfile != NULL && mix_load(mixfile)) {
+        goto cleanup;
+    }
+
+    if (host == NULL || port == NULL || mixweight == 0 || connections == 0) {
+        usage();
+        goto cleanup;
+    }
+
+    hint.ai_socktype = SOCK_STREAM;
+    hint.ai_family = AF_UNSPEC;
+
+    if ((ret = getaddrinfo(host, port, &hint, &addresses))) {
+        fprintf(stderr, "Failed to resolve host: %s: %s\n",
+                host, gai_strerror(ret));
+        ec = 2;
+        goto cleanup;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    r = src_rcon_new();
+    stats.corrected = hist_new();
+    stats.measured = hist_new();
+    conns = calloc(connections, sizeof(load_conn_t));
+    if (r == NULL || stats.corrected == NULL || stats.measured == NULL ||
+        conns == NULL) {
+        goto cleanup;
+    }
+
+    for (i = 0; i < connections; i++) {
+        conns[i].sock = -1;
+    }
+
+    for (i = 0; i < connections; i++) {
+        if (load_connect(&conns[i], addresses)) {
+            ec = 3;
+            goto cleanup;
+        }
+    }
+
+    start = timers_now();
+    if (load_run(conns)) {
+        fprintf(stderr, "Failed to wait for replies: %s\n", strerror(errno));
+        goto cleanup;
+    }
+
+    load_report(timers_now() - start);
+
+    ec = (stats.errors > 0 ? 3 : 0);
+
+cleanup:
+
+    for (i = 0; conns != NULL && i < connections; i++) {
+        load_close(&conns[i]);
+    }
+    free(conns);
+
+    if (addresses != NULL) {
+        freeaddrinfo(addresses);
+    }
+
+    for (i = 0; mix != NULL && i < mix->len; i++) {
+        g_free(g_array_index(mix, load_command_t, i).command);
+    }
+    if (mix != NULL) {
+        g_array_free(mix, TRUE);
+    }
+
+    hist_free(stats.corrected);
+    hist_free(stats.measured);
+    src_rcon_free(r);
+
+    free(host);
+    free(port);
+    free(password);
+    free(mixfile);
+
+    return ec;
+}
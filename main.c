@@ -1,8 +1,23 @@
 #include "rcon.h"
 #include "config.h"
 #include "srcrcon.h"
+#include "ratelimit.h"
+#include "timers.h"
+#include "capture.h"
+#include "hexdump.h"
+#include "metrics.h"
+#include "session.h"
+#include "check.h"
+#include "diff.h"
+#include "json.h"
 #include "sysconfig.h"
 #include "memstream.h"
+#include "sockopt.h"
+#include "resolve.h"
+#include "batch.h"
+#include "lease.h"
+#include "journal.h"
+#include "retry.h"
 
 #include <glib.h>
 
@@ -15,11 +30,17 @@
 #include <errno.h>
 #include <ctype.h>
 #include <err.h>
+#include <poll.h>
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <netdb.h>
 #include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
 
 static char *host = NULL;
 static char *password = NULL;
@@ -29,15 +50,194 @@ static char *server = NULL;
 static bool debug = false;
 static bool nowait = false;
 static bool minecraft = false;
+static double rate = 0;
+static double burst = 0;
+static char **urgent = NULL;
+static char **bulk = NULL;
+static unsigned int reconnects = 0;
+static bool timing = false;
+static char *capturefile = NULL;
+static char *debugfile = NULL;
+static size_t debugmax = 0;
+static char *metricsfile = NULL;
+static double metricsinterval = 10;
+static bool check = false;
+static unsigned int jobs = 64;
+static double deadline = 30;
+static char *format = NULL;
+static bool jsonl = false;
+/* Name of the server in metrics and records
+ */
+static char *label = NULL;
+static char *selector = NULL;
+static double watch = 0;
+static bool changes = false;
+static bool pipeline = false;
+static bool fastopen = false;
+static sockopt_t sockopts;
+static char *dnscache = NULL;
+static double dnsttl = RESOLVE_TTL;
+static bool batching = false;
+static char *brokerpath = NULL;
+static char *journaldir = NULL;
+static uint64_t journalsize = JOURNAL_SIZE;
+static double journalage = JOURNAL_AGE;
 
 static GByteArray *response = NULL;
 static src_rcon_t *r = NULL;
+static ratelimit_t *ratelimit = NULL;
+static batch_t *batch = NULL;
+static lease_t *lease = NULL;
+static journal_t *journal = NULL;
+static struct addrinfo *addresses = NULL;
+static capture_t *capture = NULL;
+static int debugfd = STDERR_FILENO;
+static char *dumpbuf = NULL;
+static size_t dumpsize = 0;
+static metrics_t *metrics = NULL;
+static double metricsdue = 0;
+/* Where replies are printed to
+ */
+static FILE *output = NULL;
+/* With --format jsonl, the start of a character the last frame cut off
+ */
+static char held[4];
+static size_t heldlen = 0;
+/* With --pipeline the auth request goes out together with the first
+ * command, and is kept until its reply was seen. With --fastopen it
+ * already went out with the handshake.
+ */
+static src_rcon_message_t *pending = NULL;
+static bool pendingsent = false;
+/* The auth request that went out with the handshake, see connect_host()
+ */
+static src_rcon_message_t *early = NULL;
+/* Whether the connection came from the broker, and has not carried a
+ * reply yet. The server may have closed it in the meantime.
+ */
+static bool borrowed = false;
+
+/* send_command() and authenticate() result if the connection was lost, and
+ * we were asked to reconnect, or it was borrowed.
+ */
+#define COMMAND_DISCONNECTED 1
+
+/* Minecraft splits replies into frames of this many bytes, and does not
+ * allow us to send an end marker. After a full frame we wait for more for a
+ * while, derived from the round trip time (in seconds).
+ */
+#define MINECRAFT_FRAGMENT 4096
+#define MINECRAFT_IDLE_MIN 0.05
+#define MINECRAFT_IDLE_MAX 1.0
+
+static double srtt = 0;
+
+/* Each phase of talking to the server can have its own deadline
+ */
+typedef enum {
+    phase_connect = 0,
+    phase_auth,
+    phase_first_byte,
+    phase_command,
+    phase_max,
+} phase_t;
+
+static char const *phase_names[phase_max] = {
+    "connect", "auth", "first byte", "command"
+};
+
+/* Exit code if the given phase timed out
+ */
+static int const phase_exit[phase_max] = { 5, 6, 7, 8 };
+
+static double timeouts[phase_max] = {0};
+/* Zero if the phase is not running, negative if it was not measured
+ */
+static double started[phase_max] = {0};
+static double elapsed[phase_max] = { -1, -1, -1, -1 };
+static timers_entry_t deadlines[phase_max];
+static timers_t *timers = NULL;
+static int expired = -1;
+
+/* wait_ready() results
+ */
+#define WAIT_READY    0
+#define WAIT_ERROR   -1
+#define WAIT_EXPIRED -2
+#define WAIT_IDLE    -3
+
+/* Long options without a short equivalent
+ */
+enum {
+    opt_rate = 256,
+    opt_burst,
+    opt_reconnect,
+    opt_connect_timeout,
+    opt_auth_timeout,
+    opt_first_byte_timeout,
+    opt_timeout,
+    opt_timing,
+    opt_capture,
+    opt_debug_file,
+    opt_debug_max,
+    opt_metrics,
+    opt_metrics_interval,
+    opt_check,
+    opt_jobs,
+    opt_deadline,
+    opt_format,
+    opt_config_cache,
+    opt_select,
+    opt_watch,
+    opt_changes,
+    opt_pipeline,
+    opt_fastopen,
+    opt_dns_cache,
+    opt_dns_ttl,
+    opt_batch,
+    opt_broker,
+    opt_journal,
+    opt_journal_size,
+    opt_journal_age,
+};
 
 static void cleanup(void)
 {
     config_free();
+    config_set_cache(NULL);
+    resolve_free();
+    free(dnscache);
 
+    src_rcon_message_free(pending);
+    src_rcon_message_free(early);
     src_rcon_free(r);
+    ratelimit_free(ratelimit);
+    batch_free(batch);
+    lease_close(lease);
+    free(brokerpath);
+    journal_close(journal);
+    free(journaldir);
+    timers_free(timers);
+
+    if (capture_close(capture)) {
+        fprintf(stderr, "Failed to write capture: %s\n", strerror(errno));
+    }
+    free(capturefile);
+
+    if (debugfd != STDERR_FILENO) {
+        close(debugfd);
+    }
+    free(debugfile);
+    free(dumpbuf);
+
+    metrics_free(metrics);
+    free(metricsfile);
+    free(format);
+    free(selector);
+    g_free(label);
+
+    g_strfreev(urgent);
+    g_strfreev(bulk);
 
     free(host);
     free(password);
@@ -58,7 +258,10 @@ static void usage(void)
     puts("");
     puts("Options:");
     puts(" -c, --config     Alternate configuration file");
+    puts("     --config-cache  Keep a compiled configuration in this file");
     puts(" -d, --debug      Debug output");
+    puts("     --debug-file Write debug output to this file");
+    puts("     --debug-max  Show at most this many bytes of each chunk");
     puts(" -h, --help       This bogus");
     puts(" -H, --host       Host name or IP");
     puts(" -m, --minecraft  Minecraft mode");
@@ -67,12 +270,40 @@ static void usage(void)
     puts(" -p, --port       Port or service");
     puts(" -s, --server     Use this server from config file");
     puts(" -1, --1packet    Unused, backward compability");
+    puts("     --rate       Send at most this many commands per second");
+    puts("     --burst      Allow this many commands back to back");
+    puts("     --reconnect  Reconnect this many times if the connection drops");
+    puts("     --connect-timeout     Seconds to wait for the connection");
+    puts("     --auth-timeout        Seconds to wait for authentication");
+    puts("     --first-byte-timeout  Seconds to wait for the first reply byte");
+    puts("     --timeout             Seconds to wait for a command to finish");
+    puts("     --timing     Report how long each phase took");
+    puts("     --capture    Record all network traffic to this file");
+    puts("     --journal    Append commands and replies to this directory");
+    puts("     --journal-size  MiB per journal segment, 64 by default");
+    puts("     --journal-age   Seconds per journal segment, a day by default");
+    puts("     --watch      Repeat the command every this many seconds");
+    puts("     --changes    Only print what changed since the last reply");
+    puts("     --pipeline   Send the password along with the first command");
+    puts("     --fastopen   Use TCP Fast Open if possible");
+    puts("     --dns-cache  Keep resolved addresses in this file");
+    puts("     --dns-ttl    Seconds to use addresses from the DNS cache");
+    puts("     --batch      Send script commands joined by ; in fewer frames");
+    puts("     --broker     Borrow connections from rcon-broker at this socket");
+    puts("     --metrics    Write Prometheus metrics to this file");
+    puts("     --metrics-interval  Seconds between metrics updates");
+    puts("     --check      Check all servers in the config file");
+    puts("     --select     Only these servers, e.g. tag:eu,-eu3");
+    puts("     --jobs       Talk to this many servers at the same time");
+    puts("     --deadline   Seconds to wait for all selected servers");
+    puts("     --format     Output format, text, json or jsonl");
 }
 
 static int parse_args(int ac, char **av)
 {
     static struct option opts[] = {
         { "config", required_argument, 0, 'c' },
+        { "config-cache", required_argument, 0, opt_config_cache },
         { "debug", no_argument, 0, 'd' },
         { "help", no_argument, 0, 'h' },
         { "host", required_argument, 0, 'H' },
@@ -82,6 +313,36 @@ static int parse_args(int ac, char **av)
         { "port", required_argument, 0, 'p' },
         { "server", required_argument, 0, 's' },
         { "1packet", no_argument, 0, '1' },
+        { "rate", required_argument, 0, opt_rate },
+        { "burst", required_argument, 0, opt_burst },
+        { "reconnect", required_argument, 0, opt_reconnect },
+        { "connect-timeout", required_argument, 0, opt_connect_timeout },
+        { "auth-timeout", required_argument, 0, opt_auth_timeout },
+        { "first-byte-timeout", required_argument, 0,
+          opt_first_byte_timeout },
+        { "timeout", required_argument, 0, opt_timeout },
+        { "timing", no_argument, 0, opt_timing },
+        { "capture", required_argument, 0, opt_capture },
+        { "debug-file", required_argument, 0, opt_debug_file },
+        { "debug-max", required_argument, 0, opt_debug_max },
+        { "metrics", required_argument, 0, opt_metrics },
+        { "metrics-interval", required_argument, 0, opt_metrics_interval },
+        { "check", no_argument, 0, opt_check },
+        { "select", required_argument, 0, opt_select },
+        { "watch", required_argument, 0, opt_watch },
+        { "changes", no_argument, 0, opt_changes },
+        { "pipeline", no_argument, 0, opt_pipeline },
+        { "fastopen", no_argument, 0, opt_fastopen },
+        { "dns-cache", required_argument, 0, opt_dns_cache },
+        { "dns-ttl", required_argument, 0, opt_dns_ttl },
+        { "batch", no_argument, 0, opt_batch },
+        { "broker", required_argument, 0, opt_broker },
+        { "journal", required_argument, 0, opt_journal },
+        { "journal-size", required_argument, 0, opt_journal_size },
+        { "journal-age", required_argument, 0, opt_journal_age },
+        { "jobs", required_argument, 0, opt_jobs },
+        { "deadline", required_argument, 0, opt_deadline },
+        { "format", required_argument, 0, opt_format },
         { NULL, 0, 0, 0 }
     };
 
@@ -101,6 +362,48 @@ static int parse_args(int ac, char **av)
         case 's': free(server); server = strdup(optarg); break;
         case 'n': nowait = true; break;
         case '1': /* backward compability */ break;
+        case opt_rate: rate = strtod(optarg, NULL); break;
+        case opt_burst: burst = strtod(optarg, NULL); break;
+        case opt_reconnect: reconnects = strtoul(optarg, NULL, 10); break;
+        case opt_connect_timeout:
+            timeouts[phase_connect] = strtod(optarg, NULL);
+            break;
+        case opt_auth_timeout:
+            timeouts[phase_auth] = strtod(optarg, NULL);
+            break;
+        case opt_first_byte_timeout:
+            timeouts[phase_first_byte] = strtod(optarg, NULL);
+            break;
+        case opt_timeout: timeouts[phase_command] = strtod(optarg, NULL); break;
+        case opt_timing: timing = true; break;
+        case opt_capture: free(capturefile); capturefile = strdup(optarg); break;
+        case opt_debug_file:
+            free(debugfile);
+            debugfile = strdup(optarg);
+            debug = true;
+            break;
+        case opt_debug_max: debugmax = strtoul(optarg, NULL, 10); break;
+        case opt_metrics: free(metricsfile); metricsfile = strdup(optarg); break;
+        case opt_metrics_interval: metricsinterval = strtod(optarg, NULL); break;
+        case opt_check: check = true; break;
+        case opt_jobs: jobs = strtoul(optarg, NULL, 10); break;
+        case opt_deadline: deadline = strtod(optarg, NULL); break;
+        case opt_format: free(format); format = strdup(optarg); break;
+        case opt_config_cache: config_set_cache(optarg); break;
+        case opt_select: free(selector); selector = strdup(optarg); break;
+        case opt_watch: watch = strtod(optarg, NULL); break;
+        case opt_changes: changes = true; break;
+        case opt_pipeline: pipeline = true; break;
+        case opt_fastopen: fastopen = true; break;
+        case opt_dns_cache: free(dnscache); dnscache = strdup(optarg); break;
+        case opt_dns_ttl: dnsttl = strtod(optarg, NULL); break;
+        case opt_batch: batching = true; break;
+        case opt_broker: free(brokerpath); brokerpath = strdup(optarg); break;
+        case opt_journal: free(journaldir); journaldir = strdup(optarg); break;
+        case opt_journal_size:
+            journalsize = strtoull(optarg, NULL, 10) * 1024 * 1024;
+            break;
+        case opt_journal_age: journalage = strtod(optarg, NULL); break;
         case 'h': usage(); exit(0); break;
         default: /* intentional */
         case '?': usage(); exit(1); break;
@@ -110,59 +413,289 @@ static int parse_args(int ac, char **av)
     return 0;
 }
 
+/* Renders the whole chunk into one buffer, that is reused, and writes it
+ * out at once.
+ */
 static void debug_dump(bool in, uint8_t const *data, size_t sz)
 {
-    size_t i = 0;
+    size_t shown = sz, need = 0, len = 0;
+    ssize_t ret = 0;
 
     if (!debug) {
         return;
     }
 
-    printf("%s ", (in ? ">>" : "<<"));
+    if (debugmax > 0 && shown > debugmax) {
+        shown = debugmax;
+    }
+
+    /* prefix, dump, and a note about truncated bytes
+     */
+    need = 3 + hexdump_size(shown) + 64;
+    if (need > dumpsize) {
+        char *tmp = realloc(dumpbuf, need);
 
-    for (i = 0; i < sz; i++) {
-        if (isprint((int)data[i])) {
-            fputc((int)data[i], stdout);
-        } else {
-            printf("0x%.2X", (int)data[i]);
+        if (tmp == NULL) {
+            return;
         }
-        if (i < sz-1) {
-            printf(",");
+
+        dumpbuf = tmp;
+        dumpsize = need;
+    }
+
+    memcpy(dumpbuf, (in ? ">> " : "<< "), 3);
+    len = 3 + hexdump_format(dumpbuf + 3, data, shown);
+    if (shown < sz) {
+        len += snprintf(dumpbuf + len, dumpsize - len, " ... %zu more bytes",
+                        sz - shown);
+    }
+    dumpbuf[len++] = '\n';
+
+    for (data = (uint8_t const *)dumpbuf; len > 0; data += ret, len -= ret) {
+        ret = write(debugfd, data, len);
+        if (ret < 0 && errno == EINTR) {
+            ret = 0;
+        } else if (ret <= 0) {
+            break;
         }
     }
+}
+
+/* Writes out the metrics if they are due, or if forced to
+ */
+static void metrics_dump(bool force)
+{
+    double now = timers_now();
+
+    if (metricsfile == NULL || metrics == NULL) {
+        return;
+    }
+
+    if (!force && now < metricsdue) {
+        return;
+    }
+
+    metricsdue = now + metricsinterval;
+    metrics->queued = ratelimit_pending(ratelimit);
+
+    if (metrics_write(&metrics, 1, metricsfile)) {
+        fprintf(stderr, "Failed to write metrics: %s: %s\n",
+                metricsfile, strerror(errno));
+    }
+}
+
+static void deadline_start(phase_t phase)
+{
+    double now = timers_now();
 
-    printf("\n");
+    started[phase] = now;
+    elapsed[phase] = -1;
+
+    if (timeouts[phase] > 0) {
+        timers_add(timers, &deadlines[phase], now + timeouts[phase]);
+    }
 }
 
-static int send_message(int sock, src_rcon_message_t *msg)
+static void deadline_stop(phase_t phase)
 {
-    uint8_t *data = NULL;
-    uint8_t *p = NULL;
-    size_t size = 0;
-    int ret = 0;
+    if (started[phase] > 0) {
+        elapsed[phase] = timers_now() - started[phase];
+        started[phase] = 0;
+    }
+    timers_remove(timers, &deadlines[phase]);
+}
 
-    if (src_rcon_serialize(r, msg, &data, &size)) {
-        return -1;
+/* Stops the phase without taking its time
+ */
+static void deadline_cancel(phase_t phase)
+{
+    started[phase] = 0;
+    timers_remove(timers, &deadlines[phase]);
+}
+
+static void report_timing(phase_t from, phase_t to)
+{
+    int i = 0;
+
+    if (!timing) {
+        return;
     }
 
-    debug_dump(false, data, size);
+    fprintf(stderr, "timing:");
+    for (i = from; i <= to; i++) {
+        if (i == expired) {
+            fprintf(stderr, " %s=timeout", phase_names[i]);
+        } else if (elapsed[i] >= 0) {
+            fprintf(stderr, " %s=%.3fms", phase_names[i], elapsed[i] * 1000);
+        }
+    }
+    fprintf(stderr, "\n");
+}
+
+/* Waits until the socket is ready for the given events, or a deadline
+ * passes. If idle is not negative, also gives up after that many
+ * milliseconds.
+ */
+static int wait_ready(int sock, short events, int idle)
+{
+    struct pollfd pfd = {0};
+    timers_entry_t *e = NULL;
+    int timeout = 0, ret = 0;
+    bool idled = false;
+
+    pfd.fd = sock;
+    pfd.events = events;
 
-    p = data;
     do {
-        ret = write(sock, p, size);
+        double now = timers_now();
+
+        if ((e = timers_expired(timers, now)) != NULL) {
+            expired = (int)(e - deadlines);
+            deadline_stop(expired);
+            ++metrics->timeouts;
+            fprintf(stderr, "Timeout: %s took longer than %gs\n",
+                    phase_names[expired], timeouts[expired]);
+            return WAIT_EXPIRED;
+        }
+
+        timeout = timers_timeout(timers, now);
+        idled = (idle >= 0 && (timeout < 0 || idle <= timeout));
+        if (idled) {
+            timeout = idle;
+        }
+
+        ret = poll(&pfd, 1, timeout);
+        if (ret < 0 && errno != EINTR) {
+            fprintf(stderr, "Failed to wait for data: %s\n", strerror(errno));
+            return WAIT_ERROR;
+        }
+    } while (ret < 0 || (ret == 0 && !idled));
+
+    return (ret == 0 ? WAIT_IDLE : WAIT_READY);
+}
+
+/* Whether the given error means that the peer went away, and we could try
+ * again on a new connection.
+ */
+static bool disconnected(int error)
+{
+    if (reconnects == 0 && !borrowed) {
+        return false;
+    }
+
+    switch (error)
+    {
+    case EPIPE:
+    case ECONNRESET:
+    case ECONNABORTED:
+    case ENOTCONN:
+    case ETIMEDOUT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/* Everything that goes over the wire passes through here
+ */
+static void traffic(bool in, uint8_t const *data, size_t sz)
+{
+    if (sz == 0) {
+        return;
+    }
+
+    debug_dump(in, data, sz);
+
+    if (in) {
+        metrics->bytes_in += sz;
+    } else {
+        metrics->bytes_out += sz;
+    }
+
+    if (capture != NULL &&
+        capture_write(capture, (in ? capture_in : capture_out), data, sz)) {
+        fprintf(stderr, "Failed to write capture: %s\n", strerror(errno));
+        capture_close(capture);
+        capture = NULL;
+    }
+}
+
+/* Most messages sent at once: auth, command and end marker
+ */
+#define SEND_MAX 3
+
+/* Writes all messages with as few system calls as possible
+ */
+static int send_messages(int sock, src_rcon_message_t * const *msgs,
+                         size_t count)
+{
+    struct iovec iov[SEND_MAX];
+    uint8_t *data[SEND_MAX] = {NULL};
+    size_t i = 0, first = 0;
+    ssize_t ret = 0;
+    int ec = -2;
+
+    if (count > SEND_MAX) {
+        return -1;
+    }
+
+    for (i = 0; i < count; i++) {
+        size_t size = 0;
+
+        if (src_rcon_serialize(r, msgs[i], &data[i], &size)) {
+            ec = -1;
+            goto cleanup;
+        }
+        iov[i].iov_base = data[i];
+        iov[i].iov_len = size;
+    }
+
+    while (first < count) {
+        if (wait_ready(sock, POLLOUT, -1)) {
+            goto cleanup;
+        }
+
+        ret = writev(sock, iov + first, count - first);
         if (ret == 0 || ret < 0) {
-            free(data);
+            if (disconnected(errno)) {
+                ec = COMMAND_DISCONNECTED;
+                goto cleanup;
+            }
             fprintf(stderr, "Failed to communicate: %s\n", strerror(errno));
-            return -2;
+            goto cleanup;
         }
 
-        p += ret;
-        size -= ret;
-    } while (size > 0);
+        /* Skip what was written, which may end within a message
+         */
+        for (; first < count && ret > 0; first++) {
+            size_t n = ((size_t)ret < iov[first].iov_len ?
+                        (size_t)ret : iov[first].iov_len);
 
-    free(data);
+            traffic(false, iov[first].iov_base, n);
+            iov[first].iov_base = (uint8_t*)iov[first].iov_base + n;
+            iov[first].iov_len -= n;
+            ret -= n;
 
-    return 0;
+            if (iov[first].iov_len > 0) {
+                break;
+            }
+        }
+    }
+
+    ec = 0;
+
+cleanup:
+
+    for (i = 0; i < count; i++) {
+        free(data[i]);
+    }
+
+    return ec;
+}
+
+static int send_message(int sock, src_rcon_message_t *msg)
+{
+    return send_messages(sock, &msg, 1);
 }
 
 static int wait_auth(int sock, src_rcon_message_t *auth)
@@ -173,13 +706,24 @@ static int wait_auth(int sock, src_rcon_message_t *auth)
     size_t off = 0;
 
     do {
+        if (wait_ready(sock, POLLIN, -1)) {
+            return -1;
+        }
+
         ret = read(sock, tmp, sizeof(tmp));
         if (ret < 0) {
             fprintf(stderr, "Failed to receive data: %s\n", strerror(errno));
             return -1;
         }
 
-        debug_dump(true, tmp, ret);
+        /* As in send_command(), so that the caller may reconnect
+         */
+        if (ret == 0) {
+            fprintf(stderr, "Peer: connection closed\n");
+            return ((reconnects > 0 || borrowed) ? COMMAND_DISCONNECTED : -1);
+        }
+
+        traffic(true, tmp, ret);
 
         g_byte_array_append(response, tmp, ret);
 
@@ -195,34 +739,193 @@ static int wait_auth(int sock, src_rcon_message_t *auth)
     return 1;
 }
 
+/* Smoothed round trip time, as in RFC 6298
+ */
+static void update_rtt(double sample)
+{
+    if (srtt <= 0) {
+        srtt = sample;
+    } else {
+        srtt = 0.875 * srtt + 0.125 * sample;
+    }
+}
+
+static int minecraft_idle(void)
+{
+    double idle = 2 * srtt;
+
+    if (idle < MINECRAFT_IDLE_MIN) {
+        idle = MINECRAFT_IDLE_MIN;
+    } else if (idle > MINECRAFT_IDLE_MAX) {
+        idle = MINECRAFT_IDLE_MAX;
+    }
+
+    return (int)(idle * 1000);
+}
+
+/* With --format jsonl each command is one record. The body is written as
+ * the frames come in, and the counters follow it once the command is done.
+ */
+static void record_start(char const *cmd, src_rcon_message_t const *m)
+{
+    fputs("{\"server\":", output);
+    json_string(output, label, strlen(label));
+    fputs(",\"command\":", output);
+    json_string(output, cmd, strlen(cmd));
+    fprintf(output, ",\"id\":%ld,\"body\":\"", (long)m->id);
+}
+
+/* Writes a frame of the body. A character that is split between two frames
+ * is held back until the rest of it arrives.
+ */
+static void record_body(char const *body, size_t len, bool more)
+{
+    char joined[8];
+    size_t take = 0, left = 0;
+
+    if (heldlen > 0) {
+        take = (len < sizeof(joined) - heldlen ? len :
+                sizeof(joined) - heldlen);
+        memcpy(joined, held, heldlen);
+        memcpy(joined + heldlen, body, take);
+
+        left = json_chars(output, joined, heldlen + take, more || take < len);
+        if (left > take) {
+            memmove(held, joined + heldlen + take - left, left);
+            heldlen = left;
+            return;
+        }
+
+        body += take - left;
+        len -= take - left;
+        heldlen = 0;
+    }
+
+    left = json_chars(output, body, len, more);
+    memcpy(held, body + len - left, left);
+    heldlen = left;
+}
+
+static void record_end(bool complete, size_t frames, size_t bytes)
+{
+    record_body("", 0, false);
+    fprintf(output, "\",\"frames\":%zu,\"bytes\":%zu,\"latency\":",
+            frames, bytes);
+    json_seconds(output, elapsed[phase_command]);
+    fprintf(output, ",\"complete\":%s}\n", (complete ? "true" : "false"));
+    fflush(output);
+}
+
+/* With --pipeline the reply to the auth request comes first, before any
+ * reply to the command is let through. Returns 0 once it was verified, 1
+ * if more data is needed, and -1 if authentication failed.
+ */
+static int pipelined_auth(void)
+{
+    while (pending != NULL) {
+        src_rcon_message_t **p = NULL;
+        size_t off = 0, count = 1;
+        rcon_error_t status;
+        int32_t id = 0, type = 0;
+
+        if (response->len == 0) {
+            return 1;
+        }
+
+        status = src_rcon_deserialize(r, &p, &off, &count,
+                                      response->data, response->len);
+        if (status == rcon_error_moredata) {
+            return 1;
+        } else if (status != rcon_error_success) {
+            return -1;
+        }
+
+        g_byte_array_remove_range(response, 0, off);
+        id = p[0]->id;
+        type = p[0]->type;
+        src_rcon_message_freev(p);
+
+        if (type == serverdata_auth_response) {
+            if (id != pending->id) {
+                return -1;
+            }
+
+            src_rcon_message_free(pending);
+            pending = NULL;
+            pendingsent = false;
+            deadline_stop(phase_auth);
+            report_timing(phase_auth, phase_auth);
+            metrics->state = metrics_state_ready;
+        } else if (id != pending->id) {
+            /* Only the empty value that some servers send before the
+             * auth response may come first.
+             */
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Appends the command, and as much of the reply as came in
+ */
+static void journal_command(char const *cmd, src_rcon_message_t const *m,
+                            src_rcon_response_t const *answer)
+{
+    size_t count = (answer != NULL ? answer->frames : 0), i = 0;
+    struct iovec *body = NULL;
+
+    body = calloc(count + 1, sizeof(struct iovec));
+    if (body == NULL) {
+        return;
+    }
+
+    for (i = 0; i < count; i++) {
+        body[i].iov_base = (void *)src_rcon_response_frame(answer, i,
+                                                           &body[i].iov_len);
+    }
+
+    if (journal_append(journal, label, m->id, cmd, body, count,
+                       elapsed[phase_command])) {
+        fprintf(stderr, "Failed to write to journal: %s\n", strerror(errno));
+    }
+
+    free(body);
+}
+
 static int send_command(int sock, char const *cmd)
 {
     src_rcon_message_t *command = NULL, *end = NULL;
-    src_rcon_message_t **commandanswers = NULL;
-    src_rcon_message_t **p = NULL;
+    src_rcon_message_t *msgs[SEND_MAX];
+    size_t count = 0;
+    src_rcon_response_t *answer = NULL;
     uint8_t tmp[512];
     int ret = 0;
     rcon_error_t status;
     size_t off = 0;
     int ec = -1;
     bool done = false;
+    bool fragment = false;
+    bool newline = false;
+    bool record = false;
+    bool transmitted = false;
+    size_t printed = 0, received = 0;
+    double sent = 0;
+
+    elapsed[phase_first_byte] = -1;
+    deadline_start(phase_command);
 
-    /* Send command
-     */
     command = src_rcon_command(r, cmd);
     if (command == NULL) {
         goto cleanup;
     }
 
-    if (send_message(sock, command)) {
-        goto cleanup;
-    }
-
-    if (nowait == true) {
-        goto cleanup;
+    if (pending != NULL && !pendingsent) {
+        msgs[count++] = pending;
     }
+    msgs[count++] = command;
 
-    if (!minecraft) {
+    if (!minecraft && !nowait) {
         /* minecraft does not like the empty command at the end.
          * it will abort the connection if it finds an empty command
          * and we get no answer back.
@@ -231,91 +934,520 @@ static int send_command(int sock, char const *cmd)
         if (end == NULL) {
             goto cleanup;
         }
-        if (send_message(sock, end)) {
-            goto cleanup;
-        }
+        msgs[count++] = end;
+    }
+
+    /* Send command, and the end marker right behind it
+     */
+    if ((ret = send_messages(sock, msgs, count))) {
+        ec = (ret == COMMAND_DISCONNECTED ? ret : -1);
+        goto cleanup;
+    }
+
+    deadline_start(phase_first_byte);
+    ++metrics->commands;
+    transmitted = true;
+
+    if (jsonl) {
+        record_start(cmd, command);
+        record = true;
+    }
+
+    if (nowait == true) {
+        goto cleanup;
     }
 
+    sent = timers_now();
+
     do {
+        /* If the last frame was full, and there was nothing after it, the
+         * reply might be exactly a multiple of the fragment size.
+         */
+        ret = wait_ready(sock, POLLIN,
+                         (fragment && response->len == 0 ?
+                          minecraft_idle() : -1));
+        if (ret == WAIT_IDLE) {
+            if (newline && !jsonl) {
+                fputc('\n', output);
+            }
+            break;
+        } else if (ret != WAIT_READY) {
+            goto cleanup;
+        }
+
+#ifdef TCP_QUICKACK
+        if (minecraft) {
+            int on = 1;
+
+            /* Acknowledge fragments right away, so that Nagle on the
+             * server side does not hold back the next one until our
+             * delayed ACK fires.
+             */
+            setsockopt(sock, IPPROTO_TCP, TCP_QUICKACK, &on, sizeof(on));
+        }
+#endif
+
         ret = read(sock, tmp, sizeof(tmp));
         if (ret < 0) {
+            if (disconnected(errno)) {
+                ec = COMMAND_DISCONNECTED;
+                goto cleanup;
+            }
             fprintf(stderr, "Failed to receive data: %s\n", strerror(errno));
-            return -1;
+            goto cleanup;
+        }
+
+        traffic(true, tmp, ret);
+
+        /* Once the server answered, the connection was not stale
+         */
+        if (ret > 0) {
+            borrowed = false;
         }
 
         if (ret == 0) {
             fprintf(stderr, "Peer: connection closed\n");
+            metrics->state = metrics_state_disconnected;
+            if (reconnects > 0 || borrowed) {
+                ec = COMMAND_DISCONNECTED;
+                goto cleanup;
+            }
             done = true;
         }
 
+        if (sent > 0) {
+            update_rtt(timers_now() - sent);
+            deadline_stop(phase_first_byte);
+            sent = 0;
+        }
+
         g_byte_array_append(response, tmp, ret);
-        status = src_rcon_command_wait(r, command, &commandanswers, &off,
+
+        if (pending != NULL) {
+            ret = pipelined_auth();
+            if (ret < 0 || (ret > 0 && done)) {
+                if (expired != phase_auth) {
+                    fprintf(stderr, "Invalid auth reply, valid password?\n");
+                }
+                ++metrics->auth_failures;
+                metrics->state = metrics_state_disconnected;
+                goto cleanup;
+            } else if (ret > 0 || response->len == 0) {
+                continue;
+            }
+        }
+
+        status = src_rcon_response_add(r, command, end, &answer, &off,
                                        response->data, response->len
             );
         if (status != rcon_error_moredata) {
             g_byte_array_remove_range(response, 0, off);
         }
 
-        if (status == rcon_error_success) {
-            if (commandanswers != NULL) {
-                for (p = commandanswers; *p != NULL; p++) {
-                    if (!minecraft && (*p)->id == end->id) {
-                        done = true;
-                    } else {
-                        size_t bodylen = strlen((char const*)(*p)->body);
+        if (status == rcon_error_protocol) {
+            fprintf(stderr, "Invalid reply from server\n");
+            goto cleanup;
+        } else if (status != rcon_error_success) {
+            continue;
+        }
+
+        metrics->frames += answer->received - received;
+        received = answer->received;
+
+        /* Print the frames as they come in
+         */
+        for (; printed < answer->frames; printed++) {
+            size_t bodylen = 0;
+            char const *body = src_rcon_response_frame(answer, printed,
+                                                       &bodylen);
+
+            /* in minecraft mode we are done after the first message that
+             * is not full
+             */
+            if (minecraft) {
+                fragment = (bodylen >= MINECRAFT_FRAGMENT);
+                done = !fragment;
+            }
 
-                        fprintf(stdout, "%s", (char const*)(*p)->body);
+            if (jsonl) {
+                record_body(body, bodylen, true);
+                continue;
+            }
 
-                        if (bodylen > 0 && (*p)->body[bodylen-1] != '\n') {
-                            fprintf(stdout, "\n");
-                        }
+            fwrite(body, 1, bodylen, output);
 
-                        /* in minecraft mode we are done after the first message
-                         */
-                        if (minecraft) {
-                            done = true;
-                        }
-                    }
-                }
+            newline = (bodylen > 0 && body[bodylen-1] != '\n');
+            if (newline && !fragment) {
+                fputc('\n', output);
             }
         }
 
-        src_rcon_message_freev(commandanswers);
-        commandanswers = NULL;
+        /* Only the journal needs the frames once they are printed
+         */
+        if (journal == NULL) {
+            src_rcon_response_drop(answer);
+        }
+
+        if (answer->complete) {
+            done = true;
+        }
     } while (!done);
 
     ec = 0;
 
 cleanup:
 
+    deadline_cancel(phase_first_byte);
+    deadline_stop(phase_command);
+    report_timing(phase_first_byte, phase_command);
+
+    if (record) {
+        record_end(ec == 0, (answer != NULL ? answer->frames : 0),
+                   (answer != NULL ? answer->size : 0));
+    }
+
+    if (journal != NULL && transmitted) {
+        journal_command(cmd, command, answer);
+    }
+
+    if (ec == 0 && !nowait) {
+        metrics_latency(metrics, elapsed[phase_command]);
+    } else if (ec == COMMAND_DISCONNECTED) {
+        metrics->state = metrics_state_disconnected;
+    }
+    metrics_dump(false);
+
     src_rcon_message_free(command);
     src_rcon_message_free(end);
-    src_rcon_message_freev(commandanswers);
+    src_rcon_response_free(answer);
 
     return ec;
 }
 
-static int handle_arguments(int sock, int ac, char **av)
+/* Connects without blocking, so that the connect deadline applies. data,
+ * if any, is written as soon as the socket takes it, which with fast open
+ * is in the SYN. Either way the handshake is over once this returns, so a
+ * refused address can still be skipped.
+ */
+static int connect_address(int sock, struct addrinfo const *ai,
+                           uint8_t const *data, size_t size)
 {
-    char *c = NULL;
-    size_t size = 0;
-    FILE *cmd = NULL;
-    int i = 0;
+    int flags = 0, error = 0;
+    socklen_t len = sizeof(error);
+    size_t off = 0;
+    ssize_t ret = 0;
 
-    cmd = open_memstream(&c, &size);
-    if (cmd == NULL) {
+    flags = fcntl(sock, F_GETFL);
+    if (flags < 0 || fcntl(sock, F_SETFL, flags | O_NONBLOCK) < 0) {
         return -1;
     }
 
-    for (i = 0; i < ac; i++) {
-        if (i > 0) {
-            fputc(' ', cmd);
-        }
+#ifdef TCP_FASTOPEN_CONNECT
+    if (data != NULL) {
+        int on = 1;
+
+        /* connect() returns right away, and the handshake happens with the
+         * first write. With a cookie from an earlier connection that data
+         * goes out in the SYN. If the kernel does not know the option, this
+         * is just a normal connect.
+         */
+        setsockopt(sock, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &on, sizeof(on));
+    }
+#endif
+
+    if (connect(sock, ai->ai_addr, ai->ai_addrlen) < 0 &&
+        errno != EINPROGRESS) {
+        return -1;
+    }
+
+    while (off < size) {
+        ret = write(sock, data + off, size - off);
+        if (ret < 0 && (errno == EAGAIN || errno == EINPROGRESS)) {
+            if (wait_ready(sock, POLLOUT, -1)) {
+                return -1;
+            }
+            continue;
+        } else if (ret <= 0) {
+            return -1;
+        }
+
+        traffic(false, data + off, ret);
+        off += ret;
+    }
+
+    if (wait_ready(sock, POLLOUT, -1)) {
+        return -1;
+    }
+
+    if (getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &len) < 0 ||
+        error != 0) {
+        return -1;
+    }
+
+    return fcntl(sock, F_SETFL, flags);
+}
+
+/* Whether the server took the data that came with the SYN
+ */
+static void report_fastopen(int sock)
+{
+#if defined(TCP_INFO) && defined(TCPI_OPT_SYN_DATA)
+    struct tcp_info info;
+    socklen_t len = sizeof(info);
+
+    if (!timing || !fastopen) {
+        return;
+    }
+
+    memset(&info, 0, sizeof(info));
+    if (getsockopt(sock, IPPROTO_TCP, TCP_INFO, &info, &len) == 0) {
+        fprintf(stderr, "timing: fastopen=%s\n",
+                (info.tcpi_options & TCPI_OPT_SYN_DATA ? "yes" : "no"));
+    }
+#endif
+}
+
+static int connect_host(void)
+{
+    struct addrinfo *ai = NULL;
+    src_rcon_message_t *auth = NULL;
+    uint8_t *data = NULL;
+    size_t size = 0;
+    int sock = -1;
+
+    deadline_start(phase_connect);
+    metrics->state = metrics_state_connecting;
+
+    /* Fast open needs something to send with the SYN, and the auth request
+     * is known up front
+     */
+    if (fastopen && password != NULL && strlen(password) > 0) {
+        auth = src_rcon_auth(r, password);
+        if (auth == NULL || src_rcon_serialize(r, auth, &data, &size)) {
+            src_rcon_message_free(auth);
+            auth = NULL;
+            data = NULL;
+            size = 0;
+        }
+    }
+
+    for (ai = addresses; ai != NULL; ai = ai->ai_next ) {
+        sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (sock < 0) {
+            continue;
+        }
+
+        /* Not worth giving up over, the defaults still work
+         */
+        if (sockopt_apply(sock, &sockopts) && debug) {
+            fprintf(stderr, "Failed to set socket options: %s\n",
+                    strerror(errno));
+        }
+
+        if (connect_address(sock, ai, data, size) == 0) {
+            break;
+        }
+
+        close(sock);
+        sock = -1;
+
+        if (expired == phase_connect) {
+            break;
+        }
+    }
+
+    deadline_stop(phase_connect);
+
+    src_rcon_message_free(early);
+    early = NULL;
+    if (sock < 0) {
+        metrics->state = metrics_state_disconnected;
+        src_rcon_message_free(auth);
+    } else {
+        early = auth;
+    }
+    free(data);
+
+    return sock;
+}
+
+static int authenticate(int sock)
+{
+    src_rcon_message_t *auth = NULL;
+    bool sent = false;
+    int ec = 0, ret = 0;
+
+    /* Do we have a password?
+     */
+    if (password == NULL || strlen(password) == 0) {
+        metrics->state = metrics_state_ready;
+        return 0;
+    }
+
+    /* Send auth request first, unless it went out with the handshake
+     */
+    sent = (early != NULL);
+    auth = (sent ? early : src_rcon_auth(r, password));
+    early = NULL;
+    if (auth == NULL) {
+        return -1;
+    }
+
+    deadline_start(phase_auth);
+    metrics->state = metrics_state_authenticating;
+
+    /* Or along with the first command, see pipelined_auth()
+     */
+    if (pipeline && !nowait) {
+        src_rcon_message_free(pending);
+        pendingsent = sent;
+        pending = auth;
+        return 0;
+    }
+
+    if (!sent && send_message(sock, auth)) {
+        ec = -1;
+    } else if ((ret = wait_auth(sock, auth)) == COMMAND_DISCONNECTED) {
+        ec = ret;
+    } else if (ret) {
+        if (expired != phase_auth) {
+            fprintf(stderr, "Invalid auth reply, valid password?\n");
+        }
+        ++metrics->auth_failures;
+        ec = -1;
+    }
+
+    deadline_stop(phase_auth);
+    metrics->state = (ec == 0 ? metrics_state_ready :
+                      metrics_state_disconnected);
+    src_rcon_message_free(auth);
+
+    return ec;
+}
+
+/* Establishes a new, authenticated connection and puts it in place of the
+ * old socket, so that sock stays valid for the caller. A stale connection
+ * from the broker is replaced right away.
+ */
+static int reestablish(int sock, unsigned int tries, bool stale)
+{
+    unsigned int attempt = 0;
+    int fresh = -1;
+
+    for (attempt = 0; attempt < tries; attempt++) {
+        if (!stale || attempt > 0) {
+            poll(NULL, 0, retry_delay(attempt));
+        }
+
+        g_byte_array_set_size(response, 0);
+
+        fresh = connect_host();
+        if (fresh < 0) {
+            continue;
+        }
+
+        if (authenticate(fresh) == 0) {
+            break;
+        }
+
+        close(fresh);
+        fresh = -1;
+    }
+
+    if (fresh < 0) {
+        fprintf(stderr, "Failed to reconnect after %u attempts\n", tries);
+        return -1;
+    }
+
+    expired = -1;
+    ++metrics->reconnects;
+    report_timing(phase_connect, phase_auth);
+
+    if (dup2(fresh, sock) < 0) {
+        close(fresh);
+        return -1;
+    }
+    close(fresh);
+
+    return 0;
+}
+
+/* Sends the command, and if the connection drops, reconnects. Commands that
+ * are not idempotent are not sent again, and neither are commands that keep
+ * losing the connection. Both return 1. A borrowed connection the server
+ * already closed is replaced once, whatever --reconnect says, and the
+ * command sent again, as the server never saw it.
+ */
+static int run_command(int sock, char const *cmd, bool idempotent)
+{
+    unsigned int tries = 0;
+    bool stale = false;
+    int ret = 0;
+
+    while ((ret = send_command(sock, cmd)) == COMMAND_DISCONNECTED) {
+        stale = borrowed;
+        borrowed = false;
+
+        if (stale) {
+            fprintf(stderr, "Borrowed connection was closed, reconnecting\n");
+            if (reestablish(sock, 1, true)) {
+                return -1;
+            }
+            continue;
+        }
+
+        fprintf(stderr, "Connection lost, reconnecting\n");
+
+        if (reestablish(sock, reconnects, false)) {
+            return -1;
+        }
+
+        if (!retry_command(idempotent, tries++, reconnects)) {
+            fprintf(stderr, "Not repeating command: %s\n", cmd);
+            return 1;
+        }
+    }
+
+    borrowed = false;
+
+    return ret;
+}
+
+/* All arguments form one command
+ */
+static char *join_arguments(int ac, char **av)
+{
+    char *c = NULL;
+    size_t size = 0;
+    FILE *cmd = NULL;
+    int i = 0;
+
+    cmd = open_memstream(&c, &size);
+    if (cmd == NULL) {
+        return NULL;
+    }
+
+    for (i = 0; i < ac; i++) {
+        if (i > 0) {
+            fputc(' ', cmd);
+        }
         fprintf(cmd, "%s", av[i]);
     }
     fclose(cmd);
 
-    if (send_command(sock, c)) {
+    return c;
+}
+
+static int handle_arguments(int sock, int ac, char **av)
+{
+    char *c = NULL;
+
+    c = join_arguments(ac, av);
+    if (c == NULL) {
+        return -1;
+    }
+
+    if (run_command(sock, c, true)) {
         free(c);
         return -1;
     }
@@ -325,47 +1457,344 @@ static int handle_arguments(int sock, int ac, char **av)
     return 0;
 }
 
+/* Prints an inserted or removed line of a --changes reply
+ */
+static void print_change(diff_op_t op, diff_line_t const *line, void *data)
+{
+    if (op == diff_keep) {
+        return;
+    }
+
+    fputc((op == diff_insert ? '+' : '-'), stdout);
+    fwrite(line->data, 1, line->len, stdout);
+    fputc('\n', stdout);
+}
+
+/* Runs the command over and over on the same connection. Each tick is
+ * computed from the first one, so that the time the command takes does not
+ * add up, and ticks that were missed are skipped rather than caught up on.
+ */
+static int handle_watch(int sock, int ac, char **av)
+{
+    diff_line_t *lines = NULL, *previous = NULL;
+    char *cmd = NULL, *reply = NULL, *last = NULL;
+    ssize_t count = 0, lastcount = -1;
+    size_t size = 0;
+    double next = 0, now = 0;
+    int ec = -1;
+
+    cmd = join_arguments(ac, av);
+    if (cmd == NULL) {
+        return -1;
+    }
+
+    next = timers_now();
+
+    do {
+        if (changes) {
+            output = open_memstream(&reply, &size);
+            if (output == NULL) {
+                output = stdout;
+                goto cleanup;
+            }
+        }
+
+        ec = run_command(sock, cmd, true);
+
+        if (changes) {
+            fclose(output);
+            output = stdout;
+        }
+
+        if (ec) {
+            goto cleanup;
+        }
+        ec = -1;
+
+        if (changes) {
+            count = diff_split(reply, size, &lines);
+            if (count < 0) {
+                goto cleanup;
+            }
+
+            if (lastcount < 0) {
+                fwrite(reply, 1, size, stdout);
+            } else if (diff_lines(previous, lastcount, lines, count,
+                                  print_change, NULL)) {
+                goto cleanup;
+            }
+
+            /* The lines point into the reply, so both are kept
+             */
+            free(last);
+            free(previous);
+            last = reply;
+            previous = lines;
+            lastcount = count;
+            reply = NULL;
+            lines = NULL;
+        }
+        fflush(stdout);
+
+        next += watch;
+        now = timers_now();
+        if (next < now) {
+            next += ((long)((now - next) / watch) + 1) * watch;
+        }
+
+        poll(NULL, 0, (int)((next - now) * 1000));
+    } while (true);
+
+cleanup:
+
+    free(cmd);
+    free(reply);
+    free(last);
+    free(lines);
+    free(previous);
+
+    return ec;
+}
+
+/* Returns the command on the given script line, or NULL if the line is
+ * a comment or empty. Commands prefixed with ! are not idempotent, and
+ * those prefixed with @ are never batched with others. separate may be
+ * NULL.
+ */
+static char *script_command(char *line, bool *idempotent, bool *separate)
+{
+    char *cmd = line;
+    size_t len = strlen(line);
+
+    /* Strip away \n
+     */
+    if (len > 0 && line[len-1] == '\n') {
+        line[len-1] = '\0';
+    }
+
+    while (*cmd != '\0' && isspace(*cmd)) {
+        ++cmd;
+    }
+
+    /* Comment or empty line
+     */
+    if (cmd[0] == '\0' || cmd[0] == '#') {
+        return NULL;
+    }
+
+    *idempotent = true;
+    if (separate) {
+        *separate = false;
+    }
+
+    for (; *cmd == '!' || *cmd == '@'; cmd++) {
+        if (*cmd == '!') {
+            *idempotent = false;
+        } else if (separate) {
+            *separate = true;
+        }
+    }
+
+    return cmd;
+}
+
+static int send_scheduled(int sock)
+{
+    char *cmd = NULL;
+    unsigned int idempotent = 0;
+    int ret = 0, ec = 0;
+
+    while ((cmd = ratelimit_pop(ratelimit, timers_now(),
+                                &idempotent)) != NULL) {
+        ret = run_command(sock, cmd, idempotent);
+        free(cmd);
+        if (ret < 0) {
+            return ret;
+        } else if (ret > 0) {
+            ec = ret;
+        }
+    }
+
+    return ec;
+}
+
+/* With rate limiting enabled the script is read as it becomes available,
+ * and queued. This allows urgent commands to overtake queued bulk commands.
+ */
+static int handle_stdin_scheduled(int sock)
+{
+    GByteArray *in = g_byte_array_new();
+    struct pollfd pfd = {0};
+    bool eof = false;
+    uint8_t tmp[512];
+    int ec = 0, ret = 0;
+
+    while (ec >= 0 && (!eof || ratelimit_pending(ratelimit) > 0)) {
+        double delay = ratelimit_delay(ratelimit, timers_now());
+        int timeout = (delay < 0 ? -1 : (int)(delay * 1000) + 1);
+        uint8_t *nl = NULL;
+        bool idempotent = true;
+        ssize_t len = 0;
+
+        if (eof) {
+            poll(NULL, 0, timeout);
+        } else {
+            pfd.fd = STDIN_FILENO;
+            pfd.events = POLLIN;
+
+            if (poll(&pfd, 1, timeout) > 0) {
+                len = read(STDIN_FILENO, tmp, sizeof(tmp));
+                if (len < 0 && errno != EINTR) {
+                    fprintf(stderr, "Failed to read commands: %s\n",
+                            strerror(errno));
+                    ec = -1;
+                    break;
+                }
+
+                if (len == 0) {
+                    /* Last line might not be terminated
+                     */
+                    eof = true;
+                    g_byte_array_append(in, (uint8_t const *)"\n", 1);
+                } else if (len > 0) {
+                    g_byte_array_append(in, tmp, len);
+                }
+            }
+        }
+
+        while ((nl = memchr(in->data, '\n', in->len)) != NULL) {
+            char *cmd = NULL;
+
+            len = nl - in->data;
+            *nl = '\0';
+            cmd = script_command((char*)in->data, &idempotent, NULL);
+            if (cmd != NULL && ratelimit_push(ratelimit, cmd, idempotent)) {
+                ec = -1;
+            }
+            g_byte_array_remove_range(in, 0, len + 1);
+        }
+
+        if (ec >= 0 && (ret = send_scheduled(sock))) {
+            ec = ret;
+        }
+
+        metrics_dump(false);
+    }
+
+    g_byte_array_free(in, TRUE);
+
+    return (ec != 0 ? -1 : 0);
+}
+
+static int send_batch(int sock)
+{
+    int ret = 0;
+
+    if (batch_count(batch) == 0) {
+        return 0;
+    }
+
+    ret = run_command(sock, batch_commands(batch), batch_idempotent(batch));
+    batch_clear(batch);
+
+    return ret;
+}
+
+/* With --batch commands are collected, and sent once the next one does
+ * not fit anymore. Commands that are kept separate go out on their own,
+ * after those collected before them.
+ */
+static int batch_command(int sock, char const *cmd, bool idempotent,
+                         bool separate)
+{
+    int ret = 0, sent = 0;
+
+    if (batch == NULL) {
+        return run_command(sock, cmd, idempotent);
+    }
+
+    if (!separate && batch_add(batch, cmd, idempotent) == 0) {
+        return 0;
+    }
+
+    if ((ret = send_batch(sock)) < 0) {
+        return ret;
+    }
+
+    if (separate) {
+        sent = run_command(sock, cmd, idempotent);
+        return (sent != 0 ? sent : ret);
+    }
+
+    /* An empty batch takes any command
+     */
+    batch_add(batch, cmd, idempotent);
+
+    return ret;
+}
+
 static int handle_stdin(int sock)
 {
     char *line = NULL;
     size_t sz = 0;
-    int read = 0;
-    int ec = 0;
+    int ec = 0, ret = 0;
 
-    while ((read = getline(&line, &sz, stdin)) != -1) {
-        char *cmd = line;
+    if (ratelimit_limited(ratelimit)) {
+        return handle_stdin_scheduled(sock);
+    }
 
-        /* Strip away \n
-         */
-        line[read-1] = '\0';
+    while (getline(&line, &sz, stdin) != -1) {
+        bool idempotent = true, separate = false;
+        char *cmd = script_command(line, &idempotent, &separate);
 
-        while (*cmd != '\0' && isspace(*cmd)) {
-            ++cmd;
-        }
-
-        /* Comment or empty line
-         */
-        if (cmd[0] == '\0' || cmd[0] == '#') {
+        if (cmd == NULL) {
             continue;
         }
 
-        if (send_command(sock, cmd)) {
+        ret = batch_command(sock, cmd, idempotent, separate);
+        if (ret < 0) {
             ec = -1;
             break;
+        } else if (ret > 0) {
+            /* Command was lost, but we can go on
+             */
+            ec = -1;
         }
     }
 
+    if (ret >= 0 && send_batch(sock) != 0) {
+        ec = -1;
+    }
+
     free(line);
 
     return ec;
 }
 
-int do_config(void)
+static int setup_ratelimit(void)
 {
-    if (server == NULL) {
-        return 0;
+    ratelimit = ratelimit_new(rate, burst);
+    if (ratelimit == NULL) {
+        return -1;
+    }
+
+    if (urgent != NULL &&
+        ratelimit_set_commands(ratelimit, ratelimit_priority_urgent,
+                               (char const * const *)urgent)) {
+        return -1;
+    }
+
+    if (bulk != NULL &&
+        ratelimit_set_commands(ratelimit, ratelimit_priority_bulk,
+                               (char const * const *)bulk)) {
+        return -1;
     }
 
+    return 0;
+}
+
+static int load_config(void)
+{
     if (config == NULL) {
         char const *home = getenv("HOME");
         size_t sz = 0;
@@ -389,6 +1818,21 @@ int do_config(void)
         return 2;
     }
 
+    return 0;
+}
+
+int do_config(void)
+{
+    int ret = 0;
+
+    if (server == NULL) {
+        return 0;
+    }
+
+    if ((ret = load_config())) {
+        return ret;
+    }
+
     free(host);
     free(port);
     free(password);
@@ -398,30 +1842,317 @@ int do_config(void)
         return 2;
     }
 
+    config_host_schedule(server, &rate, &burst, &urgent, &bulk);
+    config_host_timeouts(server, &timeouts[phase_connect],
+                         &timeouts[phase_auth], &timeouts[phase_first_byte],
+                         &timeouts[phase_command]);
+    config_host_sockopts(server, &sockopts);
+
     return 0;
 }
 
+static void free_sessions(session_t **sessions, size_t n)
+{
+    size_t i = 0;
+
+    for (i = 0; sessions != NULL && i < n; i++) {
+        session_free(sessions[i]);
+    }
+    free(sessions);
+}
+
+/* Sessions for all selected servers, that will run the given commands.
+ * Returns NULL, after printing why, if the configuration could not be
+ * loaded or the selection is wrong.
+ */
+static session_t **new_sessions(char * const *commands, size_t *n)
+{
+    char **groups = NULL;
+    session_t **sessions = NULL;
+    size_t count = 0, i = 0;
+
+    *n = 0;
+
+    if (load_config()) {
+        return NULL;
+    }
+
+    groups = (selector != NULL ? config_select(selector) : config_groups());
+    if (groups == NULL && selector != NULL) {
+        return NULL;
+    }
+    count = (groups != NULL ? g_strv_length(groups) : 0);
+
+    sessions = calloc(count + 1, sizeof(session_t*));
+    if (sessions == NULL) {
+        g_strfreev(groups);
+        return NULL;
+    }
+
+    for (i = 0; i < count; i++) {
+        char *h = NULL, *p = NULL, *pw = NULL;
+        double t[phase_max] = {0};
+        bool mc = false;
+        session_t *s = NULL;
+        int k = 0, ret = 0;
+
+        /* Groups that are only inherited from have no hostname. Other
+         * broken servers are reported as failed.
+         */
+        ret = config_host_data(groups[i], &h, &p, &pw, &mc);
+        if (ret == -3) {
+            continue;
+        }
+
+        s = session_new(groups[i], (ret == 0 ? h : ""), (ret == 0 ? p : ""),
+                        pw, mc);
+        free(h);
+        free(p);
+        free(pw);
+        if (s == NULL) {
+            fprintf(stderr, "Failed to set up server %s\n", groups[i]);
+            free_sessions(sessions, *n);
+            g_strfreev(groups);
+            return NULL;
+        }
+        sessions[(*n)++] = s;
+
+        if (ret != 0) {
+            s->status = session_status_config;
+            s->finished = true;
+            continue;
+        }
+
+        /* The command line takes precedence
+         */
+        config_host_timeouts(groups[i], &t[phase_connect], &t[phase_auth],
+                             &t[phase_first_byte], &t[phase_command]);
+        for (k = 0; k < phase_max; k++) {
+            if (timeouts[k] > 0) {
+                t[k] = timeouts[k];
+            }
+        }
+
+        s->timeouts[session_phase_connect] = t[phase_connect];
+        s->timeouts[session_phase_auth] = t[phase_auth];
+        s->timeouts[session_phase_first_byte] = t[phase_first_byte];
+        s->timeouts[session_phase_command] = t[phase_command];
+        s->commands = commands;
+        config_host_sockopts(groups[i], &s->sockopts);
+    }
+
+    g_strfreev(groups);
+
+    return sessions;
+}
+
+/* Connects to, and authenticates with, every selected server at once. The
+ * given commands, if any, are run as a probe.
+ */
+static int do_check(int ac, char **av)
+{
+    session_t **sessions = NULL;
+    size_t n = 0;
+    char *probe[2] = { NULL, NULL };
+    bool json = false;
+    int ec = 3;
+
+    if (format != NULL) {
+        if (strcmp(format, "json") == 0) {
+            json = true;
+        } else if (strcmp(format, "text") != 0) {
+            fprintf(stderr, "Output format %s is not supported with "
+                    "--check\n", format);
+            return 1;
+        }
+    }
+
+    if (metricsfile != NULL) {
+        fprintf(stderr, "--metrics is not supported with --check\n");
+        return 1;
+    }
+
+    if (ac > 0 && (probe[0] = join_arguments(ac, av)) == NULL) {
+        return 3;
+    }
+
+    sessions = new_sessions(probe[0] != NULL ? probe : NULL, &n);
+    if (sessions == NULL) {
+        free(probe[0]);
+        return 2;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    if (session_run(sessions, n, jobs, deadline, NULL, NULL)) {
+        fprintf(stderr, "Failed to check servers: %s\n", strerror(errno));
+        goto cleanup;
+    }
+
+    check_report(stdout, sessions, n, json);
+    ec = (check_passed(sessions, n) ? 0 : 9);
+
+cleanup:
+
+    free_sessions(sessions, n);
+    free(probe[0]);
+
+    return ec;
+}
+
+/* Output of the selected servers, printed in order as soon as all servers
+ * before them are done.
+ */
+typedef struct {
+    session_t **sessions;
+    size_t count;
+    size_t next;
+    bool failed;
+} fanout_t;
+
+static void fanout_done(session_t *s, void *data)
+{
+    fanout_t *f = (fanout_t*)data;
+
+    (void)s;
+
+    for (; f->next < f->count && f->sessions[f->next]->finished; f->next++) {
+        session_t *done = f->sessions[f->next];
+        char const *error = session_error(done);
+
+        fprintf(output, "[%s]\n", done->name);
+        if (done->outputlen > 0) {
+            fwrite(done->output, 1, done->outputlen, output);
+        }
+        fflush(output);
+
+        if (error != NULL) {
+            fprintf(stderr, "%s: %s: %s\n", done->name,
+                    session_phase_name(done->phase), error);
+            f->failed = true;
+        }
+
+        /* Do not hold on to replies that were already printed
+         */
+        free(done->output);
+        done->output = NULL;
+        done->outputlen = 0;
+    }
+}
+
+/* Reads the whole script from stdin
+ */
+static char **read_script(void)
+{
+    GPtrArray *commands = g_ptr_array_new();
+    char *line = NULL;
+    size_t sz = 0;
+
+    while (getline(&line, &sz, stdin) != -1) {
+        bool idempotent = true;
+        char *cmd = script_command(line, &idempotent, NULL);
+
+        if (cmd != NULL) {
+            g_ptr_array_add(commands, g_strdup(cmd));
+        }
+    }
+    free(line);
+
+    g_ptr_array_add(commands, NULL);
+
+    return (char**)g_ptr_array_free(commands, FALSE);
+}
+
+/* Runs the same commands, or script, on every selected server at once.
+ * Each server gets its commands in order, and its replies are printed as
+ * one block, in the order the servers were selected in.
+ */
+static int do_fanout(int ac, char **av)
+{
+    session_t **sessions = NULL;
+    char **commands = NULL;
+    fanout_t f = {0};
+    int ec = 3;
+
+    if (format != NULL && strcmp(format, "text") != 0) {
+        fprintf(stderr, "Output format %s is not supported with --select\n",
+                format);
+        return 1;
+    }
+
+    /* The counters are kept for a single connection
+     */
+    if (metricsfile != NULL) {
+        fprintf(stderr, "--metrics is not supported with --select\n");
+        return 1;
+    }
+
+    if (ac > 0) {
+        char *c = join_arguments(ac, av);
+
+        if (c == NULL) {
+            return 3;
+        }
+        commands = g_new0(char*, 2);
+        commands[0] = g_strdup(c);
+        free(c);
+    } else {
+        commands = read_script();
+    }
+
+    sessions = new_sessions(commands, &f.count);
+    if (sessions == NULL) {
+        g_strfreev(commands);
+        return 2;
+    }
+    f.sessions = sessions;
+
+    signal(SIGPIPE, SIG_IGN);
+
+    if (session_run(sessions, f.count, jobs, deadline, fanout_done, &f)) {
+        fprintf(stderr, "Failed to run commands: %s\n", strerror(errno));
+        goto cleanup;
+    }
+
+    ec = (f.failed ? 9 : 0);
+
+cleanup:
+
+    free_sessions(sessions, f.count);
+    g_strfreev(commands);
+
+    return ec;
+}
+
 int main(int ac, char **av)
 {
-    struct addrinfo *info = NULL, *ai = NULL, hint = {0};
-    src_rcon_message_t *auth = NULL;
-    src_rcon_message_t **authanswers = NULL;
-    int sock = 0;
+    int sock = -1;
     int ret = 0;
     int ec = 3;
+    bool leased = false;
+#ifdef HAVE_PLEDGE
+    char *promises = NULL;
+#endif
 
 #ifdef HAVE_PLEDGE
     /* stdio = standard IO and send/recv
      * rpath = config file
+     * wpath cpath = capture file
+     * flock = journal
      * inet = dns = :-)
+     * unix sendfd recvfd = connections from and to rcon-broker
      */
-    if (pledge("stdio rpath inet dns", NULL) == -1) {
+    if (pledge("stdio rpath wpath cpath flock inet dns unix sendfd recvfd",
+               NULL) == -1) {
         err(1, "pledge");
     }
 #endif
 
     atexit(cleanup);
 
+    output = stdout;
+    sockopt_init(&sockopts);
+
     parse_args(ac, av);
     if (do_config()) {
         return 2;
@@ -432,75 +2163,171 @@ int main(int ac, char **av)
     optind = 1;
     parse_args(ac, av);
 
+    resolve_set_cache(dnscache, dnsttl);
 
     ac -= optind;
     av += optind;
 
+    if (check) {
+        return do_check(ac, av);
+    } else if (selector != NULL) {
+        return do_fanout(ac, av);
+    }
+
     if (host == NULL || port == NULL) {
         fprintf(stderr, "No host and/or port specified\n");
         return 1;
     }
 
-    memset(&hint, 0, sizeof(hint));
-    hint.ai_socktype = SOCK_STREAM;
-    hint.ai_family = AF_UNSPEC;
-    hint.ai_flags = AI_PASSIVE;
+    if (format != NULL) {
+        if (strcmp(format, "jsonl") == 0) {
+            jsonl = true;
+        } else if (strcmp(format, "text") != 0) {
+            fprintf(stderr, "Output format %s is not supported for a "
+                    "single server\n", format);
+            return 1;
+        }
+    }
+
+    if (jsonl && changes) {
+        fprintf(stderr, "--changes only works with the text format\n");
+        return 1;
+    }
 
-    if ((ret = getaddrinfo(host, port, &hint, &info))) {
+    if ((ret = resolve_addresses(host, port, &addresses))) {
         fprintf(stderr, "Failed to resolve host: %s: %s\n",
                 host, gai_strerror(ret)
             );
         goto cleanup;
     }
 
-    for (ai = info; ai != NULL; ai = ai->ai_next ) {
-        sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
-        if (sock < 0) {
-            continue;
+    timers = timers_new();
+    if (timers == NULL) {
+        goto cleanup;
+    }
+
+    if (server != NULL) {
+        label = g_strdup(server);
+    } else {
+        label = g_strdup_printf("%s:%s", host, port);
+    }
+
+    metrics = metrics_new(label);
+    if (metrics == NULL) {
+        goto cleanup;
+    }
+
+    if (debugfile != NULL) {
+        debugfd = open(debugfile, O_WRONLY | O_CREAT | O_APPEND, 0600);
+        if (debugfd < 0) {
+            fprintf(stderr, "Failed to open debug file: %s: %s\n",
+                    debugfile, strerror(errno));
+            debugfd = STDERR_FILENO;
+            goto cleanup;
         }
+    }
 
-        if (connect(sock, ai->ai_addr, ai->ai_addrlen) == 0) {
-            break;
+    if (capturefile != NULL) {
+        capture = capture_open(capturefile);
+        if (capture == NULL) {
+            fprintf(stderr, "Failed to open capture file: %s: %s\n",
+                    capturefile, strerror(errno));
+            goto cleanup;
         }
+    }
 
-        close(sock);
-        sock = -1;
+    if (journaldir != NULL) {
+        journal = journal_open(journaldir, journalsize, journalage);
+        if (journal == NULL) {
+            fprintf(stderr, "Failed to open journal: %s: %s\n",
+                    journaldir, strerror(errno));
+            goto cleanup;
+        }
+    }
+
+    /* A connection an earlier rcon left with the broker skips both the
+     * handshake and the password
+     */
+    if (brokerpath != NULL) {
+        lease = lease_open(brokerpath);
+        sock = lease_get(lease, host, port, password);
+        if (debug) {
+            fprintf(stderr, "%s\n",
+                    (lease == NULL ? "No broker running" :
+                     sock > -1 ? "Borrowed connection from broker" :
+                     "Broker has no connection"));
+        }
+        leased = (sock > -1);
     }
 
     if (sock < 0) {
-        fprintf(stderr, "Failed to connect to the given host/service\n");
+        sock = connect_host();
+    }
+    if (sock < 0) {
+        if (expired != phase_connect) {
+            fprintf(stderr, "Failed to connect to the given host/service\n");
+        }
+        report_timing(phase_connect, phase_connect);
         goto cleanup;
     }
 
 #ifdef HAVE_PLEDGE
-    /* Drop privileges further, since we are done socket()ing.
+    /* Drop privileges further, since we are done socket()ing. Unless we
+     * may have to reconnect, or give the connection to the broker. The
+     * journal lists, rotates and locks its segments as it goes.
      */
-    if (pledge("stdio", NULL) == -1) {
+    promises = g_strconcat((reconnects > 0 || leased ? "stdio inet" : "stdio"),
+                           (metricsfile != NULL ? " wpath cpath" : ""),
+                           (journaldir != NULL ?
+                            " rpath wpath cpath flock" : ""),
+                           (lease != NULL ? " unix sendfd" : ""), NULL);
+    if (pledge(promises, NULL) == -1) {
         err(1, "pledge");
     }
+    g_free(promises);
 #endif
 
+    /* A dropped connection should be reported by write(), and not kill us.
+     */
+    signal(SIGPIPE, SIG_IGN);
+
     response = g_byte_array_new();
     r = src_rcon_new();
 
-    /* Do we have a password?
-     */
-    if (password != NULL && strlen(password) > 0) {
-        /* Send auth request first
-         */
-        auth = src_rcon_auth(r, password);
+    if (setup_ratelimit()) {
+        goto cleanup;
+    }
 
-        if (send_message(sock, auth)) {
+    /* Minecraft runs a frame as one command, and with a rate limit each
+     * command has to be queued by itself.
+     */
+    if (batching && !minecraft && !ratelimit_limited(ratelimit)) {
+        batch = batch_new(BATCH_MAX);
+        if (batch == NULL) {
             goto cleanup;
         }
+    }
 
-        if (wait_auth(sock, auth)) {
-            fprintf(stderr, "Invalid auth reply, valid password?\n");
+    if (leased) {
+        borrowed = true;
+        metrics->state = metrics_state_ready;
+    } else {
+        ret = authenticate(sock);
+        report_timing(phase_connect, phase_auth);
+        if (ret == COMMAND_DISCONNECTED) {
+            fprintf(stderr, "Connection lost, reconnecting\n");
+            ret = reestablish(sock, reconnects, false);
+        }
+        if (ret) {
             goto cleanup;
         }
     }
 
-    if (ac > 0) {
+    if (ac > 0 && watch > 0) {
+        if (handle_watch(sock, ac, av)) {
+            goto cleanup;
+        }
+    } else if (ac > 0) {
         if (handle_arguments(sock, ac, av)) {
             goto cleanup;
         }
@@ -514,15 +2341,33 @@ int main(int ac, char **av)
 
 cleanup:
 
-    src_rcon_message_free(auth);
-    src_rcon_message_freev(authanswers);
+    if (expired >= 0) {
+        ec = phase_exit[expired];
+    }
+
+    if (metrics != NULL) {
+        metrics->state = metrics_state_disconnected;
+        metrics_dump(true);
+    }
+
+    /* Give the connection to the broker for the next rcon, unless a reply
+     * may still be on its way
+     */
+    if (sock > -1 && lease != NULL && ec == 0 && !nowait && pending == NULL &&
+        (response == NULL || response->len == 0)) {
+        if (lease_put(lease, host, port, password, sock) == 0 && debug) {
+            fprintf(stderr, "Gave connection to broker\n");
+        }
+    }
 
     if (sock > -1) {
+        report_fastopen(sock);
         close(sock);
     }
 
-    if (info) {
-        freeaddrinfo(info);
+    if (addresses) {
+        resolve_free_addresses(addresses);
+        addresses = NULL;
     }
 
     return ec;
@@ -0,0 +1,211 @@
+#include "metrics.h"
+#include "rcon.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+
+static double const buckets[METRICS_BUCKETS] = {
+    0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10
+};
+
+metrics_t *metrics_new(char const *server)
+{
+    metrics_t *tmp = NULL;
+
+    tmp = calloc(1, sizeof(metrics_t));
+    if (tmp == NULL) {
+        return NULL;
+    }
+
+    tmp->server = strdup(server);
+    if (tmp->server == NULL) {
+        free(tmp);
+        return NULL;
+    }
+
+    return tmp;
+}
+
+void metrics_free(metrics_t *m)
+{
+    return_if_true(m == NULL,);
+
+    free(m->server);
+    free(m);
+}
+
+void metrics_latency(metrics_t *m, double seconds)
+{
+    size_t i = 0;
+
+    return_if_true(m == NULL,);
+
+    for (i = 0; i < METRICS_BUCKETS && seconds > buckets[i]; i++)
+        ;
+
+    ++m->latency[i];
+    ++m->latency_count;
+    m->latency_sum += seconds;
+}
+
+static void metrics_label(FILE *f, char const *server, char const *le)
+{
+    char const *p = NULL;
+
+    fputs("{server=\"", f);
+    for (p = server; *p != '\0'; p++) {
+        switch (*p)
+        {
+        case '\\': fputs("\\\\", f); break;
+        case '"': fputs("\\\"", f); break;
+        case '\n': fputs("\\n", f); break;
+        default: fputc(*p, f); break;
+        }
+    }
+    fputc('"', f);
+
+    if (le != NULL) {
+        fprintf(f, ",le=\"%s\"", le);
+    }
+
+    fputc('}', f);
+}
+
+/* Writes one sample per server of the uint64_t at the given offset within
+ * metrics_t.
+ */
+static void metrics_series(FILE *f, metrics_t * const *m, size_t count,
+                           char const *name, char const *type,
+                           char const *help, size_t offset)
+{
+    size_t i = 0;
+
+    fprintf(f, "# HELP rcon_%s %s\n", name, help);
+    fprintf(f, "# TYPE rcon_%s %s\n", name, type);
+
+    for (i = 0; i < count; i++) {
+        uint8_t const *base = (uint8_t const *)m[i];
+
+        fprintf(f, "rcon_%s", name);
+        metrics_label(f, m[i]->server, NULL);
+        fprintf(f, " %llu\n",
+                (unsigned long long)*(uint64_t const *)(base + offset));
+    }
+}
+
+static void metrics_histogram(FILE *f, metrics_t * const *m, size_t count)
+{
+    char le[32];
+    size_t i = 0, b = 0;
+
+    fputs("# HELP rcon_command_latency_seconds Time from sending a command "
+          "until its reply was complete\n", f);
+    fputs("# TYPE rcon_command_latency_seconds histogram\n", f);
+
+    for (i = 0; i < count; i++) {
+        uint64_t total = 0;
+
+        for (b = 0; b <= METRICS_BUCKETS; b++) {
+            total += m[i]->latency[b];
+
+            if (b < METRICS_BUCKETS) {
+                snprintf(le, sizeof(le), "%g", buckets[b]);
+            } else {
+                strcpy(le, "+Inf");
+            }
+
+            fputs("rcon_command_latency_seconds_bucket", f);
+            metrics_label(f, m[i]->server, le);
+            fprintf(f, " %llu\n", (unsigned long long)total);
+        }
+
+        fputs("rcon_command_latency_seconds_sum", f);
+        metrics_label(f, m[i]->server, NULL);
+        fprintf(f, " %.6f\n", m[i]->latency_sum);
+
+        fputs("rcon_command_latency_seconds_count", f);
+        metrics_label(f, m[i]->server, NULL);
+        fprintf(f, " %llu\n", (unsigned long long)m[i]->latency_count);
+    }
+}
+
+int metrics_write(metrics_t * const *m, size_t count, char const *filename)
+{
+    char *tmp = NULL;
+    FILE *f = NULL;
+    size_t len = 0, i = 0;
+    int ret = 0;
+
+    return_if_true(m == NULL || filename == NULL, -1);
+
+    len = strlen(filename) + 32;
+    tmp = calloc(1, len);
+    if (tmp == NULL) {
+        return -1;
+    }
+    snprintf(tmp, len, "%s.%ld.tmp", filename, (long)getpid());
+
+    f = fopen(tmp, "w");
+    if (f == NULL) {
+        free(tmp);
+        return -1;
+    }
+
+    fputs("# HELP rcon_connection_state 0 disconnected, 1 connecting, "
+          "2 authenticating, 3 ready\n", f);
+    fputs("# TYPE rcon_connection_state gauge\n", f);
+    for (i = 0; i < count; i++) {
+        fputs("rcon_connection_state", f);
+        metrics_label(f, m[i]->server, NULL);
+        fprintf(f, " %d\n", (int)m[i]->state);
+    }
+
+    metrics_series(f, m, count, "commands_sent_total", "counter",
+                   "Commands sent to the server",
+                   offsetof(metrics_t, commands));
+    metrics_series(f, m, count, "frames_received_total", "counter",
+                   "Reply frames received from the server",
+                   offsetof(metrics_t, frames));
+    metrics_series(f, m, count, "received_bytes_total", "counter",
+                   "Bytes received from the server",
+                   offsetof(metrics_t, bytes_in));
+    metrics_series(f, m, count, "sent_bytes_total", "counter",
+                   "Bytes sent to the server",
+                   offsetof(metrics_t, bytes_out));
+    metrics_series(f, m, count, "auth_failures_total", "counter",
+                   "Failed authentication attempts",
+                   offsetof(metrics_t, auth_failures));
+    metrics_series(f, m, count, "reconnects_total", "counter",
+                   "Connections re-established after they were lost",
+                   offsetof(metrics_t, reconnects));
+    metrics_series(f, m, count, "timeouts_total", "counter",
+                   "Deadlines that passed",
+                   offsetof(metrics_t, timeouts));
+    metrics_series(f, m, count, "queued_commands", "gauge",
+                   "Commands waiting to be sent",
+                   offsetof(metrics_t, queued));
+
+    metrics_histogram(f, m, count);
+
+    if (ferror(f)) {
+        ret = -1;
+    }
+
+    if (fclose(f) || ret) {
+        unlink(tmp);
+        free(tmp);
+        return -1;
+    }
+
+    if (rename(tmp, filename)) {
+        unlink(tmp);
+        ret = -1;
+    }
+
+    free(tmp);
+
+    return ret;
+}
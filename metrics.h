@@ -0,0 +1,51 @@
+#ifndef RCON_METRICS_H
+#define RCON_METRICS_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef enum {
+    metrics_state_disconnected = 0,
+    metrics_state_connecting,
+    metrics_state_authenticating,
+    metrics_state_ready,
+} metrics_state_t;
+
+/* Upper bounds of the command latency histogram, in seconds
+ */
+#define METRICS_BUCKETS 13
+
+/* Counters of one server. The process is single threaded, so these are
+ * plain integers that are bumped directly on the hot path, and only read
+ * when written out.
+ */
+typedef struct {
+    char *server;
+    metrics_state_t state;
+
+    uint64_t commands;
+    uint64_t frames;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t auth_failures;
+    uint64_t reconnects;
+    uint64_t timeouts;
+    uint64_t queued;
+
+    uint64_t latency[METRICS_BUCKETS+1];
+    uint64_t latency_count;
+    double latency_sum;
+} metrics_t;
+
+metrics_t *metrics_new(char const *server);
+void metrics_free(metrics_t *m);
+
+void metrics_latency(metrics_t *m, double seconds);
+
+/* Writes the metrics of all given servers in the Prometheus text format,
+ * e.g. for the textfile collector of the node exporter. The file is
+ * replaced atomically.
+ */
+int metrics_write(metrics_t * const *m, size_t count, char const *filename);
+
+#endif
@@ -0,0 +1,1626 @@
+#include "rcon.h"
+#include "srcrcon.h"
+#include "config.h"
+#include "sockopt.h"
+#include "timers.h"
+#include "http.h"
+#include "route.h"
+
+#include <glib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+
+/* Seconds between attempts to connect to a server
+ */
+#define PROXY_RETRY 5
+/* Servers split replies into frames of this size, and take no larger
+ * requests
+ */
+#define PROXY_FRAGMENT 4096
+#define PROXY_BODY_MAX (PROXY_FRAGMENT - 10)
+/* Routes per server in use at the same time, by HTTP requests and RCON
+ * clients alike. With half of them free, a free one is found quickly.
+ */
+#define PROXY_PENDING (ROUTE_MAX / 2)
+/* Requests of one client in flight at the same time
+ */
+#define PROXY_INFLIGHT (PROXY_PENDING / 4)
+/* Bytes of requests queued for a server, or of replies for a client,
+ * before clients are no longer read from
+ */
+#define PROXY_QUEUED (1024 * 1024)
+/* Seconds an HTTP request waits for its reply before it is answered with
+ * 504, and for the frame after a full one from a Minecraft server
+ */
+#define PROXY_TIMEOUT 30
+#define PROXY_MINECRAFT_IDLE 1.0
+/* Requests read ahead on one HTTP connection
+ */
+#define PROXY_PIPELINE 128
+
+static char *config = NULL;
+static char *bindaddr = NULL;
+static char *password = NULL;
+static char *httpport = NULL;
+static bool debug = false;
+
+typedef struct _proxy_server proxy_server_t;
+typedef struct _proxy_http proxy_http_t;
+
+typedef struct {
+    int sock;
+    proxy_server_t *server;
+    bool authenticated;
+    bool closing;
+    /* Requests are left in the buffer, and no more are read, until there
+     * is room for them
+     */
+    bool waiting;
+    size_t inflight;
+    GByteArray *in;
+    GByteArray *out;
+} proxy_client_t;
+
+typedef enum {
+    upstream_down = 0,
+    upstream_connecting,
+    upstream_auth,
+    upstream_ready,
+} upstream_state_t;
+
+/* A request to the HTTP gateway. Responses are written in the order the
+ * requests came in, so a response is held back in out until those before
+ * it are done.
+ */
+typedef struct {
+    proxy_http_t *conn;
+    proxy_server_t *server;
+    int32_t id;
+    int32_t end;
+    bool chunked;
+    /* When the request is answered with 504, or 0 if it was not sent
+     */
+    double deadline;
+    bool started;
+    bool done;
+    /* The response ended early
+     */
+    bool cut;
+    GByteArray *out;
+} proxy_request_t;
+
+struct _proxy_http
+{
+    int sock;
+    bool closing;
+    /* No more requests are read, and the connection is closed once all
+     * responses are written
+     */
+    bool close;
+    /* Requests are left in the buffer until there is room for them
+     */
+    bool waiting;
+    GByteArray *in;
+    GByteArray *out;
+    GPtrArray *requests;
+};
+
+/* Where the reply to a forwarded request goes: back to an RCON client, or
+ * into the response of an HTTP request. The reply to the empty command
+ * that follows each HTTP request marks its end.
+ */
+typedef enum {
+    proxy_route_client = 0,
+    proxy_route_request,
+    proxy_route_end,
+} proxy_route_kind_t;
+
+struct _proxy_server
+{
+    char *name;
+    char *host;
+    char *port;
+    char *password;
+    bool minecraft;
+    sockopt_t sockopts;
+
+    /* -1 for servers that are only used through the HTTP gateway
+     */
+    int listener;
+    GPtrArray *clients;
+
+    int sock;
+    upstream_state_t state;
+    double retry;
+    struct addrinfo *addresses;
+    struct addrinfo *next;
+    src_rcon_message_t *auth;
+    GByteArray *in;
+    /* Requests are queued here until the server accepted our password
+     */
+    GByteArray *out;
+
+    route_table_t routes;
+};
+
+static src_rcon_t *r = NULL;
+static GPtrArray *servers = NULL;
+static int httplistener = -1;
+static GPtrArray *conns = NULL;
+
+static void usage(void)
+{
+    puts("");
+    puts("Usage:");
+    puts(" rcon-proxy [options] port=server...");
+    puts(" rcon-proxy [options] --http port port=server|server...");
+    puts("");
+    puts("Listens on each local port for RCON clients, and forwards their");
+    puts("commands over a single connection to the server from the");
+    puts("configuration file.");
+    puts("");
+    puts("With --http, commands can also be sent as HTTP requests:");
+    puts(" POST /servers/{name}/command");
+    puts("with the command as body, and the password as bearer token. The");
+    puts("reply is streamed back as the body of the response. Servers given");
+    puts("without a port are only reachable over HTTP.");
+    puts("");
+    puts("Options:");
+    puts(" -b, --bind      Listen on this address, 127.0.0.1 by default");
+    puts(" -c, --config    Alternate configuration file");
+    puts(" -d, --debug     Report connections on standard error");
+    puts(" -h, --help      This bogus");
+    puts(" -w, --http      Serve HTTP requests on this port");
+    puts(" -P, --password  Password clients must use, the server's own by");
+    puts("                 default");
+}
+
+static int parse_args(int ac, char **av)
+{
+    static struct option opts[] = {
+        { "bind", required_argument, 0, 'b' },
+        { "config", required_argument, 0, 'c' },
+        { "debug", no_argument, 0, 'd' },
+        { "help", no_argument, 0, 'h' },
+        { "http", required_argument, 0, 'w' },
+        { "password", required_argument, 0, 'P' },
+        { NULL, 0, 0, 0 }
+    };
+
+    static char const *optstr = "b:c:dhP:w:";
+
+    int c = 0;
+
+    while ((c = getopt_long(ac, av, optstr, opts, NULL)) != -1) {
+        switch (c)
+        {
+        case 'b': free(bindaddr); bindaddr = strdup(optarg); break;
+        case 'c': free(config); config = strdup(optarg); break;
+        case 'd': debug = true; break;
+        case 'P': free(password); password = strdup(optarg); break;
+        case 'w': free(httpport); httpport = strdup(optarg); break;
+        case 'h': usage(); exit(0); break;
+        default: /* intentional */
+        case '?': usage(); exit(1); break;
+        }
+    }
+
+    return 0;
+}
+
+static int32_t proxy_get32(uint8_t const *p)
+{
+    int32_t v = 0;
+
+    memcpy(&v, p, sizeof(v));
+
+    return v;
+}
+
+static int proxy_nonblock(int sock)
+{
+    int flags = fcntl(sock, F_GETFL);
+
+    if (flags < 0 || fcntl(sock, F_SETFL, flags | O_NONBLOCK) < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Writes as much as the socket takes
+ */
+static int proxy_flush(int sock, GByteArray *out)
+{
+    ssize_t ret = 0;
+
+    if (out->len == 0) {
+        return 0;
+    }
+
+    ret = write(sock, out->data, out->len);
+    if (ret < 0) {
+        return (errno == EAGAIN || errno == EINTR ? 0 : -1);
+    }
+    g_byte_array_remove_range(out, 0, ret);
+
+    return 0;
+}
+
+/* Reads what is there. Returns -1 if the connection is gone.
+ */
+static int proxy_fill(int sock, GByteArray *in)
+{
+    uint8_t tmp[4096];
+    ssize_t ret = 0;
+
+    ret = read(sock, tmp, sizeof(tmp));
+    if (ret < 0) {
+        return (errno == EAGAIN || errno == EINTR ? 0 : -1);
+    } else if (ret == 0) {
+        return -1;
+    }
+    g_byte_array_append(in, tmp, ret);
+
+    return 0;
+}
+
+/* A frame with an empty body
+ */
+static void proxy_frame(GByteArray *out, int32_t id, int32_t type)
+{
+    int32_t size = 10;
+    uint8_t nul[2] = {0, 0};
+
+    g_byte_array_append(out, (uint8_t const *)&size, sizeof(size));
+    g_byte_array_append(out, (uint8_t const *)&id, sizeof(id));
+    g_byte_array_append(out, (uint8_t const *)&type, sizeof(type));
+    g_byte_array_append(out, nul, sizeof(nul));
+}
+
+/* Replies that still come for the route are dropped from now on
+ */
+static void proxy_route_release(proxy_server_t *s, route_t *route)
+{
+    if (route->owner != NULL && route->kind == proxy_route_client) {
+        --((proxy_client_t *)route->owner)->inflight;
+    }
+    route_release(&s->routes, route);
+}
+
+static void proxy_client_free(proxy_client_t *c)
+{
+    return_if_true(c == NULL,);
+
+    if (c->sock > -1) {
+        close(c->sock);
+    }
+    g_byte_array_free(c->in, TRUE);
+    g_byte_array_free(c->out, TRUE);
+    free(c);
+}
+
+/* The request gives back the routes it holds. Replies may still come, but
+ * there is nowhere to put them.
+ */
+static void proxy_request_settle(proxy_request_t *req)
+{
+    route_t *route = NULL;
+
+    return_if_true(req->server == NULL,);
+
+    route = route_find(&req->server->routes, req->id);
+    if (route != NULL && route->owner == req) {
+        proxy_route_release(req->server, route);
+    }
+    route = route_find(&req->server->routes, req->end);
+    if (route != NULL && route->owner == req) {
+        proxy_route_release(req->server, route);
+    }
+    req->deadline = 0;
+}
+
+static void proxy_request_free(proxy_request_t *req)
+{
+    return_if_true(req == NULL,);
+
+    proxy_request_settle(req);
+    g_byte_array_free(req->out, TRUE);
+    free(req);
+}
+
+static void proxy_request_finish(proxy_request_t *req)
+{
+    if (!req->started) {
+        http_start(req->out, req->chunked, req->conn->close);
+        req->started = true;
+    }
+    http_finish(req->out, req->chunked);
+    req->done = true;
+    proxy_request_settle(req);
+}
+
+/* Answers with an error if nothing was sent yet. Otherwise the response
+ * can only be cut short by closing the connection.
+ */
+static void proxy_request_fail(proxy_request_t *req, int status,
+                               char const *body)
+{
+    return_if_true(req->done,);
+
+    if (!req->started) {
+        http_respond(req->out, status, body, req->conn->close);
+        req->started = true;
+    } else {
+        req->cut = true;
+        req->conn->close = true;
+    }
+    req->done = true;
+    proxy_request_settle(req);
+}
+
+/* Streams the body of each reply as one chunk. Source servers answer the
+ * empty command after the real one, once all of the reply was sent, and a
+ * Minecraft reply ends with the first frame that is not full.
+ */
+static void proxy_request_reply(proxy_request_t *req, uint8_t const *frame,
+                                bool end)
+{
+    size_t len = proxy_get32(frame) - 10;
+
+    return_if_true(req->done,);
+
+    if (end) {
+        proxy_request_finish(req);
+        return;
+    }
+
+    if (!req->started) {
+        http_start(req->out, req->chunked, req->conn->close);
+        req->started = true;
+    }
+    http_chunk(req->out, frame + 12, strnlen((char const *)frame + 12, len),
+               req->chunked);
+
+    if (req->server->minecraft && len < PROXY_FRAGMENT) {
+        proxy_request_finish(req);
+    } else if (req->server->minecraft) {
+        req->deadline = timers_now() + PROXY_MINECRAFT_IDLE;
+    }
+}
+
+/* Servers answer in order, so the routes of everything sent before id are
+ * given back, and HTTP requests among them are done
+ */
+static void proxy_settle(proxy_server_t *s, int32_t id)
+{
+    route_t *route = NULL;
+
+    while ((route = route_settled(&s->routes, id)) != NULL) {
+        if (route->kind != proxy_route_client) {
+            proxy_request_finish(route->owner);
+        }
+        proxy_route_release(s, route);
+    }
+}
+
+/* Closes the clients that are done, and forgets their routes
+ */
+static void proxy_reap(proxy_server_t *s)
+{
+    guint i = 0;
+    size_t k = 0;
+
+    for (i = 0; i < s->clients->len; ) {
+        proxy_client_t *c = g_ptr_array_index(s->clients, i);
+
+        if (!c->closing) {
+            ++i;
+            continue;
+        }
+
+        for (k = 0; k < ROUTE_MAX; k++) {
+            route_t *route = &s->routes.routes[k];
+
+            if (route->owner == c && route->kind == proxy_route_client) {
+                proxy_route_release(s, route);
+            }
+        }
+
+        if (debug) {
+            fprintf(stderr, "%s: client left\n", s->name);
+        }
+
+        proxy_client_free(c);
+        g_ptr_array_remove_index(s->clients, i);
+    }
+}
+
+static void proxy_upstream_down(proxy_server_t *s, char const *why)
+{
+    guint i = 0;
+
+    if (why != NULL) {
+        fprintf(stderr, "%s: %s\n", s->name, why);
+    }
+
+    if (s->sock > -1) {
+        close(s->sock);
+        s->sock = -1;
+    }
+
+    if (s->addresses != NULL) {
+        freeaddrinfo(s->addresses);
+        s->addresses = NULL;
+        s->next = NULL;
+    }
+
+    src_rcon_message_free(s->auth);
+    s->auth = NULL;
+
+    g_byte_array_set_size(s->in, 0);
+    g_byte_array_set_size(s->out, 0);
+
+    s->state = upstream_down;
+    s->retry = timers_now() + PROXY_RETRY;
+
+    /* Their replies are lost, so they better find out
+     */
+    for (i = 0; i < s->clients->len; i++) {
+        proxy_client_t *c = g_ptr_array_index(s->clients, i);
+
+        c->closing = true;
+    }
+
+    for (i = 0; i < ROUTE_MAX; i++) {
+        route_t *route = &s->routes.routes[i];
+
+        if (route->owner != NULL && route->kind != proxy_route_client) {
+            proxy_request_fail(route->owner, 502,
+                               "Connection to server lost\n");
+        }
+    }
+    route_reset(&s->routes);
+}
+
+/* Tries the remaining addresses until one connects, or is in progress
+ */
+static void proxy_upstream_next(proxy_server_t *s)
+{
+    for (; s->next != NULL; s->next = s->next->ai_next) {
+        struct addrinfo const *ai = s->next;
+
+        s->sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (s->sock < 0) {
+            continue;
+        }
+
+        sockopt_apply(s->sock, &s->sockopts);
+
+        if (proxy_nonblock(s->sock) == 0 &&
+            (connect(s->sock, ai->ai_addr, ai->ai_addrlen) == 0 ||
+             errno == EINPROGRESS)) {
+            s->next = ai->ai_next;
+            s->state = upstream_connecting;
+            return;
+        }
+
+        close(s->sock);
+        s->sock = -1;
+    }
+
+    proxy_upstream_down(s, "failed to connect");
+}
+
+static void proxy_upstream_connect(proxy_server_t *s)
+{
+    struct addrinfo hint = {0};
+    int ret = 0;
+
+    hint.ai_socktype = SOCK_STREAM;
+    hint.ai_family = AF_UNSPEC;
+
+    if ((ret = getaddrinfo(s->host, s->port, &hint, &s->addresses))) {
+        fprintf(stderr, "%s: failed to resolve host: %s\n", s->name,
+                gai_strerror(ret));
+        s->retry = timers_now() + PROXY_RETRY;
+        return;
+    }
+
+    s->next = s->addresses;
+    proxy_upstream_next(s);
+}
+
+/* The connection is up, so send the password first
+ */
+static void proxy_upstream_connected(proxy_server_t *s)
+{
+    uint8_t *data = NULL;
+    size_t size = 0;
+
+    if (s->password == NULL || strlen(s->password) == 0) {
+        s->state = upstream_ready;
+        fprintf(stderr, "%s: connected\n", s->name);
+        return;
+    }
+
+    s->auth = src_rcon_auth(r, s->password);
+    if (s->auth == NULL || src_rcon_serialize(r, s->auth, &data, &size)) {
+        free(data);
+        proxy_upstream_down(s, "out of memory");
+        return;
+    }
+
+    /* Queued requests wait until the password was accepted. A fresh
+     * connection always has room for it.
+     */
+    if (write(s->sock, data, size) != (ssize_t)size) {
+        free(data);
+        proxy_upstream_down(s, "failed to send password");
+        return;
+    }
+    free(data);
+
+    s->state = upstream_auth;
+}
+
+static void proxy_upstream_auth(proxy_server_t *s)
+{
+    rcon_error_t status;
+    size_t off = 0;
+
+    status = src_rcon_auth_wait(r, s->auth, &off, s->in->data, s->in->len);
+    if (status == rcon_error_moredata) {
+        return;
+    } else if (status != rcon_error_success) {
+        proxy_upstream_down(s, "invalid password");
+        return;
+    }
+
+    g_byte_array_remove_range(s->in, 0, off);
+    src_rcon_message_free(s->auth);
+    s->auth = NULL;
+    s->state = upstream_ready;
+
+    fprintf(stderr, "%s: connected\n", s->name);
+}
+
+/* Hands each reply to the client that sent the request, with its own id
+ * put back. Replies nobody waits for anymore are dropped.
+ */
+static void proxy_upstream_replies(proxy_server_t *s)
+{
+    ssize_t count = 0, i = 0;
+    size_t end = 0, o = 0;
+
+    count = src_rcon_scan(s->in->data, s->in->len, NULL, 0, &end);
+    if (count < 0) {
+        proxy_upstream_down(s, "invalid reply from server");
+        return;
+    }
+
+    for (i = 0; i < count; i++) {
+        uint8_t *frame = s->in->data + o;
+        size_t len = sizeof(int32_t) + proxy_get32(frame);
+        route_t *route = NULL;
+
+        proxy_settle(s, proxy_get32(frame + 4));
+        route = route_reply(&s->routes, frame);
+
+        if (route == NULL) {
+            /* Nobody waits for it anymore
+             */
+        } else if (route->kind == proxy_route_client) {
+            proxy_client_t *c = route->owner;
+
+            if (!c->closing) {
+                g_byte_array_append(c->out, frame, len);
+            }
+        } else {
+            proxy_request_reply(route->owner, frame,
+                                route->kind == proxy_route_end);
+        }
+
+        o += len;
+    }
+
+    g_byte_array_remove_range(s->in, 0, end);
+}
+
+/* Compares in the same time however early the given one differs
+ */
+static bool proxy_password_equal(char const *given, char const *expected)
+{
+    size_t len = strlen(expected), have = strlen(given), i = 0;
+    uint8_t diff = (have != len);
+
+    for (i = 0; i < len; i++) {
+        diff |= (uint8_t)((i < have ? given[i] : 0) ^ expected[i]);
+    }
+
+    return (diff == 0);
+}
+
+/* Checks the password locally, and answers as a Source server would: an
+ * empty value, and then the auth response with the id, or -1.
+ */
+static void proxy_client_auth(proxy_client_t *c, uint8_t const *frame)
+{
+    char const *expected = (password != NULL ? password : c->server->password);
+    char const *given = (char const *)frame + 12;
+    int32_t id = proxy_get32(frame + 4);
+
+    c->authenticated = (expected == NULL ||
+                        proxy_password_equal(given, expected));
+
+    proxy_frame(c->out, id, serverdata_value);
+    proxy_frame(c->out, (c->authenticated ? id : -1),
+                serverdata_auth_response);
+
+    if (!c->authenticated && debug) {
+        fprintf(stderr, "%s: client used a wrong password\n",
+                c->server->name);
+    }
+}
+
+/* Requests of a client wait while too many of its own are in flight,
+ * while the server has no routes to spare, or while requests or replies
+ * pile up unsent
+ */
+static bool proxy_client_full(proxy_client_t const *c)
+{
+    proxy_server_t const *s = c->server;
+
+    return (c->inflight >= PROXY_INFLIGHT ||
+            s->routes.pending >= PROXY_PENDING ||
+            s->out->len >= PROXY_QUEUED || c->out->len >= PROXY_QUEUED);
+}
+
+/* Forwards the request with an id of our own, so that requests of
+ * different clients cannot be mistaken for each other. Only the id is
+ * changed, the frame is passed on as it came. Returns -1 if the request
+ * has to wait.
+ */
+static int proxy_client_request(proxy_client_t *c, uint8_t *frame,
+                                size_t len)
+{
+    route_t *route = NULL;
+
+    return_if_true(proxy_client_full(c), -1);
+
+    route = route_request(&c->server->routes, c, proxy_route_client, frame);
+    return_if_true(route == NULL, -1);
+
+    ++c->inflight;
+    g_byte_array_append(c->server->out, frame, len);
+
+    return 0;
+}
+
+/* Handles the frames of the client, up to the first request that has to
+ * wait. Everything but the password goes to the server, so the empty
+ * value that clients send behind a command to find the end of its reply
+ * comes back to them as well.
+ */
+static void proxy_client_frames(proxy_client_t *c)
+{
+    ssize_t count = 0, i = 0;
+    size_t end = 0, o = 0;
+
+    c->waiting = false;
+
+    count = src_rcon_scan(c->in->data, c->in->len, NULL, 0, &end);
+    if (count < 0) {
+        c->closing = true;
+        return;
+    }
+
+    for (i = 0; i < count && !c->closing; i++) {
+        uint8_t *frame = c->in->data + o;
+        size_t len = sizeof(int32_t) + proxy_get32(frame);
+        int32_t type = proxy_get32(frame + 8);
+
+        if (type == serverdata_auth) {
+            proxy_client_auth(c, frame);
+        } else if (!c->authenticated) {
+            /* Servers drop clients that skip the password
+             */
+            c->closing = true;
+        } else if (proxy_client_request(c, frame, len)) {
+            c->waiting = true;
+            break;
+        }
+
+        o += len;
+    }
+
+    g_byte_array_remove_range(c->in, 0, o);
+}
+
+static void proxy_accept(proxy_server_t *s)
+{
+    proxy_client_t *c = NULL;
+    int sock = -1;
+
+    sock = accept(s->listener, NULL, NULL);
+    if (sock < 0) {
+        return;
+    }
+
+    c = calloc(1, sizeof(proxy_client_t));
+    if (c == NULL || proxy_nonblock(sock)) {
+        free(c);
+        close(sock);
+        return;
+    }
+
+    c->sock = sock;
+    c->server = s;
+    c->in = g_byte_array_new();
+    c->out = g_byte_array_new();
+    g_ptr_array_add(s->clients, c);
+
+    if (debug) {
+        fprintf(stderr, "%s: client connected\n", s->name);
+    }
+}
+
+static int proxy_listen(char const *port)
+{
+    struct addrinfo hint = {0}, *addresses = NULL, *ai = NULL;
+    int on = 1, ret = 0, sock = -1;
+
+    hint.ai_socktype = SOCK_STREAM;
+    hint.ai_family = AF_UNSPEC;
+    hint.ai_flags = AI_PASSIVE;
+
+    if ((ret = getaddrinfo(bindaddr, port, &hint, &addresses))) {
+        fprintf(stderr, "Failed to resolve %s: %s\n",
+                (bindaddr != NULL ? bindaddr : port), gai_strerror(ret));
+        return -1;
+    }
+
+    for (ai = addresses; ai != NULL; ai = ai->ai_next) {
+        sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (sock < 0) {
+            continue;
+        }
+
+        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+        if (bind(sock, ai->ai_addr, ai->ai_addrlen) == 0 &&
+            listen(sock, SOMAXCONN) == 0 &&
+            proxy_nonblock(sock) == 0) {
+            break;
+        }
+
+        close(sock);
+        sock = -1;
+    }
+
+    freeaddrinfo(addresses);
+
+    if (sock < 0) {
+        fprintf(stderr, "Failed to listen on port %s: %s\n", port,
+                strerror(errno));
+    }
+
+    return sock;
+}
+
+static void proxy_server_free(proxy_server_t *s)
+{
+    guint i = 0;
+
+    return_if_true(s == NULL,);
+
+    if (s->clients != NULL) {
+        for (i = 0; i < s->clients->len; i++) {
+            proxy_client_free(g_ptr_array_index(s->clients, i));
+        }
+        g_ptr_array_free(s->clients, TRUE);
+    }
+
+    if (s->sock > -1) {
+        close(s->sock);
+    }
+    if (s->listener > -1) {
+        close(s->listener);
+    }
+    if (s->addresses != NULL) {
+        freeaddrinfo(s->addresses);
+    }
+    src_rcon_message_free(s->auth);
+
+    if (s->in != NULL) {
+        g_byte_array_free(s->in, TRUE);
+    }
+    if (s->out != NULL) {
+        g_byte_array_free(s->out, TRUE);
+    }
+
+    free(s->name);
+    free(s->host);
+    free(s->port);
+    free(s->password);
+    free(s);
+}
+
+static proxy_server_t *proxy_server_new(char const *name)
+{
+    proxy_server_t *tmp = NULL;
+
+    tmp = calloc(1, sizeof(proxy_server_t));
+    if (tmp == NULL) {
+        return NULL;
+    }
+
+    tmp->sock = -1;
+    tmp->listener = -1;
+    route_init(&tmp->routes);
+    tmp->name = strdup(name);
+    tmp->clients = g_ptr_array_new();
+    tmp->in = g_byte_array_new();
+    tmp->out = g_byte_array_new();
+    sockopt_init(&tmp->sockopts);
+
+    /* Minecraft servers speak the same protocol, and replies are routed
+     * by id either way. Only the end of a reply has to be found
+     * differently.
+     */
+    if (config_host_data(name, &tmp->host, &tmp->port, &tmp->password,
+                         &tmp->minecraft)) {
+        proxy_server_free(tmp);
+        return NULL;
+    }
+    config_host_sockopts(name, &tmp->sockopts);
+
+    return tmp;
+}
+
+/* A "port=server" argument, or with --http just "server", which is then
+ * only reachable over HTTP
+ */
+static proxy_server_t *proxy_server_listen(char const *arg)
+{
+    proxy_server_t *tmp = NULL;
+    char *port = NULL, *name = NULL;
+
+    port = strdup(arg);
+    if (port == NULL) {
+        return NULL;
+    }
+
+    name = strchr(port, '=');
+    if (name == NULL && httpport != NULL && port[0] != '\0') {
+        name = port;
+        port = NULL;
+    } else if (name == NULL || name[1] == '\0') {
+        fprintf(stderr, "Expected port=server: %s\n", arg);
+        goto cleanup;
+    } else {
+        *name++ = '\0';
+    }
+
+    tmp = proxy_server_new(name);
+    if (tmp == NULL) {
+        fprintf(stderr, "Server %s not found in configuration\n", name);
+        goto cleanup;
+    }
+
+    if (port != NULL) {
+        tmp->listener = proxy_listen(port);
+        if (tmp->listener < 0) {
+            goto cleanup;
+        }
+    }
+
+    free(port != NULL ? port : name);
+
+    return tmp;
+
+cleanup:
+
+    proxy_server_free(tmp);
+    free(port != NULL ? port : name);
+
+    return NULL;
+}
+
+/* The server of that name, if it was given on the command line. Others
+ * from the configuration file are never connected to.
+ */
+static proxy_server_t *proxy_server_find(char const *name)
+{
+    proxy_server_t *s = NULL;
+    guint i = 0;
+
+    for (i = 0; i < servers->len; i++) {
+        s = g_ptr_array_index(servers, i);
+        if (strcmp(s->name, name) == 0) {
+            return s;
+        }
+    }
+
+    return NULL;
+}
+
+static void proxy_http_free(proxy_http_t *conn)
+{
+    guint i = 0;
+
+    return_if_true(conn == NULL,);
+
+    for (i = 0; i < conn->requests->len; i++) {
+        proxy_request_free(g_ptr_array_index(conn->requests, i));
+    }
+    g_ptr_array_free(conn->requests, TRUE);
+
+    if (conn->sock > -1) {
+        close(conn->sock);
+    }
+    g_byte_array_free(conn->in, TRUE);
+    g_byte_array_free(conn->out, TRUE);
+    free(conn);
+}
+
+static void proxy_http_reap(void)
+{
+    guint i = 0;
+
+    for (i = 0; i < conns->len; ) {
+        proxy_http_t *conn = g_ptr_array_index(conns, i);
+
+        if (!conn->closing) {
+            ++i;
+            continue;
+        }
+
+        proxy_http_free(conn);
+        g_ptr_array_remove_index(conns, i);
+    }
+}
+
+/* Moves the responses that are next in line to the connection. Once a
+ * response was cut short, the ones after it cannot be told apart anymore,
+ * so the connection has to go.
+ */
+static void proxy_http_pump(proxy_http_t *conn)
+{
+    while (conn->requests->len > 0) {
+        proxy_request_t *req = g_ptr_array_index(conn->requests, 0);
+
+        g_byte_array_append(conn->out, req->out->data, req->out->len);
+        g_byte_array_set_size(req->out, 0);
+
+        if (!req->done) {
+            break;
+        }
+
+        g_ptr_array_remove_index(conn->requests, 0);
+
+        if (req->cut) {
+            while (conn->requests->len > 0) {
+                proxy_request_free(g_ptr_array_index(conn->requests, 0));
+                g_ptr_array_remove_index(conn->requests, 0);
+            }
+        }
+        proxy_request_free(req);
+    }
+}
+
+/* Answers the requests whose reply did not come in time, and gives back
+ * their routes. A Minecraft reply that ended with a full frame has no
+ * other end. Sets wake to the next deadline.
+ */
+static void proxy_http_expire(proxy_http_t *conn, double now, double *wake)
+{
+    guint i = 0;
+
+    for (i = 0; i < conn->requests->len; i++) {
+        proxy_request_t *req = g_ptr_array_index(conn->requests, i);
+
+        if (req->done || req->deadline == 0) {
+            continue;
+        }
+
+        if (req->deadline > now) {
+            if (*wake == 0 || req->deadline < *wake) {
+                *wake = req->deadline;
+            }
+        } else if (req->server->minecraft && req->started) {
+            proxy_request_finish(req);
+        } else {
+            proxy_request_fail(req, 504, "No reply from server\n");
+        }
+    }
+}
+
+/* Sends the command, followed by an empty one whose reply marks the end
+ */
+static void proxy_http_command(proxy_request_t *req, char const *body,
+                               size_t len)
+{
+    src_rcon_message_t *msg = NULL;
+    proxy_server_t *s = req->server;
+    route_t *route = NULL;
+    uint8_t *data = NULL;
+    size_t size = 0;
+    char *cmd = NULL;
+    int i = 0;
+
+    cmd = g_strndup(body, len);
+    req->deadline = timers_now() + PROXY_TIMEOUT;
+
+    for (i = 0; i < (s->minecraft ? 1 : 2); i++) {
+        route = route_take(&s->routes, req,
+                           (i == 0 ? proxy_route_request : proxy_route_end));
+        if (route == NULL) {
+            proxy_request_fail(req, 503, "Too many requests\n");
+            break;
+        }
+
+        msg = src_rcon_command(r, (i == 0 ? cmd : ""));
+        if (msg == NULL) {
+            proxy_route_release(s, route);
+            proxy_request_fail(req, 500, "Out of memory\n");
+            break;
+        }
+
+        msg->id = route->id;
+        if (i == 0) {
+            req->id = route->id;
+        } else {
+            req->end = route->id;
+        }
+
+        if (src_rcon_serialize(r, msg, &data, &size) == rcon_error_success) {
+            g_byte_array_append(s->out, data, size);
+        }
+        free(data);
+        data = NULL;
+        src_rcon_message_free(msg);
+    }
+
+    g_free(cmd);
+}
+
+/* The server in a "/servers/{name}/command" path
+ */
+static char *proxy_http_server(char const *path)
+{
+    char const *suffix = NULL;
+    size_t len = strlen(path);
+
+    return_if_true(strncmp(path, "/servers/", 9) != 0, NULL);
+    return_if_true(len <= 9 + 8, NULL);
+
+    suffix = path + len - 8;
+    return_if_true(strcmp(suffix, "/command") != 0, NULL);
+    return_if_true(memchr(path + 9, '/', suffix - path - 9) != NULL, NULL);
+
+    return g_strndup(path + 9, suffix - path - 9);
+}
+
+/* Every request carries a bearer token, which is the password RCON
+ * clients would use: the one given with -P, or that of the server. Without
+ * either, no request is let through.
+ */
+static bool proxy_http_authorized(http_request_t const *h,
+                                  proxy_server_t const *s)
+{
+    char const *expected = password;
+
+    if (expected == NULL && s != NULL) {
+        expected = s->password;
+    }
+
+    return (expected != NULL && expected[0] != '\0' && h->token != NULL &&
+            proxy_password_equal(h->token, expected));
+}
+
+static void proxy_http_dispatch(proxy_http_t *conn, http_request_t const *h,
+                                bool found, proxy_server_t *s,
+                                char const *body)
+{
+    proxy_request_t *req = NULL;
+
+    req = calloc(1, sizeof(proxy_request_t));
+    if (req == NULL) {
+        conn->closing = true;
+        return;
+    }
+
+    req->conn = conn;
+    req->out = g_byte_array_new();
+    /* HTTP/1.0 clients read the body until the connection closes
+     */
+    req->chunked = (h->minor > 0);
+    g_ptr_array_add(conn->requests, req);
+
+    if (!req->chunked) {
+        conn->close = true;
+    }
+
+    if (!found) {
+        proxy_request_fail(req, 404, "Not found\n");
+    } else if (h->token == NULL ||
+               ((password != NULL || s != NULL) &&
+                !proxy_http_authorized(h, s))) {
+        proxy_request_fail(req, 401, "Send the password as bearer token\n");
+    } else if (strcmp(h->method, "POST") != 0) {
+        proxy_request_fail(req, 405, "Use POST to send a command\n");
+    } else if (s == NULL) {
+        proxy_request_fail(req, 404, "Server not served by this proxy\n");
+    } else if (s->state == upstream_down) {
+        proxy_request_fail(req, 503, "Server not connected\n");
+    } else {
+        req->server = s;
+        proxy_http_command(req, body, h->length);
+    }
+}
+
+/* Answers a request that cannot be read past
+ */
+static void proxy_http_refuse(proxy_http_t *conn, int status,
+                              char const *body)
+{
+    proxy_request_t *req = calloc(1, sizeof(proxy_request_t));
+
+    conn->close = true;
+    if (req == NULL) {
+        conn->closing = true;
+        return;
+    }
+
+    req->conn = conn;
+    req->out = g_byte_array_new();
+    g_ptr_array_add(conn->requests, req);
+    proxy_request_fail(req, status, body);
+}
+
+static void proxy_http_requests(proxy_http_t *conn)
+{
+    proxy_server_t *s = NULL;
+    http_request_t h;
+    ssize_t head = 0;
+    char *name = NULL;
+
+    conn->waiting = false;
+
+    while (!conn->close && conn->in->len > 0) {
+        if (conn->requests->len >= PROXY_PIPELINE) {
+            conn->waiting = true;
+            break;
+        }
+
+        head = http_parse(conn->in->data, conn->in->len, &h);
+        if (head == 0) {
+            break;
+        } else if (head < 0) {
+            proxy_http_refuse(conn, 400, "Malformed request\n");
+            break;
+        } else if (h.encoded) {
+            proxy_http_refuse(conn, 501, "Send the command as it is\n");
+            http_request_clear(&h);
+            break;
+        } else if (h.length > PROXY_BODY_MAX) {
+            proxy_http_refuse(conn, 413, "Command too long\n");
+            http_request_clear(&h);
+            break;
+        } else if (conn->in->len < head + h.length) {
+            http_request_clear(&h);
+            break;
+        }
+
+        name = proxy_http_server(h.path);
+        s = NULL;
+        if (name != NULL) {
+            s = proxy_server_find(name);
+        }
+
+        if (s != NULL && strcmp(h.method, "POST") == 0 &&
+            proxy_http_authorized(&h, s) &&
+            (s->routes.pending + 2 > PROXY_PENDING ||
+                          s->out->len >= PROXY_QUEUED)) {
+            conn->waiting = true;
+            g_free(name);
+            http_request_clear(&h);
+            break;
+        }
+
+        if (h.close) {
+            conn->close = true;
+        }
+        proxy_http_dispatch(conn, &h, (name != NULL), s,
+                            (char const *)conn->in->data + head);
+        g_byte_array_remove_range(conn->in, 0, head + h.length);
+        g_free(name);
+        http_request_clear(&h);
+    }
+
+    if (conn->close) {
+        g_byte_array_set_size(conn->in, 0);
+    }
+}
+
+static void proxy_http_accept(void)
+{
+    proxy_http_t *conn = NULL;
+    sockopt_t opts;
+    int sock = -1;
+
+    sock = accept(httplistener, NULL, NULL);
+    if (sock < 0) {
+        return;
+    }
+
+    conn = calloc(1, sizeof(proxy_http_t));
+    if (conn == NULL || proxy_nonblock(sock)) {
+        free(conn);
+        close(sock);
+        return;
+    }
+
+    /* Chunks go out as the replies come in
+     */
+    sockopt_init(&opts);
+    sockopt_apply(sock, &opts);
+
+    conn->sock = sock;
+    conn->in = g_byte_array_new();
+    conn->out = g_byte_array_new();
+    conn->requests = g_ptr_array_new();
+    g_ptr_array_add(conns, conn);
+}
+
+static int proxy_run(void)
+{
+    GArray *pfds = g_array_new(FALSE, TRUE, sizeof(struct pollfd));
+    guint i = 0, j = 0, k = 0, polled = 0;
+    int ec = -1;
+
+    for (;;) {
+        double now = timers_now(), wake = 0;
+        int timeout = -1;
+
+        g_array_set_size(pfds, 0);
+        proxy_http_reap();
+
+        for (j = 0; conns != NULL && j < conns->len; j++) {
+            proxy_http_t *conn = g_ptr_array_index(conns, j);
+
+            proxy_http_expire(conn, now, &wake);
+            proxy_http_pump(conn);
+        }
+
+        /* Poll each listener, its upstream connection, and its clients in
+         * that order, so the results can be matched up the same way.
+         */
+        for (i = 0; i < servers->len; i++) {
+            proxy_server_t *s = g_ptr_array_index(servers, i);
+            struct pollfd p = {0};
+
+            if (s->state == upstream_down && now >= s->retry) {
+                proxy_upstream_connect(s);
+            }
+            proxy_reap(s);
+
+            /* Clients that had to wait go on once there is room again
+             */
+            for (j = 0; j < s->clients->len; j++) {
+                proxy_client_t *c = g_ptr_array_index(s->clients, j);
+
+                if (c->waiting && !c->closing && !proxy_client_full(c)) {
+                    proxy_client_frames(c);
+                }
+            }
+
+            if (s->state == upstream_down &&
+                (wake == 0 || s->retry < wake)) {
+                wake = s->retry;
+            }
+
+            p.fd = s->listener;
+            p.events = (s->listener > -1 ? POLLIN : 0);
+            g_array_append_val(pfds, p);
+
+            p.fd = s->sock;
+            p.events = 0;
+            if (s->state == upstream_connecting ||
+                (s->state == upstream_ready && s->out->len > 0)) {
+                p.events |= POLLOUT;
+            }
+            if (s->state == upstream_auth || s->state == upstream_ready) {
+                p.events |= POLLIN;
+            }
+            g_array_append_val(pfds, p);
+
+            for (j = 0; j < s->clients->len; j++) {
+                proxy_client_t *c = g_ptr_array_index(s->clients, j);
+
+                p.fd = c->sock;
+                p.events = (c->waiting ? 0 : POLLIN) |
+                    (c->out->len > 0 ? POLLOUT : 0);
+                g_array_append_val(pfds, p);
+            }
+        }
+
+        /* And then the HTTP gateway
+         */
+        polled = servers->len;
+        if (httplistener > -1) {
+            struct pollfd p = {0};
+
+            p.fd = httplistener;
+            p.events = POLLIN;
+            g_array_append_val(pfds, p);
+
+            for (j = 0; j < conns->len; j++) {
+                proxy_http_t *conn = g_ptr_array_index(conns, j);
+
+                p.fd = conn->sock;
+                p.events = (conn->close || conn->waiting ? 0 : POLLIN) |
+                    (conn->out->len > 0 ? POLLOUT : 0);
+                g_array_append_val(pfds, p);
+            }
+        }
+
+        if (wake > 0) {
+            timeout = (int)((wake - now) * 1000) + 1;
+            if (timeout < 0) {
+                timeout = 0;
+            }
+        }
+
+        if (poll((struct pollfd*)pfds->data, pfds->len, timeout) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            goto cleanup;
+        }
+
+        /* HTTP requests first, so they too go out with this round of
+         * writes
+         */
+        for (i = 0, k = 0; i < polled; i++) {
+            proxy_server_t *s = g_ptr_array_index(servers, i);
+
+            k += 2 + s->clients->len;
+        }
+        if (httplistener > -1) {
+            struct pollfd *listener = &g_array_index(pfds, struct pollfd, k++);
+            guint count = conns->len;
+
+            for (j = 0; j < count; j++) {
+                proxy_http_t *conn = g_ptr_array_index(conns, j);
+                struct pollfd *p = &g_array_index(pfds, struct pollfd, k++);
+
+                if ((p->revents & (POLLIN | POLLERR | POLLHUP)) &&
+                    !conn->close && !conn->waiting) {
+                    if (proxy_fill(conn->sock, conn->in)) {
+                        conn->closing = true;
+                    } else {
+                        proxy_http_requests(conn);
+                    }
+                } else if (p->revents & (POLLERR | POLLHUP)) {
+                    conn->closing = true;
+                }
+            }
+
+            if (listener->revents & POLLIN) {
+                proxy_http_accept();
+            }
+        }
+
+        for (i = 0, k = 0; i < polled; i++) {
+            proxy_server_t *s = g_ptr_array_index(servers, i);
+            struct pollfd *listener = &g_array_index(pfds, struct pollfd, k++);
+            struct pollfd *upstream = &g_array_index(pfds, struct pollfd, k++);
+            guint clients = s->clients->len;
+
+            /* Requests first, so they go out with this round of writes
+             */
+            for (j = 0; j < clients; j++) {
+                proxy_client_t *c = g_ptr_array_index(s->clients, j);
+                struct pollfd *p = &g_array_index(pfds, struct pollfd, k++);
+
+                if (p->revents & (POLLIN | POLLERR | POLLHUP)) {
+                    if (proxy_fill(c->sock, c->in)) {
+                        c->closing = true;
+                    } else {
+                        proxy_client_frames(c);
+                    }
+                }
+            }
+
+            if (upstream->revents != 0 && s->state == upstream_connecting) {
+                int error = 0;
+                socklen_t len = sizeof(error);
+
+                if (getsockopt(s->sock, SOL_SOCKET, SO_ERROR, &error,
+                               &len) < 0 || error != 0) {
+                    close(s->sock);
+                    s->sock = -1;
+                    proxy_upstream_next(s);
+                } else {
+                    proxy_upstream_connected(s);
+                }
+            } else if (upstream->revents != 0) {
+                if ((upstream->revents & (POLLIN | POLLERR | POLLHUP)) &&
+                    proxy_fill(s->sock, s->in)) {
+                    proxy_upstream_down(s, "connection lost");
+                } else if (s->state == upstream_auth) {
+                    proxy_upstream_auth(s);
+                }
+
+                if (s->state == upstream_ready && s->in->len > 0) {
+                    proxy_upstream_replies(s);
+                }
+            }
+
+
+            if (s->state == upstream_ready &&
+                proxy_flush(s->sock, s->out)) {
+                proxy_upstream_down(s, "connection lost");
+            }
+
+            for (j = 0; j < s->clients->len; j++) {
+                proxy_client_t *c = g_ptr_array_index(s->clients, j);
+
+                if (!c->closing && proxy_flush(c->sock, c->out)) {
+                    c->closing = true;
+                }
+            }
+
+            if (listener->revents & POLLIN) {
+                proxy_accept(s);
+            }
+        }
+
+        for (j = 0; conns != NULL && j < conns->len; j++) {
+            proxy_http_t *conn = g_ptr_array_index(conns, j);
+
+            if (conn->closing) {
+                continue;
+            }
+
+            proxy_http_pump(conn);
+            if (conn->waiting) {
+                proxy_http_requests(conn);
+            }
+            if (proxy_flush(conn->sock, conn->out)) {
+                conn->closing = true;
+            } else if (conn->close && conn->out->len == 0 &&
+                       conn->requests->len == 0) {
+                conn->closing = true;
+            }
+        }
+    }
+
+    ec = 0;
+
+cleanup:
+
+    g_array_free(pfds, TRUE);
+
+    return ec;
+}
+
+int main(int ac, char **av)
+{
+    int i = 0, ec = 1;
+
+    parse_args(ac, av);
+
+    ac -= optind;
+    av += optind;
+
+    if (ac == 0) {
+        usage();
+        goto cleanup;
+    }
+
+    if (config == NULL) {
+        char const *home = getenv("HOME");
+        size_t sz = 0;
+
+        if (home == NULL) {
+            fprintf(stderr, "Neither config file nor $HOME is set\n");
+            goto cleanup;
+        }
+
+        sz = strlen(home) + 10;
+        config = calloc(1, sz);
+        if (config == NULL) {
+            goto cleanup;
+        }
+
+        g_strlcpy(config, home, sz);
+        g_strlcat(config, "/.rconrc", sz);
+    }
+
+    if (config_load(config)) {
+        ec = 2;
+        goto cleanup;
+    }
+
+    if (bindaddr == NULL) {
+        bindaddr = strdup("127.0.0.1");
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    r = src_rcon_new();
+    servers = g_ptr_array_new();
+    conns = g_ptr_array_new();
+
+    for (i = 0; i < ac; i++) {
+        proxy_server_t *s = proxy_server_listen(av[i]);
+
+        if (s == NULL) {
+            ec = 2;
+            goto cleanup;
+        }
+        g_ptr_array_add(servers, s);
+    }
+
+    if (httpport != NULL) {
+        httplistener = proxy_listen(httpport);
+        if (httplistener < 0) {
+            ec = 2;
+            goto cleanup;
+        }
+    }
+
+    if (proxy_run()) {
+        fprintf(stderr, "Failed to wait for connections: %s\n",
+                strerror(errno));
+        goto cleanup;
+    }
+
+    ec = 0;
+
+cleanup:
+
+    for (i = 0; conns != NULL && i < (int)conns->len; i++) {
+        proxy_http_free(g_ptr_array_index(conns, i));
+    }
+    if (conns != NULL) {
+        g_ptr_array_free(conns, TRUE);
+    }
+
+    for (i = 0; servers != NULL && i < (int)servers->len; i++) {
+        proxy_server_free(g_ptr_array_index(servers, i));
+    }
+    if (servers != NULL) {
+        g_ptr_array_free(servers, TRUE);
+    }
+
+    if (httplistener > -1) {
+        close(httplistener);
+    }
+
+    src_rcon_free(r);
+    config_free();
+
+    free(config);
+    free(bindaddr);
+    free(password);
+    free(httpport);
+
+    return ec;
+}
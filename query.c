@@ -0,0 +1,203 @@
+#include "rcon.h"
+#include "journal.h"
+#include "json.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <time.h>
+
+static char *server = NULL;
+static uint64_t from = 0;
+static uint64_t to = UINT64_MAX;
+static bool jsonl = false;
+static bool count = false;
+
+static void usage(void)
+{
+    puts("");
+    puts("Usage:");
+    puts(" rcon-journal [options] directory");
+    puts("");
+    puts("Prints the commands and replies rcon --journal wrote to the");
+    puts("directory, oldest first.");
+    puts("");
+    puts("Options:");
+    puts(" -c, --count   Only print how many records there are");
+    puts(" -f, --from    Records from this time on");
+    puts(" -h, --help    This bogus");
+    puts(" -j, --jsonl   One JSON object per record");
+    puts(" -s, --server  Records of this server only");
+    puts(" -t, --to      Records up to this time");
+    puts("");
+    puts("Times are seconds since the epoch, or local time as");
+    puts("YYYY-MM-DD, YYYY-MM-DD HH:MM or YYYY-MM-DD HH:MM:SS.");
+}
+
+/* Nanoseconds since the epoch, or 0 if the time makes no sense
+ */
+static uint64_t parse_time(char const *s)
+{
+    struct tm tm = {0};
+    char *end = NULL;
+    double seconds = 0;
+    time_t t = 0;
+    int n = 0;
+
+    n = sscanf(s, "%d-%d-%d%*c%d:%d:%d", &tm.tm_year, &tm.tm_mon,
+               &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec);
+    if (n == 3 || n >= 5) {
+        tm.tm_year -= 1900;
+        tm.tm_mon -= 1;
+        tm.tm_isdst = -1;
+
+        t = mktime(&tm);
+        return (t < 0 ? 0 : (uint64_t)t * 1000000000ULL);
+    }
+
+    seconds = strtod(s, &end);
+    if (end == s || *end != '\0' || seconds <= 0) {
+        return 0;
+    }
+
+    return (uint64_t)(seconds * 1e9);
+}
+
+static int parse_args(int ac, char **av)
+{
+    static struct option opts[] = {
+        { "count", no_argument, 0, 'c' },
+        { "from", required_argument, 0, 'f' },
+        { "help", no_argument, 0, 'h' },
+        { "jsonl", no_argument, 0, 'j' },
+        { "server", required_argument, 0, 's' },
+        { "to", required_argument, 0, 't' },
+        { NULL, 0, 0, 0 }
+    };
+
+    static char const *optstr = "cf:hjs:t:";
+
+    int c = 0;
+
+    while ((c = getopt_long(ac, av, optstr, opts, NULL)) != -1) {
+        switch (c)
+        {
+        case 'c': count = true; break;
+        case 'f':
+            from = parse_time(optarg);
+            if (from == 0) {
+                fprintf(stderr, "Invalid time: %s\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'j': jsonl = true; break;
+        case 's': free(server); server = strdup(optarg); break;
+        case 't':
+            to = parse_time(optarg);
+            if (to == 0) {
+                fprintf(stderr, "Invalid time: %s\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'h': usage(); exit(0); break;
+        default: /* intentional */
+        case '?': usage(); exit(1); break;
+        }
+    }
+
+    return 0;
+}
+
+static void print_text(journal_record_t const *rec)
+{
+    time_t t = (time_t)(rec->time / 1000000000ULL);
+    char when[32];
+
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&t));
+
+    printf("%s.%03u [%.*s] #%ld %.3fms ", when,
+           (unsigned int)(rec->time / 1000000 % 1000),
+           (int)rec->serverlen, rec->server, (long)rec->id,
+           rec->latency / 1e6);
+    fwrite(rec->command, 1, rec->commandlen, stdout);
+    fputc('\n', stdout);
+
+    fwrite(rec->body, 1, rec->bodylen, stdout);
+    if (rec->bodylen > 0 && rec->body[rec->bodylen - 1] != '\n') {
+        fputc('\n', stdout);
+    }
+}
+
+/* The same fields as rcon --format jsonl, plus the time
+ */
+static void print_json(journal_record_t const *rec)
+{
+    printf("{\"time\":%llu.%09llu,\"server\":",
+           (unsigned long long)(rec->time / 1000000000ULL),
+           (unsigned long long)(rec->time % 1000000000ULL));
+    json_string(stdout, rec->server, rec->serverlen);
+    fputs(",\"command\":", stdout);
+    json_string(stdout, rec->command, rec->commandlen);
+    printf(",\"id\":%ld,\"body\":", (long)rec->id);
+    json_string(stdout, rec->body, rec->bodylen);
+    fputs(",\"latency\":", stdout);
+    json_seconds(stdout, rec->latency / 1e9);
+    fputs("}\n", stdout);
+}
+
+int main(int ac, char **av)
+{
+    journal_query_t *q = NULL;
+    journal_record_t rec;
+    unsigned long long n = 0;
+    int ret = 0, ec = 1;
+
+    parse_args(ac, av);
+
+    ac -= optind;
+    av += optind;
+
+    if (ac != 1) {
+        usage();
+        goto cleanup;
+    }
+
+    q = journal_query(av[0], from, to, server);
+    if (q == NULL) {
+        fprintf(stderr, "Failed to open journal: %s\n", av[0]);
+        ec = 2;
+        goto cleanup;
+    }
+
+    while ((ret = journal_next(q, &rec)) > 0) {
+        ++n;
+        if (count) {
+            continue;
+        } else if (jsonl) {
+            print_json(&rec);
+        } else {
+            print_text(&rec);
+        }
+    }
+
+    if (count) {
+        printf("%llu\n", n);
+    }
+
+    if (ret < 0) {
+        fprintf(stderr, "Journal is corrupt: %s\n", av[0]);
+        ec = 3;
+        goto cleanup;
+    }
+
+    ec = 0;
+
+cleanup:
+
+    journal_query_free(q);
+    free(server);
+
+    return ec;
+}
@@ -0,0 +1,271 @@
+#include "ratelimit.h"
+#include "timers.h"
+#include "rcon.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+typedef struct _ratelimit_entry
+{
+    char *cmd;
+    unsigned int flags;
+    struct _ratelimit_entry *next;
+} ratelimit_entry_t;
+
+struct _ratelimit
+{
+    double rate;
+    double burst;
+    double tokens;
+    double last;
+
+    char **names[ratelimit_priority_max];
+
+    ratelimit_entry_t *head[ratelimit_priority_max];
+    ratelimit_entry_t *tail[ratelimit_priority_max];
+    size_t pending;
+};
+
+/* Commands that change the state of players or the map should not wait
+ * behind chat spam.
+ */
+static char const * const default_urgent[] = {
+    "kick", "kickid", "banid", "banip", "changelevel", "map", NULL
+};
+
+static char const * const default_bulk[] = {
+    "say", "say_team", "echo", NULL
+};
+
+static void ratelimit_free_names(char **names);
+
+ratelimit_t *ratelimit_new(double rate, double burst)
+{
+    ratelimit_t *tmp = NULL;
+
+    tmp = calloc(1, sizeof(ratelimit_t));
+    if (tmp == NULL) {
+        return NULL;
+    }
+
+    tmp->rate = (rate > 0 ? rate : 0);
+    tmp->burst = (burst >= 1 ? burst : 1);
+    tmp->tokens = tmp->burst;
+    tmp->last = timers_now();
+
+    if (ratelimit_set_commands(tmp, ratelimit_priority_urgent,
+                               default_urgent) ||
+        ratelimit_set_commands(tmp, ratelimit_priority_bulk, default_bulk)) {
+        ratelimit_free(tmp);
+        return NULL;
+    }
+
+    return tmp;
+}
+
+void ratelimit_free(ratelimit_t *s)
+{
+    ratelimit_entry_t *e = NULL, *n = NULL;
+    int i = 0;
+
+    return_if_true(s == NULL,);
+
+    for (i = 0; i < ratelimit_priority_max; i++) {
+        for (e = s->head[i]; e != NULL; e = n) {
+            n = e->next;
+            free(e->cmd);
+            free(e);
+        }
+        ratelimit_free_names(s->names[i]);
+    }
+
+    free(s);
+}
+
+bool ratelimit_limited(ratelimit_t const *s)
+{
+    return (s != NULL && s->rate > 0);
+}
+
+static void ratelimit_free_names(char **names)
+{
+    char **i = NULL;
+
+    return_if_true(names == NULL,);
+
+    for (i = names; *i != NULL; i++) {
+        free(*i);
+    }
+    free(names);
+}
+
+int ratelimit_set_commands(ratelimit_t *s, ratelimit_priority_t prio,
+                           char const * const *names)
+{
+    char **tmp = NULL;
+    size_t count = 0, i = 0;
+
+    return_if_true(s == NULL, -1);
+    return_if_true(prio >= ratelimit_priority_max, -1);
+
+    for (count = 0; names != NULL && names[count] != NULL; count++)
+        ;
+
+    tmp = calloc(count + 1, sizeof(char*));
+    if (tmp == NULL) {
+        return -1;
+    }
+
+    for (i = 0; i < count; i++) {
+        tmp[i] = strdup(names[i]);
+        if (tmp[i] == NULL) {
+            ratelimit_free_names(tmp);
+            return -1;
+        }
+    }
+
+    ratelimit_free_names(s->names[prio]);
+    s->names[prio] = tmp;
+
+    return 0;
+}
+
+static bool ratelimit_match(char **names, char const *cmd, size_t len)
+{
+    char **i = NULL;
+
+    return_if_true(names == NULL, false);
+
+    for (i = names; *i != NULL; i++) {
+        if (strlen(*i) == len && strncasecmp(*i, cmd, len) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+ratelimit_priority_t ratelimit_classify(ratelimit_t const *s, char const *cmd)
+{
+    size_t len = 0;
+
+    while (*cmd != '\0' && isspace((int)*cmd)) {
+        ++cmd;
+    }
+
+    while (cmd[len] != '\0' && !isspace((int)cmd[len]) && cmd[len] != ';') {
+        ++len;
+    }
+
+    if (ratelimit_match(s->names[ratelimit_priority_urgent], cmd, len)) {
+        return ratelimit_priority_urgent;
+    }
+
+    if (ratelimit_match(s->names[ratelimit_priority_bulk], cmd, len)) {
+        return ratelimit_priority_bulk;
+    }
+
+    return ratelimit_priority_normal;
+}
+
+int ratelimit_push(ratelimit_t *s, char const *cmd, unsigned int flags)
+{
+    ratelimit_entry_t *e = NULL;
+    ratelimit_priority_t prio;
+
+    return_if_true(s == NULL || cmd == NULL, -1);
+
+    e = calloc(1, sizeof(ratelimit_entry_t));
+    if (e == NULL) {
+        return -1;
+    }
+
+    e->cmd = strdup(cmd);
+    if (e->cmd == NULL) {
+        free(e);
+        return -1;
+    }
+
+    e->flags = flags;
+    prio = ratelimit_classify(s, cmd);
+
+    if (s->tail[prio] != NULL) {
+        s->tail[prio]->next = e;
+    } else {
+        s->head[prio] = e;
+    }
+    s->tail[prio] = e;
+    ++s->pending;
+
+    return 0;
+}
+
+size_t ratelimit_pending(ratelimit_t const *s)
+{
+    return (s != NULL ? s->pending : 0);
+}
+
+static void ratelimit_refill(ratelimit_t *s, double now)
+{
+    if (now > s->last) {
+        s->tokens += (now - s->last) * s->rate;
+        if (s->tokens > s->burst) {
+            s->tokens = s->burst;
+        }
+    }
+    s->last = now;
+}
+
+double ratelimit_delay(ratelimit_t *s, double now)
+{
+    return_if_true(s == NULL || s->pending == 0, -1.0);
+    return_if_true(s->rate <= 0, 0.0);
+
+    ratelimit_refill(s, now);
+
+    if (s->tokens >= 1.0) {
+        return 0.0;
+    }
+
+    return (1.0 - s->tokens) / s->rate;
+}
+
+char *ratelimit_pop(ratelimit_t *s, double now, unsigned int *flags)
+{
+    ratelimit_entry_t *e = NULL;
+    char *cmd = NULL;
+    int i = 0;
+
+    return_if_true(s == NULL || s->pending == 0, NULL);
+
+    if (s->rate > 0) {
+        ratelimit_refill(s, now);
+        if (s->tokens < 1.0) {
+            return NULL;
+        }
+        s->tokens -= 1.0;
+    }
+
+    for (i = 0; i < ratelimit_priority_max; i++) {
+        if (s->head[i] != NULL) {
+            break;
+        }
+    }
+
+    e = s->head[i];
+    s->head[i] = e->next;
+    if (s->head[i] == NULL) {
+        s->tail[i] = NULL;
+    }
+    --s->pending;
+
+    cmd = e->cmd;
+    if (flags) {
+        *flags = e->flags;
+    }
+    free(e);
+
+    return cmd;
+}
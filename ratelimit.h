@@ -0,0 +1,49 @@
+#ifndef RCON_RATELIMIT_H
+#define RCON_RATELIMIT_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+/* Commands are queued by priority class, and leave the queue no faster than
+ * a token bucket allows. Within one class commands keep their order.
+ */
+typedef enum {
+    ratelimit_priority_urgent = 0,
+    ratelimit_priority_normal,
+    ratelimit_priority_bulk,
+    ratelimit_priority_max,
+} ratelimit_priority_t;
+
+typedef struct _ratelimit ratelimit_t;
+
+/* rate is in commands per second, a rate of zero disables rate limiting.
+ * burst is the amount of commands that may be sent back to back.
+ */
+ratelimit_t *ratelimit_new(double rate, double burst);
+void ratelimit_free(ratelimit_t *s);
+
+bool ratelimit_limited(ratelimit_t const *s);
+
+/* Override the built-in list of command names that are treated as urgent
+ * or bulk. The lists are NULL terminated and copied.
+ */
+int ratelimit_set_commands(ratelimit_t *s, ratelimit_priority_t prio,
+                           char const * const *names);
+ratelimit_priority_t ratelimit_classify(ratelimit_t const *s, char const *cmd);
+
+/* flags are not interpreted, and are handed back by ratelimit_pop()
+ */
+int ratelimit_push(ratelimit_t *s, char const *cmd, unsigned int flags);
+size_t ratelimit_pending(ratelimit_t const *s);
+
+/* Seconds until the next queued command may be sent, or a negative value if
+ * the queue is empty. Points in time are given by timers_now().
+ */
+double ratelimit_delay(ratelimit_t *s, double now);
+
+/* Returns the next command if a token is available, the caller must free
+ * it. Returns NULL if the queue is empty or the bucket is exhausted.
+ */
+char *ratelimit_pop(ratelimit_t *s, double now, unsigned int *flags);
+
+#endif
@@ -6,21 +6,31 @@ _rcon()
 
     _init_completion || return
 
-    lngopts="--config --help --host --port --password --server --1packet"
+    lngopts="--config --config-cache --help --host --port --password --server --1packet --rate --burst --reconnect --connect-timeout --auth-timeout --first-byte-timeout --timeout --timing --watch --changes --pipeline --fastopen --dns-cache --dns-ttl --batch --broker --journal --journal-size --journal-age --capture --debug-file --debug-max --metrics --metrics-interval --check --select --jobs --deadline --format"
     shtopts="-c -H -h -p -P -s -1"
     configfile="$HOME/.rconrc"
 
     case "${prev}" in
-        -c|--config)
+        -c|--config|--config-cache|--dns-cache|--broker|--capture|--debug-file|--metrics)
             _filedir
             return
             ;;
 
+        --journal)
+            _filedir -d
+            return
+            ;;
+
         -H|--host)
             _known_hosts_real "$cur"
             return
             ;;
 
+        --format)
+            COMPREPLY=( $(compgen -W 'text json jsonl' -- "$cur") )
+            return
+            ;;
+
         -s|--server)
             servers=$(egrep "^\s*\\[.*?\\]" "${configfile}" 2>/dev/null | tr -d '[]')
             COMPREPLY=( $(compgen -W '"${servers}"' -- "$cur") )
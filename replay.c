@@ -0,0 +1,208 @@
+#include "rcon.h"
+#include "srcrcon.h"
+#include "capture.h"
+#include "timers.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <stdbool.h>
+
+static unsigned long iterations = 1;
+static bool verbose = false;
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    size_t size;
+} replay_buffer_t;
+
+typedef struct {
+    unsigned long chunks;
+    unsigned long frames;
+    unsigned long long bytes;
+} replay_stats_t;
+
+static void usage(void)
+{
+    puts("");
+    puts("Usage:");
+    puts(" rcon-replay [options] capture");
+    puts("");
+    puts("Feeds the received data of a capture made with rcon --capture");
+    puts("through the decoder, chunk by chunk, as fast as possible.");
+    puts("");
+    puts("Options:");
+    puts(" -h, --help        This bogus");
+    puts(" -n, --iterations  Replay the capture this many times");
+    puts(" -v, --verbose     Print every decoded frame");
+}
+
+static int parse_args(int ac, char **av)
+{
+    static struct option opts[] = {
+        { "help", no_argument, 0, 'h' },
+        { "iterations", required_argument, 0, 'n' },
+        { "verbose", no_argument, 0, 'v' },
+        { NULL, 0, 0, 0 }
+    };
+
+    static char const *optstr = "hn:v";
+
+    int c = 0;
+
+    while ((c = getopt_long(ac, av, optstr, opts, NULL)) != -1) {
+        switch (c)
+        {
+        case 'n': iterations = strtoul(optarg, NULL, 10); break;
+        case 'v': verbose = true; break;
+        case 'h': usage(); exit(0); break;
+        default: /* intentional */
+        case '?': usage(); exit(1); break;
+        }
+    }
+
+    return 0;
+}
+
+static int buffer_append(replay_buffer_t *b, uint8_t const *data, size_t len)
+{
+    if (b->len + len > b->size) {
+        size_t size = (b->size > 0 ? b->size : 4096);
+        uint8_t *tmp = NULL;
+
+        while (size < b->len + len) {
+            size *= 2;
+        }
+
+        tmp = realloc(b->data, size);
+        if (tmp == NULL) {
+            return -1;
+        }
+
+        b->data = tmp;
+        b->size = size;
+    }
+
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+
+    return 0;
+}
+
+static int replay(src_rcon_t *r, capture_file_t *f, replay_stats_t *stats)
+{
+    replay_buffer_t buf = {0};
+    capture_record_t rec;
+    int ret = 0;
+
+    capture_rewind(f);
+
+    while ((ret = capture_next(f, &rec)) > 0) {
+        src_rcon_message_t **msgs = NULL, **p = NULL;
+        size_t off = 0, count = 0;
+        rcon_error_t status;
+
+        if (rec.direction != capture_in) {
+            continue;
+        }
+
+        ++stats->chunks;
+        stats->bytes += rec.length;
+
+        if (buffer_append(&buf, rec.data, rec.length)) {
+            ret = -1;
+            break;
+        }
+
+        status = src_rcon_deserialize(r, &msgs, &off, &count,
+                                      buf.data, buf.len);
+        if (status == rcon_error_moredata) {
+            continue;
+        } else if (status != rcon_error_success) {
+            fprintf(stderr, "Decoder failed at %.6fs: %d\n",
+                    rec.time / 1e9, status);
+            ret = -1;
+            break;
+        }
+
+        stats->frames += count;
+
+        if (verbose) {
+            for (p = msgs; *p != NULL; p++) {
+                printf("%.6f id=%d type=%d size=%d\n", rec.time / 1e9,
+                       (*p)->id, (*p)->type, (*p)->size);
+            }
+        }
+
+        src_rcon_message_freev(msgs);
+
+        memmove(buf.data, buf.data + off, buf.len - off);
+        buf.len -= off;
+    }
+
+    if (ret == 0 && buf.len > 0) {
+        fprintf(stderr, "%zu bytes of incomplete frames left over\n",
+                buf.len);
+    }
+
+    free(buf.data);
+
+    return (ret < 0 ? -1 : 0);
+}
+
+int main(int ac, char **av)
+{
+    replay_stats_t stats = {0};
+    capture_file_t *f = NULL;
+    src_rcon_t *r = NULL;
+    double start = 0, took = 0;
+    unsigned long i = 0;
+    int ec = 1;
+
+    parse_args(ac, av);
+
+    ac -= optind;
+    av += optind;
+
+    if (ac != 1) {
+        usage();
+        return 1;
+    }
+
+    f = capture_map(av[0]);
+    if (f == NULL) {
+        fprintf(stderr, "Failed to open capture: %s\n", av[0]);
+        return 2;
+    }
+
+    r = src_rcon_new();
+    if (r == NULL) {
+        goto cleanup;
+    }
+
+    start = timers_now();
+    for (i = 0; i < iterations; i++) {
+        if (replay(r, f, &stats)) {
+            goto cleanup;
+        }
+    }
+    took = timers_now() - start;
+
+    printf("%lu chunks, %lu frames, %llu bytes in %.3fms\n",
+           stats.chunks, stats.frames, stats.bytes, took * 1000);
+    if (took > 0) {
+        printf("%.1f frames/s, %.2f MiB/s\n", stats.frames / took,
+               stats.bytes / took / (1024.0 * 1024.0));
+    }
+
+    ec = 0;
+
+cleanup:
+
+    src_rcon_free(r);
+    capture_unmap(f);
+
+    return ec;
+}
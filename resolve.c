@@ -0,0 +1,503 @@
+#include "resolve.h"
+#include "rcon.h"
+
+#include <glib.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <netinet/in.h>
+
+/* getaddrinfo() mostly waits for the network, so there is little harm in
+ * having many of them at once.
+ */
+#define RESOLVE_THREADS_MAX 32
+
+/* Host, port, expiry, numeric address and numeric port
+ */
+#define RESOLVE_FORMAT "%255s %63s %ld %63s %15s"
+
+typedef struct {
+    time_t expires;
+    size_t count;
+    struct sockaddr_storage *addrs;
+    socklen_t *lens;
+} resolve_entry_t;
+
+/* Lists handed out are made of these, so each address comes with its own
+ * storage.
+ */
+typedef struct {
+    struct addrinfo ai;
+    struct sockaddr_storage addr;
+} resolve_node_t;
+
+typedef struct {
+    char const *host;
+    char const *port;
+    int error;
+    struct addrinfo *addresses;
+} resolve_job_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    resolve_job_t *jobs;
+    size_t count;
+    size_t next;
+} resolve_queue_t;
+
+/* "host port" to resolve_entry_t
+ */
+static GHashTable *cache = NULL;
+static char *cachefile = NULL;
+static double cachettl = RESOLVE_TTL;
+static bool dirty = false;
+
+static void resolve_entry_free(gpointer data)
+{
+    resolve_entry_t *e = (resolve_entry_t*)data;
+
+    return_if_true(e == NULL,);
+
+    free(e->addrs);
+    free(e->lens);
+    free(e);
+}
+
+static char *resolve_key(char const *host, char const *port)
+{
+    return g_strdup_printf("%s %s", host, port);
+}
+
+static void resolve_hint(struct addrinfo *hint, int flags)
+{
+    memset(hint, 0, sizeof(*hint));
+    hint->ai_socktype = SOCK_STREAM;
+    hint->ai_family = AF_UNSPEC;
+    hint->ai_flags = flags;
+}
+
+static int resolve_entry_add(resolve_entry_t *e, struct sockaddr const *addr,
+                             socklen_t len)
+{
+    struct sockaddr_storage *addrs = NULL;
+    socklen_t *lens = NULL;
+
+    return_if_true(len > sizeof(struct sockaddr_storage), -1);
+
+    addrs = realloc(e->addrs, (e->count + 1) * sizeof(*addrs));
+    if (addrs == NULL) {
+        return -1;
+    }
+    e->addrs = addrs;
+
+    lens = realloc(e->lens, (e->count + 1) * sizeof(*lens));
+    if (lens == NULL) {
+        return -1;
+    }
+    e->lens = lens;
+
+    memset(&e->addrs[e->count], 0, sizeof(struct sockaddr_storage));
+    memcpy(&e->addrs[e->count], addr, len);
+    e->lens[e->count] = len;
+    ++e->count;
+
+    return 0;
+}
+
+/* The entry for the key, made if there is none yet
+ */
+static resolve_entry_t *resolve_entry(char const *host, char const *port,
+                                      time_t expires)
+{
+    resolve_entry_t *e = NULL;
+    char *key = NULL;
+
+    key = resolve_key(host, port);
+    e = g_hash_table_lookup(cache, key);
+    if (e != NULL) {
+        g_free(key);
+        return e;
+    }
+
+    e = calloc(1, sizeof(resolve_entry_t));
+    if (e == NULL) {
+        g_free(key);
+        return NULL;
+    }
+    e->expires = expires;
+
+    g_hash_table_insert(cache, key, e);
+
+    return e;
+}
+
+static void resolve_put(char const *host, char const *port,
+                        struct addrinfo const *addresses)
+{
+    struct addrinfo const *ai = NULL;
+    resolve_entry_t *e = NULL;
+    char *key = NULL;
+
+    key = resolve_key(host, port);
+    g_hash_table_remove(cache, key);
+    g_free(key);
+
+    e = resolve_entry(host, port, time(NULL) + (time_t)cachettl);
+    if (e == NULL) {
+        return;
+    }
+
+    for (ai = addresses; ai != NULL; ai = ai->ai_next) {
+        resolve_entry_add(e, ai->ai_addr, ai->ai_addrlen);
+    }
+
+    dirty = true;
+}
+
+static void resolve_load(void)
+{
+    char line[512];
+    char host[256], port[64], addr[64], serv[16];
+    long expires = 0;
+    time_t now = time(NULL);
+    FILE *f = NULL;
+
+    f = fopen(cachefile, "r");
+    if (f == NULL) {
+        return;
+    }
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        struct addrinfo hint, *ai = NULL;
+        resolve_entry_t *e = NULL;
+
+        if (sscanf(line, RESOLVE_FORMAT, host, port, &expires,
+                   addr, serv) != 5 || expires <= now) {
+            continue;
+        }
+
+        /* Only numbers, this never asks DNS
+         */
+        resolve_hint(&hint, AI_NUMERICHOST | AI_NUMERICSERV);
+        if (getaddrinfo(addr, serv, &hint, &ai)) {
+            continue;
+        }
+
+        e = resolve_entry(host, port, (time_t)expires);
+        if (e != NULL) {
+            resolve_entry_add(e, ai->ai_addr, ai->ai_addrlen);
+        }
+        freeaddrinfo(ai);
+    }
+
+    fclose(f);
+}
+
+static void resolve_store(void)
+{
+    GHashTableIter it;
+    gpointer key = NULL, value = NULL;
+    time_t now = time(NULL);
+    char *tmp = NULL;
+    FILE *f = NULL;
+    size_t len = 0;
+    int fd = -1;
+
+    return_if_true(cachefile == NULL || !dirty,);
+
+    len = strlen(cachefile) + 32;
+    tmp = calloc(1, len);
+    if (tmp == NULL) {
+        return;
+    }
+    snprintf(tmp, len, "%s.%ld.tmp", cachefile, (long)getpid());
+
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        goto cleanup;
+    }
+
+    f = fdopen(fd, "w");
+    if (f == NULL) {
+        close(fd);
+        unlink(tmp);
+        goto cleanup;
+    }
+
+    g_hash_table_iter_init(&it, cache);
+    while (g_hash_table_iter_next(&it, &key, &value)) {
+        resolve_entry_t const *e = (resolve_entry_t const *)value;
+        size_t i = 0;
+
+        if (e->expires <= now) {
+            continue;
+        }
+
+        for (i = 0; i < e->count; i++) {
+            char addr[64], serv[16];
+
+            if (getnameinfo((struct sockaddr const *)&e->addrs[i], e->lens[i],
+                            addr, sizeof(addr), serv, sizeof(serv),
+                            NI_NUMERICHOST | NI_NUMERICSERV)) {
+                continue;
+            }
+            fprintf(f, "%s %ld %s %s\n", (char const *)key, (long)e->expires,
+                    addr, serv);
+        }
+    }
+
+    if (ferror(f) | fclose(f)) {
+        unlink(tmp);
+        goto cleanup;
+    }
+
+    if (rename(tmp, cachefile)) {
+        unlink(tmp);
+        goto cleanup;
+    }
+
+    dirty = false;
+
+cleanup:
+
+    free(tmp);
+}
+
+static int resolve_init(void)
+{
+    if (cache != NULL) {
+        return 0;
+    }
+
+    cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                  resolve_entry_free);
+    if (cache == NULL) {
+        return -1;
+    }
+
+    if (cachefile != NULL) {
+        resolve_load();
+    }
+
+    return 0;
+}
+
+void resolve_set_cache(char const *filename, double ttl)
+{
+    free(cachefile);
+    cachefile = NULL;
+
+    if (filename != NULL) {
+        cachefile = strdup(filename);
+    }
+    cachettl = ttl;
+}
+
+static void *resolve_worker(void *arg)
+{
+    resolve_queue_t *q = (resolve_queue_t*)arg;
+    struct addrinfo hint;
+
+    resolve_hint(&hint, 0);
+
+    for (;;) {
+        resolve_job_t *job = NULL;
+
+        pthread_mutex_lock(&q->lock);
+        if (q->next < q->count) {
+            job = &q->jobs[q->next++];
+        }
+        pthread_mutex_unlock(&q->lock);
+
+        if (job == NULL) {
+            break;
+        }
+
+        job->error = getaddrinfo(job->host, job->port, &hint,
+                                 &job->addresses);
+    }
+
+    return NULL;
+}
+
+int resolve_prefetch(char const * const *hosts, char const * const *ports,
+                     size_t count, unsigned int threads)
+{
+    resolve_queue_t q;
+    GHashTable *seen = NULL;
+    pthread_t *tids = NULL;
+    size_t i = 0, started = 0;
+    int ec = -1;
+
+    return_if_true(resolve_init(), -1);
+
+    memset(&q, 0, sizeof(q));
+    q.jobs = calloc(count + 1, sizeof(resolve_job_t));
+    seen = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    if (q.jobs == NULL || seen == NULL) {
+        goto cleanup;
+    }
+
+    for (i = 0; i < count; i++) {
+        char *key = resolve_key(hosts[i], ports[i]);
+
+        if (g_hash_table_contains(cache, key) ||
+            g_hash_table_contains(seen, key)) {
+            g_free(key);
+            continue;
+        }
+        g_hash_table_insert(seen, key, NULL);
+
+        q.jobs[q.count].host = hosts[i];
+        q.jobs[q.count].port = ports[i];
+        ++q.count;
+    }
+
+    if (q.count == 0) {
+        ec = 0;
+        goto cleanup;
+    }
+
+    if (threads > RESOLVE_THREADS_MAX) {
+        threads = RESOLVE_THREADS_MAX;
+    }
+    if (threads > q.count) {
+        threads = q.count;
+    }
+
+    pthread_mutex_init(&q.lock, NULL);
+
+    /* This thread takes part as well, so that lookups still happen if no
+     * thread could be started.
+     */
+    tids = calloc(threads, sizeof(pthread_t));
+    for (i = 1; tids != NULL && i < threads; i++) {
+        if (pthread_create(&tids[started], NULL, resolve_worker, &q)) {
+            break;
+        }
+        ++started;
+    }
+
+    resolve_worker(&q);
+
+    for (i = 0; i < started; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    pthread_mutex_destroy(&q.lock);
+
+    for (i = 0; i < q.count; i++) {
+        if (q.jobs[i].error == 0) {
+            resolve_put(q.jobs[i].host, q.jobs[i].port, q.jobs[i].addresses);
+            freeaddrinfo(q.jobs[i].addresses);
+        }
+    }
+
+    resolve_store();
+
+    ec = 0;
+
+cleanup:
+
+    free(tids);
+    free(q.jobs);
+    if (seen != NULL) {
+        g_hash_table_destroy(seen);
+    }
+
+    return ec;
+}
+
+int resolve_addresses(char const *host, char const *port,
+                      struct addrinfo **addresses)
+{
+    resolve_entry_t const *e = NULL;
+    struct addrinfo *head = NULL, **tail = &head;
+    char *key = NULL;
+    size_t i = 0;
+
+    return_if_true(addresses == NULL, EAI_FAIL);
+    *addresses = NULL;
+
+    return_if_true(resolve_init(), EAI_MEMORY);
+
+    key = resolve_key(host, port);
+    e = g_hash_table_lookup(cache, key);
+    g_free(key);
+
+    if (e == NULL) {
+        struct addrinfo hint, *ai = NULL;
+        int ret = 0;
+
+        resolve_hint(&hint, 0);
+        if ((ret = getaddrinfo(host, port, &hint, &ai))) {
+            return ret;
+        }
+
+        resolve_put(host, port, ai);
+        freeaddrinfo(ai);
+        resolve_store();
+
+        key = resolve_key(host, port);
+        e = g_hash_table_lookup(cache, key);
+        g_free(key);
+    }
+
+    if (e == NULL || e->count == 0) {
+        return EAI_NONAME;
+    }
+
+    for (i = 0; i < e->count; i++) {
+        resolve_node_t *n = calloc(1, sizeof(resolve_node_t));
+
+        if (n == NULL) {
+            resolve_free_addresses(head);
+            return EAI_MEMORY;
+        }
+
+        memcpy(&n->addr, &e->addrs[i], sizeof(n->addr));
+        n->ai.ai_family = n->addr.ss_family;
+        n->ai.ai_socktype = SOCK_STREAM;
+        n->ai.ai_protocol = IPPROTO_TCP;
+        n->ai.ai_addr = (struct sockaddr*)&n->addr;
+        n->ai.ai_addrlen = e->lens[i];
+
+        *tail = &n->ai;
+        tail = &n->ai.ai_next;
+    }
+
+    *addresses = head;
+
+    return 0;
+}
+
+void resolve_free_addresses(struct addrinfo *addresses)
+{
+    struct addrinfo *next = NULL;
+
+    /* The addrinfo is the first member of each node
+     */
+    for (; addresses != NULL; addresses = next) {
+        next = addresses->ai_next;
+        free(addresses);
+    }
+}
+
+void resolve_free(void)
+{
+    if (cache != NULL) {
+        g_hash_table_destroy(cache);
+        cache = NULL;
+    }
+
+    free(cachefile);
+    cachefile = NULL;
+    cachettl = RESOLVE_TTL;
+    dirty = false;
+}
@@ -0,0 +1,39 @@
+#ifndef RCON_RESOLVE_H
+#define RCON_RESOLVE_H
+
+#include <stdlib.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+
+/* Seconds addresses are taken from the cache file by default
+ */
+#define RESOLVE_TTL 300
+
+/* Resolved addresses are kept for the rest of the run, keyed by host and
+ * port. With a cache file, they are also stored there, and later runs use
+ * them for ttl seconds instead of asking DNS again. getaddrinfo() does not
+ * tell the TTL of the records, so it is up to the user.
+ */
+void resolve_set_cache(char const *filename, double ttl);
+
+/* Looks up all hosts that are not cached yet at the same time, with at
+ * most threads lookups in flight. Hosts that fail to resolve are not
+ * cached, so that resolve_addresses() reports why. Returns -1 if out of
+ * memory.
+ */
+int resolve_prefetch(char const * const *hosts, char const * const *ports,
+                     size_t count, unsigned int threads);
+
+/* Stream addresses for the host and port, from the cache if possible.
+ * Returns 0, or an error for gai_strerror(). The list must be freed with
+ * resolve_free_addresses().
+ */
+int resolve_addresses(char const *host, char const *port,
+                      struct addrinfo **addresses);
+void resolve_free_addresses(struct addrinfo *addresses);
+
+void resolve_free(void);
+
+#endif
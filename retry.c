@@ -0,0 +1,29 @@
+#include "retry.h"
+#include "sysconfig.h"
+
+#ifndef HAVE_ARC4RANDOM_UNIFORM
+#include <bsd/stdlib.h>
+#endif
+
+#include <stdlib.h>
+
+unsigned int retry_delay(unsigned int attempt)
+{
+    unsigned int delay = RETRY_BASE;
+
+    while (attempt-- > 0 && delay < RETRY_MAX) {
+        delay *= 2;
+    }
+
+    if (delay > RETRY_MAX) {
+        delay = RETRY_MAX;
+    }
+
+    return delay / 2 + arc4random_uniform(delay / 2 + 1);
+}
+
+bool retry_command(bool idempotent, unsigned int tries,
+                   unsigned int reconnects)
+{
+    return (idempotent && tries < reconnects);
+}
@@ -0,0 +1,24 @@
+#ifndef RCON_RETRY_H
+#define RCON_RETRY_H
+
+#include <stdbool.h>
+
+/* Milliseconds between attempts to reconnect
+ */
+#define RETRY_BASE 250
+#define RETRY_MAX  30000
+
+/* Milliseconds to wait before the given attempt to reconnect, counted from
+ * zero. The delay doubles with each attempt, and half of it is random so
+ * that many clients don't come back all at once.
+ */
+unsigned int retry_delay(unsigned int attempt);
+
+/* Whether a command whose connection was lost is sent again, after it was
+ * already sent again tries times. Commands that are not idempotent are
+ * never repeated, others at most reconnects times.
+ */
+bool retry_command(bool idempotent, unsigned int tries,
+                   unsigned int reconnects);
+
+#endif
@@ -0,0 +1,122 @@
+#include "rcon.h"
+#include "route.h"
+
+#include <string.h>
+
+static int32_t route_next_id(int32_t id)
+{
+    return (id == INT32_MAX ? 1 : id + 1);
+}
+
+static int32_t route_get32(uint8_t const *p)
+{
+    int32_t v = 0;
+
+    memcpy(&v, p, sizeof(v));
+
+    return v;
+}
+
+void route_init(route_table_t *t)
+{
+    memset(t, 0, sizeof(*t));
+    t->nextid = 1;
+    t->settled = 1;
+}
+
+route_t *route_take(route_table_t *t, void *owner, int kind)
+{
+    route_t *route = NULL;
+    size_t tries = 0;
+
+    return_if_true(owner == NULL, NULL);
+
+    for (tries = 0; tries < ROUTE_MAX; tries++) {
+        int32_t id = t->nextid;
+
+        t->nextid = route_next_id(t->nextid);
+
+        route = &t->routes[(uint32_t)id % ROUTE_MAX];
+        if (route->owner == NULL) {
+            memset(route, 0, sizeof(*route));
+            route->id = id;
+            route->owner = owner;
+            route->kind = kind;
+            ++t->pending;
+            return route;
+        }
+    }
+
+    return NULL;
+}
+
+void route_release(route_table_t *t, route_t *route)
+{
+    if (route->owner != NULL) {
+        --t->pending;
+    }
+    route->owner = NULL;
+}
+
+route_t *route_find(route_table_t *t, int32_t id)
+{
+    route_t *route = &t->routes[(uint32_t)id % ROUTE_MAX];
+
+    return_if_true(route->owner == NULL || route->id != id, NULL);
+
+    return route;
+}
+
+route_t *route_request(route_table_t *t, void *owner, int kind,
+                       uint8_t *frame)
+{
+    route_t *route = route_take(t, owner, kind);
+
+    return_if_true(route == NULL, NULL);
+
+    route->clientid = route_get32(frame + 4);
+    memcpy(frame + 4, &route->id, sizeof(int32_t));
+
+    return route;
+}
+
+route_t *route_reply(route_table_t *t, uint8_t *frame)
+{
+    route_t *route = route_find(t, route_get32(frame + 4));
+
+    return_if_true(route == NULL, NULL);
+
+    memcpy(frame + 4, &route->clientid, sizeof(int32_t));
+
+    return route;
+}
+
+route_t *route_settled(route_table_t *t, int32_t id)
+{
+    /* Only ids in use lie between settled and nextid
+     */
+    return_if_true(route_find(t, id) == NULL, NULL);
+
+    while (t->settled != id) {
+        route_t *route = &t->routes[(uint32_t)t->settled % ROUTE_MAX];
+        int32_t settled = t->settled;
+
+        t->settled = route_next_id(t->settled);
+        if (route->owner != NULL && route->id == settled) {
+            return route;
+        }
+    }
+
+    return NULL;
+}
+
+void route_reset(route_table_t *t)
+{
+    size_t i = 0;
+
+    for (i = 0; i < ROUTE_MAX; i++) {
+        t->routes[i].owner = NULL;
+    }
+    t->pending = 0;
+    t->settled = t->nextid;
+}
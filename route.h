@@ -0,0 +1,69 @@
+#ifndef RCON_ROUTE_H
+#define RCON_ROUTE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+/* Replies are told apart by the id of their request. To send the requests
+ * of many clients over one connection, each request gets an id of its own,
+ * and its reply finds the way back by it. Routes are kept in a ring indexed
+ * by id, and ids are handed out in order, skipping those whose route is
+ * still in use.
+ */
+#define ROUTE_MAX 4096
+
+typedef struct {
+    int32_t id;
+    /* The id the client used, put back into the replies
+     */
+    int32_t clientid;
+    /* Whoever waits for the replies, NULL while the route is free. kind is
+     * left to the caller.
+     */
+    void *owner;
+    int kind;
+} route_t;
+
+typedef struct {
+    /* Routes in use, and the oldest id that might still be answered
+     */
+    size_t pending;
+    int32_t settled;
+    int32_t nextid;
+    route_t routes[ROUTE_MAX];
+} route_table_t;
+
+void route_init(route_table_t *t);
+
+/* Takes the next id whose route is free. Returns NULL if none is.
+ */
+route_t *route_take(route_table_t *t, void *owner, int kind);
+void route_release(route_table_t *t, route_t *route);
+
+/* The route in use for id, or NULL
+ */
+route_t *route_find(route_table_t *t, int32_t id);
+
+/* Takes a route for the request frame, and puts its id in place of the
+ * one the client used. Returns NULL if no route is free.
+ */
+route_t *route_request(route_table_t *t, void *owner, int kind,
+                       uint8_t *frame);
+/* Finds the route of the reply frame, and puts the id the client used
+ * back. Returns NULL for replies nobody waits for.
+ */
+route_t *route_reply(route_table_t *t, uint8_t *frame);
+
+/* Servers answer in order, so once a reply to id came in, everything sent
+ * before it was answered in full. Returns those routes that are still in
+ * use one by one, for the caller to release, and then NULL.
+ */
+route_t *route_settled(route_table_t *t, int32_t id);
+
+/* Forgets all routes, once the connection they were for is gone. The
+ * caller deals with the owners first.
+ */
+void route_reset(route_table_t *t);
+
+#endif
@@ -0,0 +1,847 @@
+#include "session.h"
+#include "srcrcon.h"
+#include "timers.h"
+#include "rcon.h"
+#include "memstream.h"
+#include "sockopt.h"
+#include "resolve.h"
+
+#include <glib.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+
+/* Minecraft splits replies into frames of this many bytes. After a full
+ * frame we wait this long for another one, in seconds.
+ */
+#define SESSION_FRAGMENT 4096
+#define SESSION_FRAGMENT_IDLE 0.1
+
+typedef enum {
+    io_free = 0,
+    io_connecting,
+    io_auth,
+    io_command,
+} io_state_t;
+
+/* One slot of the poll() loop, and the state of the session running in it
+ */
+typedef struct {
+    session_t *s;
+    io_state_t state;
+    int sock;
+
+    struct addrinfo *addresses;
+    struct addrinfo *next;
+
+    src_rcon_t *r;
+    src_rcon_message_t *msg;
+    /* Commands are pipelined, each followed by an end marker, except with
+     * Minecraft, where they are sent one after another.
+     */
+    int32_t *ends;
+    size_t count;
+    /* The end marker of the previous command. Servers may send more than
+     * one reply to it.
+     */
+    int32_t stale;
+
+    uint8_t *out;
+    size_t outlen;
+    size_t outoff;
+    GByteArray *in;
+    FILE *output;
+
+    size_t command;
+    double started;
+    /* When the commands went out, and when the current one did
+     */
+    double began;
+    double sent;
+    double deadline;
+    bool fragment;
+
+    timers_entry_t timer;
+
+    session_done_t done;
+    void *data;
+} session_io_t;
+
+static char const *status_names[] = {
+    "ok", "skipped", "config", "resolve", "connect", "auth", "command",
+    "timeout"
+};
+
+static char const *phase_names[session_phase_max] = {
+    "connect", "auth", "first_byte", "command"
+};
+
+char const *session_status_name(session_status_t status)
+{
+    return_if_true(status > session_status_timeout, "unknown");
+    return status_names[status];
+}
+
+char const *session_phase_name(session_phase_t phase)
+{
+    return_if_true(phase >= session_phase_max, "unknown");
+    return phase_names[phase];
+}
+
+/* Why the given session failed, or NULL if it did not
+ */
+char const *session_error(session_t const *s)
+{
+    return_if_true(s == NULL, NULL);
+
+    switch (s->status)
+    {
+    case session_status_ok: return NULL;
+    case session_status_skipped: return "not started before the deadline";
+    case session_status_config: return "no port in configuration";
+    case session_status_resolve: return "failed to resolve host";
+    case session_status_timeout: return "timed out";
+    case session_status_auth:
+        if (s->error == EACCES) {
+            return "invalid password";
+        }
+        break;
+    default:
+        break;
+    }
+
+    return (s->error != 0 ? strerror(s->error) : "failed");
+}
+
+session_t *session_new(char const *name, char const *host, char const *port,
+                       char const *password, bool minecraft)
+{
+    session_t *tmp = NULL;
+    int i = 0;
+
+    tmp = calloc(1, sizeof(session_t));
+    if (tmp == NULL) {
+        return NULL;
+    }
+
+    tmp->name = strdup(name);
+    tmp->host = strdup(host);
+    tmp->port = strdup(port);
+    if (password != NULL) {
+        tmp->password = strdup(password);
+    }
+    tmp->minecraft = minecraft;
+    sockopt_init(&tmp->sockopts);
+
+    if (tmp->name == NULL || tmp->host == NULL || tmp->port == NULL ||
+        (password != NULL && tmp->password == NULL)) {
+        session_free(tmp);
+        return NULL;
+    }
+
+    for (i = 0; i < session_phase_max; i++) {
+        tmp->latency[i] = -1;
+    }
+
+    return tmp;
+}
+
+void session_free(session_t *s)
+{
+    return_if_true(s == NULL,);
+
+    free(s->name);
+    free(s->host);
+    free(s->port);
+    free(s->password);
+    free(s->output);
+    free(s);
+}
+
+static void session_io_finish(session_io_t *io, timers_t *timers,
+                              session_status_t status, int error)
+{
+    session_t *s = io->s;
+
+    s->status = status;
+    s->error = error;
+
+    timers_remove(timers, &io->timer);
+
+    if (io->sock > -1) {
+        close(io->sock);
+        io->sock = -1;
+    }
+
+    if (io->addresses != NULL) {
+        resolve_free_addresses(io->addresses);
+        io->addresses = NULL;
+    }
+
+    src_rcon_message_free(io->msg);
+    src_rcon_free(io->r);
+    io->msg = NULL;
+    io->r = NULL;
+
+    free(io->ends);
+    io->ends = NULL;
+
+    free(io->out);
+    io->out = NULL;
+    io->outlen = io->outoff = 0;
+
+    if (io->in != NULL) {
+        g_byte_array_free(io->in, TRUE);
+        io->in = NULL;
+    }
+
+    if (io->output != NULL) {
+        fclose(io->output);
+        io->output = NULL;
+    }
+
+    io->s = NULL;
+    io->state = io_free;
+
+    s->finished = true;
+    if (io->done != NULL) {
+        io->done(s, io->data);
+    }
+}
+
+static session_status_t session_io_failed(session_io_t const *io)
+{
+    switch (io->state)
+    {
+    case io_auth: return session_status_auth;
+    case io_command: return session_status_command;
+    default: return session_status_connect;
+    }
+}
+
+/* Arms the deadline of the current phase, counted from since. Waiting for
+ * the first byte also counts against the command deadline.
+ */
+static void session_io_arm(session_io_t *io, timers_t *timers, double since)
+{
+    session_t *s = io->s;
+    double timeout = s->timeouts[s->phase];
+    double command = s->timeouts[session_phase_command];
+
+    if (s->phase == session_phase_first_byte && command > 0 &&
+        (timeout <= 0 || command < timeout)) {
+        timeout = command;
+    }
+
+    io->deadline = 0;
+
+    timers_remove(timers, &io->timer);
+    if (timeout > 0) {
+        io->deadline = since + timeout;
+        timers_add(timers, &io->timer, io->deadline);
+    }
+}
+
+/* Starts timing the given phase, and arms its deadline
+ */
+static void session_io_phase(session_io_t *io, timers_t *timers,
+                             session_phase_t phase)
+{
+    io->s->phase = phase;
+    io->started = timers_now();
+    session_io_arm(io, timers, io->started);
+}
+
+static void session_io_done(session_io_t *io)
+{
+    session_t *s = io->s;
+    double took = timers_now() - io->started;
+
+    if (s->latency[s->phase] < 0) {
+        s->latency[s->phase] = took;
+    } else {
+        s->latency[s->phase] += took;
+    }
+}
+
+/* Appends a serialised message to the output buffer
+ */
+static int session_io_queue(session_io_t *io, src_rcon_message_t const *m)
+{
+    uint8_t *data = NULL, *tmp = NULL;
+    size_t size = 0;
+
+    if (src_rcon_serialize(io->r, m, &data, &size)) {
+        return -1;
+    }
+
+    tmp = realloc(io->out, io->outlen + size);
+    if (tmp == NULL) {
+        free(data);
+        return -1;
+    }
+
+    memcpy(tmp + io->outlen, data, size);
+    io->out = tmp;
+    io->outlen += size;
+    free(data);
+
+    return 0;
+}
+
+/* Queues the given command, and its end marker
+ */
+static int session_io_command(session_io_t *io, size_t i)
+{
+    src_rcon_message_t *end = NULL;
+
+    src_rcon_message_free(io->msg);
+
+    io->msg = src_rcon_command(io->r, io->s->commands[i]);
+    if (io->msg == NULL || session_io_queue(io, io->msg)) {
+        return -1;
+    }
+
+    /* Minecraft does not like the empty command at the end, see
+     * send_command() in main.c
+     */
+    if (io->s->minecraft) {
+        return 0;
+    }
+
+    end = src_rcon_command(io->r, "");
+    if (end == NULL || session_io_queue(io, end)) {
+        src_rcon_message_free(end);
+        return -1;
+    }
+
+    io->ends[i] = end->id;
+    src_rcon_message_free(end);
+
+    return 0;
+}
+
+static void session_io_commands(session_io_t *io, timers_t *timers)
+{
+    session_t *s = io->s;
+    size_t i = 0;
+
+    for (io->count = 0; s->commands != NULL && s->commands[io->count] != NULL;
+         io->count++)
+        ;
+
+    if (io->count == 0) {
+        session_io_finish(io, timers, session_status_ok, 0);
+        return;
+    }
+
+    io->ends = calloc(io->count, sizeof(int32_t));
+    if (io->ends == NULL) {
+        session_io_finish(io, timers, session_status_command, ENOMEM);
+        return;
+    }
+
+    session_io_phase(io, timers, session_phase_first_byte);
+    io->began = io->sent = io->started;
+    io->state = io_command;
+    io->command = 0;
+    io->fragment = false;
+
+    for (i = 0; i < (s->minecraft ? 1 : io->count); i++) {
+        if (session_io_command(io, i)) {
+            session_io_finish(io, timers, session_status_command, ENOMEM);
+            return;
+        }
+    }
+}
+
+/* The current command is complete
+ */
+static void session_io_next(session_io_t *io, timers_t *timers)
+{
+    session_t *s = io->s;
+
+    io->stale = io->ends[io->command];
+    io->fragment = false;
+    ++s->completed;
+    ++io->command;
+
+    if (io->command == io->count) {
+        s->latency[session_phase_command] = timers_now() - io->began;
+        session_io_finish(io, timers, session_status_ok, 0);
+        return;
+    }
+
+    /* Minecraft commands go out one at a time, so each waits for its
+     * first byte. Pipelined ones were sent long ago.
+     */
+    if (s->minecraft) {
+        session_io_phase(io, timers, session_phase_first_byte);
+        io->sent = io->started;
+        if (session_io_command(io, io->command)) {
+            session_io_finish(io, timers, session_status_command, ENOMEM);
+        }
+        return;
+    }
+
+    io->sent = timers_now();
+    session_io_arm(io, timers, io->sent);
+}
+
+/* The reply to the current command started to come in
+ */
+static void session_io_first_byte(session_io_t *io, timers_t *timers)
+{
+    session_io_done(io);
+    io->s->phase = session_phase_command;
+    io->started = timers_now();
+    session_io_arm(io, timers, io->sent);
+}
+
+static void session_io_connected(session_io_t *io, timers_t *timers)
+{
+    session_t *s = io->s;
+
+    session_io_done(io);
+
+    if (s->password == NULL || strlen(s->password) == 0) {
+        session_io_commands(io, timers);
+        return;
+    }
+
+    session_io_phase(io, timers, session_phase_auth);
+    io->state = io_auth;
+
+    io->msg = src_rcon_auth(io->r, s->password);
+    if (io->msg == NULL || session_io_queue(io, io->msg)) {
+        session_io_finish(io, timers, session_status_auth, ENOMEM);
+    }
+}
+
+/* Tries the remaining addresses until one connects, or is in progress
+ */
+static void session_io_connect(session_io_t *io, timers_t *timers)
+{
+    int error = 0, flags = 0;
+
+    for (; io->next != NULL; io->next = io->next->ai_next) {
+        struct addrinfo const *ai = io->next;
+
+        io->sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (io->sock < 0) {
+            error = errno;
+            continue;
+        }
+
+        /* Best effort, a session does not fail over its options
+         */
+        sockopt_apply(io->sock, &io->s->sockopts);
+
+        flags = fcntl(io->sock, F_GETFL);
+        if (flags < 0 || fcntl(io->sock, F_SETFL, flags | O_NONBLOCK) < 0) {
+            error = errno;
+        } else if (connect(io->sock, ai->ai_addr, ai->ai_addrlen) == 0) {
+            io->next = ai->ai_next;
+            session_io_connected(io, timers);
+            return;
+        } else if (errno == EINPROGRESS) {
+            io->next = ai->ai_next;
+            io->state = io_connecting;
+            return;
+        } else {
+            error = errno;
+        }
+
+        close(io->sock);
+        io->sock = -1;
+    }
+
+    session_io_finish(io, timers, session_status_connect, error);
+}
+
+static void session_io_start(session_io_t *io, timers_t *timers,
+                             session_t *s)
+{
+    io->s = s;
+    io->sock = -1;
+    io->command = 0;
+    io->stale = 0;
+    io->timer.data = io;
+
+    io->output = open_memstream(&s->output, &s->outputlen);
+    io->in = g_byte_array_new();
+    io->r = src_rcon_new();
+    if (io->output == NULL || io->r == NULL) {
+        session_io_finish(io, timers, session_status_connect, ENOMEM);
+        return;
+    }
+
+    session_io_phase(io, timers, session_phase_connect);
+
+    /* Answered from the cache session_run() filled, unless the host failed
+     * to resolve there, in which case this blocks to find out why.
+     */
+    if (resolve_addresses(s->host, s->port, &io->addresses)) {
+        session_io_finish(io, timers, session_status_resolve, 0);
+        return;
+    }
+
+    io->next = io->addresses;
+    session_io_connect(io, timers);
+}
+
+static void session_io_writable(session_io_t *io, timers_t *timers)
+{
+    ssize_t ret = 0;
+
+    if (io->state == io_connecting) {
+        int error = 0;
+        socklen_t len = sizeof(error);
+
+        if (getsockopt(io->sock, SOL_SOCKET, SO_ERROR, &error, &len) < 0) {
+            error = errno;
+        }
+
+        if (error != 0) {
+            close(io->sock);
+            io->sock = -1;
+            if (io->next == NULL) {
+                session_io_finish(io, timers, session_status_connect, error);
+            } else {
+                session_io_connect(io, timers);
+            }
+            return;
+        }
+
+        session_io_connected(io, timers);
+        return;
+    }
+
+    ret = write(io->sock, io->out + io->outoff, io->outlen - io->outoff);
+    if (ret < 0) {
+        if (errno != EAGAIN && errno != EINTR) {
+            session_io_finish(io, timers, session_io_failed(io), errno);
+        }
+        return;
+    }
+
+    io->outoff += ret;
+    if (io->outoff == io->outlen) {
+        free(io->out);
+        io->out = NULL;
+        io->outlen = io->outoff = 0;
+    }
+}
+
+/* Prints the replies into the output buffer, and moves on to the next
+ * command whenever an end marker is seen.
+ */
+static void session_io_replies(session_io_t *io, timers_t *timers,
+                               src_rcon_message_t **replies)
+{
+    src_rcon_message_t **p = NULL;
+
+    for (p = replies; p != NULL && *p != NULL && io->s != NULL; p++) {
+        size_t bodylen = 0;
+
+        if (io->stale != 0 && (*p)->id == io->stale) {
+            continue;
+        }
+
+        if (!io->s->minecraft && (*p)->id == io->ends[io->command]) {
+            session_io_next(io, timers);
+            continue;
+        }
+
+        bodylen = strlen((char const *)(*p)->body);
+        fwrite((*p)->body, 1, bodylen, io->output);
+
+        if (io->s->minecraft) {
+            io->fragment = (bodylen >= SESSION_FRAGMENT);
+        }
+
+        if (bodylen > 0 && (*p)->body[bodylen-1] != '\n' && !io->fragment) {
+            fputc('\n', io->output);
+        }
+
+        if (io->s->minecraft && !io->fragment) {
+            session_io_next(io, timers);
+        }
+    }
+
+    if (io->s != NULL && io->fragment) {
+        /* The reply might be exactly a multiple of the fragment size
+         */
+        double idle = timers_now() + SESSION_FRAGMENT_IDLE;
+
+        if (io->deadline > 0 && io->deadline < idle) {
+            idle = io->deadline;
+        }
+        timers_add(timers, &io->timer, idle);
+    }
+}
+
+static void session_io_readable(session_io_t *io, timers_t *timers)
+{
+    src_rcon_message_t **replies = NULL;
+    uint8_t tmp[SESSION_FRAGMENT];
+    rcon_error_t status;
+    ssize_t ret = 0;
+    size_t off = 0;
+
+    ret = read(io->sock, tmp, sizeof(tmp));
+    if (ret < 0) {
+        if (errno != EAGAIN && errno != EINTR) {
+            session_io_finish(io, timers, session_io_failed(io), errno);
+        }
+        return;
+    }
+
+    if (ret == 0) {
+        session_io_finish(io, timers, session_io_failed(io), ECONNRESET);
+        return;
+    }
+
+    g_byte_array_append(io->in, tmp, ret);
+
+    if (io->state == io_command && io->s->phase == session_phase_first_byte) {
+        session_io_first_byte(io, timers);
+    }
+
+    if (io->state == io_auth) {
+        status = src_rcon_auth_wait(io->r, io->msg, &off,
+                                    io->in->data, io->in->len);
+        if (status == rcon_error_moredata) {
+            return;
+        }
+
+        g_byte_array_remove_range(io->in, 0, off);
+        if (status != rcon_error_success) {
+            session_io_finish(io, timers, session_status_auth,
+                              (status == rcon_error_auth ? EACCES : EPROTO));
+            return;
+        }
+
+        session_io_done(io);
+        session_io_commands(io, timers);
+        return;
+    }
+
+    status = src_rcon_command_wait(io->r, io->msg, &replies, &off,
+                                   io->in->data, io->in->len);
+    if (status == rcon_error_moredata) {
+        return;
+    }
+
+    g_byte_array_remove_range(io->in, 0, off);
+    if (status != rcon_error_success) {
+        session_io_finish(io, timers, session_status_command, EPROTO);
+        return;
+    }
+
+    session_io_replies(io, timers, replies);
+    src_rcon_message_freev(replies);
+}
+
+static void session_io_expired(session_io_t *io, timers_t *timers,
+                               double now)
+{
+    if (io->state == io_command && io->fragment &&
+        (io->deadline <= 0 || now < io->deadline)) {
+        /* Nothing came after a full frame, so that was the last one
+         */
+        session_io_next(io, timers);
+        return;
+    }
+
+    /* The command deadline also runs while waiting for the first byte
+     */
+    if (io->s->phase == session_phase_first_byte &&
+        io->s->timeouts[session_phase_command] > 0 &&
+        now >= io->sent + io->s->timeouts[session_phase_command]) {
+        io->s->phase = session_phase_command;
+    }
+
+    session_io_finish(io, timers, session_status_timeout, ETIMEDOUT);
+}
+
+int session_run(session_t **sessions, size_t count, unsigned int jobs,
+                double deadline, session_done_t done, void *data)
+{
+    session_io_t *slots = NULL;
+    struct pollfd *pfds = NULL;
+    timers_t *timers = NULL;
+    timers_entry_t *e = NULL;
+    char const **hosts = NULL, **ports = NULL;
+    size_t next = 0, active = 0, i = 0;
+    double end = 0, now = 0;
+    int timeout = 0, ec = -1;
+
+    return_if_true(sessions == NULL && count > 0, -1);
+
+    if (jobs == 0 || jobs > count) {
+        jobs = (count > 0 ? count : 1);
+    }
+
+    slots = calloc(jobs, sizeof(session_io_t));
+    pfds = calloc(jobs, sizeof(struct pollfd));
+    timers = timers_new();
+    if (slots == NULL || pfds == NULL || timers == NULL) {
+        goto cleanup;
+    }
+
+    for (i = 0; i < jobs; i++) {
+        slots[i].done = done;
+        slots[i].data = data;
+    }
+
+    end = (deadline > 0 ? timers_now() + deadline : 0);
+
+    /* Look up all hosts at once, rather than one after another as the
+     * sessions start. Whatever this misses is resolved by the session.
+     */
+    hosts = calloc(count + 1, sizeof(char const *));
+    ports = calloc(count + 1, sizeof(char const *));
+    if (hosts != NULL && ports != NULL) {
+        size_t n = 0;
+
+        for (i = 0; i < count; i++) {
+            if (!sessions[i]->finished) {
+                hosts[n] = sessions[i]->host;
+                ports[n++] = sessions[i]->port;
+            }
+        }
+        resolve_prefetch(hosts, ports, n, jobs);
+    }
+    free(hosts);
+    free(ports);
+
+    while (next < count || active > 0) {
+        now = timers_now();
+
+        if (end > 0 && now >= end) {
+            break;
+        }
+
+        for (i = 0; i < jobs && next < count; i++) {
+            /* Failed before they could start
+             */
+            while (next < count && sessions[next]->finished) {
+                if (done != NULL) {
+                    done(sessions[next], data);
+                }
+                ++next;
+            }
+
+            if (slots[i].s == NULL && next < count) {
+                session_io_start(&slots[i], timers, sessions[next++]);
+            }
+        }
+
+        while ((e = timers_expired(timers, now)) != NULL) {
+            session_io_expired((session_io_t*)e->data, timers, now);
+        }
+
+        active = 0;
+        for (i = 0; i < jobs; i++) {
+            session_io_t *io = &slots[i];
+
+            pfds[i].fd = -1;
+            pfds[i].events = 0;
+            pfds[i].revents = 0;
+
+            if (io->s == NULL) {
+                continue;
+            }
+
+            /* Keep reading while the pipelined commands are written, so
+             * neither side can block the other.
+             */
+            ++active;
+            pfds[i].fd = io->sock;
+            if (io->state == io_connecting) {
+                pfds[i].events = POLLOUT;
+            } else {
+                pfds[i].events = POLLIN;
+                if (io->outoff < io->outlen) {
+                    pfds[i].events |= POLLOUT;
+                }
+            }
+        }
+
+        if (active == 0) {
+            continue;
+        }
+
+        timeout = timers_timeout(timers, now);
+        if (end > 0) {
+            int left = (int)((end - now) * 1000) + 1;
+
+            if (timeout < 0 || left < timeout) {
+                timeout = left;
+            }
+        }
+
+        if (poll(pfds, jobs, timeout) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            goto cleanup;
+        }
+
+        for (i = 0; i < jobs; i++) {
+            session_io_t *io = &slots[i];
+
+            if (io->s == NULL || pfds[i].revents == 0) {
+                continue;
+            }
+
+            if (io->state == io_connecting ||
+                (pfds[i].revents & POLLOUT)) {
+                session_io_writable(io, timers);
+            }
+
+            if (io->s != NULL && io->state != io_connecting &&
+                (pfds[i].revents & (POLLIN | POLLERR | POLLHUP))) {
+                session_io_readable(io, timers);
+            }
+        }
+    }
+
+    ec = 0;
+
+cleanup:
+
+    /* Whatever is still running missed the deadline
+     */
+    for (i = 0; slots != NULL && i < jobs; i++) {
+        if (slots[i].s != NULL) {
+            session_io_finish(&slots[i], timers, session_status_timeout,
+                              ETIMEDOUT);
+        }
+    }
+
+    for (; next < count; next++) {
+        if (!sessions[next]->finished) {
+            sessions[next]->status = session_status_skipped;
+            sessions[next]->finished = true;
+        }
+        if (done != NULL) {
+            done(sessions[next], data);
+        }
+    }
+
+    timers_free(timers);
+    free(slots);
+    free(pfds);
+
+    return ec;
+}
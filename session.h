@@ -0,0 +1,93 @@
+#ifndef RCON_SESSION_H
+#define RCON_SESSION_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "sockopt.h"
+
+/* Talks to many servers at once from a single poll() loop. Each session
+ * connects, authenticates, and sends all its commands at once, and the
+ * replies are collected in memory, so that they can be printed in a
+ * deterministic order afterwards.
+ */
+typedef enum {
+    session_phase_connect = 0,
+    session_phase_auth,
+    /* From sending a command until the first byte of its reply
+     */
+    session_phase_first_byte,
+    session_phase_command,
+    session_phase_max,
+} session_phase_t;
+
+typedef enum {
+    session_status_ok = 0,
+    /* Never started, because the overall deadline passed first
+     */
+    session_status_skipped,
+    /* The server has no port in the configuration file
+     */
+    session_status_config,
+    session_status_resolve,
+    session_status_connect,
+    session_status_auth,
+    session_status_command,
+    session_status_timeout,
+} session_status_t;
+
+typedef struct {
+    char *name;
+    char *host;
+    char *port;
+    char *password;
+    bool minecraft;
+    /* NULL terminated, not owned by the session
+     */
+    char * const *commands;
+    /* Per session deadlines, zero for none. The first byte and command
+     * deadlines apply to each command, and the command deadline also runs
+     * while waiting for the first byte.
+     */
+    double timeouts[session_phase_max];
+    sockopt_t sockopts;
+
+    session_status_t status;
+    /* The phase that failed or timed out, and the errno behind it, if any
+     */
+    session_phase_t phase;
+    int error;
+    /* Seconds each phase took, negative if it was not reached. The command
+     * phase is the time spent running all commands.
+     */
+    double latency[session_phase_max];
+    size_t completed;
+    bool finished;
+    char *output;
+    size_t outputlen;
+} session_t;
+
+session_t *session_new(char const *name, char const *host, char const *port,
+                       char const *password, bool minecraft);
+void session_free(session_t *s);
+
+/* Called as soon as a session finished, or was skipped
+ */
+typedef void (*session_done_t)(session_t *s, void *data);
+
+/* Runs all sessions, at most jobs of them at the same time. If deadline is
+ * positive, gives up on everything that did not finish within that many
+ * seconds. Sessions that are finished already are not started, only handed
+ * to the done callback, which may be NULL.
+ */
+int session_run(session_t **sessions, size_t count, unsigned int jobs,
+                double deadline, session_done_t done, void *data);
+
+char const *session_status_name(session_status_t status);
+char const *session_phase_name(session_phase_t phase);
+
+/* Why the given session failed, or NULL if it did not
+ */
+char const *session_error(session_t const *s);
+
+#endif
@@ -0,0 +1,72 @@
+#include "sockopt.h"
+#include "rcon.h"
+
+#include <stdlib.h>
+#include <errno.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+void sockopt_init(sockopt_t *o)
+{
+    return_if_true(o == NULL,);
+
+    o->nodelay = 1;
+    o->keepalive = -1;
+    o->keepalive_idle = -1;
+    o->keepalive_interval = -1;
+    o->keepalive_count = -1;
+    o->rcvbuf = -1;
+    o->sndbuf = -1;
+    o->busy_poll = -1;
+}
+
+static int sockopt_set(int sock, int level, int name, int value, int *error)
+{
+    if (value < 0) {
+        return 0;
+    }
+
+    if (setsockopt(sock, level, name, &value, sizeof(value)) < 0) {
+        if (*error == 0) {
+            *error = errno;
+        }
+        return -1;
+    }
+
+    return 0;
+}
+
+int sockopt_apply(int sock, sockopt_t const *o)
+{
+    int error = 0;
+
+    return_if_true(o == NULL, 0);
+
+    sockopt_set(sock, IPPROTO_TCP, TCP_NODELAY, o->nodelay, &error);
+    sockopt_set(sock, SOL_SOCKET, SO_KEEPALIVE, o->keepalive, &error);
+#ifdef TCP_KEEPIDLE
+    sockopt_set(sock, IPPROTO_TCP, TCP_KEEPIDLE, o->keepalive_idle, &error);
+#endif
+#ifdef TCP_KEEPINTVL
+    sockopt_set(sock, IPPROTO_TCP, TCP_KEEPINTVL, o->keepalive_interval,
+                &error);
+#endif
+#ifdef TCP_KEEPCNT
+    sockopt_set(sock, IPPROTO_TCP, TCP_KEEPCNT, o->keepalive_count, &error);
+#endif
+    sockopt_set(sock, SOL_SOCKET, SO_RCVBUF, o->rcvbuf, &error);
+    sockopt_set(sock, SOL_SOCKET, SO_SNDBUF, o->sndbuf, &error);
+#ifdef SO_BUSY_POLL
+    sockopt_set(sock, SOL_SOCKET, SO_BUSY_POLL, o->busy_poll, &error);
+#endif
+
+    if (error != 0) {
+        errno = error;
+        return -1;
+    }
+
+    return 0;
+}
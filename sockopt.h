@@ -0,0 +1,35 @@
+#ifndef RCON_SOCKOPT_H
+#define RCON_SOCKOPT_H
+
+/* Options set on every socket before it connects, so that the buffer sizes
+ * are part of the window the handshake announces. A negative value leaves
+ * the system default alone.
+ */
+typedef struct {
+    /* Disables Nagle, on by default since every command waits for its reply
+     */
+    int nodelay;
+    int keepalive;
+    /* Seconds before the first probe, between probes, and how many probes
+     * go unanswered before the connection is dropped
+     */
+    int keepalive_idle;
+    int keepalive_interval;
+    int keepalive_count;
+    /* Bytes
+     */
+    int rcvbuf;
+    int sndbuf;
+    /* Microseconds to busy poll for data before sleeping in poll()
+     */
+    int busy_poll;
+} sockopt_t;
+
+void sockopt_init(sockopt_t *o);
+
+/* Sets all options that are not negative. Tries every option, and returns
+ * -1 with errno set if any of them failed.
+ */
+int sockopt_apply(int sock, sockopt_t const *o);
+
+#endif
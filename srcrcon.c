@@ -3,7 +3,6 @@
 #include "sysconfig.h"
 
 #include "memstream.h"
-#include "fmemopen.h"
 
 #ifndef HAVE_ARC4RANDOM_UNIFORM
 #include <bsd/stdlib.h>
@@ -264,105 +263,311 @@ src_rcon_serialize(src_rcon_t *r,
     return rcon_error_success;
 }
 
+/* Size of a frame without its size field: id, type and two NULs
+ */
+#define SRC_RCON_MIN_SIZE 10
+
+/* Largest size field taken. Servers send at most 4096 bytes of body in a
+ * frame. Minecraft counts those in characters, which take up to three
+ * bytes each once encoded.
+ */
+#define SRC_RCON_MAX_SIZE (3 * 4096 + SRC_RCON_MIN_SIZE)
+
+static int32_t src_rcon_get32(uint8_t const *p)
+{
+    int32_t v = 0;
+
+    memcpy(&v, p, sizeof(v));
+
+    return v;
+}
+
+ssize_t src_rcon_scan(void const *buf, size_t sz, size_t *frames,
+                      size_t max, size_t *end)
+{
+    uint8_t const *p = (uint8_t const *)buf;
+    size_t o = 0, count = 0;
+
+    while (sz - o >= sizeof(int32_t) && (frames == NULL || count < max)) {
+        int32_t size = src_rcon_get32(p + o);
+        int32_t type = 0;
+
+        if (size < SRC_RCON_MIN_SIZE || size > SRC_RCON_MAX_SIZE) {
+            break;
+        }
+
+        if ((size_t)size > sz - o - sizeof(int32_t)) {
+            /* Not all there yet
+             */
+            if (end) {
+                *end = o;
+            }
+            return count;
+        }
+
+        type = src_rcon_get32(p + o + 8);
+        if ((type != serverdata_value && type != serverdata_auth_response &&
+             type != serverdata_auth) ||
+            p[o + sizeof(int32_t) + size - 2] != '\0' ||
+            p[o + sizeof(int32_t) + size - 1] != '\0') {
+            break;
+        }
+
+        if (frames != NULL) {
+            frames[count] = o;
+        }
+        ++count;
+        o += sizeof(int32_t) + size;
+    }
+
+    if (end) {
+        *end = o;
+    }
+
+    /* Only a broken frame right at the start is an error, so that the
+     * frames before it can still be used.
+     */
+    if (count == 0 && sz - o >= sizeof(int32_t) &&
+        (frames == NULL || max > 0)) {
+        return -1;
+    }
+
+    return count;
+}
+
 rcon_error_t
 src_rcon_deserialize(src_rcon_t *r,
                      src_rcon_message_t ***msg, size_t *off,
                      size_t *cnt, void const *buf, size_t sz)
 {
-    uint32_t count = 1;
-    FILE *str = NULL;
+    uint8_t const *p = (uint8_t const *)buf;
     src_rcon_message_t **res = NULL;
-    size_t consumed = 0;
+    ssize_t count = 0, i = 0;
+    size_t consumed = 0, o = 0;
 
     return_if_true(msg == NULL, rcon_error_args);
     return_if_true(off == NULL, rcon_error_args);
     return_if_true(buf == NULL, rcon_error_args);
     return_if_true(sz == 0, rcon_error_args);
 
-    str = fmemopen((char*)buf, sz, "r");
-    if (str == NULL) {
+    /* Find all complete frames first, so that the result is allocated
+     * once, and only then decode them.
+     */
+    count = src_rcon_scan(buf, sz, NULL, 0, &consumed);
+    if (count < 0) {
+        return rcon_error_protocol;
+    } else if (count == 0) {
+        return rcon_error_moredata;
+    }
+
+    if (cnt && *cnt > 0 && (size_t)count > *cnt) {
+        count = *cnt;
+        consumed = 0;
+    }
+
+    res = calloc(count + 1, sizeof(src_rcon_message_t*));
+    if (res == NULL) {
         return rcon_error_memory;
     }
 
-    do {
+    for (i = 0; i < count; i++) {
         src_rcon_message_t *m = NULL;
-        src_rcon_message_t **tmp = NULL;
-        size_t bufsize = 0;
+        size_t bodysize = 0;
 
-        if (cnt && *cnt > 0) {
-            if (count-1 > *cnt) {
-                break;
-            }
-        }
-
-        m = src_rcon_message_new();
+        m = calloc(1, sizeof(src_rcon_message_t));
         if (m == NULL) {
             src_rcon_message_freev(res);
             return rcon_error_memory;
         }
+        res[i] = m;
 
-        if (fread(&m->size, 1, sizeof(m->size), str) < sizeof(m->size)) {
-            src_rcon_message_free(m);
-            break;
-        }
-
-        if (fread(&m->id, 1, sizeof(m->id), str) < sizeof(m->id)) {
-            src_rcon_message_free(m);
-            break;
-        }
+        m->size = src_rcon_get32(p + o);
+        m->id = src_rcon_get32(p + o + 4);
+        m->type = src_rcon_get32(p + o + 8);
 
-        if (fread(&m->type, 1, sizeof(m->type), str) < sizeof(m->type)) {
-            src_rcon_message_free(m);
-            break;
-        }
-
-        bufsize = m->size - sizeof(m->id) - sizeof(m->type) - sizeof(m->null);
-        free(m->body);
-        m->body = calloc(1, bufsize+1);
+        /* The body, including its NUL, and the trailing NUL
+         */
+        bodysize = m->size - sizeof(m->id) - sizeof(m->type) - sizeof(m->null);
+        m->body = malloc(bodysize + 1);
         if (m->body == NULL) {
-            src_rcon_message_free(m);
             src_rcon_message_freev(res);
             return rcon_error_memory;
         }
+        memcpy(m->body, p + o + 12, bodysize);
+        m->body[bodysize] = '\0';
+        m->null = p[o + 12 + bodysize];
 
-        if (fread(m->body, 1, bufsize, str) < bufsize) {
-            src_rcon_message_free(m);
-            break;
-        }
+        o += m->size + sizeof(m->size);
+    }
 
-        if (fread(&m->null, 1, sizeof(m->null), str) < sizeof(m->null)) {
-            src_rcon_message_free(m);
-            break;
-        }
+    if (consumed == 0) {
+        consumed = o;
+    }
 
-        ++count;
+    *off = consumed;
+    *msg = res;
+    if (cnt) {
+        *cnt = count;
+    }
+
+    return rcon_error_success;
+}
 
-        tmp = realloc(res, count * sizeof(src_rcon_message_t*));
+/* Length of the body of a frame src_rcon_scan() found, up to its NUL
+ */
+static size_t src_rcon_body_length(uint8_t const *p)
+{
+    int32_t size = src_rcon_get32(p);
+    uint8_t const *nul = NULL;
+
+    nul = memchr(p + 12, '\0', size - 8);
+
+    return (size_t)(nul - (p + 12));
+}
+
+/* Grows an array geometrically until it holds need elements, so that
+ * adding frames one read at a time stays linear in the reply size.
+ */
+static bool src_rcon_grow(void **array, size_t *capacity, size_t need,
+                          size_t element)
+{
+    size_t n = (*capacity > 0 ? *capacity : 16);
+    void *tmp = NULL;
+
+    if (need <= *capacity) {
+        return true;
+    }
+
+    while (n < need) {
+        n *= 2;
+    }
+
+    tmp = realloc(*array, n * element);
+    if (tmp == NULL) {
+        return false;
+    }
+
+    *array = tmp;
+    *capacity = n;
+
+    return true;
+}
+
+rcon_error_t
+src_rcon_response_add(src_rcon_t *r,
+                      src_rcon_message_t const *cmd,
+                      src_rcon_message_t const *end,
+                      src_rcon_response_t **response,
+                      size_t *off, void const *buf,
+                      size_t sz)
+{
+    uint8_t const *p = (uint8_t const *)buf;
+    src_rcon_response_t *tmp = NULL;
+    ssize_t count = 0, i = 0;
+    size_t consumed = 0, o = 0, frames = 0, size = 0;
+
+    return_if_true(cmd == NULL, rcon_error_args);
+    return_if_true(response == NULL, rcon_error_args);
+    return_if_true(off == NULL, rcon_error_args);
+    return_if_true(buf == NULL, rcon_error_args);
+    return_if_true(sz == 0, rcon_error_args);
+
+    count = src_rcon_scan(buf, sz, NULL, 0, &consumed);
+    if (count < 0) {
+        return rcon_error_protocol;
+    } else if (count == 0) {
+        return rcon_error_moredata;
+    }
+
+    if (*response == NULL) {
+        tmp = calloc(1, sizeof(src_rcon_response_t));
         if (tmp == NULL) {
-            src_rcon_message_freev(res);
-            src_rcon_message_free(m);
             return rcon_error_memory;
         }
-        res = tmp;
+        tmp->id = cmd->id;
+        *response = tmp;
+    }
+    tmp = *response;
 
-        tmp[count-2] = m;
-        tmp[count-1] = NULL;
+    frames = tmp->frames - tmp->first;
+    size = tmp->size - tmp->base;
 
-        consumed += m->size + sizeof(m->size);
-    } while(true);
+    /* Size the new frames first, so that the arrays grow at most once for
+     * all of them.
+     */
+    for (i = 0; i < count; i++) {
+        if (src_rcon_get32(p + o + 4) == cmd->id) {
+            ++frames;
+            size += src_rcon_body_length(p + o);
+        }
+        o += sizeof(int32_t) + src_rcon_get32(p + o);
+    }
 
-    fclose(str);
+    if (!src_rcon_grow((void **)&tmp->ends, &tmp->endcapacity, frames,
+                       sizeof(size_t)) ||
+        !src_rcon_grow((void **)&tmp->body, &tmp->capacity, size + 1, 1)) {
+        return rcon_error_memory;
+    }
 
-    if (res != NULL) {
-        if (off) {
-            *off = consumed;
-        }
-        *msg = res;
-        if (cnt) {
-            *cnt = (count-1);
+    for (i = 0, o = 0; i < count; i++) {
+        int32_t id = src_rcon_get32(p + o + 4);
+
+        ++tmp->received;
+        if (id == cmd->id) {
+            size_t len = src_rcon_body_length(p + o);
+
+            memcpy(tmp->body + (tmp->size - tmp->base), p + o + 12, len);
+            tmp->size += len;
+            tmp->ends[tmp->frames++ - tmp->first] = tmp->size;
+        } else if (end != NULL && id == end->id) {
+            tmp->complete = true;
         }
-        return rcon_error_success;
+        o += sizeof(int32_t) + src_rcon_get32(p + o);
+    }
+    tmp->body[tmp->size - tmp->base] = '\0';
+
+    *off = consumed;
+
+    return rcon_error_success;
+}
+
+void src_rcon_response_free(src_rcon_response_t *response)
+{
+    if (response == NULL) {
+        return;
+    }
+
+    free(response->ends);
+    free(response->body);
+    free(response);
+}
+
+void src_rcon_response_drop(src_rcon_response_t *response)
+{
+    if (response == NULL) {
+        return;
+    }
+
+    response->first = response->frames;
+    response->base = response->size;
+    if (response->body != NULL) {
+        response->body[0] = '\0';
+    }
+}
+
+char const *src_rcon_response_frame(src_rcon_response_t const *response,
+                                    size_t i, size_t *len)
+{
+    size_t start = 0;
+
+    return_if_true(response == NULL, NULL);
+    return_if_true(i < response->first || i >= response->frames, NULL);
+
+    i -= response->first;
+    start = (i > 0 ? response->ends[i - 1] : response->base);
+    if (len) {
+        *len = response->ends[i] - start;
     }
 
-    return rcon_error_moredata;
+    return (char const *)response->body + (start - response->base);
 }
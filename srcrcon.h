@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <sys/types.h>
 #include "rcon.h"
 
 typedef enum {
@@ -22,6 +24,36 @@ typedef struct {
     uint8_t null;
 } src_rcon_message_t;
 
+/* The reply to one command, put together from all of its frames. The
+ * frame ends and the body grow geometrically as frames come in.
+ */
+typedef struct {
+    int32_t id;
+    /* Set once the reply to the end marker sent behind the command came
+     * in. Minecraft has no end marker, there the caller has to decide.
+     */
+    bool complete;
+    /* Frames of the reply, and all frames read, including those for the end
+     * marker or for other requests
+     */
+    size_t frames;
+    size_t received;
+    /* Frames and body bytes given up by src_rcon_response_drop()
+     */
+    size_t first;
+    size_t base;
+    /* Offset in the reply after each frame from first on
+     */
+    size_t *ends;
+    size_t endcapacity;
+    /* Length of the whole reply, and the frame bodies from first on back
+     * to back, NUL terminated
+     */
+    size_t size;
+    uint8_t *body;
+    size_t capacity;
+} src_rcon_response_t;
+
 src_rcon_t *src_rcon_new(void);
 void src_rcon_free(src_rcon_t *msg);
 
@@ -36,6 +68,31 @@ rcon_error_t src_rcon_command_wait(src_rcon_t *r,
                                    size_t *off, void const *buf,
                                    size_t size);
 
+/* Adds all complete frames in the buffer that answer cmd to the response,
+ * which is allocated on the first call. end is the end marker sent behind
+ * cmd, or NULL. Frames for other requests are skipped. Returns
+ * rcon_error_moredata if there is no complete frame yet, otherwise off is
+ * set to the bytes used.
+ */
+rcon_error_t src_rcon_response_add(src_rcon_t *r,
+                                   src_rcon_message_t const *cmd,
+                                   src_rcon_message_t const *end,
+                                   src_rcon_response_t **response,
+                                   size_t *off, void const *buf,
+                                   size_t size);
+void src_rcon_response_free(src_rcon_response_t *response);
+
+/* Gives up the frames read so far, for callers that are done with them.
+ * The counts keep covering the whole reply.
+ */
+void src_rcon_response_drop(src_rcon_response_t *response);
+
+/* The body of the i-th frame of the response, not NUL terminated, or NULL
+ * if it was dropped
+ */
+char const *src_rcon_response_frame(src_rcon_response_t const *response,
+                                    size_t i, size_t *len);
+
 src_rcon_message_t *src_rcon_auth(src_rcon_t *r, char const *password);
 rcon_error_t src_rcon_auth_wait(src_rcon_t *r,
                                 src_rcon_message_t const *auth,
@@ -46,6 +103,23 @@ rcon_error_t src_rcon_serialize(src_rcon_t *r,
                                 src_rcon_message_t const *m,
                                 uint8_t **buf, size_t *sz);
 
+/* Finds the complete frames at the start of the buffer by their size
+ * fields, checking their type and terminators but without decoding them.
+ * The offset of each frame is stored in frames, unless it is NULL, up to
+ * max of them, and end is set to the offset after the last one.
+ *
+ * Returns the amount of frames found. Scanning stops at the first broken
+ * frame, and -1 is returned if that is the very first one. A size field
+ * larger than any server sends counts as broken, rather than waiting for
+ * more data.
+ */
+ssize_t src_rcon_scan(void const *buf, size_t sz, size_t *frames,
+                      size_t max, size_t *end);
+
+/* Decodes all complete frames, at most *cnt of them if that is not zero.
+ * Returns rcon_error_moredata if there is none, and rcon_error_protocol if
+ * the first frame is broken.
+ */
 rcon_error_t src_rcon_deserialize(src_rcon_t *r,
                                   src_rcon_message_t ***msg, size_t *off,
                                   size_t *count, void const *buf,
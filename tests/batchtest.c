@@ -0,0 +1,83 @@
+#include <check.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <batch.h>
+
+START_TEST(batch_quoting)
+{
+    ck_assert_msg(batch_joinable("sv_cheats 0"), "batch: plain command");
+    ck_assert_msg(batch_joinable("say \"a;b\""),
+                  "batch: quoted semicolon");
+    ck_assert_msg(!batch_joinable("say \"open"), "batch: open quote");
+    ck_assert_msg(!batch_joinable("exec x // comment"), "batch: comment");
+    ck_assert_msg(batch_joinable("say \"http://example.com\""),
+                  "batch: quoted comment");
+}
+END_TEST
+
+START_TEST(batch_join)
+{
+    batch_t *b = batch_new(20);
+
+    ck_assert_msg(b != NULL, "batch: failed to allocate");
+    ck_assert_msg(batch_count(b) == 0 && strcmp(batch_commands(b), "") == 0,
+                  "batch: not empty");
+
+    ck_assert_msg(batch_add(b, "mp_a 1", true) == 0 &&
+                  batch_add(b, "mp_b 2", false) == 0 &&
+                  batch_add(b, "mp_c", true) == 0,
+                  "batch: failed to add");
+    ck_assert_msg(strcmp(batch_commands(b), "mp_a 1;mp_b 2;mp_c") == 0,
+                  "batch: wrong commands: %s", batch_commands(b));
+    ck_assert_msg(batch_count(b) == 3 && !batch_idempotent(b),
+                  "batch: wrong count or idempotence");
+
+    /* Exactly 20 with the separator would fit, 21 does not
+     */
+    ck_assert_msg(batch_add(b, "x", true) == 0, "batch: full too early");
+    ck_assert_msg(batch_add(b, "y", true) == -1, "batch: over the limit");
+
+    batch_clear(b);
+    ck_assert_msg(batch_count(b) == 0 && batch_idempotent(b),
+                  "batch: not cleared");
+
+    /* An empty batch takes anything, but nothing follows an open quote
+     */
+    ck_assert_msg(batch_add(b, "say \"this is longer than twenty", true) == 0,
+                  "batch: long command refused");
+    ck_assert_msg(batch_add(b, "a", true) == -1,
+                  "batch: command after open quote");
+
+    batch_free(b);
+}
+END_TEST
+
+int main(int ac, char **av)
+{
+    Suite *s = NULL;
+    SRunner *r = NULL;
+    TCase *c = NULL;
+    int failed = 0;
+
+    /* Don't fork
+     */
+    putenv("CK_FORK=no");
+
+    s = suite_create("rcon");
+
+    c = tcase_create("batch");
+
+    tcase_add_test(c, batch_quoting);
+    tcase_add_test(c, batch_join);
+
+    suite_add_tcase(s, c);
+
+    r = srunner_create(s);
+    srunner_run_all(r, CK_NORMAL);
+    failed = srunner_ntests_failed(r);
+
+    srunner_free(r);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
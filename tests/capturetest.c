@@ -0,0 +1,202 @@
+#include <check.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <capture.h>
+
+static char const *capfile = "capturetest.cap";
+
+static struct {
+    capture_direction_t direction;
+    char const *data;
+} const chunks[] = {
+    { capture_out, "\x0C\x00\x00\x00\x01\x00\x00\x00\x03\x00\x00\x00pw\0\0" },
+    { capture_in, "\x0A\x00\x00\x00\x01\x00\x00\x00" },
+    { capture_in, "\x00\x00\x00\x00\0\0" },
+    { capture_out, "" },
+    { capture_in, "hostname: eu1" },
+};
+
+#define CHUNKS (sizeof(chunks) / sizeof(chunks[0]))
+
+/* The sizes above, as strlen() stops at the first NUL
+ */
+static size_t const lengths[CHUNKS] = { 16, 8, 6, 0, 13 };
+
+static void capture_record(void)
+{
+    capture_t *c = NULL;
+    size_t i = 0;
+
+    c = capture_open(capfile);
+    ck_assert_msg(c != NULL, "capture: failed to open %s", capfile);
+
+    for (i = 0; i < CHUNKS; i++) {
+        ck_assert_msg(capture_write(c, chunks[i].direction, chunks[i].data,
+                                    lengths[i]) == 0,
+                      "capture: failed to write chunk %zu", i);
+    }
+
+    ck_assert_msg(capture_close(c) == 0, "capture: failed to close");
+}
+
+START_TEST(capture_roundtrip)
+{
+    capture_file_t *f = NULL;
+    capture_record_t rec;
+    struct timespec ts = {0};
+    uint64_t now = 0, first = 0, last = 0;
+    size_t i = 0;
+    int ret = 0;
+
+    capture_record();
+
+    f = capture_map(capfile);
+    ck_assert_msg(f != NULL, "capture: failed to map %s", capfile);
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    now = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    ck_assert_msg(capture_start(f) > 0 && capture_start(f) <= now,
+                  "capture: wrong start time");
+
+    /* Each chunk comes back whole, in the order and direction written
+     */
+    for (i = 0; (ret = capture_next(f, &rec)) > 0; i++) {
+        ck_assert_msg(i < CHUNKS, "capture: more records than written");
+        ck_assert_msg(rec.direction == chunks[i].direction,
+                      "capture: wrong direction of chunk %zu", i);
+        ck_assert_msg(rec.length == lengths[i] &&
+                      memcmp(rec.data, chunks[i].data, lengths[i]) == 0,
+                      "capture: wrong data in chunk %zu", i);
+        ck_assert_msg(rec.time >= last,
+                      "capture: chunk %zu is older than the one before", i);
+        if (i == 0) {
+            first = rec.time;
+        }
+        last = rec.time;
+    }
+    ck_assert_msg(ret == 0 && i == CHUNKS,
+                  "capture: %zu of %zu records read", i, CHUNKS);
+    ck_assert_msg(capture_next(f, &rec) == 0, "capture: read past the end");
+
+    /* And again from the start
+     */
+    capture_rewind(f);
+    ck_assert_msg(capture_next(f, &rec) == 1 && rec.time == first &&
+                  rec.direction == capture_out && rec.length == lengths[0],
+                  "capture: rewind did not start over");
+
+    capture_unmap(f);
+    unlink(capfile);
+}
+END_TEST
+
+START_TEST(capture_truncated)
+{
+    capture_file_t *f = NULL;
+    capture_record_t rec;
+    size_t i = 0;
+    off_t full = CAPTURE_HEADER_SIZE;
+    int ret = 0;
+
+    capture_record();
+
+    for (i = 0; i < CHUNKS; i++) {
+        full += CAPTURE_RECORD_SIZE + lengths[i];
+    }
+
+    /* The last chunk lost some of its data
+     */
+    ck_assert_msg(truncate(capfile, full - 3) == 0,
+                  "capture: failed to truncate");
+    f = capture_map(capfile);
+    ck_assert_msg(f != NULL, "capture: failed to map %s", capfile);
+
+    for (i = 0; (ret = capture_next(f, &rec)) > 0; i++)
+        ;
+    ck_assert_msg(ret == -1 && i == CHUNKS - 1,
+                  "capture: truncated chunk not reported after %zu", i);
+    capture_unmap(f);
+
+    /* Or is cut off within its record header
+     */
+    ck_assert_msg(truncate(capfile, full - lengths[CHUNKS - 1] - 5) == 0,
+                  "capture: failed to truncate");
+    f = capture_map(capfile);
+    ck_assert_msg(f != NULL, "capture: failed to map %s", capfile);
+
+    for (i = 0; (ret = capture_next(f, &rec)) > 0; i++)
+        ;
+    ck_assert_msg(ret == -1 && i == CHUNKS - 1,
+                  "capture: truncated header not reported after %zu", i);
+    capture_unmap(f);
+
+    /* Nothing but the header is an empty capture
+     */
+    ck_assert_msg(truncate(capfile, CAPTURE_HEADER_SIZE) == 0,
+                  "capture: failed to truncate");
+    f = capture_map(capfile);
+    ck_assert_msg(f != NULL && capture_next(f, &rec) == 0,
+                  "capture: header only capture not empty");
+    capture_unmap(f);
+
+    /* And less than that is no capture at all
+     */
+    ck_assert_msg(truncate(capfile, CAPTURE_HEADER_SIZE - 1) == 0,
+                  "capture: failed to truncate");
+    ck_assert_msg(capture_map(capfile) == NULL,
+                  "capture: mapped a short file");
+
+    unlink(capfile);
+}
+END_TEST
+
+START_TEST(capture_foreign)
+{
+    FILE *f = NULL;
+
+    f = fopen(capfile, "wb");
+    ck_assert_msg(f != NULL, "capture: failed to write %s", capfile);
+    fputs("RCONCAP0 and then something else", f);
+    fclose(f);
+
+    ck_assert_msg(capture_map(capfile) == NULL,
+                  "capture: mapped a file with the wrong magic");
+    ck_assert_msg(capture_map("capturetest.d/none.cap") == NULL,
+                  "capture: mapped a missing file");
+
+    unlink(capfile);
+}
+END_TEST
+
+int main(int ac, char **av)
+{
+    Suite *s = NULL;
+    SRunner *r = NULL;
+    TCase *c = NULL;
+    int failed = 0;
+
+    /* Don't fork
+     */
+    putenv("CK_FORK=no");
+
+    s = suite_create("rcon");
+
+    c = tcase_create("capture");
+
+    tcase_add_test(c, capture_roundtrip);
+    tcase_add_test(c, capture_truncated);
+    tcase_add_test(c, capture_foreign);
+
+    suite_add_tcase(s, c);
+
+    r = srunner_create(s);
+    srunner_run_all(r, CK_NORMAL);
+    failed = srunner_ntests_failed(r);
+
+    srunner_free(r);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
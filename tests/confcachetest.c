@@ -0,0 +1,166 @@
+#include <check.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <confcache.h>
+#include <sysconfig.h>
+#include <stdbool.h>
+
+static char const *config =
+    "[one]\n"
+    "hostname=127.0.0.1\n"
+    "port=27015\n"
+    "urgent=kick,ban\n"
+    "\n"
+    "[two]\n"
+    "hostname=example.com\n"
+    "password=a\\sb\n"
+    "\n"
+    "[empty]\n";
+
+static GKeyFile *confcache_parse(struct stat *st)
+{
+    GKeyFile *k = g_key_file_new();
+    FILE *f = NULL;
+
+    f = fopen("confcachetest.ini", "w");
+    ck_assert_msg(f != NULL, "confcache: failed to write config");
+    fputs(config, f);
+    fclose(f);
+
+    ck_assert_msg(stat("confcachetest.ini", st) == 0,
+                  "confcache: failed to stat config");
+    ck_assert_msg(g_key_file_load_from_file(k, "confcachetest.ini",
+                                            G_KEY_FILE_NONE, NULL),
+                  "confcache: failed to parse config");
+
+    return k;
+}
+
+static char const *confcache_value(confcache_t *c, uint32_t group,
+                                   char const *key)
+{
+    char const *k = NULL, *v = NULL;
+    uint32_t i = 0;
+
+    for (i = 0; i < confcache_pairs(c, group); i++) {
+        ck_assert_msg(confcache_pair(c, group, i, &k, &v),
+                      "confcache: broken pair");
+        if (strcmp(k, key) == 0) {
+            return v;
+        }
+    }
+
+    return NULL;
+}
+
+START_TEST(confcache_roundtrip)
+{
+    GKeyFile *k = NULL;
+    confcache_t *c = NULL;
+    struct stat st;
+    uint32_t g = 0;
+
+    k = confcache_parse(&st);
+    ck_assert_msg(confcache_write("confcachetest.cache", &st, k) == 0,
+                  "confcache: failed to write cache");
+
+    c = confcache_map("confcachetest.cache", &st);
+    ck_assert_msg(c != NULL, "confcache: failed to map cache");
+    ck_assert_msg(confcache_groups(c) == 3, "confcache: wrong group count");
+
+    ck_assert_msg(confcache_find(c, "two", &g), "confcache: group missing");
+    ck_assert_msg(strcmp(confcache_name(c, g), "two") == 0,
+                  "confcache: wrong group found");
+    ck_assert_msg(confcache_pairs(c, g) == 2, "confcache: wrong pair count");
+    /* Values are kept raw, with their escapes
+     */
+    ck_assert_msg(strcmp(confcache_value(c, g, "password"), "a\\sb") == 0,
+                  "confcache: wrong value");
+
+    ck_assert_msg(confcache_find(c, "one", &g), "confcache: group missing");
+    ck_assert_msg(strcmp(confcache_value(c, g, "urgent"), "kick,ban") == 0,
+                  "confcache: wrong value");
+
+    ck_assert_msg(confcache_find(c, "empty", &g), "confcache: group missing");
+    ck_assert_msg(confcache_pairs(c, g) == 0, "confcache: wrong pair count");
+
+    ck_assert_msg(!confcache_find(c, "three", NULL),
+                  "confcache: found a group that does not exist");
+
+    confcache_unmap(c);
+    g_key_file_free(k);
+}
+END_TEST
+
+START_TEST(confcache_stale)
+{
+    GKeyFile *k = NULL;
+    confcache_t *c = NULL;
+    struct stat st;
+
+    k = confcache_parse(&st);
+    ck_assert_msg(confcache_write("confcachetest.cache", &st, k) == 0,
+                  "confcache: failed to write cache");
+
+    st.st_mtime += 1;
+    c = confcache_map("confcachetest.cache", &st);
+    ck_assert_msg(c == NULL, "confcache: used a stale cache");
+    st.st_mtime -= 1;
+
+    /* Changed within the same second
+     */
+#if defined(HAVE_STAT_MTIM)
+    st.st_mtim.tv_nsec ^= 1;
+    c = confcache_map("confcachetest.cache", &st);
+    ck_assert_msg(c == NULL, "confcache: used a stale cache");
+    st.st_mtim.tv_nsec ^= 1;
+#elif defined(HAVE_STAT_MTIMESPEC)
+    st.st_mtimespec.tv_nsec ^= 1;
+    c = confcache_map("confcachetest.cache", &st);
+    ck_assert_msg(c == NULL, "confcache: used a stale cache");
+    st.st_mtimespec.tv_nsec ^= 1;
+#endif
+
+    st.st_size += 1;
+    c = confcache_map("confcachetest.cache", &st);
+    ck_assert_msg(c == NULL, "confcache: used a stale cache");
+
+    ck_assert_msg(confcache_map("confcachetest.ini", &st) == NULL,
+                  "confcache: mapped something that is not a cache");
+
+    unlink("confcachetest.cache");
+    unlink("confcachetest.ini");
+    g_key_file_free(k);
+}
+END_TEST
+
+int main(int ac, char **av)
+{
+    Suite *s = NULL;
+    SRunner *r = NULL;
+    TCase *c = NULL;
+    int failed = 0;
+
+    /* Don't fork
+     */
+    putenv("CK_FORK=no");
+
+    s = suite_create("rcon");
+
+    c = tcase_create("confcache");
+
+    tcase_add_test(c, confcache_roundtrip);
+    tcase_add_test(c, confcache_stale);
+
+    suite_add_tcase(s, c);
+
+    r = srunner_create(s);
+    srunner_run_all(r, CK_NORMAL);
+    failed = srunner_ntests_failed(r);
+
+    srunner_free(r);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
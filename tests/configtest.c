@@ -0,0 +1,213 @@
+#include <check.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <config.h>
+#include <stdbool.h>
+
+#include <glib.h>
+
+static char const *configfile =
+    "[defaults]\n"
+    "port=27015\n"
+    "password=shared\n"
+    "\n"
+    "[eu]\n"
+    "inherit=defaults\n"
+    "tags=eu,competitive\n"
+    "keepalive=true\n"
+    "keepalive_idle=60\n"
+    "\n"
+    "[eu1]\n"
+    "hostname=eu1.example.com\n"
+    "inherit=eu\n"
+    "\n"
+    "[eu2]\n"
+    "hostname=eu2.example.com\n"
+    "inherit=eu\n"
+    "password=own\n"
+    "\n"
+    "[us1]\n"
+    "hostname=us1.example.com\n"
+    "inherit=defaults\n"
+    "tags=us, competitive\n"
+    "nodelay=false\n"
+    "rcvbuf=nonsense\n"
+    "\n"
+    "[loop1]\n"
+    "inherit=loop2\n"
+    "\n"
+    "[loop2]\n"
+    "inherit=loop1\n"
+    "\n"
+    "[noport]\n"
+    "hostname=noport.example.com\n";
+
+static void config_setup(void)
+{
+    FILE *f = NULL;
+
+    f = fopen("configtest.ini", "w");
+    ck_assert_msg(f != NULL, "config: failed to write config");
+    fputs(configfile, f);
+    fclose(f);
+
+    ck_assert_msg(config_load("configtest.ini") == 0,
+                  "config: failed to load config");
+}
+
+static void config_teardown(void)
+{
+    config_free();
+    unlink("configtest.ini");
+}
+
+static char *config_joined(char const *selector)
+{
+    char **names = NULL;
+    char *tmp = NULL;
+
+    names = config_select(selector);
+    if (names == NULL) {
+        return NULL;
+    }
+
+    tmp = g_strjoinv(",", names);
+    g_strfreev(names);
+
+    return tmp;
+}
+
+START_TEST(config_inherit)
+{
+    char *host = NULL, *port = NULL, *password = NULL;
+
+    config_setup();
+
+    ck_assert_msg(config_host_data("eu1", &host, &port, &password,
+                                   NULL) == 0,
+                  "config: server not found");
+    ck_assert_msg(strcmp(port, "27015") == 0,
+                  "config: port not inherited over two levels");
+    ck_assert_msg(strcmp(password, "shared") == 0,
+                  "config: password not inherited");
+    free(host);
+    free(port);
+    free(password);
+    password = NULL;
+
+    ck_assert_msg(config_host_data("eu2", NULL, NULL, &password,
+                                   NULL) == 0,
+                  "config: server not found");
+    ck_assert_msg(strcmp(password, "own") == 0,
+                  "config: inherited value overrides own value");
+    free(password);
+
+    /* Loops end, and leave the group without a hostname
+     */
+    ck_assert_msg(config_host_data("loop1", NULL, NULL, NULL, NULL) != 0,
+                  "config: loop made up a hostname");
+
+    /* Groups without a hostname are told apart from broken servers
+     */
+    ck_assert_msg(config_host_data("eu", NULL, NULL, NULL, NULL) == -3,
+                  "config: group without hostname");
+    ck_assert_msg(config_host_data("noport", NULL, NULL, NULL, NULL) == -4,
+                  "config: server without port");
+
+    config_teardown();
+}
+END_TEST
+
+START_TEST(config_sockopts)
+{
+    sockopt_t o;
+
+    config_setup();
+
+    sockopt_init(&o);
+    ck_assert_msg(config_host_sockopts("eu1", &o) == 0,
+                  "config: server not found");
+    ck_assert_msg(o.keepalive == 1 && o.keepalive_idle == 60,
+                  "config: keepalive not inherited");
+    ck_assert_msg(o.nodelay == 1 && o.keepalive_interval == -1,
+                  "config: missing option changed default");
+
+    /* Values that do not parse leave the default
+     */
+    sockopt_init(&o);
+    ck_assert_msg(config_host_sockopts("us1", &o) == 0,
+                  "config: server not found");
+    ck_assert_msg(o.nodelay == 0, "config: nodelay not turned off");
+    ck_assert_msg(o.rcvbuf == -1, "config: invalid buffer size used");
+
+    ck_assert_msg(config_host_sockopts("nosuchserver", &o) == -2,
+                  "config: made up a server");
+
+    config_teardown();
+}
+END_TEST
+
+START_TEST(config_selectors)
+{
+    char *s = NULL;
+
+    config_setup();
+
+    s = config_joined("tag:eu");
+    ck_assert_msg(s != NULL && strcmp(s, "eu,eu1,eu2") == 0,
+                  "config: wrong servers for tag:eu: %s", s);
+    g_free(s);
+
+    s = config_joined("us1,tag:competitive,eu1");
+    ck_assert_msg(s != NULL && strcmp(s, "eu,eu1,eu2,us1") == 0,
+                  "config: selection not unique or not in order: %s", s);
+    g_free(s);
+
+    s = config_joined("tag:competitive,-tag:us,-eu");
+    ck_assert_msg(s != NULL && strcmp(s, "eu1,eu2") == 0,
+                  "config: exclusion failed: %s", s);
+    g_free(s);
+
+    s = config_joined("tag:nothing");
+    ck_assert_msg(s != NULL && strcmp(s, "") == 0,
+                  "config: unknown tag selected servers: %s", s);
+    g_free(s);
+
+    ck_assert_msg(config_select("nosuchserver") == NULL,
+                  "config: selected an unknown server");
+
+    config_teardown();
+}
+END_TEST
+
+int main(int ac, char **av)
+{
+    Suite *s = NULL;
+    SRunner *r = NULL;
+    TCase *c = NULL;
+    int failed = 0;
+
+    /* Don't fork
+     */
+    putenv("CK_FORK=no");
+
+    s = suite_create("rcon");
+
+    c = tcase_create("config");
+
+    tcase_add_test(c, config_inherit);
+    tcase_add_test(c, config_selectors);
+    tcase_add_test(c, config_sockopts);
+
+    suite_add_tcase(s, c);
+
+    r = srunner_create(s);
+    srunner_run_all(r, CK_NORMAL);
+    failed = srunner_ntests_failed(r);
+
+    srunner_free(r);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
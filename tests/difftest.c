@@ -0,0 +1,163 @@
+#include <check.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <diff.h>
+#include <stdbool.h>
+
+typedef struct {
+    char a[256];
+    char b[256];
+    size_t edits;
+} diff_result_t;
+
+static void diff_collect(diff_op_t op, diff_line_t const *line, void *data)
+{
+    diff_result_t *r = data;
+
+    if (op != diff_insert) {
+        strncat(r->a, line->data, line->len);
+        strcat(r->a, "\n");
+    }
+
+    if (op != diff_delete) {
+        strncat(r->b, line->data, line->len);
+        strcat(r->b, "\n");
+    }
+
+    if (op != diff_keep) {
+        ++r->edits;
+    }
+}
+
+static size_t diff_run(char const *a, char const *b, diff_result_t *r)
+{
+    diff_line_t *la = NULL, *lb = NULL;
+    ssize_t na = 0, nb = 0;
+
+    memset(r, 0, sizeof(*r));
+
+    na = diff_split(a, strlen(a), &la);
+    nb = diff_split(b, strlen(b), &lb);
+    ck_assert_msg(na >= 0 && nb >= 0, "diff: split failed");
+
+    ck_assert_msg(diff_lines(la, na, lb, nb, diff_collect, r) == 0,
+                  "diff: failed");
+
+    free(la);
+    free(lb);
+
+    /* Both texts come out of the edit script again
+     */
+    ck_assert_msg(strcmp(r->a, a) == 0, "diff: wrong old text: %s", r->a);
+    ck_assert_msg(strcmp(r->b, b) == 0, "diff: wrong new text: %s", r->b);
+
+    return r->edits;
+}
+
+/* Length of the longest common subsequence of the letters
+ */
+static size_t diff_lcs(char const *a, char const *b)
+{
+    size_t t[16][16] = {{0}};
+    size_t i = 0, j = 0, na = strlen(a), nb = strlen(b);
+
+    for (i = 1; i <= na; i++) {
+        for (j = 1; j <= nb; j++) {
+            if (a[i-1] == b[j-1]) {
+                t[i][j] = t[i-1][j-1] + 1;
+            } else {
+                t[i][j] = (t[i-1][j] > t[i][j-1] ? t[i-1][j] : t[i][j-1]);
+            }
+        }
+    }
+
+    return t[na][nb];
+}
+
+static void diff_lines_of(char const *letters, char *out)
+{
+    for (; *letters != '\0'; letters++) {
+        *out++ = *letters;
+        *out++ = '\n';
+    }
+    *out = '\0';
+}
+
+START_TEST(diff_basic)
+{
+    diff_result_t r;
+
+    ck_assert_msg(diff_run("a\nb\nc\n", "a\nb\nc\n", &r) == 0,
+                  "diff: edits between equal texts");
+    ck_assert_msg(diff_run("a\nb\nc\n", "a\nx\nc\n", &r) == 2,
+                  "diff: wrong edits for a changed line");
+    ck_assert_msg(diff_run("", "a\nb\n", &r) == 2,
+                  "diff: wrong edits from empty text");
+    ck_assert_msg(diff_run("a\nb\n", "", &r) == 2,
+                  "diff: wrong edits to empty text");
+    ck_assert_msg(diff_run("players: 3\nmap: x\n", "players: 4\nmap: x\n",
+                           &r) == 2,
+                  "diff: wrong edits for first line");
+}
+END_TEST
+
+START_TEST(diff_minimal)
+{
+    static char const letters[] = "abcab";
+    char a[16], b[16], la[32], lb[32];
+    diff_result_t r;
+    int i = 0, j = 0;
+
+    srand(42);
+
+    for (i = 0; i < 500; i++) {
+        size_t na = rand() % 12, nb = rand() % 12;
+
+        for (j = 0; j < (int)na; j++) {
+            a[j] = letters[rand() % 5];
+        }
+        a[na] = '\0';
+
+        for (j = 0; j < (int)nb; j++) {
+            b[j] = letters[rand() % 5];
+        }
+        b[nb] = '\0';
+
+        diff_lines_of(a, la);
+        diff_lines_of(b, lb);
+
+        ck_assert_msg(diff_run(la, lb, &r) == na + nb - 2 * diff_lcs(a, b),
+                      "diff: edit script not minimal for %s -> %s", a, b);
+    }
+}
+END_TEST
+
+int main(int ac, char **av)
+{
+    Suite *s = NULL;
+    SRunner *r = NULL;
+    TCase *c = NULL;
+    int failed = 0;
+
+    /* Don't fork
+     */
+    putenv("CK_FORK=no");
+
+    s = suite_create("rcon");
+
+    c = tcase_create("diff");
+
+    tcase_add_test(c, diff_basic);
+    tcase_add_test(c, diff_minimal);
+
+    suite_add_tcase(s, c);
+
+    r = srunner_create(s);
+    srunner_run_all(r, CK_NORMAL);
+    failed = srunner_ntests_failed(r);
+
+    srunner_free(r);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,94 @@
+#include <check.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <hexdump.h>
+
+START_TEST(hexdump_bytes)
+{
+    char out[hexdump_size(256) + 1], expected[hexdump_size(256) + 1];
+    uint8_t data[256];
+    size_t len = 0, pos = 0;
+    int i = 0;
+
+    for (i = 0; i < 256; i++) {
+        data[i] = (uint8_t)i;
+
+        if (i > 0) {
+            expected[pos++] = ',';
+        }
+        if (i >= 0x20 && i < 0x7F) {
+            expected[pos++] = (char)i;
+        } else {
+            pos += sprintf(expected + pos, "0x%02X", i);
+        }
+    }
+
+    /* Every byte value, against a plain rendering of it
+     */
+    len = hexdump_format(out, data, sizeof(data));
+    ck_assert_msg(len == pos && memcmp(out, expected, len) == 0,
+                  "hexdump: wrong rendering: %.*s", (int)len, out);
+}
+END_TEST
+
+START_TEST(hexdump_edges)
+{
+    uint8_t const printable[] = { 'a', 'b' };
+    uint8_t const binary[] = { 0x00, 0xFF };
+    char out[hexdump_size(2) + 1];
+    size_t len = 0;
+
+    len = hexdump_format(out, NULL, 0);
+    ck_assert_msg(len == 0, "hexdump: output for no data");
+
+    len = hexdump_format(out, printable, 1);
+    ck_assert_msg(len == 1 && out[0] == 'a', "hexdump: wrong single byte");
+
+    len = hexdump_format(out, binary, 1);
+    ck_assert_msg(len == 4 && memcmp(out, "0x00", 4) == 0,
+                  "hexdump: wrong single byte");
+
+    /* Entries are copied whole, but never past hexdump_size()
+     */
+    memset(out, '#', sizeof(out));
+    len = hexdump_format(out, printable, 2);
+    ck_assert_msg(len == 3 && memcmp(out, "a,b", 3) == 0,
+                  "hexdump: wrong rendering: %.*s", (int)len, out);
+    ck_assert_msg(out[hexdump_size(2)] == '#', "hexdump: wrote past end");
+
+    len = hexdump_format(out, binary, 2);
+    ck_assert_msg(len == 9 && memcmp(out, "0x00,0xFF", 9) == 0,
+                  "hexdump: wrong rendering: %.*s", (int)len, out);
+    ck_assert_msg(out[hexdump_size(2)] == '#', "hexdump: wrote past end");
+}
+END_TEST
+
+int main(int ac, char **av)
+{
+    Suite *s = NULL;
+    SRunner *r = NULL;
+    TCase *c = NULL;
+    int failed = 0;
+
+    /* Don't fork
+     */
+    putenv("CK_FORK=no");
+
+    s = suite_create("rcon");
+
+    c = tcase_create("hexdump");
+
+    tcase_add_test(c, hexdump_bytes);
+    tcase_add_test(c, hexdump_edges);
+
+    suite_add_tcase(s, c);
+
+    r = srunner_create(s);
+    srunner_run_all(r, CK_NORMAL);
+    failed = srunner_ntests_failed(r);
+
+    srunner_free(r);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
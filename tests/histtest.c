@@ -0,0 +1,127 @@
+#include <check.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <hist.h>
+
+START_TEST(hist_exact)
+{
+    hist_t *h = hist_new();
+    uint64_t i = 0;
+
+    ck_assert_msg(h != NULL, "hist: failed to allocate");
+    ck_assert_msg(hist_percentile(h, 50) == 0, "hist: empty percentile");
+
+    /* Small values are counted exactly
+     */
+    for (i = 1; i <= 1000; i++) {
+        hist_record(h, i);
+    }
+
+    ck_assert_msg(hist_count(h) == 1000, "hist: wrong count");
+    ck_assert_msg(hist_min(h) == 1, "hist: wrong min");
+    ck_assert_msg(hist_max(h) == 1000, "hist: wrong max");
+    ck_assert_msg(hist_mean(h) == 500.5, "hist: wrong mean");
+    ck_assert_msg(hist_percentile(h, 50) == 500, "hist: wrong median: %lu",
+                  (unsigned long)hist_percentile(h, 50));
+    ck_assert_msg(hist_percentile(h, 99) == 990, "hist: wrong p99");
+    ck_assert_msg(hist_percentile(h, 100) == 1000, "hist: wrong p100");
+    ck_assert_msg(hist_percentile(h, 0) == 1, "hist: wrong p0");
+
+    hist_free(h);
+}
+END_TEST
+
+START_TEST(hist_precision)
+{
+    hist_t *h = hist_new();
+    uint64_t v = 0;
+
+    /* Large values are off by less than 0.1%
+     */
+    for (v = 2047; v < HIST_MAX; v = v * 3 + 7) {
+        uint64_t p = 0;
+
+        hist_free(h);
+        h = hist_new();
+        hist_record(h, v);
+        hist_record(h, v + 1);
+
+        p = hist_percentile(h, 50);
+        ck_assert_msg(p >= v && p - v <= v / 1000,
+                      "hist: %lu recorded as %lu", (unsigned long)v,
+                      (unsigned long)p);
+    }
+
+    /* Beyond the range everything is the maximum
+     */
+    hist_record(h, HIST_MAX * 4);
+    ck_assert_msg(hist_max(h) == HIST_MAX, "hist: value not clamped");
+    ck_assert_msg(hist_percentile(h, 100) == HIST_MAX, "hist: wrong p100");
+
+    hist_free(h);
+}
+END_TEST
+
+START_TEST(hist_corrected)
+{
+    hist_t *h = hist_new();
+    hist_t *sum = hist_new();
+
+    /* A stall of 100 with requests due every 10 hides 9 more requests,
+     * that would have waited 90, 80, ... 10.
+     */
+    hist_record_corrected(h, 100, 10);
+    ck_assert_msg(hist_count(h) == 10, "hist: wrong corrected count: %lu",
+                  (unsigned long)hist_count(h));
+    ck_assert_msg(hist_min(h) == 10, "hist: wrong corrected min");
+    ck_assert_msg(hist_percentile(h, 50) == 50, "hist: wrong median");
+
+    /* Nothing to correct for
+     */
+    hist_record_corrected(h, 5, 10);
+    hist_record_corrected(h, 7, 0);
+    ck_assert_msg(hist_count(h) == 12, "hist: corrected too much");
+
+    hist_add(sum, h);
+    hist_add(sum, h);
+    ck_assert_msg(hist_count(sum) == 24, "hist: wrong sum count");
+    ck_assert_msg(hist_min(sum) == 5 && hist_max(sum) == 100,
+                  "hist: wrong sum range");
+    ck_assert_msg(hist_percentile(sum, 50) == hist_percentile(h, 50),
+                  "hist: sum has different median");
+
+    hist_free(h);
+    hist_free(sum);
+}
+END_TEST
+
+int main(int ac, char **av)
+{
+    Suite *s = NULL;
+    SRunner *r = NULL;
+    TCase *c = NULL;
+    int failed = 0;
+
+    /* Don't fork
+     */
+    putenv("CK_FORK=no");
+
+    s = suite_create("rcon");
+
+    c = tcase_create("hist");
+
+    tcase_add_test(c, hist_exact);
+    tcase_add_test(c, hist_precision);
+    tcase_add_test(c, hist_corrected);
+
+    suite_add_tcase(s, c);
+
+    r = srunner_create(s);
+    srunner_run_all(r, CK_NORMAL);
+    failed = srunner_ntests_failed(r);
+
+    srunner_free(r);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,138 @@
+#include <check.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <http.h>
+
+START_TEST(http_parse_request)
+{
+    char const *raw = "POST /servers/eu1/command HTTP/1.1\r\n"
+        "Host: localhost\r\n"
+        "content-length:  7\r\n"
+        "\r\n"
+        "status\n";
+    http_request_t req;
+    ssize_t head = 0;
+
+    head = http_parse(raw, strlen(raw), &req);
+    ck_assert_msg(head == (ssize_t)strlen(raw) - 7,
+                  "http: wrong head size: %d", (int)head);
+    ck_assert_msg(strcmp(req.method, "POST") == 0, "http: wrong method");
+    ck_assert_msg(strcmp(req.path, "/servers/eu1/command") == 0,
+                  "http: wrong path: %s", req.path);
+    ck_assert_msg(req.minor == 1 && req.length == 7 && !req.close &&
+                  !req.encoded, "http: wrong request");
+    http_request_clear(&req);
+
+    /* Incomplete, until the empty line came in
+     */
+    ck_assert_msg(http_parse(raw, 40, &req) == 0, "http: incomplete head");
+    ck_assert_msg(http_parse("GET /\r\n\r\n", 9, &req) == -1,
+                  "http: no version");
+}
+END_TEST
+
+START_TEST(http_parse_connection)
+{
+    char const *old = "GET / HTTP/1.0\r\n\r\n";
+    char const *kept = "GET / HTTP/1.0\r\nConnection: keep-alive\r\n\r\n";
+    char const *closed = "GET / HTTP/1.1\r\nConnection: close\r\n"
+        "Transfer-Encoding: chunked\r\n\r\n";
+    http_request_t req;
+
+    ck_assert_msg(http_parse(old, strlen(old), &req) > 0 && req.close,
+                  "http: 1.0 kept open");
+    http_request_clear(&req);
+    ck_assert_msg(http_parse(kept, strlen(kept), &req) > 0 && !req.close,
+                  "http: keep-alive ignored");
+    http_request_clear(&req);
+    ck_assert_msg(http_parse(closed, strlen(closed), &req) > 0 &&
+                  req.close && req.encoded, "http: close ignored");
+    http_request_clear(&req);
+}
+END_TEST
+
+START_TEST(http_authorization)
+{
+    char const *bearer = "POST / HTTP/1.1\r\n"
+        "authorization: bearer  s3cret\r\n\r\n";
+    char const *basic = "POST / HTTP/1.1\r\n"
+        "Authorization: Basic dXNlcjpwYXNz\r\n\r\n";
+    GByteArray *out = g_byte_array_new();
+    http_request_t req;
+
+    ck_assert_msg(http_parse(bearer, strlen(bearer), &req) > 0 &&
+                  req.token != NULL && strcmp(req.token, "s3cret") == 0,
+                  "http: bearer token not found");
+    http_request_clear(&req);
+
+    /* Only bearer tokens are taken
+     */
+    ck_assert_msg(http_parse(basic, strlen(basic), &req) > 0 &&
+                  req.token == NULL, "http: basic credentials taken");
+    http_request_clear(&req);
+
+    http_respond(out, 401, "No\n", false);
+    g_byte_array_append(out, (uint8_t const *)"", 1);
+    ck_assert_msg(strncmp((char *)out->data, "HTTP/1.1 401 Unauthorized\r\n",
+                          27) == 0 &&
+                  strstr((char *)out->data, "\r\nWWW-Authenticate: Bearer ")
+                  != NULL, "http: no challenge");
+    g_byte_array_free(out, TRUE);
+}
+END_TEST
+
+START_TEST(http_chunked)
+{
+    GByteArray *out = g_byte_array_new();
+    char const *expected = "1a\r\nabcdefghijklmnopqrstuvwxyz\r\n0\r\n\r\n";
+
+    http_chunk(out, "abcdefghijklmnopqrstuvwxyz", 26, true);
+    /* Nothing, as an empty chunk would end the body early
+     */
+    http_chunk(out, "", 0, true);
+    http_finish(out, true);
+
+    ck_assert_msg(out->len == strlen(expected) &&
+                  memcmp(out->data, expected, out->len) == 0,
+                  "http: wrong chunks");
+
+    g_byte_array_set_size(out, 0);
+    http_chunk(out, "abc", 3, false);
+    http_finish(out, false);
+    ck_assert_msg(out->len == 3, "http: plain body encoded");
+
+    g_byte_array_free(out, TRUE);
+}
+END_TEST
+
+int main(int ac, char **av)
+{
+    Suite *s = NULL;
+    SRunner *r = NULL;
+    TCase *c = NULL;
+    int failed = 0;
+
+    /* Don't fork
+     */
+    putenv("CK_FORK=no");
+
+    s = suite_create("rcon");
+
+    c = tcase_create("http");
+
+    tcase_add_test(c, http_parse_request);
+    tcase_add_test(c, http_parse_connection);
+    tcase_add_test(c, http_chunked);
+    tcase_add_test(c, http_authorization);
+
+    suite_add_tcase(s, c);
+
+    r = srunner_create(s);
+    srunner_run_all(r, CK_NORMAL);
+    failed = srunner_ntests_failed(r);
+
+    srunner_free(r);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,265 @@
+#include <check.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <journal.h>
+
+static char const *dir = "journaltest.d";
+
+static void journal_cleanup(void)
+{
+    char path[64];
+    unsigned long i = 0;
+
+    for (i = 1; i < 100; i++) {
+        snprintf(path, sizeof(path), "%s/%08lu.seg", dir, i);
+        unlink(path);
+        snprintf(path, sizeof(path), "%s/%08lu.idx", dir, i);
+        unlink(path);
+    }
+    snprintf(path, sizeof(path), "%s/lock", dir);
+    unlink(path);
+    rmdir(dir);
+}
+
+static void journal_fill(uint64_t size)
+{
+    struct iovec body[2];
+    journal_t *j = NULL;
+    char cmd[32];
+    int i = 0;
+
+    body[0].iov_base = "players: ";
+    body[0].iov_len = 9;
+    body[1].iov_base = "3\n";
+    body[1].iov_len = 2;
+
+    j = journal_open(dir, size, 0);
+    ck_assert_msg(j != NULL, "journal: failed to open");
+
+    for (i = 0; i < 10; i++) {
+        snprintf(cmd, sizeof(cmd), "status %d", i);
+        ck_assert_msg(journal_append(j, (i % 2 ? "eu1" : "eu2"), i, cmd,
+                                     body, 2, 0.005) == 0,
+                      "journal: failed to append");
+    }
+
+    journal_close(j);
+}
+
+START_TEST(journal_write_read)
+{
+    journal_query_t *q = NULL;
+    journal_record_t rec;
+    uint64_t last = 0;
+    int n = 0, ret = 0;
+
+    journal_cleanup();
+    journal_fill(0);
+
+    q = journal_query(dir, 0, UINT64_MAX, NULL);
+    ck_assert_msg(q != NULL, "journal: failed to query");
+
+    while ((ret = journal_next(q, &rec)) > 0) {
+        char cmd[32];
+
+        snprintf(cmd, sizeof(cmd), "status %d", n);
+        ck_assert_msg(rec.id == n && rec.commandlen == strlen(cmd) &&
+                      memcmp(rec.command, cmd, rec.commandlen) == 0,
+                      "journal: wrong record %d", n);
+        ck_assert_msg(rec.bodylen == 11 &&
+                      memcmp(rec.body, "players: 3\n", 11) == 0,
+                      "journal: wrong body");
+        ck_assert_msg(rec.latency == 5000000, "journal: wrong latency");
+        ck_assert_msg(rec.time >= last, "journal: time went back");
+        last = rec.time;
+        ++n;
+    }
+
+    ck_assert_msg(ret == 0 && n == 10, "journal: %d records", n);
+    journal_query_free(q);
+
+    /* Only one server, and an empty range
+     */
+    q = journal_query(dir, 0, UINT64_MAX, "eu1");
+    for (n = 0; journal_next(q, &rec) > 0; n++) {
+        ck_assert_msg(rec.serverlen == 3 && memcmp(rec.server, "eu1", 3) == 0,
+                      "journal: wrong server");
+    }
+    ck_assert_msg(n == 5, "journal: %d records of eu1", n);
+    journal_query_free(q);
+
+    q = journal_query(dir, last + 1, UINT64_MAX, NULL);
+    ck_assert_msg(journal_next(q, &rec) == 0, "journal: record after end");
+    journal_query_free(q);
+
+    journal_cleanup();
+}
+END_TEST
+
+START_TEST(journal_rotate)
+{
+    journal_query_t *q = NULL;
+    journal_record_t rec;
+    int n = 0;
+
+    journal_cleanup();
+
+    /* Every record fills a segment
+     */
+    journal_fill(64);
+    ck_assert_msg(access("journaltest.d/00000010.seg", F_OK) == 0 &&
+                  access("journaltest.d/00000011.seg", F_OK) != 0,
+                  "journal: wrong number of segments");
+
+    /* Segments without an index are read in full
+     */
+    unlink("journaltest.d/00000004.idx");
+
+    q = journal_query(dir, 0, UINT64_MAX, "eu2");
+    for (n = 0; journal_next(q, &rec) > 0; n++) {
+        ck_assert_msg(rec.id == n * 2, "journal: wrong record");
+    }
+    ck_assert_msg(n == 5, "journal: %d records of eu2", n);
+    journal_query_free(q);
+
+    journal_cleanup();
+}
+END_TEST
+
+static void journal_patch(char const *path, off_t off, void const *data,
+                          size_t len)
+{
+    int fd = open(path, O_WRONLY);
+
+    ck_assert_msg(fd > -1 && pwrite(fd, data, len, off) == (ssize_t)len,
+                  "journal: failed to patch %s", path);
+    close(fd);
+}
+
+static size_t journal_count(uint64_t from)
+{
+    journal_query_t *q = NULL;
+    journal_record_t rec;
+    size_t n = 0;
+    int ret = 0;
+
+    q = journal_query(dir, from, UINT64_MAX, NULL);
+    ck_assert_msg(q != NULL, "journal: failed to query");
+    while ((ret = journal_next(q, &rec)) > 0) {
+        ck_assert_msg(rec.id == (int32_t)n, "journal: wrong record");
+        ++n;
+    }
+    ck_assert_msg(ret == 0, "journal: corrupt");
+    journal_query_free(q);
+
+    return n;
+}
+
+START_TEST(journal_repair)
+{
+    char const *idx = "journaltest.d/00000001.idx";
+    char const *seg = "journaltest.d/00000001.seg";
+    journal_t *j = NULL;
+    struct stat st;
+    int fd = -1;
+
+    journal_cleanup();
+    journal_fill(0);
+
+    /* A writer died before the last entry, and another one halfway
+     * through the entry before it
+     */
+    ck_assert_msg(stat(idx, &st) == 0 &&
+                  truncate(idx, st.st_size - JOURNAL_ENTRY_SIZE - 10) == 0,
+                  "journal: failed to truncate index");
+    ck_assert_msg(journal_count(0) == 10, "journal: records not found");
+
+    /* And one more halfway through a record
+     */
+    fd = open(seg, O_WRONLY | O_APPEND);
+    ck_assert_msg(fd > -1 && write(fd, "\1\2\3\4\5", 5) == 5,
+                  "journal: failed to write");
+    close(fd);
+
+    j = journal_open(dir, 0, 0);
+    ck_assert_msg(journal_append(j, "eu1", 10, "status 10", NULL, 0, 0) == 0,
+                  "journal: failed to append");
+    journal_close(j);
+
+    ck_assert_msg(stat(idx, &st) == 0 && st.st_size == JOURNAL_INDEX_HEADER_SIZE +
+                  11 * JOURNAL_ENTRY_SIZE, "journal: index not repaired");
+    ck_assert_msg(journal_count(0) == 11, "journal: records lost");
+
+    journal_cleanup();
+}
+END_TEST
+
+START_TEST(journal_rotate_time)
+{
+    uint8_t future[8] = { 0, 0, 0, 0, 0, 0, 0, 0x7f };
+    journal_query_t *q = NULL;
+    journal_record_t rec;
+    journal_t *j = NULL;
+
+    journal_cleanup();
+    journal_fill(64);
+
+    /* The clock was set back after the last record
+     */
+    journal_patch("journaltest.d/00000010.seg", JOURNAL_HEADER_SIZE,
+                  future, sizeof(future));
+    journal_patch("journaltest.d/00000010.idx", JOURNAL_INDEX_HEADER_SIZE,
+                  future, sizeof(future));
+
+    j = journal_open(dir, 64, 0);
+    ck_assert_msg(journal_append(j, "eu1", 10, "status 10", NULL, 0, 0) == 0,
+                  "journal: failed to append");
+    journal_close(j);
+    ck_assert_msg(access("journaltest.d/00000011.seg", F_OK) == 0,
+                  "journal: not rotated");
+
+    q = journal_query(dir, 0x7f00000000000000ULL, UINT64_MAX, NULL);
+    ck_assert_msg(journal_next(q, &rec) > 0 && rec.id == 9 &&
+                  journal_next(q, &rec) > 0 && rec.id == 10 &&
+                  journal_next(q, &rec) == 0,
+                  "journal: time went back across segments");
+    journal_query_free(q);
+
+    journal_cleanup();
+}
+END_TEST
+
+int main(int ac, char **av)
+{
+    Suite *s = NULL;
+    SRunner *r = NULL;
+    TCase *c = NULL;
+    int failed = 0;
+
+    /* Don't fork
+     */
+    putenv("CK_FORK=no");
+
+    s = suite_create("rcon");
+
+    c = tcase_create("journal");
+
+    tcase_add_test(c, journal_write_read);
+    tcase_add_test(c, journal_rotate);
+    tcase_add_test(c, journal_repair);
+    tcase_add_test(c, journal_rotate_time);
+
+    suite_add_tcase(s, c);
+
+    r = srunner_create(s);
+    srunner_run_all(r, CK_NORMAL);
+    failed = srunner_ntests_failed(r);
+
+    srunner_free(r);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
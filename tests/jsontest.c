@@ -0,0 +1,146 @@
+#include <check.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <json.h>
+#include <memstream.h>
+
+static char *buf = NULL;
+static size_t size = 0;
+static FILE *out = NULL;
+
+static void json_open(void)
+{
+    free(buf);
+    buf = NULL;
+    out = open_memstream(&buf, &size);
+    ck_assert_msg(out != NULL, "json: failed to open buffer");
+}
+
+static void json_expect(char const *s, size_t len, char const *expected)
+{
+    json_open();
+    json_string(out, s, len);
+    fclose(out);
+
+    ck_assert_msg(strcmp(buf, expected) == 0,
+                  "json: got %s instead of %s", buf, expected);
+}
+
+START_TEST(json_escapes)
+{
+    json_expect("", 0, "\"\"");
+    json_expect("status", 6, "\"status\"");
+    json_expect("say \"hi\" \\o/", 12, "\"say \\\"hi\\\" \\\\o/\"");
+    json_expect("a\nb\r\tc", 6, "\"a\\nb\\r\\tc\"");
+
+    /* Other control characters, NUL and DEL included
+     */
+    json_expect("\x01\x1f\x7f", 3, "\"\\u0001\\u001f\\u007f\"");
+    json_expect("a\0b", 3, "\"a\\u0000b\"");
+    json_expect("\x1b[0m", 4, "\"\\u001b[0m\"");
+}
+END_TEST
+
+START_TEST(json_utf8)
+{
+    /* Valid sequences of two, three and four bytes are kept
+     */
+    json_expect("caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80", 14,
+                "\"caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80\"");
+    json_expect("\xef\xbf\xbf\xf4\x8f\xbf\xbf", 7,
+                "\"\xef\xbf\xbf\xf4\x8f\xbf\xbf\"");
+
+    /* Anything else is replaced byte by byte
+     */
+    json_expect("a\xff" "b", 3, "\"a\\ufffdb\"");
+    json_expect("\x80", 1, "\"\\ufffd\"");
+    json_expect("\xc0\xaf", 2, "\"\\ufffd\\ufffd\"");
+    json_expect("\xe0\x80\xaf", 3, "\"\\ufffd\\ufffd\\ufffd\"");
+    json_expect("\xed\xa0\x80", 3, "\"\\ufffd\\ufffd\\ufffd\"");
+    json_expect("\xf4\x90\x80\x80", 4,
+                "\"\\ufffd\\ufffd\\ufffd\\ufffd\"");
+    json_expect("\xc3" "a", 2, "\"\\ufffda\"");
+    json_expect("\xe2\x82", 2, "\"\\ufffd\\ufffd\"");
+}
+END_TEST
+
+START_TEST(json_pieces)
+{
+    size_t left = 0;
+
+    /* A character cut off at the end is held back if more follows
+     */
+    json_open();
+    left = json_chars(out, "price: \xe2\x82", 9, true);
+    ck_assert_msg(left == 2, "json: %zu bytes held back", left);
+    left = json_chars(out, "\xe2\x82\xac" "5", 4, true);
+    ck_assert_msg(left == 0, "json: %zu bytes held back", left);
+    fclose(out);
+    ck_assert_msg(strcmp(buf, "price: \xe2\x82\xac" "5") == 0,
+                  "json: got %s", buf);
+
+    /* But not at the very end
+     */
+    json_open();
+    left = json_chars(out, "\xf0\x9f", 2, false);
+    fclose(out);
+    ck_assert_msg(left == 0 && strcmp(buf, "\\ufffd\\ufffd") == 0,
+                  "json: got %s", buf);
+
+    /* Nor if it cannot become valid
+     */
+    json_open();
+    left = json_chars(out, "\xc3" "a", 2, true);
+    fclose(out);
+    ck_assert_msg(left == 0 && strcmp(buf, "\\ufffda") == 0,
+                  "json: got %s", buf);
+}
+END_TEST
+
+START_TEST(json_numbers)
+{
+    json_open();
+    json_seconds(out, 1.5);
+    fputc(' ', out);
+    json_seconds(out, 0);
+    fputc(' ', out);
+    json_seconds(out, -1);
+    fclose(out);
+
+    ck_assert_msg(strcmp(buf, "1.500000 0.000000 null") == 0,
+                  "json: got %s", buf);
+}
+END_TEST
+
+int main(int ac, char **av)
+{
+    Suite *s = NULL;
+    SRunner *r = NULL;
+    TCase *c = NULL;
+    int failed = 0;
+
+    /* Don't fork
+     */
+    putenv("CK_FORK=no");
+
+    s = suite_create("rcon");
+
+    c = tcase_create("json");
+
+    tcase_add_test(c, json_escapes);
+    tcase_add_test(c, json_utf8);
+    tcase_add_test(c, json_pieces);
+    tcase_add_test(c, json_numbers);
+
+    suite_add_tcase(s, c);
+
+    r = srunner_create(s);
+    srunner_run_all(r, CK_NORMAL);
+    failed = srunner_ntests_failed(r);
+
+    srunner_free(r);
+    free(buf);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,110 @@
+#include <check.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <lease.h>
+
+START_TEST(lease_pass_descriptor)
+{
+    int channel[2] = {-1, -1}, conn[2] = {-1, -1};
+    char msg[LEASE_MESSAGE_MAX], c = 0;
+    ssize_t ret = 0;
+    int fd = -1;
+
+    ck_assert_msg(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, channel) == 0,
+                  "lease: no channel");
+    ck_assert_msg(socketpair(AF_UNIX, SOCK_STREAM, 0, conn) == 0,
+                  "lease: no connection");
+
+    ck_assert_msg(lease_send(channel[0], "Lkey", 4, conn[0]) == 0,
+                  "lease: failed to send");
+    ret = lease_recv(channel[1], msg, sizeof(msg), &fd);
+    ck_assert_msg(ret == 4 && memcmp(msg, "Lkey", 4) == 0,
+                  "lease: wrong message");
+    ck_assert_msg(fd > -1 && fd != conn[0], "lease: no descriptor");
+
+    /* The passed descriptor is the same connection
+     */
+    ck_assert_msg(write(conn[1], "x", 1) == 1, "lease: failed to write");
+    ck_assert_msg(read(fd, &c, 1) == 1 && c == 'x', "lease: wrong data");
+
+    /* Messages without a descriptor
+     */
+    ck_assert_msg(lease_send(channel[1], "N", 1, -1) == 0,
+                  "lease: failed to answer");
+    ck_assert_msg(lease_recv(channel[0], msg, sizeof(msg), &fd) == 1 &&
+                  fd == -1, "lease: descriptor out of nowhere");
+
+    close(channel[0]);
+    close(channel[1]);
+    close(conn[0]);
+    close(conn[1]);
+}
+END_TEST
+
+START_TEST(lease_idle_connection)
+{
+    int conn[2] = {-1, -1};
+    char c = 0;
+
+    ck_assert_msg(socketpair(AF_UNIX, SOCK_STREAM, 0, conn) == 0,
+                  "lease: no connection");
+
+    ck_assert_msg(lease_idle(conn[0]), "lease: fresh connection not idle");
+
+    /* A reply that was never read
+     */
+    ck_assert_msg(write(conn[1], "x", 1) == 1, "lease: failed to write");
+    ck_assert_msg(!lease_idle(conn[0]), "lease: unread data");
+    ck_assert_msg(read(conn[0], &c, 1) == 1, "lease: failed to read");
+    ck_assert_msg(lease_idle(conn[0]), "lease: idle after reading");
+
+    /* Closed by the other side
+     */
+    close(conn[1]);
+    ck_assert_msg(!lease_idle(conn[0]), "lease: closed connection idle");
+
+    close(conn[0]);
+}
+END_TEST
+
+START_TEST(lease_no_broker)
+{
+    ck_assert_msg(lease_open("/nonexistent/rcon-broker.sock") == NULL,
+                  "lease: connected to nothing");
+    ck_assert_msg(lease_get(NULL, "host", "27015", "pw") == -1,
+                  "lease: connection without broker");
+}
+END_TEST
+
+int main(int ac, char **av)
+{
+    Suite *s = NULL;
+    SRunner *r = NULL;
+    TCase *c = NULL;
+    int failed = 0;
+
+    /* Don't fork
+     */
+    putenv("CK_FORK=no");
+
+    s = suite_create("rcon");
+
+    c = tcase_create("lease");
+
+    tcase_add_test(c, lease_pass_descriptor);
+    tcase_add_test(c, lease_idle_connection);
+    tcase_add_test(c, lease_no_broker);
+
+    suite_add_tcase(s, c);
+
+    r = srunner_create(s);
+    srunner_run_all(r, CK_NORMAL);
+    failed = srunner_ntests_failed(r);
+
+    srunner_free(r);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,172 @@
+#include <check.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <metrics.h>
+
+static char const *promfile = "metricstest.prom";
+
+static char *metrics_read(char const *filename)
+{
+    static char buf[16384];
+    FILE *f = NULL;
+    size_t len = 0;
+
+    f = fopen(filename, "r");
+    ck_assert_msg(f != NULL, "metrics: %s not written", filename);
+    len = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[len] = '\0';
+
+    return buf;
+}
+
+static void metrics_expect(char const *text, char const *line)
+{
+    char const *p = strstr(text, line);
+
+    ck_assert_msg(p != NULL && (p == text || p[-1] == '\n') &&
+                  p[strlen(line)] == '\n',
+                  "metrics: missing line: %s", line);
+}
+
+START_TEST(metrics_text)
+{
+    metrics_t *m[2] = {NULL};
+    char *text = NULL;
+
+    m[0] = metrics_new("eu1");
+    m[1] = metrics_new("a\"b\\c\nd");
+    ck_assert_msg(m[0] != NULL && m[1] != NULL, "metrics: allocation error");
+
+    m[0]->state = metrics_state_ready;
+    m[0]->commands = 3;
+    m[0]->frames = 7;
+    m[0]->bytes_in = 12345;
+    m[0]->queued = 2;
+    metrics_latency(m[0], 0.0005);
+    metrics_latency(m[0], 0.001);
+    metrics_latency(m[0], 0.003);
+    metrics_latency(m[0], 20);
+
+    ck_assert_msg(metrics_write(m, 2, promfile) == 0,
+                  "metrics: failed to write");
+    text = metrics_read(promfile);
+
+    metrics_expect(text, "# TYPE rcon_connection_state gauge");
+    metrics_expect(text, "rcon_connection_state{server=\"eu1\"} 3");
+    metrics_expect(text, "# TYPE rcon_commands_sent_total counter");
+    metrics_expect(text, "rcon_commands_sent_total{server=\"eu1\"} 3");
+    metrics_expect(text, "rcon_frames_received_total{server=\"eu1\"} 7");
+    metrics_expect(text, "rcon_received_bytes_total{server=\"eu1\"} 12345");
+    metrics_expect(text, "# TYPE rcon_queued_commands gauge");
+    metrics_expect(text, "rcon_queued_commands{server=\"eu1\"} 2");
+
+    /* Buckets are cumulative, and bounds are inclusive
+     */
+    metrics_expect(text, "# TYPE rcon_command_latency_seconds histogram");
+    metrics_expect(text, "rcon_command_latency_seconds_bucket"
+                   "{server=\"eu1\",le=\"0.001\"} 2");
+    metrics_expect(text, "rcon_command_latency_seconds_bucket"
+                   "{server=\"eu1\",le=\"0.0025\"} 2");
+    metrics_expect(text, "rcon_command_latency_seconds_bucket"
+                   "{server=\"eu1\",le=\"0.005\"} 3");
+    metrics_expect(text, "rcon_command_latency_seconds_bucket"
+                   "{server=\"eu1\",le=\"10\"} 3");
+    metrics_expect(text, "rcon_command_latency_seconds_bucket"
+                   "{server=\"eu1\",le=\"+Inf\"} 4");
+    metrics_expect(text, "rcon_command_latency_seconds_sum"
+                   "{server=\"eu1\"} 20.004500");
+    metrics_expect(text, "rcon_command_latency_seconds_count"
+                   "{server=\"eu1\"} 4");
+
+    /* Label values are escaped
+     */
+    metrics_expect(text, "rcon_connection_state{server=\"a\\\"b\\\\c\\nd\"} 0");
+
+    unlink(promfile);
+    metrics_free(m[0]);
+    metrics_free(m[1]);
+}
+END_TEST
+
+START_TEST(metrics_replace)
+{
+    metrics_t *m = NULL;
+    struct stat before, after;
+    char old[64] = {0};
+    char tmp[64];
+    int fd = -1;
+
+    m = metrics_new("eu1");
+    ck_assert_msg(m != NULL, "metrics: allocation error");
+
+    ck_assert_msg(metrics_write(&m, 1, promfile) == 0 &&
+                  stat(promfile, &before) == 0,
+                  "metrics: failed to write");
+
+    /* A reader of the old file keeps seeing all of it, as the new one
+     * takes its place by rename()
+     */
+    fd = open(promfile, O_RDONLY);
+    ck_assert_msg(fd > -1, "metrics: failed to open");
+
+    m->commands = 42;
+    ck_assert_msg(metrics_write(&m, 1, promfile) == 0 &&
+                  stat(promfile, &after) == 0,
+                  "metrics: failed to write");
+    ck_assert_msg(before.st_ino != after.st_ino,
+                  "metrics: file was written in place");
+
+    ck_assert_msg(read(fd, old, sizeof(old) - 1) > 0 &&
+                  strncmp(old, "# HELP rcon_connection_state", 28) == 0,
+                  "metrics: old file was changed");
+    close(fd);
+
+    metrics_expect(metrics_read(promfile),
+                   "rcon_commands_sent_total{server=\"eu1\"} 42");
+
+    snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", promfile, (long)getpid());
+    ck_assert_msg(access(tmp, F_OK) != 0, "metrics: temporary file left");
+
+    /* Nothing is left behind where the file cannot be written
+     */
+    ck_assert_msg(metrics_write(&m, 1, "metricstest.d/none/x.prom") == -1,
+                  "metrics: wrote into a missing directory");
+
+    unlink(promfile);
+    metrics_free(m);
+}
+END_TEST
+
+int main(int ac, char **av)
+{
+    Suite *s = NULL;
+    SRunner *r = NULL;
+    TCase *c = NULL;
+    int failed = 0;
+
+    /* Don't fork
+     */
+    putenv("CK_FORK=no");
+
+    s = suite_create("rcon");
+
+    c = tcase_create("metrics");
+
+    tcase_add_test(c, metrics_text);
+    tcase_add_test(c, metrics_replace);
+
+    suite_add_tcase(s, c);
+
+    r = srunner_create(s);
+    srunner_run_all(r, CK_NORMAL);
+    failed = srunner_ntests_failed(r);
+
+    srunner_free(r);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
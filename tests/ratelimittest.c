@@ -0,0 +1,250 @@
+#include <check.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "ratelimit.h"
+#include "timers.h"
+#include "config.h"
+
+#include <glib.h>
+
+static void ratelimit_expect(ratelimit_t *s, double now, char const *cmd)
+{
+    char *got = ratelimit_pop(s, now, NULL);
+
+    if (cmd == NULL) {
+        ck_assert_msg(got == NULL, "ratelimit: %s was let through", got);
+    } else {
+        ck_assert_msg(got != NULL && strcmp(got, cmd) == 0,
+                      "ratelimit: got %s instead of %s",
+                      (got != NULL ? got : "nothing"), cmd);
+    }
+    free(got);
+}
+
+START_TEST(ratelimit_refill)
+{
+    ratelimit_t *s = NULL;
+    double now = 0, delay = 0;
+
+    s = ratelimit_new(2, 1);
+    ck_assert_msg(s != NULL, "ratelimit: allocation error");
+    ck_assert_msg(ratelimit_limited(s), "ratelimit: not limited");
+
+    ck_assert_msg(ratelimit_push(s, "status 1", 0) == 0 &&
+                  ratelimit_push(s, "status 2", 0) == 0 &&
+                  ratelimit_push(s, "status 3", 0) == 0,
+                  "ratelimit: failed to push");
+
+    now = timers_now();
+    ratelimit_expect(s, now, "status 1");
+    ratelimit_expect(s, now, NULL);
+
+    /* Two commands a second, so the next token takes half a second
+     */
+    delay = ratelimit_delay(s, now);
+    ck_assert_msg(delay > 0.49 && delay < 0.51,
+                  "ratelimit: delay is %f", delay);
+    ratelimit_expect(s, now + 0.25, NULL);
+    ratelimit_expect(s, now + 0.5, "status 2");
+
+    /* Time that runs backwards does not add tokens
+     */
+    ratelimit_expect(s, now, NULL);
+    ratelimit_expect(s, now + 1.0, "status 3");
+
+    ck_assert_msg(ratelimit_pending(s) == 0 &&
+                  ratelimit_delay(s, now + 1.0) < 0,
+                  "ratelimit: queue not empty");
+
+    ratelimit_free(s);
+}
+END_TEST
+
+START_TEST(ratelimit_burst)
+{
+    ratelimit_t *s = NULL;
+    double now = 0;
+    char cmd[32];
+    int i = 0;
+
+    s = ratelimit_new(1, 3);
+    ck_assert_msg(s != NULL, "ratelimit: allocation error");
+
+    for (i = 0; i < 8; i++) {
+        snprintf(cmd, sizeof(cmd), "status %d", i);
+        ck_assert_msg(ratelimit_push(s, cmd, 0) == 0,
+                      "ratelimit: failed to push");
+    }
+
+    now = timers_now();
+    ratelimit_expect(s, now, "status 0");
+    ratelimit_expect(s, now, "status 1");
+    ratelimit_expect(s, now, "status 2");
+    ratelimit_expect(s, now, NULL);
+    ratelimit_expect(s, now + 1.0, "status 3");
+
+    /* A long pause still only allows a burst
+     */
+    now += 100;
+    ratelimit_expect(s, now, "status 4");
+    ratelimit_expect(s, now, "status 5");
+    ratelimit_expect(s, now, "status 6");
+    ratelimit_expect(s, now, NULL);
+    ck_assert_msg(ratelimit_pending(s) == 1, "ratelimit: commands lost");
+
+    ratelimit_free(s);
+
+    /* Without a rate everything goes at once
+     */
+    s = ratelimit_new(0, 0);
+    ck_assert_msg(s != NULL && !ratelimit_limited(s), "ratelimit: limited");
+    for (i = 0; i < 100; i++) {
+        ck_assert_msg(ratelimit_push(s, "status", 0) == 0,
+                      "ratelimit: failed to push");
+    }
+    for (i = 0; i < 100; i++) {
+        ratelimit_expect(s, 0, "status");
+    }
+    ratelimit_free(s);
+}
+END_TEST
+
+START_TEST(ratelimit_priorities)
+{
+    static char const *pushed[] = {
+        "say hello", "status", "  KICK bob", "echo hi", "changelevel de_dust",
+        "users", "kick;say bye", NULL
+    };
+    static char const *popped[] = {
+        "  KICK bob", "changelevel de_dust", "kick;say bye", "status",
+        "users", "say hello", "echo hi", NULL
+    };
+    ratelimit_t *s = NULL;
+    unsigned int flags = 0;
+    char *cmd = NULL;
+    int i = 0;
+
+    s = ratelimit_new(0, 0);
+    ck_assert_msg(s != NULL, "ratelimit: allocation error");
+
+    for (i = 0; pushed[i] != NULL; i++) {
+        ck_assert_msg(ratelimit_push(s, pushed[i], i) == 0,
+                      "ratelimit: failed to push");
+    }
+    ck_assert_msg(ratelimit_pending(s) == 7,
+                  "ratelimit: wrong amount pending");
+
+    /* Urgent first, then normal, then bulk, each in the order pushed
+     */
+    for (i = 0; popped[i] != NULL; i++) {
+        cmd = ratelimit_pop(s, 0, &flags);
+        ck_assert_msg(cmd != NULL && strcmp(cmd, popped[i]) == 0,
+                      "ratelimit: got %s instead of %s", cmd, popped[i]);
+        ck_assert_msg(strcmp(pushed[flags], cmd) == 0,
+                      "ratelimit: flags not handed back");
+        free(cmd);
+    }
+    ck_assert_msg(ratelimit_pop(s, 0, NULL) == NULL,
+                  "ratelimit: queue not empty");
+
+    ratelimit_free(s);
+}
+END_TEST
+
+START_TEST(ratelimit_lists)
+{
+    static char const *configfile =
+        "[eu1]\n"
+        "hostname=eu1.example.com\n"
+        "port=27015\n"
+        "rate=2.5\n"
+        "burst=4\n"
+        "urgent=kick,changelevel\n"
+        "bulk=say\n";
+    char **urgent = NULL, **bulk = NULL;
+    double rate = 0, burst = 0;
+    ratelimit_t *s = NULL;
+    FILE *f = NULL;
+
+    f = fopen("ratelimittest.ini", "w");
+    ck_assert_msg(f != NULL, "ratelimit: failed to write config");
+    fputs(configfile, f);
+    fclose(f);
+
+    ck_assert_msg(config_load("ratelimittest.ini") == 0,
+                  "ratelimit: failed to load config");
+    ck_assert_msg(config_host_schedule("eu1", &rate, &burst,
+                                       &urgent, &bulk) == 0,
+                  "ratelimit: no schedule");
+    ck_assert_msg(rate == 2.5 && burst == 4, "ratelimit: wrong rate or burst");
+
+    ck_assert_msg(urgent != NULL && urgent[0] != NULL && urgent[1] != NULL &&
+                  urgent[2] == NULL && strcmp(urgent[0], "kick") == 0 &&
+                  strcmp(urgent[1], "changelevel") == 0,
+                  "ratelimit: urgent list not split at ','");
+    ck_assert_msg(bulk != NULL && bulk[0] != NULL && bulk[1] == NULL &&
+                  strcmp(bulk[0], "say") == 0,
+                  "ratelimit: wrong bulk list");
+
+    s = ratelimit_new(rate, burst);
+    ck_assert_msg(s != NULL, "ratelimit: allocation error");
+    ck_assert_msg(ratelimit_set_commands(s, ratelimit_priority_urgent,
+                                         (char const * const *)urgent) == 0 &&
+                  ratelimit_set_commands(s, ratelimit_priority_bulk,
+                                         (char const * const *)bulk) == 0,
+                  "ratelimit: failed to set commands");
+
+    /* The lists replace the built-in ones
+     */
+    ck_assert_msg(ratelimit_classify(s, "changelevel de_dust") ==
+                  ratelimit_priority_urgent,
+                  "ratelimit: changelevel not urgent");
+    ck_assert_msg(ratelimit_classify(s, "map de_dust") ==
+                  ratelimit_priority_normal,
+                  "ratelimit: map still urgent");
+    ck_assert_msg(ratelimit_classify(s, "say hi") == ratelimit_priority_bulk,
+                  "ratelimit: say not bulk");
+    ck_assert_msg(ratelimit_classify(s, "echo hi") ==
+                  ratelimit_priority_normal,
+                  "ratelimit: echo still bulk");
+
+    ratelimit_free(s);
+    g_strfreev(urgent);
+    g_strfreev(bulk);
+    config_free();
+    unlink("ratelimittest.ini");
+}
+END_TEST
+
+int main(int ac, char **av)
+{
+    Suite *s = NULL;
+    SRunner *r = NULL;
+    TCase *c = NULL;
+    int failed = 0;
+
+    /* Don't fork
+     */
+    putenv("CK_FORK=no");
+
+    s = suite_create("rcon");
+
+    c = tcase_create("ratelimit");
+
+    tcase_add_test(c, ratelimit_refill);
+    tcase_add_test(c, ratelimit_burst);
+    tcase_add_test(c, ratelimit_priorities);
+    tcase_add_test(c, ratelimit_lists);
+
+    suite_add_tcase(s, c);
+
+    r = srunner_create(s);
+    srunner_run_all(r, CK_NORMAL);
+    failed = srunner_ntests_failed(r);
+
+    srunner_free(r);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,116 @@
+#include <check.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <resolve.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static char const *cachefile = "resolvetest.cache";
+
+static int resolve_port(struct addrinfo const *ai)
+{
+    return ntohs(((struct sockaddr_in const *)ai->ai_addr)->sin_port);
+}
+
+START_TEST(resolve_prefetch_many)
+{
+    char const *hosts[] = { "127.0.0.1", "127.0.0.2", "127.0.0.1" };
+    char const *ports[] = { "27015", "27016", "27015" };
+    struct addrinfo *ai = NULL;
+
+    unlink(cachefile);
+    resolve_set_cache(cachefile, 60);
+
+    ck_assert_msg(resolve_prefetch(hosts, ports, 3, 4) == 0,
+                  "resolve: prefetch failed");
+    ck_assert_msg(resolve_addresses("127.0.0.2", "27016", &ai) == 0,
+                  "resolve: prefetched host not found");
+    ck_assert_msg(ai != NULL && ai->ai_family == AF_INET &&
+                  ai->ai_next == NULL, "resolve: wrong addresses");
+    ck_assert_msg(resolve_port(ai) == 27016, "resolve: wrong port");
+    resolve_free_addresses(ai);
+
+    resolve_free();
+
+    /* Read back from the file
+     */
+    resolve_set_cache(cachefile, 60);
+    ck_assert_msg(resolve_addresses("127.0.0.1", "27015", &ai) == 0,
+                  "resolve: cached host not found");
+    ck_assert_msg(resolve_port(ai) == 27015, "resolve: wrong cached port");
+    resolve_free_addresses(ai);
+    resolve_free();
+
+    unlink(cachefile);
+}
+END_TEST
+
+START_TEST(resolve_cache_ttl)
+{
+    struct addrinfo *ai = NULL;
+    time_t now = time(NULL);
+    FILE *f = NULL;
+
+    /* Names under .invalid never resolve, so these can only come from the
+     * cache file.
+     */
+    f = fopen(cachefile, "w");
+    ck_assert_msg(f != NULL, "resolve: failed to write cache");
+    fprintf(f, "fresh.invalid 27015 %ld 10.0.0.1 27015\n", (long)now + 60);
+    fprintf(f, "fresh.invalid 27015 %ld ::1 27015\n", (long)now + 60);
+    fprintf(f, "stale.invalid 27015 %ld 10.0.0.2 27015\n", (long)now - 1);
+    fprintf(f, "garbage\n");
+    fclose(f);
+
+    resolve_set_cache(cachefile, 60);
+
+    ck_assert_msg(resolve_addresses("fresh.invalid", "27015", &ai) == 0,
+                  "resolve: cached host not used");
+    ck_assert_msg(ai->ai_family == AF_INET && ai->ai_next != NULL &&
+                  ai->ai_next->ai_family == AF_INET6 &&
+                  ai->ai_next->ai_next == NULL,
+                  "resolve: wrong cached addresses");
+    resolve_free_addresses(ai);
+    ai = NULL;
+
+    ck_assert_msg(resolve_addresses("stale.invalid", "27015", &ai) != 0,
+                  "resolve: expired entry used");
+    ck_assert_msg(ai == NULL, "resolve: addresses on failure");
+
+    resolve_free();
+    unlink(cachefile);
+}
+END_TEST
+
+int main(int ac, char **av)
+{
+    Suite *s = NULL;
+    SRunner *r = NULL;
+    TCase *c = NULL;
+    int failed = 0;
+
+    /* Don't fork
+     */
+    putenv("CK_FORK=no");
+
+    s = suite_create("rcon");
+
+    c = tcase_create("resolve");
+
+    tcase_add_test(c, resolve_prefetch_many);
+    tcase_add_test(c, resolve_cache_ttl);
+
+    suite_add_tcase(s, c);
+
+    r = srunner_create(s);
+    srunner_run_all(r, CK_NORMAL);
+    failed = srunner_ntests_failed(r);
+
+    srunner_free(r);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,79 @@
+#include <check.h>
+
+#include <stdio.h>
+#include <retry.h>
+
+/* How often run_command() sends a command that loses its connection every
+ * time: once, and then once more for each reconnect
+ */
+static unsigned int retry_sends(bool idempotent, unsigned int reconnects)
+{
+    unsigned int tries = 0, sends = 1;
+
+    while (retry_command(idempotent, tries++, reconnects)) {
+        ++sends;
+    }
+
+    return sends;
+}
+
+START_TEST(retry_count)
+{
+    unsigned int reconnects = 0;
+
+    for (reconnects = 0; reconnects < 5; reconnects++) {
+        ck_assert_msg(retry_sends(true, reconnects) == reconnects + 1,
+                      "retry: %u reconnects, command sent %u times",
+                      reconnects, retry_sends(true, reconnects));
+        ck_assert_msg(retry_sends(false, reconnects) == 1,
+                      "retry: command that is not idempotent repeated");
+    }
+}
+END_TEST
+
+START_TEST(retry_backoff)
+{
+    unsigned int attempt = 0, delay = 0, ceiling = RETRY_BASE;
+
+    for (attempt = 0; attempt < 20; attempt++) {
+        delay = retry_delay(attempt);
+        ck_assert_msg(delay >= ceiling / 2 && delay <= ceiling,
+                      "retry: attempt %u waits %u ms", attempt, delay);
+        if (ceiling < RETRY_MAX) {
+            ceiling *= 2;
+        }
+        if (ceiling > RETRY_MAX) {
+            ceiling = RETRY_MAX;
+        }
+    }
+}
+END_TEST
+
+int main(int ac, char **av)
+{
+    Suite *s = NULL;
+    SRunner *r = NULL;
+    TCase *c = NULL;
+    int failed = 0;
+
+    /* Don't fork
+     */
+    putenv("CK_FORK=no");
+
+    s = suite_create("rcon");
+
+    c = tcase_create("retry");
+
+    tcase_add_test(c, retry_count);
+    tcase_add_test(c, retry_backoff);
+
+    suite_add_tcase(s, c);
+
+    r = srunner_create(s);
+    srunner_run_all(r, CK_NORMAL);
+    failed = srunner_ntests_failed(r);
+
+    srunner_free(r);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
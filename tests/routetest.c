@@ -0,0 +1,170 @@
+#include <check.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <route.h>
+
+static void route_frame(uint8_t *frame, int32_t id)
+{
+    int32_t size = 10, type = 2;
+
+    memset(frame, 0, 14);
+    memcpy(frame, &size, sizeof(size));
+    memcpy(frame + 4, &id, sizeof(id));
+    memcpy(frame + 8, &type, sizeof(type));
+}
+
+static int32_t route_id(uint8_t const *frame)
+{
+    int32_t id = 0;
+
+    memcpy(&id, frame + 4, sizeof(id));
+
+    return id;
+}
+
+START_TEST(route_rewrite)
+{
+    route_table_t *t = calloc(1, sizeof(route_table_t));
+    int a = 0, b = 0;
+    route_t *ra = NULL, *rb = NULL, *back = NULL;
+    uint8_t fa[14], fb[14];
+
+    route_init(t);
+
+    /* Both clients use the same id, the server sees different ones
+     */
+    route_frame(fa, 7);
+    route_frame(fb, 7);
+    ra = route_request(t, &a, 0, fa);
+    rb = route_request(t, &b, 0, fb);
+    ck_assert_msg(ra != NULL && rb != NULL, "route: no route taken");
+    ck_assert_msg(route_id(fa) == ra->id && route_id(fb) == rb->id &&
+                  ra->id != rb->id, "route: request id not rewritten");
+    ck_assert_msg(t->pending == 2, "route: wrong pending count");
+
+    /* Replies go back to their client with the client's id
+     */
+    back = route_reply(t, fb);
+    ck_assert_msg(back == rb && back->owner == &b && route_id(fb) == 7,
+                  "route: reply for b not routed back");
+    back = route_reply(t, fa);
+    ck_assert_msg(back == ra && back->owner == &a && route_id(fa) == 7,
+                  "route: reply for a not routed back");
+
+    /* Nobody waits for replies to released routes, or to unknown ids
+     */
+    route_frame(fa, ra->id);
+    route_release(t, ra);
+    ck_assert_msg(route_reply(t, fa) == NULL && route_id(fa) == ra->id,
+                  "route: reply to released route");
+    route_frame(fa, -1);
+    ck_assert_msg(route_reply(t, fa) == NULL, "route: reply to unknown id");
+    ck_assert_msg(t->pending == 1, "route: pending after release");
+
+    free(t);
+}
+END_TEST
+
+START_TEST(route_full)
+{
+    route_table_t *t = calloc(1, sizeof(route_table_t));
+    route_t *first = NULL, *route = NULL;
+    int owner = 0;
+    size_t i = 0;
+    int32_t id = 0;
+
+    route_init(t);
+
+    /* More requests in flight than routes: the ring is not overwritten
+     */
+    first = route_take(t, &owner, 0);
+    id = first->id;
+    for (i = 1; i < ROUTE_MAX; i++) {
+        ck_assert_msg(route_take(t, &owner, 0) != NULL,
+                      "route: ring full too early at %u", (unsigned)i);
+    }
+    ck_assert_msg(route_take(t, &owner, 0) == NULL,
+                  "route: route in use handed out again");
+    ck_assert_msg(route_find(t, id) == first && first->id == id,
+                  "route: first route overwritten");
+
+    /* A free route is found past those in use
+     */
+    route = route_find(t, id + 5);
+    route_release(t, route);
+    ck_assert_msg(route_take(t, &owner, 0) == route && route->id != id + 5,
+                  "route: free route not reused");
+
+    free(t);
+}
+END_TEST
+
+START_TEST(route_settle)
+{
+    route_table_t *t = calloc(1, sizeof(route_table_t));
+    route_t *a = NULL, *b = NULL, *c = NULL, *d = NULL;
+    int owner = 0;
+
+    route_init(t);
+
+    a = route_take(t, &owner, 0);
+    b = route_take(t, &owner, 1);
+    c = route_take(t, &owner, 2);
+    d = route_take(t, &owner, 3);
+    route_release(t, b);
+
+    /* A reply to c settles a, skips b which is free already, and leaves
+     * c and d alone
+     */
+    ck_assert_msg(route_settled(t, c->id) == a, "route: a not settled");
+    route_release(t, a);
+    ck_assert_msg(route_settled(t, c->id) == NULL, "route: settled too much");
+    ck_assert_msg(route_find(t, c->id) == c && route_find(t, d->id) == d,
+                  "route: later routes settled");
+
+    /* Nothing is settled by replies nobody waits for
+     */
+    ck_assert_msg(route_settled(t, a->id) == NULL &&
+                  route_settled(t, 12345) == NULL,
+                  "route: settled by stale reply");
+    ck_assert_msg(route_settled(t, d->id) == c, "route: c not settled");
+    route_release(t, c);
+
+    route_reset(t);
+    ck_assert_msg(t->pending == 0 && route_find(t, d->id) == NULL,
+                  "route: not reset");
+
+    free(t);
+}
+END_TEST
+
+int main(int ac, char **av)
+{
+    Suite *s = NULL;
+    SRunner *r = NULL;
+    TCase *c = NULL;
+    int failed = 0;
+
+    /* Don't fork
+     */
+    putenv("CK_FORK=no");
+
+    s = suite_create("rcon");
+
+    c = tcase_create("route");
+
+    tcase_add_test(c, route_rewrite);
+    tcase_add_test(c, route_full);
+    tcase_add_test(c, route_settle);
+
+    suite_add_tcase(s, c);
+
+    r = srunner_create(s);
+    srunner_run_all(r, CK_NORMAL);
+    failed = srunner_ntests_failed(r);
+
+    srunner_free(r);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,470 @@
+#include <check.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <session.h>
+
+/* What the server behind a listener does with each connection
+ */
+typedef enum {
+    /* Never accepts, the kernel completes the handshake on its own
+     */
+    serve_stall = 0,
+    serve_close,
+    /* Answers the password "pw", and echoes each command back
+     */
+    serve_echo,
+    /* Answers the password, then sends the start of a reply and stalls
+     */
+    serve_partial,
+} serve_t;
+
+typedef struct {
+    int listener;
+    char port[8];
+    pid_t pid;
+} server_t;
+
+static char * const commands[] = { "status", "echo hi", NULL };
+
+static void put32(uint8_t *p, int32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static int32_t get32(uint8_t const *p)
+{
+    return (int32_t)((uint32_t)p[0] | (uint32_t)p[1] << 8 |
+                     (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+}
+
+static int read_full(int sock, uint8_t *buf, size_t len)
+{
+    size_t off = 0;
+    ssize_t ret = 0;
+
+    while (off < len) {
+        ret = read(sock, buf + off, len - off);
+        if (ret <= 0) {
+            return -1;
+        }
+        off += ret;
+    }
+
+    return 0;
+}
+
+static int reply(int sock, int32_t id, int32_t type, char const *body)
+{
+    uint8_t frame[256] = {0};
+    size_t len = strlen(body);
+
+    put32(frame, (int32_t)(len + 10));
+    put32(frame + 4, id);
+    put32(frame + 8, type);
+    memcpy(frame + 12, body, len);
+
+    return (write(sock, frame, len + 14) == (ssize_t)(len + 14) ? 0 : -1);
+}
+
+static void serve(int sock, serve_t what)
+{
+    uint8_t frame[256];
+    int32_t size = 0, id = 0, type = 0;
+
+    while (read_full(sock, frame, 4) == 0) {
+        size = get32(frame);
+        if (size < 10 || (size_t)size > sizeof(frame) - 1 ||
+            read_full(sock, frame, size)) {
+            return;
+        }
+        frame[size] = '\0';
+        id = get32(frame);
+        type = get32(frame + 4);
+
+        if (type == 3) {
+            bool ok = (strcmp((char const *)frame + 8, "pw") == 0);
+
+            reply(sock, id, 0, "");
+            reply(sock, (ok ? id : -1), 2, "");
+        } else if (what == serve_partial) {
+            /* Only the size of the frame
+             */
+            if (write(sock, "\x20\x00\x00\x00", 4) != 4) {
+                return;
+            }
+            what = serve_stall;
+        } else if (what == serve_echo) {
+            reply(sock, id, 0, (char const *)frame + 8);
+        }
+    }
+}
+
+static void server_start(server_t *srv, serve_t what, int backlog)
+{
+    struct sockaddr_in sin = {0};
+    socklen_t len = sizeof(sin);
+    int sock = -1;
+
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    srv->listener = socket(AF_INET, SOCK_STREAM, 0);
+    ck_assert_msg(srv->listener > -1 &&
+                  bind(srv->listener, (struct sockaddr *)&sin,
+                       sizeof(sin)) == 0 &&
+                  listen(srv->listener, backlog) == 0 &&
+                  getsockname(srv->listener, (struct sockaddr *)&sin,
+                              &len) == 0,
+                  "session: failed to listen: %s", strerror(errno));
+    snprintf(srv->port, sizeof(srv->port), "%d", ntohs(sin.sin_port));
+
+    srv->pid = -1;
+    if (what == serve_stall) {
+        return;
+    }
+
+    srv->pid = fork();
+    ck_assert_msg(srv->pid > -1, "session: failed to fork");
+    if (srv->pid > 0) {
+        return;
+    }
+
+    /* One connection after another is all these tests need
+     */
+    while ((sock = accept(srv->listener, NULL, NULL)) > -1) {
+        if (what != serve_close) {
+            serve(sock, what);
+        }
+        close(sock);
+    }
+    _exit(0);
+}
+
+static void server_stop(server_t *srv)
+{
+    if (srv->pid > 0) {
+        kill(srv->pid, SIGTERM);
+        waitpid(srv->pid, NULL, 0);
+    }
+    close(srv->listener);
+}
+
+static session_t *session_for(server_t const *srv, char const *password)
+{
+    session_t *s = NULL;
+
+    s = session_new(srv->port, "127.0.0.1", srv->port, password, false);
+    ck_assert_msg(s != NULL, "session: allocation error");
+    s->commands = commands;
+
+    return s;
+}
+
+static void session_expect(session_t *s, session_status_t status,
+                           session_phase_t phase)
+{
+    ck_assert_msg(s->finished, "session: not finished");
+    ck_assert_msg(s->status == status,
+                  "session: status %s instead of %s",
+                  session_status_name(s->status),
+                  session_status_name(status));
+    ck_assert_msg(s->phase == phase,
+                  "session: phase %s instead of %s",
+                  session_phase_name(s->phase), session_phase_name(phase));
+}
+
+static size_t calls = 0;
+
+static void session_count(session_t *s, void *data)
+{
+    ck_assert_msg(s->finished && data == &calls,
+                  "session: done called too early");
+    ++calls;
+}
+
+START_TEST(session_commands)
+{
+    server_t srv;
+    session_t *s = NULL;
+    int i = 0;
+
+    server_start(&srv, serve_echo, 16);
+
+    s = session_for(&srv, "pw");
+    ck_assert_msg(session_run(&s, 1, 0, 5, NULL, NULL) == 0,
+                  "session: failed to run");
+
+    session_expect(s, session_status_ok, session_phase_command);
+    ck_assert_msg(session_error(s) == NULL, "session: error without failure");
+    ck_assert_msg(s->completed == 2, "session: %zu commands", s->completed);
+    ck_assert_msg(s->output != NULL &&
+                  strcmp(s->output, "status\necho hi\n") == 0,
+                  "session: wrong output: %s", s->output);
+    for (i = 0; i < session_phase_max; i++) {
+        ck_assert_msg(s->latency[i] >= 0, "session: %s was not timed",
+                      session_phase_name(i));
+    }
+    session_free(s);
+
+    /* A wrong password
+     */
+    s = session_for(&srv, "nope");
+    session_run(&s, 1, 0, 5, NULL, NULL);
+    session_expect(s, session_status_auth, session_phase_auth);
+    ck_assert_msg(s->error == EACCES &&
+                  strcmp(session_error(s), "invalid password") == 0,
+                  "session: wrong error: %s", session_error(s));
+    ck_assert_msg(s->completed == 0 && s->latency[session_phase_auth] < 0,
+                  "session: went on after the password");
+    session_free(s);
+
+    server_stop(&srv);
+}
+END_TEST
+
+START_TEST(session_closed)
+{
+    server_t srv;
+    session_t *s = NULL;
+
+    server_start(&srv, serve_close, 16);
+
+    /* Closed before the password was answered, or before any reply
+     */
+    s = session_for(&srv, "pw");
+    session_run(&s, 1, 0, 5, NULL, NULL);
+    session_expect(s, session_status_auth, session_phase_auth);
+    ck_assert_msg(s->error == ECONNRESET, "session: wrong error %d", s->error);
+    session_free(s);
+
+    s = session_for(&srv, NULL);
+    session_run(&s, 1, 0, 5, NULL, NULL);
+    session_expect(s, session_status_command, session_phase_first_byte);
+    session_free(s);
+
+    server_stop(&srv);
+
+    /* Nobody listens anymore
+     */
+    s = session_for(&srv, NULL);
+    session_run(&s, 1, 0, 5, NULL, NULL);
+    session_expect(s, session_status_connect, session_phase_connect);
+    ck_assert_msg(s->error == ECONNREFUSED, "session: wrong error %d",
+                  s->error);
+    session_free(s);
+}
+END_TEST
+
+START_TEST(session_deadlines)
+{
+    server_t srv, partial, full;
+    session_t *s = NULL;
+    int fillers[16], sock = -1, i = 0, n = 0;
+    struct pollfd pfd = {0};
+
+    server_start(&srv, serve_stall, 16);
+
+    /* Waiting for the password to be answered
+     */
+    s = session_for(&srv, "pw");
+    s->timeouts[session_phase_auth] = 0.1;
+    session_run(&s, 1, 0, 5, NULL, NULL);
+    session_expect(s, session_status_timeout, session_phase_auth);
+    ck_assert_msg(s->error == ETIMEDOUT &&
+                  strcmp(session_error(s), "timed out") == 0,
+                  "session: wrong error: %s", session_error(s));
+    ck_assert_msg(s->latency[session_phase_connect] >= 0,
+                  "session: connect was not timed");
+    session_free(s);
+
+    /* Waiting for the first byte, under either deadline
+     */
+    s = session_for(&srv, NULL);
+    s->timeouts[session_phase_first_byte] = 0.1;
+    session_run(&s, 1, 0, 5, NULL, NULL);
+    session_expect(s, session_status_timeout, session_phase_first_byte);
+    session_free(s);
+
+    s = session_for(&srv, NULL);
+    s->timeouts[session_phase_command] = 0.1;
+    session_run(&s, 1, 0, 5, NULL, NULL);
+    session_expect(s, session_status_timeout, session_phase_command);
+    session_free(s);
+
+    server_stop(&srv);
+
+    /* The reply started, but never finished
+     */
+    server_start(&partial, serve_partial, 16);
+    s = session_for(&partial, "pw");
+    s->timeouts[session_phase_first_byte] = 5;
+    s->timeouts[session_phase_command] = 0.2;
+    session_run(&s, 1, 0, 5, NULL, NULL);
+    session_expect(s, session_status_timeout, session_phase_command);
+    ck_assert_msg(s->latency[session_phase_first_byte] >= 0 &&
+                  s->completed == 0, "session: first byte not seen");
+    session_free(s);
+    server_stop(&partial);
+
+    /* Connecting to a listener whose queue is full, where the handshake
+     * is never answered
+     */
+    server_start(&full, serve_stall, 0);
+    for (n = 0; n < 16; n++) {
+        struct sockaddr_in sin = {0};
+
+        sin.sin_family = AF_INET;
+        sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        sin.sin_port = htons(atoi(full.port));
+
+        sock = socket(AF_INET, SOCK_STREAM, 0);
+        ck_assert_msg(sock > -1, "session: no socket");
+        fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+        fillers[n] = sock;
+
+        if (connect(sock, (struct sockaddr *)&sin, sizeof(sin)) == 0) {
+            continue;
+        }
+        pfd.fd = sock;
+        pfd.events = POLLOUT;
+        if (poll(&pfd, 1, 100) == 0) {
+            ++n;
+            break;
+        }
+    }
+
+    s = session_for(&full, NULL);
+    s->timeouts[session_phase_connect] = 0.1;
+    session_run(&s, 1, 0, 5, NULL, NULL);
+    session_expect(s, session_status_timeout, session_phase_connect);
+    ck_assert_msg(s->latency[session_phase_connect] < 0,
+                  "session: connected to a full queue");
+    session_free(s);
+
+    for (i = 0; i < n; i++) {
+        close(fillers[i]);
+    }
+    server_stop(&full);
+}
+END_TEST
+
+START_TEST(session_jobs)
+{
+    server_t srv;
+    session_t *s[4] = {NULL};
+    int i = 0;
+
+    server_start(&srv, serve_stall, 16);
+
+    /* One at a time, so only the first starts before the deadline
+     */
+    for (i = 0; i < 3; i++) {
+        s[i] = session_for(&srv, NULL);
+    }
+    calls = 0;
+    ck_assert_msg(session_run(s, 3, 1, 0.2, session_count, &calls) == 0,
+                  "session: failed to run");
+    ck_assert_msg(calls == 3, "session: done called %zu times", calls);
+    session_expect(s[0], session_status_timeout, session_phase_first_byte);
+    ck_assert_msg(s[1]->status == session_status_skipped &&
+                  s[2]->status == session_status_skipped,
+                  "session: more than one job ran");
+    ck_assert_msg(strcmp(session_error(s[1]),
+                         "not started before the deadline") == 0,
+                  "session: wrong error: %s", session_error(s[1]));
+    for (i = 0; i < 3; i++) {
+        session_free(s[i]);
+    }
+
+    /* All at once, and one that failed before it could start
+     */
+    for (i = 0; i < 4; i++) {
+        s[i] = session_for(&srv, NULL);
+    }
+    s[3]->status = session_status_config;
+    s[3]->finished = true;
+    calls = 0;
+    ck_assert_msg(session_run(s, 4, 3, 0.2, session_count, &calls) == 0,
+                  "session: failed to run");
+    ck_assert_msg(calls == 4, "session: done called %zu times", calls);
+    for (i = 0; i < 3; i++) {
+        session_expect(s[i], session_status_timeout,
+                       session_phase_first_byte);
+    }
+    ck_assert_msg(s[3]->status == session_status_config &&
+                  strcmp(session_error(s[3]),
+                         "no port in configuration") == 0,
+                  "session: finished session was run");
+    for (i = 0; i < 4; i++) {
+        session_free(s[i]);
+    }
+
+    server_stop(&srv);
+}
+END_TEST
+
+START_TEST(session_names)
+{
+    ck_assert_msg(strcmp(session_status_name(session_status_ok), "ok") == 0 &&
+                  strcmp(session_status_name(session_status_timeout),
+                         "timeout") == 0 &&
+                  strcmp(session_status_name(session_status_timeout + 1),
+                         "unknown") == 0,
+                  "session: wrong status names");
+    ck_assert_msg(strcmp(session_phase_name(session_phase_first_byte),
+                         "first_byte") == 0 &&
+                  strcmp(session_phase_name(session_phase_max),
+                         "unknown") == 0,
+                  "session: wrong phase names");
+}
+END_TEST
+
+int main(int ac, char **av)
+{
+    Suite *s = NULL;
+    SRunner *r = NULL;
+    TCase *c = NULL;
+    int failed = 0;
+
+    /* Don't fork
+     */
+    putenv("CK_FORK=no");
+
+    /* Servers that close on us
+     */
+    signal(SIGPIPE, SIG_IGN);
+
+    s = suite_create("rcon");
+
+    c = tcase_create("session");
+
+    tcase_add_test(c, session_commands);
+    tcase_add_test(c, session_closed);
+    tcase_add_test(c, session_deadlines);
+    tcase_add_test(c, session_jobs);
+    tcase_add_test(c, session_names);
+
+    suite_add_tcase(s, c);
+
+    r = srunner_create(s);
+    srunner_run_all(r, CK_NORMAL);
+    failed = srunner_ntests_failed(r);
+
+    srunner_free(r);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
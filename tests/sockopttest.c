@@ -0,0 +1,175 @@
+#include <check.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sockopt.h>
+#include <config.h>
+
+static int sockopt_get(int sock, int level, int name)
+{
+    int value = -1;
+    socklen_t len = sizeof(value);
+
+    ck_assert_msg(getsockopt(sock, level, name, &value, &len) == 0,
+                  "sockopt: failed to read option %d: %s", name,
+                  strerror(errno));
+
+    return value;
+}
+
+START_TEST(sockopt_defaults)
+{
+    sockopt_t o;
+    int sock = -1;
+
+    sockopt_init(&o);
+    ck_assert_msg(o.nodelay == 1 && o.keepalive < 0 && o.rcvbuf < 0 &&
+                  o.sndbuf < 0 && o.busy_poll < 0,
+                  "sockopt: wrong defaults");
+
+    sock = socket(AF_INET, SOCK_STREAM, 0);
+    ck_assert_msg(sock > -1, "sockopt: no socket");
+    ck_assert_msg(sockopt_apply(sock, &o) == 0,
+                  "sockopt: failed to apply: %s", strerror(errno));
+
+    /* Nagle is off, and the rest is left to the system
+     */
+    ck_assert_msg(sockopt_get(sock, IPPROTO_TCP, TCP_NODELAY) != 0,
+                  "sockopt: TCP_NODELAY not set");
+    ck_assert_msg(sockopt_get(sock, SOL_SOCKET, SO_KEEPALIVE) == 0,
+                  "sockopt: SO_KEEPALIVE set");
+
+    ck_assert_msg(sockopt_apply(sock, NULL) == 0,
+                  "sockopt: failed without options");
+
+    close(sock);
+}
+END_TEST
+
+START_TEST(sockopt_config)
+{
+    static char const *configfile =
+        "[eu1]\n"
+        "hostname=eu1.example.com\n"
+        "port=27015\n"
+        "nodelay=false\n"
+        "keepalive=true\n"
+        "keepalive_idle=30\n"
+        "keepalive_interval=5\n"
+        "keepalive_count=3\n"
+        "rcvbuf=65536\n"
+        "sndbuf=32768\n";
+    sockopt_t o;
+    FILE *f = NULL;
+    int sock = -1;
+
+    f = fopen("sockopttest.ini", "w");
+    ck_assert_msg(f != NULL, "sockopt: failed to write config");
+    fputs(configfile, f);
+    fclose(f);
+
+    ck_assert_msg(config_load("sockopttest.ini") == 0,
+                  "sockopt: failed to load config");
+
+    sockopt_init(&o);
+    ck_assert_msg(config_host_sockopts("eu1", &o) == 0,
+                  "sockopt: no options");
+    ck_assert_msg(o.nodelay == 0 && o.keepalive == 1 &&
+                  o.keepalive_idle == 30 && o.keepalive_interval == 5 &&
+                  o.keepalive_count == 3 && o.rcvbuf == 65536 &&
+                  o.sndbuf == 32768, "sockopt: wrong options");
+    ck_assert_msg(o.busy_poll < 0, "sockopt: busy_poll out of nowhere");
+
+    sock = socket(AF_INET, SOCK_STREAM, 0);
+    ck_assert_msg(sock > -1, "sockopt: no socket");
+    ck_assert_msg(sockopt_apply(sock, &o) == 0,
+                  "sockopt: failed to apply: %s", strerror(errno));
+
+    ck_assert_msg(sockopt_get(sock, IPPROTO_TCP, TCP_NODELAY) == 0,
+                  "sockopt: TCP_NODELAY still set");
+    ck_assert_msg(sockopt_get(sock, SOL_SOCKET, SO_KEEPALIVE) != 0,
+                  "sockopt: SO_KEEPALIVE not set");
+#ifdef TCP_KEEPIDLE
+    ck_assert_msg(sockopt_get(sock, IPPROTO_TCP, TCP_KEEPIDLE) == 30,
+                  "sockopt: wrong TCP_KEEPIDLE");
+#endif
+#ifdef TCP_KEEPINTVL
+    ck_assert_msg(sockopt_get(sock, IPPROTO_TCP, TCP_KEEPINTVL) == 5,
+                  "sockopt: wrong TCP_KEEPINTVL");
+#endif
+#ifdef TCP_KEEPCNT
+    ck_assert_msg(sockopt_get(sock, IPPROTO_TCP, TCP_KEEPCNT) == 3,
+                  "sockopt: wrong TCP_KEEPCNT");
+#endif
+
+    /* Linux doubles the buffer sizes for its own bookkeeping
+     */
+    ck_assert_msg(sockopt_get(sock, SOL_SOCKET, SO_RCVBUF) >= 65536,
+                  "sockopt: SO_RCVBUF too small");
+    ck_assert_msg(sockopt_get(sock, SOL_SOCKET, SO_SNDBUF) >= 32768,
+                  "sockopt: SO_SNDBUF too small");
+
+    ck_assert_msg(config_host_sockopts("nosuchserver", &o) == -2,
+                  "sockopt: options for an unknown server");
+
+    close(sock);
+    config_free();
+    unlink("sockopttest.ini");
+}
+END_TEST
+
+START_TEST(sockopt_failure)
+{
+    sockopt_t o;
+    int fds[2] = {-1, -1};
+
+    sockopt_init(&o);
+    o.keepalive = 1;
+
+    /* Every option is tried, and the first error reported
+     */
+    ck_assert_msg(pipe(fds) == 0, "sockopt: no pipe");
+    errno = 0;
+    ck_assert_msg(sockopt_apply(fds[0], &o) == -1 && errno == ENOTSOCK,
+                  "sockopt: applied to a pipe");
+
+    close(fds[0]);
+    close(fds[1]);
+}
+END_TEST
+
+int main(int ac, char **av)
+{
+    Suite *s = NULL;
+    SRunner *r = NULL;
+    TCase *c = NULL;
+    int failed = 0;
+
+    /* Don't fork
+     */
+    putenv("CK_FORK=no");
+
+    s = suite_create("rcon");
+
+    c = tcase_create("sockopt");
+
+    tcase_add_test(c, sockopt_defaults);
+    tcase_add_test(c, sockopt_config);
+    tcase_add_test(c, sockopt_failure);
+
+    suite_add_tcase(s, c);
+
+    r = srunner_create(s);
+    srunner_run_all(r, CK_NORMAL);
+    failed = srunner_ntests_failed(r);
+
+    srunner_free(r);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
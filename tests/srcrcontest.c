@@ -164,7 +164,7 @@ srcrcon_check_short(void const *data, size_t size)
 
 START_TEST(srcrcon_deserialise_short)
 {
-    static char const *short1 = "\x00\x0A\0x00\x02";
+    static char const *short1 = "\x0A\x00\x00\x00";
     static char const *short2 =
         "\xE0\x00\x00\x00"
         "\x11\x11\x11\x11"
@@ -350,6 +350,234 @@ START_TEST(srcrcon_deserialise_body)
 END_TEST
 
 
+START_TEST(srcrcon_scan_frames)
+{
+    src_rcon_t *r = NULL;
+    src_rcon_message_t **msgs = NULL;
+    uint8_t *data = NULL, *buf = NULL;
+    size_t frames[300], off = 0, end = 0, sz = 0, size = 0, i = 0;
+    ssize_t n = 0;
+    rcon_error_t e;
+
+    r = src_rcon_new();
+    ck_assert_msg(r != NULL, "rcon: allocation error");
+
+    /* Many small frames back to back, and a partial one at the end
+     */
+    for (i = 0; i < 256; i++) {
+        char body[16];
+        src_rcon_message_t *m = NULL;
+
+        snprintf(body, sizeof(body), "%lu", (unsigned long)i);
+        m = src_rcon_command(r, body);
+        ck_assert_msg(m != NULL, "srcrcon: allocation error");
+        m->id = (int32_t)i;
+
+        e = src_rcon_serialize(r, m, &data, &sz);
+        ck_assert_msg(e == rcon_error_success, "srcrcon: serialize failed");
+
+        buf = realloc(buf, size + sz);
+        memcpy(buf + size, data, sz);
+        size += sz;
+
+        free(data);
+        src_rcon_message_free(m);
+    }
+    buf = realloc(buf, size + 5);
+    memcpy(buf + size, "\x0A\x00\x00\x00\x01", 5);
+
+    n = src_rcon_scan(buf, size + 5, frames, 300, &end);
+    ck_assert_msg(n == 256, "srcrcon: scan: found %ld frames", (long)n);
+    ck_assert_msg(end == size, "srcrcon: scan: wrong end");
+    ck_assert_msg(frames[0] == 0 && frames[1] == 15,
+                  "srcrcon: scan: wrong offsets");
+
+    /* Only as many as asked for
+     */
+    n = src_rcon_scan(buf, size + 5, frames, 10, &end);
+    ck_assert_msg(n == 10 && end == frames[9] + 15,
+                  "srcrcon: scan: limit ignored");
+
+    sz = 0;
+    e = src_rcon_deserialize(r, &msgs, &off, &sz, buf, size + 5);
+    ck_assert_msg(e == rcon_error_success, "srcrcon: deserialize failed");
+    ck_assert_msg(sz == 256 && off == size,
+                  "srcrcon: deserialize: wrong amount");
+
+    for (i = 0; i < 256; i++) {
+        char body[16];
+
+        snprintf(body, sizeof(body), "%lu", (unsigned long)i);
+        ck_assert_msg(msgs[i]->id == (int32_t)i &&
+                      strcmp((char const *)msgs[i]->body, body) == 0,
+                      "srcrcon: deserialize: wrong frame %lu",
+                      (unsigned long)i);
+    }
+    ck_assert_msg(msgs[256] == NULL, "srcrcon: deserialize: not terminated");
+
+    src_rcon_message_freev(msgs);
+    free(buf);
+    src_rcon_free(r);
+}
+END_TEST
+
+START_TEST(srcrcon_scan_broken)
+{
+    static char const *small =
+        "\x09\x00\x00\x00"
+        "\x11\x00\x00\x00"
+        "\x02\x00\x00\x00"
+        "\x00";
+    static char const *large =
+        "\xFF\xFF\x00\x00"
+        "\x11\x00\x00\x00"
+        "\x00\x00\x00\x00";
+    static char const *type =
+        "\x0A\x00\x00\x00"
+        "\x11\x00\x00\x00"
+        "\x05\x00\x00\x00"
+        "\x00\x00";
+    static char const *terminator =
+        "\x0A\x00\x00\x00"
+        "\x11\x00\x00\x00"
+        "\x00\x00\x00\x00"
+        "\x00\x00" /* complete message */
+        "\x0B\x00\x00\x00"
+        "\x12\x00\x00\x00"
+        "\x00\x00\x00\x00"
+        "x\x00\x01";
+
+    src_rcon_t *r = NULL;
+    src_rcon_message_t **msgs = NULL;
+    size_t off = 0, sz = 0, end = 0;
+    rcon_error_t e;
+
+    r = src_rcon_new();
+    ck_assert_msg(r != NULL, "rcon: allocation error");
+
+    ck_assert_msg(src_rcon_scan(small, 13, NULL, 0, &end) == -1,
+                  "srcrcon: scan: frame too small");
+    e = src_rcon_deserialize(r, &msgs, &off, &sz, small, 13);
+    ck_assert_msg(e == rcon_error_protocol,
+                  "srcrcon: deserialize: frame too small");
+
+    /* Never waits for more than a frame can hold
+     */
+    ck_assert_msg(src_rcon_scan(large, 12, NULL, 0, &end) == -1,
+                  "srcrcon: scan: frame too large");
+    e = src_rcon_deserialize(r, &msgs, &off, &sz, large, 12);
+    ck_assert_msg(e == rcon_error_protocol,
+                  "srcrcon: deserialize: frame too large");
+
+    ck_assert_msg(src_rcon_scan(type, 14, NULL, 0, &end) == -1,
+                  "srcrcon: scan: unknown type");
+
+    /* The good frame before the broken one is still returned
+     */
+    ck_assert_msg(src_rcon_scan(terminator, 29, NULL, 0, &end) == 1 &&
+                  end == 14, "srcrcon: scan: bad terminator");
+
+    e = src_rcon_deserialize(r, &msgs, &off, &sz, terminator, 29);
+    ck_assert_msg(e == rcon_error_success && sz == 1 && off == 14,
+                  "srcrcon: deserialize: frame before broken one");
+    src_rcon_message_freev(msgs);
+
+    sz = 0;
+    e = src_rcon_deserialize(r, &msgs, &off, &sz, terminator + 14, 15);
+    ck_assert_msg(e == rcon_error_protocol,
+                  "srcrcon: deserialize: bad terminator");
+
+    src_rcon_free(r);
+}
+END_TEST
+
+START_TEST(srcrcon_response_frames)
+{
+    static char const *data =
+        "\x0C\x00\x00\x00"
+        "\x11\x00\x00\x00"
+        "\x00\x00\x00\x00"
+        "ab\x00\x00" /* first frame */
+        "\x0C\x00\x00\x00"
+        "\x33\x00\x00\x00"
+        "\x00\x00\x00\x00"
+        "zz\x00\x00" /* other request */
+        "\x0D\x00\x00\x00"
+        "\x11\x00\x00\x00"
+        "\x00\x00\x00\x00"
+        "cde\x00\x00" /* second frame */
+        "\x0A\x00\x00\x00"
+        "\x12\x00\x00\x00"
+        "\x00\x00\x00\x00"
+        "\x00\x00"; /* end marker */
+
+    src_rcon_t *r = NULL;
+    src_rcon_message_t *cmd = NULL, *end = NULL;
+    src_rcon_response_t *resp = NULL;
+    char const *frame = NULL;
+    size_t off = 0, len = 0;
+    rcon_error_t e;
+
+    r = src_rcon_new();
+    cmd = src_rcon_command(r, "status");
+    end = src_rcon_command(r, "");
+    ck_assert_msg(r != NULL && cmd != NULL && end != NULL,
+                  "rcon: allocation error");
+    cmd->id = 0x11;
+    end->id = 0x12;
+
+    e = src_rcon_response_add(r, cmd, end, &resp, &off, data, 3);
+    ck_assert_msg(e == rcon_error_moredata && resp == NULL,
+                  "srcrcon: response: incomplete frame");
+
+    /* Up to the middle of the second frame
+     */
+    e = src_rcon_response_add(r, cmd, end, &resp, &off, data, 37);
+    ck_assert_msg(e == rcon_error_success && off == 32,
+                  "srcrcon: response: first frames");
+    ck_assert_msg(resp->id == 0x11 && resp->frames == 1 &&
+                  resp->received == 2 && !resp->complete,
+                  "srcrcon: response: wrong frame count");
+    ck_assert_msg(resp->size == 2 && strcmp((char*)resp->body, "ab") == 0,
+                  "srcrcon: response: wrong body");
+
+    e = src_rcon_response_add(r, cmd, end, &resp, &off, data + 32, 31);
+    ck_assert_msg(e == rcon_error_success && off == 31,
+                  "srcrcon: response: remaining frames");
+    ck_assert_msg(resp->frames == 2 && resp->received == 4 &&
+                  resp->complete, "srcrcon: response: not complete");
+    ck_assert_msg(resp->size == 5 &&
+                  strcmp((char*)resp->body, "abcde") == 0,
+                  "srcrcon: response: wrong joined body");
+
+    frame = src_rcon_response_frame(resp, 1, &len);
+    ck_assert_msg(frame != NULL && len == 3 && memcmp(frame, "cde", 3) == 0,
+                  "srcrcon: response: wrong second frame");
+    ck_assert_msg(src_rcon_response_frame(resp, 2, &len) == NULL,
+                  "srcrcon: response: frame out of range");
+
+    /* Dropped frames are gone, later ones still line up
+     */
+    src_rcon_response_drop(resp);
+    ck_assert_msg(resp->frames == 2 && resp->size == 5 &&
+                  src_rcon_response_frame(resp, 1, &len) == NULL,
+                  "srcrcon: response: frame not dropped");
+
+    e = src_rcon_response_add(r, cmd, end, &resp, &off, data + 32, 31);
+    ck_assert_msg(e == rcon_error_success && resp->frames == 3 &&
+                  resp->size == 8 && strcmp((char*)resp->body, "cde") == 0,
+                  "srcrcon: response: wrong body after drop");
+    frame = src_rcon_response_frame(resp, 2, &len);
+    ck_assert_msg(frame != NULL && len == 3 && memcmp(frame, "cde", 3) == 0,
+                  "srcrcon: response: wrong frame after drop");
+
+    src_rcon_response_free(resp);
+    src_rcon_message_free(cmd);
+    src_rcon_message_free(end);
+    src_rcon_free(r);
+}
+END_TEST
+
 int main(int ac, char **av)
 {
     Suite *s = NULL;
@@ -376,6 +604,9 @@ int main(int ac, char **av)
     tcase_add_test(c, srcrcon_deserialise_leftover2);
     tcase_add_test(c, srcrcon_deserialise_correct);
     tcase_add_test(c, srcrcon_deserialise_body);
+    tcase_add_test(c, srcrcon_scan_frames);
+    tcase_add_test(c, srcrcon_scan_broken);
+    tcase_add_test(c, srcrcon_response_frames);
 
     suite_add_tcase(s, c);
 
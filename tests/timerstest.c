@@ -0,0 +1,116 @@
+#include <check.h>
+
+#include <stdio.h>
+#include <timers.h>
+#include <stdbool.h>
+
+START_TEST(timers_order)
+{
+    static double const deadlines[] = { 5, 1, 4, 2, 3, 9, 0, 7, 6, 8 };
+    timers_entry_t e[10];
+    timers_entry_t *x = NULL;
+    timers_t *t = NULL;
+    double last = -1;
+    int i = 0;
+
+    t = timers_new();
+    ck_assert_msg(t != NULL, "timers: allocation failed");
+
+    memset(e, 0, sizeof(e));
+    for (i = 0; i < 10; i++) {
+        ck_assert_msg(timers_add(t, &e[i], deadlines[i]) == 0,
+                      "timers: failed to add timer");
+        ck_assert_msg(timers_armed(&e[i]), "timers: timer is not armed");
+    }
+
+    /* Nothing has expired yet
+     */
+    ck_assert_msg(timers_expired(t, -1) == NULL,
+                  "timers: timer expired too early");
+    ck_assert_msg(timers_timeout(t, -1) == 1001,
+                  "timers: wrong timeout until next deadline");
+
+    for (i = 0; i < 10; i++) {
+        x = timers_expired(t, 100);
+        ck_assert_msg(x != NULL, "timers: timer did not expire");
+        ck_assert_msg(x->deadline > last, "timers: wrong order");
+        ck_assert_msg(!timers_armed(x), "timers: expired timer still armed");
+        last = x->deadline;
+    }
+
+    ck_assert_msg(timers_expired(t, 100) == NULL,
+                  "timers: expired more timers than were added");
+    ck_assert_msg(timers_timeout(t, 100) == -1,
+                  "timers: timeout without any timers");
+
+    timers_free(t);
+}
+END_TEST
+
+START_TEST(timers_remove_rearm)
+{
+    timers_entry_t e[5];
+    timers_t *t = NULL;
+    int i = 0;
+
+    t = timers_new();
+    ck_assert_msg(t != NULL, "timers: allocation failed");
+
+    memset(e, 0, sizeof(e));
+    for (i = 0; i < 5; i++) {
+        timers_add(t, &e[i], i);
+    }
+
+    /* Remove the earliest, and one from the middle
+     */
+    timers_remove(t, &e[0]);
+    timers_remove(t, &e[3]);
+    ck_assert_msg(!timers_armed(&e[0]) && !timers_armed(&e[3]),
+                  "timers: removed timer still armed");
+
+    /* Removing twice is harmless
+     */
+    timers_remove(t, &e[3]);
+
+    /* Move the latest to the front
+     */
+    timers_add(t, &e[4], -1);
+
+    ck_assert_msg(timers_expired(t, 10) == &e[4], "timers: re-arm failed");
+    ck_assert_msg(timers_expired(t, 10) == &e[1], "timers: wrong order");
+    ck_assert_msg(timers_expired(t, 10) == &e[2], "timers: wrong order");
+    ck_assert_msg(timers_expired(t, 10) == NULL,
+                  "timers: removed timer expired");
+
+    timers_free(t);
+}
+END_TEST
+
+int main(int ac, char **av)
+{
+    Suite *s = NULL;
+    SRunner *r = NULL;
+    TCase *c = NULL;
+    int failed = 0;
+
+    /* Don't fork
+     */
+    putenv("CK_FORK=no");
+
+    s = suite_create("rcon");
+
+    c = tcase_create("timers");
+
+    tcase_add_test(c, timers_order);
+    tcase_add_test(c, timers_remove_rearm);
+
+    suite_add_tcase(s, c);
+
+    r = srunner_create(s);
+    srunner_run_all(r, CK_NORMAL);
+    failed = srunner_ntests_failed(r);
+
+    srunner_free(r);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,178 @@
+#include "timers.h"
+#include "rcon.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+struct _timers
+{
+    /* heap[0] is unused, so that an index of zero means "not armed"
+     */
+    timers_entry_t **heap;
+    size_t count;
+    size_t size;
+};
+
+double timers_now(void)
+{
+    struct timespec ts = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+timers_t *timers_new(void)
+{
+    timers_t *tmp = NULL;
+
+    tmp = calloc(1, sizeof(timers_t));
+    if (tmp == NULL) {
+        return NULL;
+    }
+
+    return tmp;
+}
+
+void timers_free(timers_t *t)
+{
+    size_t i = 0;
+
+    return_if_true(t == NULL,);
+
+    for (i = 1; i <= t->count; i++) {
+        t->heap[i]->index = 0;
+    }
+
+    free(t->heap);
+    free(t);
+}
+
+bool timers_armed(timers_entry_t const *e)
+{
+    return (e != NULL && e->index > 0);
+}
+
+static void timers_place(timers_t *t, timers_entry_t *e, size_t i)
+{
+    t->heap[i] = e;
+    e->index = i;
+}
+
+static void timers_up(timers_t *t, size_t i)
+{
+    timers_entry_t *e = t->heap[i];
+
+    while (i > 1 && t->heap[i/2]->deadline > e->deadline) {
+        timers_place(t, t->heap[i/2], i);
+        i /= 2;
+    }
+
+    timers_place(t, e, i);
+}
+
+static void timers_down(timers_t *t, size_t i)
+{
+    timers_entry_t *e = t->heap[i];
+    size_t child = 0;
+
+    while ((child = i * 2) <= t->count) {
+        if (child < t->count &&
+            t->heap[child+1]->deadline < t->heap[child]->deadline) {
+            ++child;
+        }
+
+        if (t->heap[child]->deadline >= e->deadline) {
+            break;
+        }
+
+        timers_place(t, t->heap[child], i);
+        i = child;
+    }
+
+    timers_place(t, e, i);
+}
+
+int timers_add(timers_t *t, timers_entry_t *e, double deadline)
+{
+    return_if_true(t == NULL || e == NULL, -1);
+
+    if (timers_armed(e)) {
+        timers_remove(t, e);
+    }
+
+    if (t->count + 1 >= t->size) {
+        size_t size = (t->size > 0 ? t->size * 2 : 16);
+        timers_entry_t **tmp = NULL;
+
+        tmp = realloc(t->heap, size * sizeof(timers_entry_t*));
+        if (tmp == NULL) {
+            return -1;
+        }
+
+        t->heap = tmp;
+        t->size = size;
+    }
+
+    e->deadline = deadline;
+    ++t->count;
+    timers_place(t, e, t->count);
+    timers_up(t, t->count);
+
+    return 0;
+}
+
+void timers_remove(timers_t *t, timers_entry_t *e)
+{
+    timers_entry_t *last = NULL;
+    size_t i = 0;
+
+    return_if_true(t == NULL || !timers_armed(e),);
+
+    i = e->index;
+    e->index = 0;
+
+    if (i == t->count) {
+        --t->count;
+        return;
+    }
+
+    last = t->heap[t->count];
+    --t->count;
+    timers_place(t, last, i);
+
+    timers_up(t, i);
+    timers_down(t, last->index);
+}
+
+timers_entry_t *timers_expired(timers_t *t, double now)
+{
+    timers_entry_t *e = NULL;
+
+    return_if_true(t == NULL || t->count == 0, NULL);
+
+    e = t->heap[1];
+    if (e->deadline > now) {
+        return NULL;
+    }
+
+    timers_remove(t, e);
+
+    return e;
+}
+
+int timers_timeout(timers_t const *t, double now)
+{
+    double left = 0;
+
+    return_if_true(t == NULL || t->count == 0, -1);
+
+    left = t->heap[1]->deadline - now;
+    if (left <= 0) {
+        return 0;
+    }
+
+    /* Round up, so that we do not wake up just before the deadline
+     */
+    return (int)(left * 1000) + 1;
+}
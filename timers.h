@@ -0,0 +1,44 @@
+#ifndef RCON_TIMERS_H
+#define RCON_TIMERS_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+/* Deadlines kept in a binary min-heap. Entries are embedded into whatever
+ * structure needs a deadline, so adding and removing never allocates, and
+ * many connections can each have their own timers cheaply.
+ */
+typedef struct _timers timers_t;
+
+typedef struct {
+    double deadline;
+    /* Position within the heap, zero if the timer is not armed
+     */
+    size_t index;
+    void *data;
+} timers_entry_t;
+
+timers_t *timers_new(void);
+void timers_free(timers_t *t);
+
+/* Arms the timer to expire at the given point in time, as returned by
+ * timers_now(). Re-arms it if it was already armed.
+ */
+int timers_add(timers_t *t, timers_entry_t *e, double deadline);
+void timers_remove(timers_t *t, timers_entry_t *e);
+bool timers_armed(timers_entry_t const *e);
+
+/* Removes and returns one expired timer, or NULL if none has expired.
+ */
+timers_entry_t *timers_expired(timers_t *t, double now);
+
+/* Milliseconds until the next timer expires, suitable for poll(). Returns -1
+ * if no timer is armed.
+ */
+int timers_timeout(timers_t const *t, double now);
+
+/* Seconds on a monotonic clock
+ */
+double timers_now(void);
+
+#endif